@@ -0,0 +1,41 @@
+/*
+ * kernel/arch/aarch64/asm/cpacr.h
+ * © suhas pai
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "lib/macros.h"
+
+enum cpacr_shifts {
+    CPACR_ZEN_SHIFT = 16,
+    CPACR_FPEN_SHIFT = 20,
+    CPACR_SMEN_SHIFT = 24,
+};
+
+// Setting both bits of a field disables trapping from both EL0 and EL1.
+
+enum cpacr_flags {
+    // Controls trapping of accesses to the SVE registers and instructions.
+    __CPACR_ZEN = 0b11ull << CPACR_ZEN_SHIFT,
+
+    // Controls trapping of accesses to the fp and advanced simd registers and
+    // instructions, including the SVE instructions.
+
+    __CPACR_FPEN = 0b11ull << CPACR_FPEN_SHIFT,
+
+    // Controls trapping of accesses to the SME registers and instructions.
+    __CPACR_SMEN = 0b11ull << CPACR_SMEN_SHIFT,
+};
+
+__optimize(3) static inline uint64_t read_cpacr_el1() {
+    uint64_t result = 0;
+    asm volatile("mrs %0, cpacr_el1" : "=r"(result));
+
+    return result;
+}
+
+__optimize(3) static inline void write_cpacr_el1(const uint64_t value) {
+    asm volatile("msr cpacr_el1, %0; isb" :: "r"(value) : "memory");
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+/*
+ * kernel/arch/aarch64/asm/esr.h
+ * © suhas pai
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "lib/macros.h"
+
+#define ESR_EC_SHIFT 26
+#define ESR_EC_MASK 0x3f
+
+enum esr_exception_class {
+    ESR_EC_INSTR_ABORT_LOWER_EL = 0x20,
+    ESR_EC_INSTR_ABORT_SAME_EL = 0x21,
+    ESR_EC_DATA_ABORT_LOWER_EL = 0x24,
+    ESR_EC_DATA_ABORT_SAME_EL = 0x25,
+};
+
+// Fault-status code held in ISS[5:0] of instruction and data aborts. The low
+// two bits hold the level of the table-walk the fault occurred at.
+
+#define ESR_ISS_FSC_MASK 0x3c
+
+enum esr_iss_fault_status {
+    ESR_ISS_FSC_TRANSLATION_FAULT = 0x04,
+    ESR_ISS_FSC_ACCESS_FLAG_FAULT = 0x08,
+    ESR_ISS_FSC_PERMISSION_FAULT = 0x0c,
+};
+
+// Write-not-Read, set for data aborts caused by a write.
+#define __ESR_ISS_WNR (1ull << 6)
+
+__optimize(3) static inline uint64_t read_esr_el1() {
+    uint64_t value = 0;
+    asm volatile("mrs %0, esr_el1" : "=r" (value));
+
+    return value;
+}
+
+__optimize(3) static inline uint64_t read_far_el1() {
+    uint64_t value = 0;
+    asm volatile("mrs %0, far_el1" : "=r" (value));
+
+    return value;
+}
+
+__optimize(3) static inline uint8_t esr_get_class(const uint64_t esr) {
+    return (esr >> ESR_EC_SHIFT) & ESR_EC_MASK;
+}
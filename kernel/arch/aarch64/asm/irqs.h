@@ -6,6 +6,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "lib/macros.h"
 
 __optimize(3) static inline void disable_all_interrupts(void) {
@@ -17,5 +18,9 @@ __optimize(3) static inline void enable_all_interrupts(void) {
 }
 
 __optimize(3) static inline bool are_interrupts_enabled() {
-    return true;
+    uint64_t daif = 0;
+    asm volatile ("mrs %0, daif" : "=r"(daif));
+
+    // DAIF.I (bit 7) masks irqs when set.
+    return (daif & (1ull << 7)) == 0;
 }
\ No newline at end of file
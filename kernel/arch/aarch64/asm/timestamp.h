@@ -0,0 +1,24 @@
+/*
+ * kernel/arch/aarch64/asm/timestamp.h
+ * © suhas pai
+ */
+
+#pragma once
+#include <stdint.h>
+
+// Reads the virtual count of the generic timer, which ticks at the rate in
+// cntfrq_el0.
+
+static inline uint64_t read_timestamp_counter() {
+    uint64_t result = 0;
+    asm volatile ("mrs %0, cntvct_el0" : "=r"(result));
+
+    return result;
+}
+
+static inline uint64_t timestamp_counter_frequency() {
+    uint64_t result = 0;
+    asm volatile ("mrs %0, cntfrq_el0" : "=r"(result));
+
+    return result;
+}
\ No newline at end of file
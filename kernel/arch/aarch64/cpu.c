@@ -3,9 +3,11 @@
  * © suhas pai
  */
 
+#include "asm/cpacr.h"
 #include "asm/id_regs.h"
 #include "asm/tcr.h"
 
+#include "cpu/panic.h"
 #include "dev/printk.h"
 
 #include "mm/kmalloc.h"
@@ -19,6 +21,11 @@ static struct cpu_info g_base_cpu_info = {
     .pagemap_node = LIST_INIT(g_base_cpu_info.pagemap_node),
 
     .cpu_list = LIST_INIT(g_base_cpu_info.cpu_list),
+    .xlate_cache = XLATE_CACHE_INIT(),
+    .epoch_state = EPOCH_CPU_STATE_INIT(g_base_cpu_info.epoch_state),
+    .spinlock_state = SPINLOCK_CPU_STATE_INIT(),
+    .table_reserve = TABLE_RESERVE_INIT(g_base_cpu_info.table_reserve),
+    .printk_ring = NULL,
     .spur_int_count = 0,
 
     .cpu_interface_number = 0,
@@ -1423,11 +1430,31 @@ void cpu_init() {
     collect_cpu_features();
     print_cpu_features();
 
+#if defined(__ARM_FEATURE_ATOMICS)
+    // The kernel is built for armv9-a, so the compiler emits lse atomics
+    // (cas, swp, ldadd, etc.) for everything, including spinlocks, instead
+    // of ldxr/stxr loops.
+
+    if (g_cpu_features.atomic == CPU_FEAT_ATOMIC_NONE) {
+        panic("cpu: kernel was built with lse atomics, but FEAT_LSE isn't "
+              "supported\n");
+    }
+#endif
+
+    // Stop trapping accesses to the fp and simd registers, so memcpy() and
+    // friends can use the neon variants.
+
+    write_cpacr_el1(read_cpacr_el1() | __CPACR_FPEN);
+
     g_base_cpu_info.mpidr = read_mpidr_el1();
     g_base_cpu_info.mpidr &= ~(1ull << 31);
 
     asm volatile ("msr tpidr_el1, %0" :: "r"(&g_base_cpu_info));
+    epoch_register_cpu(&g_base_cpu_info.epoch_state);
+    spinlock_register_cpu(&g_base_cpu_info.spinlock_state);
+
     g_base_cpu_init = true;
+    printk_init_cpu(&g_base_cpu_info);
 }
 
 void
@@ -1446,6 +1473,15 @@ cpu_add_gic_interface(
 
         list_init(&cpu->cpu_list);
         list_add(&g_cpu_list, &cpu->cpu_list);
+
+        cpu->xlate_cache = XLATE_CACHE_INIT();
+        cpu->epoch_state = EPOCH_CPU_STATE_INIT(cpu->epoch_state);
+        cpu->spinlock_state = SPINLOCK_CPU_STATE_INIT();
+        cpu->table_reserve = TABLE_RESERVE_INIT(cpu->table_reserve);
+
+        epoch_register_cpu(&cpu->epoch_state);
+        spinlock_register_cpu(&cpu->spinlock_state);
+        printk_init_cpu(cpu);
     }
 
     cpu->spur_int_count = 0;
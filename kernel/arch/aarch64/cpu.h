@@ -6,15 +6,27 @@
 #pragma once
 
 #include "acpi/structs.h"
+#include "cpu/spinlock.h"
+#include "mm/epoch.h"
 #include "mm/pagemap.h"
+#include "mm/table_pool.h"
+#include "mm/xlate_cache.h"
 
 struct pagemap;
+struct printk_ring;
 struct cpu_info {
     struct pagemap *pagemap;
 
     struct list pagemap_node;
     struct list cpu_list;
 
+    struct xlate_cache xlate_cache;
+    struct epoch_cpu_state epoch_state;
+    struct spinlock_cpu_state spinlock_state;
+    struct table_reserve table_reserve;
+
+    struct printk_ring *printk_ring;
+
     uint64_t spur_int_count;
 
     uint32_t cpu_interface_number;
@@ -3,6 +3,7 @@
  * © suhas pai
  */
 
+#include "asm/pause.h"
 #include "cpu/spinlock.h"
 #include "dev/printk.h"
 #include "mm/kmalloc.h"
@@ -29,6 +30,7 @@ struct pl011_device {
     volatile uint32_t dmacr_offset;
 } __packed;
 
+static const uint32_t FR_TXFE = 1 << 7;
 static const uint32_t FR_BUSY = 1 << 3;
 
 static const uint32_t CR_TXEN = 1 << 8;
@@ -38,6 +40,10 @@ static const uint32_t LCR_FEN = 1 << 4;
 static const uint32_t LCR_STP2 = 1 << 3;
 
 #define MAX_ATTEMPTS 10
+#define MAX_FIFO_ATTEMPTS 100000
+
+// Every revision of the pl011 has a transmit FIFO at least this deep.
+#define PL011_FIFO_SIZE 16
 
 struct pl011_device_info {
     struct terminal term;
@@ -59,6 +65,34 @@ static void wait_tx_complete(volatile const struct pl011_device *const dev) {
     }
 }
 
+// Wait for the transmit FIFO to empty out, so the next FIFO's worth of bytes
+// can be written without checking for space before each one.
+
+__optimize(3)
+static void wait_tx_fifo_empty(volatile const struct pl011_device *const dev) {
+    for (uint64_t i = 0; i != MAX_FIFO_ATTEMPTS; i++) {
+        if (mmio_read(&dev->fr_offset) & FR_TXFE) {
+            return;
+        }
+
+        cpu_pause();
+    }
+}
+
+__optimize(3) static inline void
+put_char(volatile struct pl011_device *const device,
+         uint32_t *const fifo_space,
+         const char ch)
+{
+    if (*fifo_space == 0) {
+        wait_tx_fifo_empty(device);
+        *fifo_space = PL011_FIFO_SIZE;
+    }
+
+    mmio_write(&device->dr_offset, ch);
+    (*fifo_space)--;
+}
+
 __optimize(3) static void
 pl011_send_char(struct terminal *const term,
                 const char ch,
@@ -68,22 +102,18 @@ pl011_send_char(struct terminal *const term,
         container_of(term, struct pl011_device_info, term);
 
     volatile struct pl011_device *const device = info->device;
-    wait_tx_complete(device);
+    const int flag = spin_acquire_with_irq(&info->lock);
 
-    if (ch == '\n') {
-        for (uint64_t i = 0; i != amount; i++) {
-            mmio_write(&device->dr_offset, '\r');
-            wait_tx_complete(device);
-
-            mmio_write(&device->dr_offset, ch);
-            wait_tx_complete(device);
-        }
-    } else {
-        for (uint64_t i = 0; i != amount; i++) {
-            mmio_write(&device->dr_offset, ch);
-            wait_tx_complete(device);
+    uint32_t fifo_space = 0;
+    for (uint64_t i = 0; i != amount; i++) {
+        if (ch == '\n') {
+            put_char(device, &fifo_space, '\r');
         }
+
+        put_char(device, &fifo_space, ch);
     }
+
+    spin_release_with_irq(&info->lock, flag);
 }
 
 __optimize(3) static void
@@ -92,18 +122,26 @@ pl011_send_sv(struct terminal *const term, const struct string_view sv) {
         container_of(term, struct pl011_device_info, term);
 
     volatile struct pl011_device *const device = info->device;
-    wait_tx_complete(device);
+    const int flag = spin_acquire_with_irq(&info->lock);
 
+    uint32_t fifo_space = 0;
     sv_foreach(sv, iter) {
-        char ch = *iter;
+        const char ch = *iter;
         if (ch == '\n') {
-            mmio_write(&device->dr_offset, '\r');
-            wait_tx_complete(device);
+            put_char(device, &fifo_space, '\r');
         }
 
-        mmio_write(&device->dr_offset, ch);
-        wait_tx_complete(device);
+        put_char(device, &fifo_space, ch);
     }
+
+    spin_release_with_irq(&info->lock, flag);
+}
+
+static void pl011_bust_locks(struct terminal *const term) {
+    struct pl011_device_info *const info =
+        container_of(term, struct pl011_device_info, term);
+
+    info->lock = SPINLOCK_INIT();
 }
 
 #define PL011_BASE_CLOCK 0x16e3600
@@ -168,6 +206,10 @@ pl011_init(const port_t base,
         lcr |= LCR_STP2;
     }
 
+    // Enable FIFOs
+    lcr |= LCR_FEN;
+    mmio_write(&device->lcr_offset, lcr);
+
     // Mask all interrupts by setting corresponding bits to 1
     mmio_write(&device->imsc_offset, 0x7ff);
 
@@ -180,9 +222,14 @@ pl011_init(const port_t base,
     // Finally enable UART
     mmio_write(&device->cr_offset, CR_TXEN | CR_UARTEN);
 
+    info->lock = SPINLOCK_INIT();
     info->device = device;
-    info->term.emit_ch = pl011_send_char,
-    info->term.emit_sv = pl011_send_sv,
+
+    info->term.emit_ch = pl011_send_char;
+    info->term.emit_sv = pl011_send_sv;
+    info->term.bust_locks = pl011_bust_locks;
+    info->term.flush = NULL;
+    info->term.is_serial = true;
 
     printk_add_terminal(&info->term);
 }
\ No newline at end of file
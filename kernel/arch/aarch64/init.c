@@ -3,6 +3,7 @@
  * © suhas pai
  */
 
+#include "lib/memops.h"
 #include "mm/init.h"
 #include "sys/isr.h"
 
@@ -14,6 +15,7 @@ void arch_early_init() {
 
 void arch_init() {
     cpu_init();
+    memops_init();
     mm_init();
 
     isr_install_vbar();
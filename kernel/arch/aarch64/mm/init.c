@@ -419,10 +419,13 @@ static void setup_mair() {
     // Device nGnRnE
     const uint64_t device_uncacheable_encoding = 0b00000000;
 
-    // Device GRE
-    const uint64_t device_write_combining_encoding = 0b00001100;
+    // Device nGnRE
+    const uint64_t device_early_ack_encoding = 0b00000100;
+
+    // Normal memory, inner and outer non-cacheable. Unlike Device-GRE, this
+    // allows unaligned accesses, so it's used for write-combining mappings
+    // like the framebuffer, which get memcpy()'d into.
 
-    // Normal memory, inner and outer non-cacheable
     const uint64_t memory_uncacheable_encoding = 0b01000100;
 
     // Normal memory inner and outer writethrough, non-transient
@@ -431,12 +434,13 @@ static void setup_mair() {
     // Normal memory, inner and outer write-back, non-transient
     const uint64_t memory_write_back_encoding = 0b11111111;
 
+    // The order here must match the __PTE_* cache-kinds in mm/types.h.
     const uint64_t mair_value =
         memory_write_back_encoding |
-        device_write_combining_encoding << 8 |
+        memory_uncacheable_encoding << 8 |
         memory_writethrough_encoding << 16 |
         device_uncacheable_encoding << 24 |
-        memory_uncacheable_encoding << 32;
+        device_early_ack_encoding << 32;
 
     write_mair_el1(mair_value);
 }
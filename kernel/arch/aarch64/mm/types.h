@@ -88,10 +88,13 @@ enum pte_flags {
     __PTE_4KPAGE = 1ull << 1, // Valid only on ptes of a pml1 table
     __PTE_TABLE  = 1ull << 1,
 
-    __PTE_WC = 1ull << 2,
+    // Indices into MAIR_EL1, see setup_mair().
+
+    __PTE_WC = 1ull << 2, // Normal non-cacheable memory
     __PTE_WT = 2ull << 2,
 
     __PTE_MMIO = 3ull << 2, // Device uncacheable memory
+    __PTE_NOCACHE = 4ull << 2, // Device memory that allows early write-acks
     __PTE_USER = 1ull << 6,
     __PTE_RO = 1ull << 7,
 
@@ -34,7 +34,7 @@ flags_from_info(struct pagemap *const pagemap,
             result |= __PTE_WC;
             break;
         case VMA_CACHEKIND_NO_CACHE:
-            result |= __PTE_UNPREDICT;
+            result |= __PTE_NOCACHE;
             break;
         case VMA_CACHEKIND_MMIO:
             result |= __PTE_MMIO;
@@ -69,6 +69,30 @@ arch_make_mapping(struct pagemap *const pagemap,
     return true;
 }
 
+bool
+arch_make_mapping_pages(struct pagemap *const pagemap,
+                        struct list *const pages,
+                        const uint64_t virt_addr,
+                        const uint64_t size,
+                        const prot_t prot,
+                        const enum vma_cachekind cachekind)
+{
+    const struct pgmap_options options = {
+        .pte_flags = flags_from_info(pagemap, prot, cachekind),
+
+        .alloc_pgtable_cb_info = NULL,
+        .free_pgtable_cb_info = NULL,
+
+        .supports_largepage_at_level_mask = 0,
+
+        .free_pages = true,
+        .is_in_early = false,
+        .is_overwrite = false
+    };
+
+    return pgmap_pages_at(pagemap, pages, virt_addr, size, &options);
+}
+
 bool
 arch_unmap_mapping(struct pagemap *const pagemap,
                    const struct range virt_range,
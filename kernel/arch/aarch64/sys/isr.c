@@ -3,9 +3,12 @@
  * © suhas pai
  */
 
+#include "asm/esr.h"
 #include "asm/irq_context.h"
+
 #include "cpu/isr.h"
 #include "dev/printk.h"
+#include "mm/fault.h"
 
 extern void *ivt_el1;
 
@@ -44,12 +47,58 @@ isr_assign_irq_to_cpu(struct cpu_info *const cpu,
     (void)masked;
 }
 
+static bool handle_abort(const uint64_t esr, const uint8_t class) {
+    uint8_t flags = 0;
+    switch ((enum esr_exception_class)class) {
+        case ESR_EC_INSTR_ABORT_LOWER_EL:
+            flags |= PAGE_FAULT_USER | PAGE_FAULT_EXEC;
+            break;
+        case ESR_EC_INSTR_ABORT_SAME_EL:
+            flags |= PAGE_FAULT_EXEC;
+            break;
+        case ESR_EC_DATA_ABORT_LOWER_EL:
+            flags |= PAGE_FAULT_USER;
+            break;
+        case ESR_EC_DATA_ABORT_SAME_EL:
+            break;
+        default:
+            return false;
+    }
+
+    if ((flags & PAGE_FAULT_EXEC) == 0 && (esr & __ESR_ISS_WNR)) {
+        flags |= PAGE_FAULT_WRITE;
+    }
+
+    switch ((enum esr_iss_fault_status)(esr & ESR_ISS_FSC_MASK)) {
+        case ESR_ISS_FSC_TRANSLATION_FAULT:
+            break;
+        case ESR_ISS_FSC_PERMISSION_FAULT:
+            flags |= PAGE_FAULT_PRESENT;
+            break;
+        case ESR_ISS_FSC_ACCESS_FLAG_FAULT:
+        default:
+            return false;
+    }
+
+    return handle_page_fault(read_far_el1(), flags) == E_PAGE_FAULT_OK;
+}
+
 void handle_exception(irq_context_t *const context) {
-    (void)context;
-    printk(LOGLEVEL_INFO, "isr: got exception\n");
+    const uint64_t esr = read_esr_el1();
+    const uint8_t class = esr_get_class(esr);
+
+    if (__builtin_expect(handle_abort(esr, class), 1)) {
+        return;
+    }
+
+    printk(LOGLEVEL_INFO,
+           "isr: got exception, class=0x%" PRIx8 ", far=%p, elr=%p\n",
+           class,
+           (void *)read_far_el1(),
+           (void *)context->elr_el1);
 }
 
 void handle_interrupt(irq_context_t *const context) {
     (void)context;
-    printk(LOGLEVEL_INFO, "isr: got interrupt\n");
+    printk_ratelimited(LOGLEVEL_INFO, "isr: got interrupt\n");
 }
\ No newline at end of file
@@ -16,6 +16,7 @@ struct acpi_rhct {
 
 enum acpi_rhct_node_kind {
     ACPI_RHCT_NODE_KIND_ISA_STRING,
+    ACPI_RHCT_NODE_KIND_CMO,
     ACPI_RHCT_NODE_KIND_HART_INFO = 65535,
 };
 
@@ -31,6 +32,16 @@ struct acpi_rhct_isa_string {
     char isa_string[];
 } __packed;
 
+// The block sizes are stored as log2 of the size in bytes.
+struct acpi_rhct_cmo {
+    struct acpi_rhct_node node;
+
+    uint8_t reserved;
+    uint8_t cbom_size;
+    uint8_t cbop_size;
+    uint8_t cboz_size;
+} __packed;
+
 struct acpi_rhct_hart_info {
     struct acpi_rhct_node node;
 
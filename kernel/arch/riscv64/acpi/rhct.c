@@ -4,6 +4,8 @@
  */
 
 #include "dev/printk.h"
+#include "cpu.h"
+
 #include "rhct.h"
 
 void
@@ -18,6 +20,7 @@ print_rhct_node(const struct acpi_rhct *const rhct,
             const struct string_view isa_sv =
                 sv_create_length(isa_str->isa_string, isa_str->isa_length);
 
+            cpu_add_isa_string(isa_sv);
             printk(LOGLEVEL_INFO,
                    "%srhct: found isa string:\n"
                    "%s\tisa length: %" PRIu16 "\n"
@@ -27,6 +30,23 @@ print_rhct_node(const struct acpi_rhct *const rhct,
                    prefix, SV_FMT_ARGS(isa_sv));
             break;
         }
+        case ACPI_RHCT_NODE_KIND_CMO: {
+            struct acpi_rhct_cmo *const cmo = (struct acpi_rhct_cmo *)node;
+            if (cmo->cboz_size < 32) {
+                cpu_set_cboz_block_size(1u << cmo->cboz_size);
+            }
+
+            printk(LOGLEVEL_INFO,
+                   "%srhct: found cmo info:\n"
+                   "%s\tcbom block size: 2^%" PRIu8 "\n"
+                   "%s\tcbop block size: 2^%" PRIu8 "\n"
+                   "%s\tcboz block size: 2^%" PRIu8 "\n",
+                   prefix,
+                   prefix, cmo->cbom_size,
+                   prefix, cmo->cbop_size,
+                   prefix, cmo->cboz_size);
+            break;
+        }
         case ACPI_RHCT_NODE_KIND_HART_INFO: {
             struct acpi_rhct_hart_info *const hart =
                 (struct acpi_rhct_hart_info *)node;
@@ -0,0 +1,22 @@
+/*
+ * kernel/arch/riscv64/asm/timestamp.h
+ * © suhas pai
+ */
+
+#pragma once
+#include <stdint.h>
+
+// The time csr ticks at the timebase-frequency the dtb or rhct reports.
+static inline uint64_t read_timestamp_counter() {
+    uint64_t result = 0;
+    asm volatile ("rdtime %0" : "=r"(result));
+
+    return result;
+}
+
+// The timebase-frequency isn't recorded anywhere yet, so assume the 10mhz qemu
+// and most boards use.
+
+static inline uint64_t timestamp_counter_frequency() {
+    return 10000000;
+}
\ No newline at end of file
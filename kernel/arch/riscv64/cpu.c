@@ -3,11 +3,29 @@
  * © suhas pai
  */
 
+#include "dev/printk.h"
+
 #include "cpu.h"
 
+static struct cpu_capabilities g_cpu_capabilities = {
+    .supports_svpbmt = false,
+    .supports_zicboz = false,
+    .cboz_block_size = 0,
+};
+
+// The block size can be found before or after zicboz support is, so keep it
+// around until both are known.
+
+static uint32_t g_cboz_block_size = 0;
+
 static struct cpu_info g_base_cpu_info = {
     .pagemap = &kernel_pagemap,
     .pagemap_node = LIST_INIT(g_base_cpu_info.pagemap_node),
+    .xlate_cache = XLATE_CACHE_INIT(),
+    .epoch_state = EPOCH_CPU_STATE_INIT(g_base_cpu_info.epoch_state),
+    .spinlock_state = SPINLOCK_CPU_STATE_INIT(),
+    .table_reserve = TABLE_RESERVE_INIT(g_base_cpu_info.table_reserve),
+    .printk_ring = NULL,
     .spur_int_count = 0
 };
 
@@ -21,4 +39,69 @@ __optimize(3) const struct cpu_info *get_cpu_info() {
 
 __optimize(3) struct cpu_info *get_cpu_info_mut() {
     return &g_base_cpu_info;
+}
+
+__optimize(3) const struct cpu_capabilities *get_cpu_capabilities() {
+    return &g_cpu_capabilities;
+}
+
+static void update_cboz_block_size() {
+    if (g_cpu_capabilities.supports_zicboz) {
+        g_cpu_capabilities.cboz_block_size = g_cboz_block_size;
+    }
+}
+
+void cpu_add_isa_extension(const struct string_view ext) {
+    if (sv_equals_c_str(ext, "svpbmt")) {
+        g_cpu_capabilities.supports_svpbmt = true;
+    } else if (sv_equals_c_str(ext, "zicboz")) {
+        g_cpu_capabilities.supports_zicboz = true;
+        update_cboz_block_size();
+    }
+}
+
+void cpu_set_cboz_block_size(const uint32_t size) {
+    // zero_page() clears whole blocks, so a block can't be larger than a
+    // page.
+
+    if (__builtin_popcount(size) != 1 || size > PAGE_SIZE) {
+        printk(LOGLEVEL_WARN,
+               "cpu: ignoring invalid cbo.zero block size %" PRIu32 "\n",
+               size);
+        return;
+    }
+
+    g_cboz_block_size = size;
+    update_cboz_block_size();
+}
+
+void cpu_add_isa_string(struct string_view isa) {
+    // The rhct counts the null-terminator as part of the string.
+    while (isa.length != 0 && isa.begin[isa.length - 1] == '\0') {
+        isa.length--;
+    }
+
+    // Multi-letter extensions follow the base isa, each prefixed with an
+    // underscore.
+
+    while (isa.length != 0) {
+        uint64_t length = 0;
+        while (length != isa.length && isa.begin[length] != '_') {
+            length++;
+        }
+
+        cpu_add_isa_extension(sv_create_length(isa.begin, length));
+
+        if (length == isa.length) {
+            break;
+        }
+
+        isa = sv_create_length(isa.begin + length + 1, isa.length - length - 1);
+    }
+}
+
+void cpu_init() {
+    epoch_register_cpu(&g_base_cpu_info.epoch_state);
+    spinlock_register_cpu(&g_base_cpu_info.spinlock_state);
+    printk_init_cpu(&g_base_cpu_info);
 }
\ No newline at end of file
@@ -5,17 +5,50 @@
 
 #pragma once
 
+#include "cpu/spinlock.h"
+#include "lib/adt/string_view.h"
 #include "lib/list.h"
+#include "mm/epoch.h"
 #include "mm/pagemap.h"
+#include "mm/table_pool.h"
+#include "mm/xlate_cache.h"
+
+struct cpu_capabilities {
+    bool supports_svpbmt : 1;
+    bool supports_zicboz : 1;
+
+    // Size of the block cbo.zero clears. Zero if zicboz isn't supported, or
+    // the size isn't known yet.
+
+    uint32_t cboz_block_size;
+};
 
 struct pagemap;
+struct printk_ring;
 struct cpu_info {
     struct pagemap *pagemap;
     struct list pagemap_node;
 
+    struct xlate_cache xlate_cache;
+    struct epoch_cpu_state epoch_state;
+    struct spinlock_cpu_state spinlock_state;
+    struct table_reserve table_reserve;
+
+    struct printk_ring *printk_ring;
+
     uint64_t spur_int_count;
 };
 
+void cpu_init();
+
 const struct cpu_info *get_base_cpu_info();
 const struct cpu_info *get_cpu_info();
-struct cpu_info *get_cpu_info_mut();
\ No newline at end of file
+struct cpu_info *get_cpu_info_mut();
+
+const struct cpu_capabilities *get_cpu_capabilities();
+
+// Record the extensions listed in an isa-string like "rv64imac_zicsr_svpbmt".
+void cpu_add_isa_string(struct string_view isa);
+void cpu_add_isa_extension(struct string_view ext);
+
+void cpu_set_cboz_block_size(uint32_t size);
\ No newline at end of file
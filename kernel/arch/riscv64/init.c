@@ -3,12 +3,17 @@
  * © suhas pai
  */
 
+#include "lib/memops.h"
 #include "mm/init.h"
 
+#include "cpu.h"
+
 void arch_early_init() {
 
 }
 
 void arch_init() {
+    cpu_init();
+    memops_init();
     mm_init();
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
  */
 
 #include "mm/pgmap.h"
+#include "cpu.h"
 
 static inline uint64_t
 flags_from_info(struct pagemap *const pagemap,
@@ -23,14 +24,26 @@ flags_from_info(struct pagemap *const pagemap,
         result |= __PTE_USER;
     }
 
+    // Without Svpbmt, the pbmt bits are reserved, and every mapping gets the
+    // attributes of the underlying physical memory.
+
+    if (!get_cpu_capabilities()->supports_svpbmt) {
+        return result;
+    }
+
     switch (cachekind) {
         case VMA_CACHEKIND_WRITEBACK:
             break;
         case VMA_CACHEKIND_WRITETHROUGH:
+            // Svpbmt has no write-through kind, so keep the memory's own
+            // attributes.
+            break;
         case VMA_CACHEKIND_WRITECOMBINING:
         case VMA_CACHEKIND_NO_CACHE:
+            result |= __PTE_NC;
             break;
         case VMA_CACHEKIND_MMIO:
+            result |= __PTE_IO;
             break;
     }
 
@@ -63,6 +76,30 @@ arch_make_mapping(struct pagemap *const pagemap,
     return true;
 }
 
+bool
+arch_make_mapping_pages(struct pagemap *const pagemap,
+                        struct list *const pages,
+                        const uint64_t virt_addr,
+                        const uint64_t size,
+                        const prot_t prot,
+                        const enum vma_cachekind cachekind)
+{
+    const struct pgmap_options options = {
+        .pte_flags = flags_from_info(pagemap, prot, cachekind),
+
+        .alloc_pgtable_cb_info = NULL,
+        .free_pgtable_cb_info = NULL,
+
+        .supports_largepage_at_level_mask = 0,
+
+        .free_pages = true,
+        .is_in_early = false,
+        .is_overwrite = false
+    };
+
+    return pgmap_pages_at(pagemap, pages, virt_addr, size, &options);
+}
+
 bool
 arch_unmap_mapping(struct pagemap *const pagemap,
                    const struct range virt_range,
@@ -22,9 +22,9 @@ lapic_timer_irq_callback(const uint64_t int_no, irq_context_t *const frame) {
 
     get_cpu_info_mut()->timer_ticks++;
     if (get_cpu_info()->timer_ticks % 1000 == 0) {
-        printk(LOGLEVEL_INFO,
-               "Timer: %" PRIu64 "\n",
-               get_cpu_info_mut()->timer_ticks);
+        printk_binary(LOGLEVEL_DEBUG,
+                      "Timer: %" PRIu64 "\n",
+                      get_cpu_info_mut()->timer_ticks);
     }
 }
 
@@ -377,4 +377,17 @@ enum {
      */
 
     __XCR0_BIT_TILEDATA = 1ull << 18,
-};
\ No newline at end of file
+};
+
+__optimize(3) static inline uint64_t read_xcr0() {
+    uint32_t low = 0, high = 0;
+    asm volatile ("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+
+    return (uint64_t)high << 32 | low;
+}
+
+__optimize(3) static inline void write_xcr0(const uint64_t xcr0) {
+    asm volatile ("xsetbv"
+                  :: "a"((uint32_t)xcr0), "d"((uint32_t)(xcr0 >> 32)), "c"(0)
+                  : "memory");
+}
\ No newline at end of file
@@ -11,6 +11,7 @@
 enum irq_number {
     IRQ_TIMER = 0,
     IRQ_KEYBOARD = 1,
+    IRQ_COM1 = 4,
 };
 
 static inline bool are_interrupts_enabled() {
@@ -0,0 +1,21 @@
+/*
+ * kernel/arch/x86_64/asm/timestamp.h
+ * © suhas pai
+ */
+
+#pragma once
+#include <stdint.h>
+
+// The tsc's frequency isn't calibrated anywhere yet, so its readings are only
+// good for ordering events and comparing durations.
+
+static inline uint64_t read_timestamp_counter() {
+    return __builtin_ia32_rdtsc();
+}
+
+// Until the tsc is calibrated, assume a frequency typical of recent cpus.
+// Only use this where being off by a factor of two or so doesn't matter.
+
+static inline uint64_t timestamp_counter_frequency() {
+    return 2000000000;
+}
\ No newline at end of file
@@ -14,7 +14,11 @@
 #include "cpu.h"
 
 static struct cpu_capabilities g_cpu_capabilities = {
+    .supports_avx = false,
+    .supports_avx2 = false,
     .supports_avx512 = false,
+    .supports_fsrm = false,
+    .supports_movdir64b = false,
     .supports_x2apic = false,
     .supports_1gib_pages = false,
 };
@@ -27,6 +31,11 @@ static struct cpu_info g_base_cpu_info = {
 
     .pagemap = &kernel_pagemap,
     .pagemap_node = LIST_INIT(g_base_cpu_info.pagemap_node),
+    .xlate_cache = XLATE_CACHE_INIT(),
+    .epoch_state = EPOCH_CPU_STATE_INIT(g_base_cpu_info.epoch_state),
+    .spinlock_state = SPINLOCK_CPU_STATE_INIT(),
+    .table_reserve = TABLE_RESERVE_INIT(g_base_cpu_info.table_reserve),
+    .printk_ring = NULL,
 
     .spur_int_count = 0
 };
@@ -78,6 +87,7 @@ static void init_cpuid_features() {
 
         if (!g_base_cpu_init) {
             g_cpu_capabilities.supports_x2apic = ecx & __CPUID_FEAT_ECX_X2APIC;
+            g_cpu_capabilities.supports_avx = ecx & __CPUID_FEAT_ECX_AVX;
         }
     }
     {
@@ -109,8 +119,15 @@ static void init_cpuid_features() {
 
         assert((ebx & expected_ebx_features) == expected_ebx_features);
         if (!g_base_cpu_init) {
+            // Bit 5 of ebx is avx2, avx itself is reported in leaf 1.
+            g_cpu_capabilities.supports_avx2 =
+                ebx & __CPUID_FEAT_EXT7_ECX0_EBX_AVX;
             g_cpu_capabilities.supports_avx512 =
                 ebx & __CPUID_FEAT_EXT7_ECX0_EBX_AVX512F;
+            g_cpu_capabilities.supports_fsrm =
+                edx & __CPUID_FEAT_EXT7_ECX0_EDX_FAST_SHORT_REP_PREFIX;
+            g_cpu_capabilities.supports_movdir64b =
+                ecx & __CPUID_FEAT_EXT7_ECX0_ECX_MOVDIR64B;
         }
     }
     {
@@ -175,7 +192,8 @@ static void init_cpuid_features() {
         }
     }
 
-    write_cr0(read_cr0() | __CR0_BIT_MP);
+    write_cr0((read_cr0() | __CR0_BIT_MP) &
+              ~(uint64_t)(__CR0_BIT_EM | __CR0_BIT_TS));
 
     const uint64_t cr4_bits =
         __CR4_BIT_TSD |
@@ -190,6 +208,17 @@ static void init_cpuid_features() {
 
     write_cr4(read_cr4() | cr4_bits);
 
+    // Let the kernel use the avx registers, which memcpy() and friends do when
+    // interrupts are disabled. The avx-512 state isn't enabled, as nothing in
+    // the kernel uses it.
+
+    uint64_t xcr0 = __XCR0_BIT_X87 | __XCR0_BIT_SSE;
+    if (g_cpu_capabilities.supports_avx) {
+        xcr0 |= __XCR0_BIT_AVX;
+    }
+
+    write_xcr0(xcr0);
+
     // Enable Syscalls and Fast-FPU
     write_msr(IA32_MSR_EFER,
               (read_msr(IA32_MSR_EFER) | __IA32_MSR_EFER_BIT_SCE));
@@ -229,6 +258,9 @@ void cpu_init() {
 
     write_gsbase((uint64_t)&g_base_cpu_info);
     list_add(&kernel_pagemap.cpu_list, &g_base_cpu_info.pagemap_node);
+    epoch_register_cpu(&g_base_cpu_info.epoch_state);
+    spinlock_register_cpu(&g_base_cpu_info.spinlock_state);
 
     g_base_cpu_init = true;
+    printk_init_cpu(&g_base_cpu_info);
 }
\ No newline at end of file
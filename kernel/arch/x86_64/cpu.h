@@ -8,16 +8,29 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "cpu/spinlock.h"
 #include "lib/list.h"
+#include "mm/epoch.h"
 #include "mm/pagemap.h"
+#include "mm/table_pool.h"
+#include "mm/xlate_cache.h"
 
 struct cpu_capabilities {
+    bool supports_avx : 1;
+    bool supports_avx2 : 1;
     bool supports_avx512 : 1;
+
+    // Fast short rep movsb, i.e. rep movsb is fast even for copies of less
+    // than 128 bytes.
+
+    bool supports_fsrm : 1;
+    bool supports_movdir64b : 1;
     bool supports_x2apic : 1;
     bool supports_1gib_pages : 1;
 };
 
 struct pagemap;
+struct printk_ring;
 struct cpu_info {
     uint32_t processor_id;
     uint32_t lapic_id;
@@ -27,6 +40,13 @@ struct cpu_info {
     struct pagemap *pagemap;
     struct list pagemap_node;
 
+    struct xlate_cache xlate_cache;
+    struct epoch_cpu_state epoch_state;
+    struct spinlock_cpu_state spinlock_state;
+    struct table_reserve table_reserve;
+
+    struct printk_ring *printk_ring;
+
     // Keep track of spurious interrupts for every lapic.
     uint64_t spur_int_count;
 };
@@ -4,6 +4,7 @@
  */
 
 #include "dev/ps2/driver.h"
+#include "dev/uart/com1.h"
 
 #include "dev/time/hpet.h"
 #include "dev/time/rtc.h"
@@ -23,6 +24,7 @@ void arch_init_dev() {
         printk(LOGLEVEL_WARN, "dev: ps2 keyboard/mouse are not supported\n");
     }
 
+    com1_init_irq();
     rtc_init();
 
     struct rtc_cmos_info rtc_info = RTC_CMOS_INFO_INIT();
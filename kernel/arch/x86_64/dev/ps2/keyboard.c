@@ -7,6 +7,7 @@
 #include "lib/adt/string.h"
 
 #include "asm/irqs.h"
+#include "asm/timestamp.h"
 #include "cpu/isr.h"
 
 #include "dev/printk.h"
@@ -77,12 +78,119 @@ static char get_char_from_ps2_kb(const uint8_t scan_code) {
     return ps2_key_to_char[scan_code];
 }
 
-void
-ps2_keyboard_interrupt(const uint64_t int_no, irq_context_t *const context) {
-    (void)int_no;
-    (void)context;
+// Only the interrupt handler reads or writes `g_kbd_state`. Readers get a copy
+// of the modifiers with every event instead.
+
+__optimize(3) static uint8_t get_modifier_flags() {
+    uint8_t flags = 0;
+    if (g_kbd_state.shift != 0) {
+        flags |= __PS2_KEY_EVENT_SHIFT;
+    }
+
+    if (g_kbd_state.ctrl != 0) {
+        flags |= __PS2_KEY_EVENT_CTRL;
+    }
+
+    if (g_kbd_state.alt) {
+        flags |= __PS2_KEY_EVENT_ALT;
+    }
+
+    if (g_kbd_state.cmd != 0) {
+        flags |= __PS2_KEY_EVENT_CMD;
+    }
+
+    if (g_kbd_state.caps_lock) {
+        flags |= __PS2_KEY_EVENT_CAPS_LOCK;
+    }
+
+    return flags;
+}
+
+/*
+ * Single-producer, single-consumer queue of key events. Only the interrupt
+ * handler pushes, and advances `g_event_head`, and only the reader pops, and
+ * advances `g_event_tail`. Both only ever increase, and are wrapped around the
+ * queue when used as indices.
+ */
+
+#define PS2_KEY_EVENT_QUEUE_SIZE 256
+
+static struct ps2_key_event g_event_queue[PS2_KEY_EVENT_QUEUE_SIZE] = {};
+
+static _Atomic uint32_t g_event_head = 0;
+static _Atomic uint32_t g_event_tail = 0;
+
+static struct ps2_keyboard_stats g_stats = {
+    .interrupt_count = 0,
+    .interrupt_cycles = 0,
+    .max_interrupt_cycles = 0,
+    .dropped_events = 0
+};
+
+__optimize(3) static void
+push_event(const uint8_t scan_code, const uint8_t flags, const char ch) {
+    const uint32_t head =
+        atomic_load_explicit(&g_event_head, memory_order_relaxed);
+    const uint32_t tail =
+        atomic_load_explicit(&g_event_tail, memory_order_acquire);
+
+    // Drop the newest event rather than the oldest when the reader has fallen
+    // behind, as the reader owns the oldest slot.
+
+    if (head - tail == PS2_KEY_EVENT_QUEUE_SIZE) {
+        atomic_fetch_add_explicit(&g_stats.dropped_events,
+                                  1,
+                                  memory_order_relaxed);
+        return;
+    }
+
+    g_event_queue[head % PS2_KEY_EVENT_QUEUE_SIZE] = (struct ps2_key_event){
+        .scan_code = scan_code,
+        .flags = flags | get_modifier_flags(),
+        .ch = ch
+    };
+
+    atomic_store_explicit(&g_event_head, head + 1, memory_order_release);
+}
+
+__optimize(3)
+bool ps2_keyboard_poll_event(struct ps2_key_event *const event_out) {
+    const uint32_t tail =
+        atomic_load_explicit(&g_event_tail, memory_order_relaxed);
+    const uint32_t head =
+        atomic_load_explicit(&g_event_head, memory_order_acquire);
+
+    if (head == tail) {
+        return false;
+    }
+
+    *event_out = g_event_queue[tail % PS2_KEY_EVENT_QUEUE_SIZE];
+    atomic_store_explicit(&g_event_tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+struct ps2_key_event ps2_keyboard_wait_event() {
+    assert_msg(are_interrupts_enabled(),
+               "ps2: ps2_keyboard_wait_event() called with interrupts "
+               "disabled");
+
+    struct ps2_key_event event;
+    while (true) {
+        disable_all_interrupts();
+        if (ps2_keyboard_poll_event(&event)) {
+            enable_all_interrupts();
+            return event;
+        }
 
-    const uint8_t scan_code = ps2_read_input_byte();
+        // sti only takes effect after the next instruction, so an interrupt
+        // that arrives after the poll above still wakes us from hlt.
+
+        asm volatile("sti; hlt");
+    }
+}
+
+static void handle_scan_code(const uint8_t scan_code) {
     if (g_kbd_state.in_e0) {
         g_kbd_state.in_e0 = false;
         switch ((enum ps2_scancode_e0_keys)scan_code) {
@@ -101,16 +209,10 @@ ps2_keyboard_interrupt(const uint64_t int_no, irq_context_t *const context) {
                 g_kbd_state.ctrl -= 1;
                 return;
             case PS2_SCANNODE_E0_UP_ARROW:
-                printk(LOGLEVEL_INFO, "ps2: up-arrow\n");
-                return;
             case PS2_SCANNODE_E0_LEFT_ARROW:
-                printk(LOGLEVEL_INFO, "ps2: left-arrow\n");
-                return;
             case PS2_SCANNODE_E0_RIGHT_ARROW:
-                printk(LOGLEVEL_INFO, "ps2: right-arrow\n");
-                return;
             case PS2_SCANNODE_E0_DOWN_ARROW:
-                printk(LOGLEVEL_INFO, "ps2: down-arrow\n");
+                push_event(scan_code, __PS2_KEY_EVENT_E0, /*ch=*/'\0');
                 return;
             case PS2_SCANNODE_E0_UP_ARROW_REL:
             case PS2_SCANNODE_E0_LEFT_ARROW_REL:
@@ -119,9 +221,9 @@ ps2_keyboard_interrupt(const uint64_t int_no, irq_context_t *const context) {
                 return;
         }
 
-        printk(LOGLEVEL_WARN,
-               "ps2: unrecognized e0 scan-code 0x%" PRIx8 "\n",
-               scan_code);
+        push_event(scan_code,
+                   __PS2_KEY_EVENT_E0 | __PS2_KEY_EVENT_UNKNOWN,
+                   /*ch=*/'\0');
         return;
     }
 
@@ -153,7 +255,7 @@ ps2_keyboard_interrupt(const uint64_t int_no, irq_context_t *const context) {
             g_kbd_state.caps_lock = !g_kbd_state.caps_lock;
             return;
         case PS2_SCANCODE_NUMLOCK:
-            printk(LOGLEVEL_INFO, "ps2: got numlock\n");
+            push_event(scan_code, /*flags=*/0, /*ch=*/'\0');
             return;
     }
 
@@ -166,50 +268,128 @@ ps2_keyboard_interrupt(const uint64_t int_no, irq_context_t *const context) {
     }
 
     if (!index_in_bounds(scan_code, countof(ps2_key_to_char))) {
-        printk(LOGLEVEL_WARN,
-               "ps2: kbd scan code: 0x%" PRIx8 " (not in array)\n", scan_code);
+        push_event(scan_code, __PS2_KEY_EVENT_UNKNOWN, /*ch=*/'\0');
         return;
     }
 
-    struct string string = STRING_EMPTY();
-    if (g_kbd_state.shift != 0) {
-        string_append_sv(&string, SV_STATIC("shift"));
+    push_event(scan_code, /*flags=*/0, get_char_from_ps2_kb(scan_code));
+}
+
+__optimize(3) void
+ps2_keyboard_interrupt(const uint64_t int_no, irq_context_t *const context) {
+    (void)int_no;
+    (void)context;
+
+    const uint64_t begin = read_timestamp_counter();
+    handle_scan_code((uint8_t)ps2_read_input_byte());
+
+    const uint64_t cycles = read_timestamp_counter() - begin;
+
+    // Only the interrupt handler writes these, so they don't need to be
+    // updated atomically as a whole.
+
+    atomic_fetch_add_explicit(&g_stats.interrupt_count,
+                              1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_stats.interrupt_cycles,
+                              cycles,
+                              memory_order_relaxed);
+
+    if (cycles > atomic_load_explicit(&g_stats.max_interrupt_cycles,
+                                      memory_order_relaxed))
+    {
+        atomic_store_explicit(&g_stats.max_interrupt_cycles,
+                              cycles,
+                              memory_order_relaxed);
     }
+}
 
-    if (g_kbd_state.ctrl != 0) {
-        if (g_kbd_state.shift != 0) {
-            string_append_sv(&string, SV_STATIC("-"));
+void ps2_keyboard_log_events() {
+    struct ps2_key_event event;
+    while (ps2_keyboard_poll_event(&event)) {
+        if (event.flags & __PS2_KEY_EVENT_UNKNOWN) {
+            printk(LOGLEVEL_WARN,
+                   "ps2: unrecognized %sscan-code 0x%" PRIx8 "\n",
+                   event.flags & __PS2_KEY_EVENT_E0 ? "e0 " : "",
+                   event.scan_code);
+            continue;
         }
 
-        string_append_sv(&string, SV_STATIC("ctrl"));
-    }
+        if (event.flags & __PS2_KEY_EVENT_E0) {
+            const char *name = NULL;
+            switch ((enum ps2_scancode_e0_keys)event.scan_code) {
+                case PS2_SCANNODE_E0_UP_ARROW:
+                    name = "up-arrow";
+                    break;
+                case PS2_SCANNODE_E0_LEFT_ARROW:
+                    name = "left-arrow";
+                    break;
+                case PS2_SCANNODE_E0_RIGHT_ARROW:
+                    name = "right-arrow";
+                    break;
+                case PS2_SCANNODE_E0_DOWN_ARROW:
+                    name = "down-arrow";
+                    break;
+                default:
+                    name = "e0-key";
+                    break;
+            }
+
+            printk(LOGLEVEL_INFO, "ps2: %s\n", name);
+            continue;
+        }
 
-    if (g_kbd_state.alt) {
-        if (g_kbd_state.shift != 0 || g_kbd_state.ctrl != 0) {
-            string_append_sv(&string, SV_STATIC("-"));
+        if (event.scan_code == PS2_SCANCODE_NUMLOCK) {
+            printk(LOGLEVEL_INFO, "ps2: got numlock\n");
+            continue;
         }
 
-        string_append_sv(&string, SV_STATIC("alt"));
-    }
+        struct string string = STRING_EMPTY();
+        if (event.flags & __PS2_KEY_EVENT_SHIFT) {
+            string_append_sv(&string, SV_STATIC("shift"));
+        }
 
-    if (g_kbd_state.cmd != 0) {
-        if (g_kbd_state.shift != 0 ||
-            g_kbd_state.ctrl != 0 ||
-            g_kbd_state.alt)
-        {
-            string_append_sv(&string, SV_STATIC("-"));
+        if (event.flags & __PS2_KEY_EVENT_CTRL) {
+            if (event.flags & __PS2_KEY_EVENT_SHIFT) {
+                string_append_sv(&string, SV_STATIC("-"));
+            }
+
+            string_append_sv(&string, SV_STATIC("ctrl"));
         }
 
-        string_append_sv(&string, SV_STATIC("cmd"));
-    }
+        if (event.flags & __PS2_KEY_EVENT_ALT) {
+            if (event.flags & (__PS2_KEY_EVENT_SHIFT | __PS2_KEY_EVENT_CTRL)) {
+                string_append_sv(&string, SV_STATIC("-"));
+            }
 
-    printk(LOGLEVEL_WARN,
-           "ps2: " STRING_FMT " '%c'%s\n",
-           STRING_FMT_ARGS(string),
-           get_char_from_ps2_kb(scan_code),
-           g_kbd_state.caps_lock ? " [caps-lock]" : "");
+            string_append_sv(&string, SV_STATIC("alt"));
+        }
+
+        if (event.flags & __PS2_KEY_EVENT_CMD) {
+            const uint8_t mask =
+                __PS2_KEY_EVENT_SHIFT |
+                __PS2_KEY_EVENT_CTRL |
+                __PS2_KEY_EVENT_ALT;
+
+            if (event.flags & mask) {
+                string_append_sv(&string, SV_STATIC("-"));
+            }
+
+            string_append_sv(&string, SV_STATIC("cmd"));
+        }
+
+        printk(LOGLEVEL_WARN,
+               "ps2: " STRING_FMT " '%c'%s\n",
+               STRING_FMT_ARGS(string),
+               event.ch,
+               event.flags & __PS2_KEY_EVENT_CAPS_LOCK ? " [caps-lock]" : "");
+
+        string_destroy(&string);
+    }
+}
 
-    string_destroy(&string);
+const struct ps2_keyboard_stats *ps2_keyboard_get_stats() {
+    return &g_stats;
 }
 
 void ps2_keyboard_init(const enum ps2_port_id device_id) {
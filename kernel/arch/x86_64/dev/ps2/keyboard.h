@@ -5,6 +5,9 @@
 
 #pragma once
 
+#include <stdatomic.h>
+#include <stdbool.h>
+
 #include "asm/irq_context.h"
 #include "driver.h"
 
@@ -46,5 +49,53 @@ enum ps2_keyboard_byte_flags {
     __PS2_KBD_KEY_RELEASE = 1ull << 7
 };
 
+enum ps2_key_event_flags {
+    __PS2_KEY_EVENT_SHIFT = 1 << 0,
+    __PS2_KEY_EVENT_CTRL = 1 << 1,
+    __PS2_KEY_EVENT_ALT = 1 << 2,
+    __PS2_KEY_EVENT_CMD = 1 << 3,
+    __PS2_KEY_EVENT_CAPS_LOCK = 1 << 4,
+
+    // The scan-code came after an 0xE0 prefix.
+    __PS2_KEY_EVENT_E0 = 1 << 5,
+    __PS2_KEY_EVENT_UNKNOWN = 1 << 6,
+};
+
+// A key press, along with the modifiers that were held down at the time.
+struct ps2_key_event {
+    uint8_t scan_code;
+    uint8_t flags;
+
+    // The char the key maps to with shift, or otherwise caps-lock, applied, or
+    // '\0' if it doesn't map to one. Ctrl, alt and cmd don't change the char,
+    // and are only reported in `flags`.
+
+    char ch;
+};
+
+struct ps2_keyboard_stats {
+    _Atomic uint64_t interrupt_count;
+
+    // Time spent in the interrupt handler, in timestamp-counter cycles.
+    _Atomic uint64_t interrupt_cycles;
+    _Atomic uint64_t max_interrupt_cycles;
+
+    // Events dropped because the queue was full.
+    _Atomic uint64_t dropped_events;
+};
+
 void ps2_keyboard_init(const enum ps2_port_id device_id);
-void ps2_keyboard_interrupt(uint64_t int_no, irq_context_t *context);
\ No newline at end of file
+void ps2_keyboard_interrupt(uint64_t int_no, irq_context_t *context);
+
+// The interrupt handler only queues key events, which are taken off the queue
+// with the functions below. The queue only supports a single reader at a time.
+
+bool ps2_keyboard_poll_event(struct ps2_key_event *event_out);
+
+// Wait until a key event is available. Interrupts must be enabled.
+struct ps2_key_event ps2_keyboard_wait_event();
+
+// Print out every queued key event.
+void ps2_keyboard_log_events();
+
+const struct ps2_keyboard_stats *ps2_keyboard_get_stats();
\ No newline at end of file
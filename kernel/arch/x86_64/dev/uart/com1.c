@@ -3,13 +3,52 @@
  * © suhas pai
  */
 
+#include "asm/irqs.h"
+#include "cpu/isr.h"
+
+#include "dev/printk.h"
 #include "dev/uart/8250.h"
+
 #include "com1.h"
 
+static struct uart8250_info *g_com1_info = NULL;
+static isr_vector_t g_com1_vector = 0;
+
+__optimize(3)
+static void com1_interrupt(const uint64_t int_no, irq_context_t *const frame) {
+    (void)int_no;
+    (void)frame;
+
+    uart8250_handle_irq(g_com1_info);
+}
+
+// The registers of the pc's com ports are at consecutive io-ports, and are
+// clocked by the standard 1.8432 MHz uart crystal.
+
+#define COM1_IN_FREQ 1843200
+
 void com1_init() {
-    uart8250_init((port_t)0x3f8,
-                  /*baudrate=*/115200,
-                  /*in_freq=*/0,
-                  /*reg_width=*/sizeof(uint8_t),
-                  /*reg_shift=*/1);
+    g_com1_info =
+        uart8250_init((port_t)0x3f8,
+                      /*baudrate=*/115200,
+                      /*in_freq=*/COM1_IN_FREQ,
+                      /*reg_width=*/sizeof(uint8_t),
+                      /*reg_shift=*/0);
+}
+
+void com1_init_irq() {
+    if (g_com1_info == NULL) {
+        return;
+    }
+
+    g_com1_vector = isr_alloc_vector();
+
+    isr_set_vector(g_com1_vector, com1_interrupt, &ARCH_ISR_INFO_NONE());
+    isr_assign_irq_to_cpu(get_cpu_info_mut(),
+                          IRQ_COM1,
+                          g_com1_vector,
+                          /*masked=*/false);
+
+    uart8250_enable_irq(g_com1_info);
+    printk(LOGLEVEL_INFO, "com1: transmitting from irq\n");
 }
\ No newline at end of file
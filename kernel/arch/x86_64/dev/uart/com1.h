@@ -5,4 +5,5 @@
 
 #pragma once
 
-void com1_init();
\ No newline at end of file
+void com1_init();
+void com1_init_irq();
\ No newline at end of file
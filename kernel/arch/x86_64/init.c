@@ -3,6 +3,7 @@
  * © suhas pai
  */
 
+#include "lib/memops.h"
 #include "mm/init.h"
 
 #include "sys/gdt.h"
@@ -18,5 +19,6 @@ void arch_init() {
     gdt_load();
     idt_init();
     cpu_init();
+    memops_init();
     mm_init();
 }
\ No newline at end of file
@@ -413,23 +413,41 @@ static void fill_kernel_pagemap_struct(const uint64_t kernel_memmap_size) {
         "mm: failed to setup kernel-pagemap");
 }
 
-void mm_init() {
-    const uint64_t pat_msr_orig = read_msr(IA32_MSR_PAT);
-    const uint64_t pat_msr =
-        pat_msr_orig |
-        (~((MSR_PAT_ENTRY_MASK << MSR_PAT_INDEX_PAT2) |
-           (MSR_PAT_ENTRY_MASK << MSR_PAT_INDEX_PAT3)));
+static void setup_pat() {
+    // Only the PWT and PCD bits are used to select a cache-kind, so program
+    // the four entries they index, and leave the PAT=1 entries alone:
+    //   PAT0 (none)    -> write-back
+    //   PAT1 (PWT)     -> write-through
+    //   PAT2 (PCD)     -> uncacheable
+    //   PAT3 (PCD|PWT) -> write-combining, i.e. __PTE_WC
 
+    const uint64_t pat_msr_orig = read_msr(IA32_MSR_PAT);
     printk(LOGLEVEL_INFO,
            "mm: pat msr original value is 0x%" PRIx64 "\n",
            pat_msr_orig);
 
-    const uint64_t uncacheable_mask =
-        (uint64_t)MSR_PAT_ENCODING_UNCACHEABLE << MSR_PAT_INDEX_PAT2;
-    const uint64_t write_combining_mask =
+    const uint64_t entries_mask =
+        MSR_PAT_ENTRY_MASK << MSR_PAT_INDEX_PAT0 |
+        MSR_PAT_ENTRY_MASK << MSR_PAT_INDEX_PAT1 |
+        MSR_PAT_ENTRY_MASK << MSR_PAT_INDEX_PAT2 |
+        MSR_PAT_ENTRY_MASK << MSR_PAT_INDEX_PAT3;
+
+    const uint64_t entries =
+        (uint64_t)MSR_PAT_ENCODING_WRITE_BACK << MSR_PAT_INDEX_PAT0 |
+        (uint64_t)MSR_PAT_ENCODING_WRITE_THROUGH << MSR_PAT_INDEX_PAT1 |
+        (uint64_t)MSR_PAT_ENCODING_UNCACHEABLE << MSR_PAT_INDEX_PAT2 |
         (uint64_t)MSR_PAT_ENCODING_WRITE_COMBINING << MSR_PAT_INDEX_PAT3;
 
-    write_msr(IA32_MSR_PAT, pat_msr | uncacheable_mask | write_combining_mask);
+    write_msr(IA32_MSR_PAT, (pat_msr_orig & ~entries_mask) | entries);
+
+    // Lines cached under the old memory-types may still be around, so write
+    // them back before anything is mapped with the new ones.
+
+    asm volatile ("wbinvd" ::: "memory");
+}
+
+void mm_init() {
+    setup_pat();
 
     uint64_t kernel_memmap_size = 0;
     setup_kernel_pagemap(&kernel_memmap_size);
@@ -3,12 +3,36 @@
  * © suhas pai
  */
 
+#include "asm/cr.h"
+#include "asm/irqs.h"
 #include "asm/tlb.h"
-#include "mm/page_alloc.h"
 
 #include "tlb.h"
 
+// Past this many pages, reloading the whole tlb is cheaper than issuing an
+// invlpg for every page.
+
+#define TLB_FULL_FLUSH_THRESHOLD 64
+
+__optimize(3) static void tlb_flush_all() {
+    // Kernel mappings are global, so a cr3 reload won't evict them. Toggling
+    // cr4.pge flushes every entry, global or not.
+
+    const bool flag = disable_all_int_if_not();
+    const uint64_t cr4 = read_cr4();
+
+    write_cr4(cr4 & ~(uint64_t)__CR4_BIT_PGE);
+    write_cr4(cr4);
+
+    enable_all_int_if_flag(flag);
+}
+
 __optimize(3) static void tlb_flush_range(const struct range range) {
+    if (PAGE_COUNT(range.size) > TLB_FULL_FLUSH_THRESHOLD) {
+        tlb_flush_all();
+        return;
+    }
+
     const uint64_t end = range_get_end_assert(range);
     for (uint64_t addr = range.front; addr < end; addr += PAGE_SIZE) {
         invlpg(addr);
@@ -16,14 +40,8 @@ __optimize(3) static void tlb_flush_range(const struct range range) {
 }
 
 void tlb_flush_pageop(struct pageop *const pageop) {
-    tlb_flush_range(pageop->flush_range);
+    // The pages in pageop->delayed_free are freed by pageop_finish() once
+    // every cpu is done with them.
 
-    struct page *page = NULL;
-    struct page *tmp = NULL;
-
-    list_foreach_mut(page, tmp, &pageop->delayed_free, table.delayed_free_list)
-    {
-        list_delete(&page->table.delayed_free_list);
-        free_page(page);
-    }
+    tlb_flush_range(pageop->flush_range);
 }
\ No newline at end of file
@@ -54,11 +54,11 @@ __optimize(3) bool pte_is_dirty(const pte_t pte) {
 }
 
 __optimize(3) pte_t pte_read(const pte_t *const pte) {
-    return *pte;
+    return *(volatile const pte_t *)pte;
 }
 
 __optimize(3) void pte_write(pte_t *const pte, const pte_t value) {
-    *pte = value;
+    *(volatile pte_t *)pte = value;
 }
 
 __optimize(3)
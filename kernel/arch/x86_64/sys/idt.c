@@ -10,6 +10,7 @@
 #include "cpu/util.h"
 
 #include "dev/printk.h"
+#include "mm/fault.h"
 
 #include "gdt.h"
 #include "pic.h"
@@ -110,6 +111,34 @@ void idt_init() {
     idt_load();
 }
 
+enum page_fault_error_code {
+    __PAGE_FAULT_ERR_PRESENT = 1 << 0,
+    __PAGE_FAULT_ERR_WRITE = 1 << 1,
+    __PAGE_FAULT_ERR_USER = 1 << 2,
+    __PAGE_FAULT_ERR_INSTR_FETCH = 1 << 4,
+};
+
+static uint8_t page_fault_flags_from_err_code(const uint64_t err_code) {
+    uint8_t flags = 0;
+    if (err_code & __PAGE_FAULT_ERR_PRESENT) {
+        flags |= PAGE_FAULT_PRESENT;
+    }
+
+    if (err_code & __PAGE_FAULT_ERR_WRITE) {
+        flags |= PAGE_FAULT_WRITE;
+    }
+
+    if (err_code & __PAGE_FAULT_ERR_USER) {
+        flags |= PAGE_FAULT_USER;
+    }
+
+    if (err_code & __PAGE_FAULT_ERR_INSTR_FETCH) {
+        flags |= PAGE_FAULT_EXEC;
+    }
+
+    return flags;
+}
+
 static
 void handle_exception(const uint64_t int_no, irq_context_t *const context) {
     switch ((enum exception)int_no) {
@@ -155,14 +184,26 @@ void handle_exception(const uint64_t int_no, irq_context_t *const context) {
         case EXCEPTION_GENERAL_PROTECTION_FAULT:
             printk(LOGLEVEL_ERROR, "General protection fault exception\n");
             break;
-        case EXCEPTION_PAGE_FAULT:
+        case EXCEPTION_PAGE_FAULT: {
+            const uint64_t addr = read_cr2();
+            const enum page_fault_result result =
+                handle_page_fault(addr,
+                                  page_fault_flags_from_err_code(
+                                    context->err_code));
+
+            if (__builtin_expect(result == E_PAGE_FAULT_OK, 1)) {
+                return;
+            }
+
             printk(LOGLEVEL_ERROR,
-                   "Page Fault accessing %p from %p\n",
-                   (void *)read_cr2(),
-                   (void *)context->rip);
+                   "Page Fault accessing %p from %p, result=%d\n",
+                   (void *)addr,
+                   (void *)context->rip,
+                   result);
 
             print_stack_trace(/*max_lines=*/10);
             break;
+        }
         case EXCEPTION_FPU_FAULT:
             printk(LOGLEVEL_ERROR, "FPU fault exception\n");
             break;
@@ -38,7 +38,9 @@ void isr_handle_interrupt(const uint64_t vector, irq_context_t *const frame) {
     if (g_funcs[vector] != NULL) {
         g_funcs[vector](vector, frame);
     } else {
-        printk(LOGLEVEL_INFO, "Got unhandled interrupt %" PRIu64 "\n", vector);
+        printk_ratelimited(LOGLEVEL_WARN,
+                           "Got unhandled interrupt %" PRIu64 "\n",
+                           vector);
     }
 }
 
@@ -69,7 +71,7 @@ isr_set_vector(const isr_vector_t vector,
     g_funcs[vector] = handler;
     idt_set_vector(vector, info->ist, IDT_DEFAULT_FLAGS);
 
-    printk(LOGLEVEL_INFO,
+    printk(LOGLEVEL_DEBUG,
            "isr: registered handler for vector %" PRIu8 "\n",
            vector);
 }
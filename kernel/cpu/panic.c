@@ -11,6 +11,8 @@
 #include "dev/printk.h"
 
 __optimize(3) void panic(const char *const fmt, ...) {
+    printk_begin_emergency();
+
     va_list list;
     va_start(list, fmt);
 
@@ -8,33 +8,175 @@
 #include "asm/irqs.h"
 #include "asm/pause.h"
 
+#include "info.h"
 #include "spinlock.h"
 
-__optimize(3) void spin_acquire(struct spinlock *const lock) {
-    const uint32_t ticket = atomic_fetch_add(&lock->back, 1);
+#define SPINLOCK_LOCKED 1
+#define SPINLOCK_LOCKED_MASK 0xFF
+#define SPINLOCK_TAIL_SHIFT 16
+
+// The tail holds the node's index in its low two bits, and one plus the
+// cpu's index in the rest.
+
+#define SPINLOCK_TAIL_NODE_BITS 2
+#define SPINLOCK_MAX_CPUS 256
+
+_Static_assert(SPINLOCK_NODE_COUNT == 1 << SPINLOCK_TAIL_NODE_BITS,
+               "SPINLOCK_NODE_COUNT must fit in the tail's node bits");
+_Static_assert(sizeof(struct spinlock) == sizeof(uint32_t),
+               "struct spinlock must be a single 32-bit word");
+
+static struct spinlock_cpu_state *g_cpu_states[SPINLOCK_MAX_CPUS] = {0};
+static _Atomic uint16_t g_cpu_count = 0;
+
+// Set once the cpu-info of the current cpu can be accessed. Before then,
+// contended locks are spun on directly.
+
+static _Atomic bool g_queue_ready = false;
+
+void spinlock_register_cpu(struct spinlock_cpu_state *const state) {
+    const uint16_t index = atomic_fetch_add(&g_cpu_count, 1);
+    if (index >= SPINLOCK_MAX_CPUS) {
+        // Cpus past the end of the table fall back to spinning on the lock
+        // word.
+
+        state->index = 0;
+        return;
+    }
+
+    g_cpu_states[index] = state;
+    state->index = index + 1;
+
+    atomic_store_explicit(&g_queue_ready, true, memory_order_release);
+}
+
+__optimize(3) static inline struct spinlock_node *
+node_for_tail(const uint16_t tail) {
+    struct spinlock_cpu_state *const state =
+        g_cpu_states[(tail >> SPINLOCK_TAIL_NODE_BITS) - 1];
+
+    return &state->nodes[tail & (SPINLOCK_NODE_COUNT - 1)];
+}
+
+__optimize(3) static bool try_lock_word(struct spinlock *const lock) {
+    uint32_t expected = 0;
+    return atomic_compare_exchange_strong_explicit(&lock->value,
+                                                   &expected,
+                                                   SPINLOCK_LOCKED,
+                                                   memory_order_acquire,
+                                                   memory_order_relaxed);
+}
+
+__optimize(3) static void spin_on_lock_word(struct spinlock *const lock) {
     while (true) {
-        const uint32_t front = atomic_load(&lock->front);
-        if (front == ticket) {
+        if (atomic_load_explicit(&lock->value, memory_order_relaxed) == 0) {
+            if (try_lock_word(lock)) {
+                return;
+            }
+        }
+
+        cpu_pause();
+    }
+}
+
+__optimize(3) static void acquire_slow(struct spinlock *const lock) {
+    if (!atomic_load_explicit(&g_queue_ready, memory_order_acquire)) {
+        spin_on_lock_word(lock);
+        return;
+    }
+
+    // The depth is only touched by the current cpu, and any irq taken here
+    // restores it before returning, so it doesn't need to be atomic.
+
+    struct spinlock_cpu_state *const state =
+        &get_cpu_info_mut()->spinlock_state;
+
+    const uint8_t depth = state->depth;
+    if (state->index == 0 || depth >= SPINLOCK_NODE_COUNT) {
+        spin_on_lock_word(lock);
+        return;
+    }
+
+    state->depth = depth + 1;
+
+    struct spinlock_node *const node = &state->nodes[depth];
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&node->is_head, false, memory_order_relaxed);
+
+    const uint16_t tail =
+        (uint16_t)(state->index << SPINLOCK_TAIL_NODE_BITS | depth);
+
+    // Publish our node as the new tail, and link it behind the previous tail,
+    // if any, then wait for its owner to hand us the head of the queue.
+
+    const uint16_t prev_tail =
+        atomic_exchange_explicit(&lock->tail, tail, memory_order_acq_rel);
+
+    if (prev_tail != 0) {
+        atomic_store_explicit(&node_for_tail(prev_tail)->next,
+                              node,
+                              memory_order_release);
+
+        while (!atomic_load_explicit(&node->is_head, memory_order_acquire)) {
+            cpu_pause();
+        }
+    }
+
+    uint32_t value = atomic_load_explicit(&lock->value, memory_order_acquire);
+    while (value & SPINLOCK_LOCKED_MASK) {
+        cpu_pause();
+        value = atomic_load_explicit(&lock->value, memory_order_acquire);
+    }
+
+    // While the queue isn't empty, neither the fast-path nor
+    // spin_try_acquire() can take the lock, so the head of the queue is the
+    // only one that can.
+    //
+    // If we're also the tail, clear the tail as we take the lock. Otherwise,
+    // take the lock and hand the head of the queue to the next node.
+
+    if ((value >> SPINLOCK_TAIL_SHIFT) == tail) {
+        const bool result =
+            atomic_compare_exchange_strong_explicit(&lock->value,
+                                                    &value,
+                                                    SPINLOCK_LOCKED,
+                                                    memory_order_acquire,
+                                                    memory_order_relaxed);
+
+        if (result) {
+            state->depth = depth;
             return;
         }
+    }
+
+    atomic_store_explicit(&lock->locked, SPINLOCK_LOCKED, memory_order_relaxed);
+
+    struct spinlock_node *next =
+        atomic_load_explicit(&node->next, memory_order_acquire);
 
+    while (next == NULL) {
         cpu_pause();
+        next = atomic_load_explicit(&node->next, memory_order_acquire);
     }
+
+    atomic_store_explicit(&next->is_head, true, memory_order_release);
+    state->depth = depth;
+}
+
+__optimize(3) void spin_acquire(struct spinlock *const lock) {
+    if (__builtin_expect(try_lock_word(lock), 1)) {
+        return;
+    }
+
+    acquire_slow(lock);
 }
 
 __optimize(3) void spin_release(struct spinlock *const lock) {
-    atomic_fetch_add(&lock->front, 1);
+    atomic_store_explicit(&lock->locked, 0, memory_order_release);
 }
 
 __optimize(3) bool spin_try_acquire(struct spinlock *const lock) {
-    uint32_t ticket = atomic_load(&lock->back);
-    const uint32_t front = atomic_load(&lock->front);
-
-    if (front == ticket) {
-        return atomic_compare_exchange_strong(&lock->back, &ticket, ticket + 1);
-    }
-
-    return false;
+    return try_lock_word(lock);
 }
 
 __optimize(3) int spin_acquire_with_irq(struct spinlock *const lock) {
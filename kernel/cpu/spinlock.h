@@ -8,17 +8,62 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/*
+ * A queued (mcs) spinlock packed into a single 32-bit word.
+ *
+ * The low byte is set while the lock is held, and the upper half holds the
+ * tail of the queue of waiting cpus. An uncontended acquire is a single
+ * compare-and-swap of the word from zero.
+ *
+ * A contended acquire appends one of the cpu's queue-nodes to the tail of the
+ * queue, and spins on a flag inside that node, so waiting cpus don't all
+ * hammer the cache-line of the lock. Only the cpu at the head of the queue
+ * spins on the lock word, and hands the queue off to the next node once it
+ * takes the lock.
+ */
+
 struct spinlock {
-    _Atomic uint32_t front;
-    _Atomic uint32_t back;
+    union {
+        _Atomic uint32_t value;
+        struct {
+            _Atomic uint8_t locked;
+            uint8_t reserved;
+            _Atomic uint16_t tail;
+        };
+    };
 };
 
-#define SPINLOCK_INIT() \
-    ((struct spinlock){ \
-        .front = 0, \
-        .back = 0 \
+#define SPINLOCK_INIT() ((struct spinlock){ .value = 0 })
+
+// A cpu can be waiting on a spinlock in task context, and then in an irq or
+// exception taken while it waits, so keep a node for each level of nesting.
+
+#define SPINLOCK_NODE_COUNT 4
+
+struct spinlock_node {
+    struct spinlock_node *_Atomic next;
+    _Atomic bool is_head;
+};
+
+struct spinlock_cpu_state {
+    struct spinlock_node nodes[SPINLOCK_NODE_COUNT];
+
+    // One plus the index of the cpu in the queue's tail, or zero if the cpu
+    // hasn't been registered.
+
+    uint16_t index;
+    uint8_t depth;
+};
+
+#define SPINLOCK_CPU_STATE_INIT() \
+    ((struct spinlock_cpu_state){ \
+        .nodes = {}, \
+        .index = 0, \
+        .depth = 0 \
     })
 
+void spinlock_register_cpu(struct spinlock_cpu_state *state);
+
 void spin_acquire(struct spinlock *lock);
 void spin_release(struct spinlock *lock);
 
@@ -7,6 +7,7 @@
 
 #if defined(__riscv64)
     #include "dev/uart/8250.h"
+    #include "cpu.h"
 #endif /* defined(__riscv64) */
 
 #include "dev/driver.h"
@@ -162,10 +163,70 @@ static void init_pci_drivers(const void *const dtb) {
     }
 #endif /* defined(__riscv64) */
 
+#if defined(__riscv64)
+    static void init_riscv_cpu_node(const void *const dtb, const int nodeoff) {
+        struct string_view isa = SV_EMPTY();
+        if (dtb_get_string_prop(dtb, nodeoff, "riscv,isa", &isa)) {
+            cpu_add_isa_string(isa);
+        }
+
+        const char *const ext_key = "riscv,isa-extensions";
+        const int ext_count = fdt_stringlist_count(dtb, nodeoff, ext_key);
+
+        for (int i = 0; i < ext_count; i++) {
+            int length = 0;
+            const char *const ext =
+                fdt_stringlist_get(dtb, nodeoff, ext_key, i, &length);
+
+            if (ext != NULL) {
+                cpu_add_isa_extension(
+                    sv_create_length(ext, (uint64_t)length));
+            }
+        }
+
+        const fdt32_t *cboz_size = NULL;
+        uint32_t cboz_length = 0;
+
+        const bool get_cboz_result =
+            dtb_get_array_prop(dtb,
+                               nodeoff,
+                               "riscv,cboz-block-size",
+                               &cboz_size,
+                               &cboz_length);
+
+        if (get_cboz_result && cboz_length == 1) {
+            cpu_set_cboz_block_size(fdt32_to_cpu(*cboz_size));
+        }
+    }
+
+    // Every hart is assumed to have the same extensions as the first one
+    // listed.
+
+    static void init_riscv_cpu_info(const void *const dtb) {
+        const int cpus_offset = fdt_path_offset(dtb, "/cpus");
+        if (cpus_offset < 0) {
+            return;
+        }
+
+        int offset = 0;
+        fdt_for_each_subnode(offset, dtb, cpus_offset) {
+            struct string_view device_type = SV_EMPTY();
+            const bool get_type_result =
+                dtb_get_string_prop(dtb, offset, "device_type", &device_type);
+
+            if (get_type_result && sv_equals_c_str(device_type, "cpu")) {
+                init_riscv_cpu_node(dtb, offset);
+                break;
+            }
+        }
+    }
+#endif /* defined(__riscv64) */
+
 void dtb_init_early() {
 #if defined(__riscv64)
     const void *const dtb = boot_get_dtb();
     if (dtb != NULL) {
+        init_riscv_cpu_info(dtb);
         init_riscv_serial_devices(dtb);
     }
 
@@ -0,0 +1,396 @@
+/*
+ * kernel/dev/fb/console.c
+ * © suhas pai
+ */
+
+#include "cpu/spinlock.h"
+#include "dev/printk.h"
+
+#include "lib/align.h"
+#include "lib/string.h"
+
+#include "mm/mmio.h"
+#include "mm/vmalloc.h"
+
+#include "console.h"
+#include "font.h"
+
+// Glyphs are drawn one pixel below the top of their cell, leaving at least a
+// pixel between lines and between characters.
+
+#define CELL_WIDTH (FONT_GLYPH_WIDTH + 1)
+#define CELL_HEIGHT (FONT_GLYPH_HEIGHT + 2)
+#define GLYPH_TOP 1
+
+#define TAB_WIDTH 8
+
+#define FOREGROUND_COLOR 0xaaaaaa
+#define BACKGROUND_COLOR 0x000000
+
+struct fb_console {
+    struct terminal term;
+    struct spinlock lock;
+
+    struct mmio_region *mmio;
+    uint8_t *pixels;
+
+    uint32_t pitch;
+    uint32_t bytes_per_pixel;
+
+    uint32_t cols;
+    uint32_t rows;
+
+    uint32_t cursor_col;
+    uint32_t cursor_row;
+
+    // Off-screen copy of the part of the framebuffer covered by cells, without
+    // the framebuffer's padding at the end of each line.
+    //
+    // The rows of cells are kept in a ring, with the top row of the screen at
+    // `top_row`, so scrolling only moves `top_row` instead of the whole
+    // buffer.
+
+    uint8_t *shadow;
+    uint32_t shadow_pitch;
+    uint32_t top_row;
+
+    // Every printable char drawn into a cell, in the framebuffer's pixel
+    // format, `cell_row_size` bytes per line.
+
+    uint8_t *glyph_cache;
+    uint32_t cell_row_size;
+
+    // Cells changed since the last flush, in screen rows, empty when
+    // `dirty_top` and `dirty_bottom` are equal.
+
+    uint32_t dirty_top;
+    uint32_t dirty_bottom;
+    uint32_t dirty_left;
+    uint32_t dirty_right;
+};
+
+static struct fb_console g_console = {0};
+
+static uint32_t
+encode_color(const struct framebuffer *const fb, const uint32_t rgb) {
+    const uint32_t red = (rgb >> 16) & 0xff;
+    const uint32_t green = (rgb >> 8) & 0xff;
+    const uint32_t blue = rgb & 0xff;
+
+    return (red >> (8 - fb->red_mask_size)) << fb->red_mask_shift |
+           (green >> (8 - fb->green_mask_size)) << fb->green_mask_shift |
+           (blue >> (8 - fb->blue_mask_size)) << fb->blue_mask_shift;
+}
+
+static void
+write_pixel(uint8_t *const dst,
+            const uint32_t value,
+            const uint32_t bytes_per_pixel)
+{
+    for (uint32_t i = 0; i != bytes_per_pixel; i++) {
+        dst[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static void
+render_glyph_cache(struct fb_console *const console,
+                   const struct framebuffer *const fb)
+{
+    const uint32_t fg = encode_color(fb, FOREGROUND_COLOR);
+    const uint32_t bg = encode_color(fb, BACKGROUND_COLOR);
+
+    uint8_t *cell = console->glyph_cache;
+    for (uint32_t ch = 0; ch != FONT_CHAR_COUNT; ch++) {
+        for (uint32_t y = 0; y != CELL_HEIGHT; y++) {
+            uint8_t bits = 0;
+            if (y >= GLYPH_TOP && y - GLYPH_TOP < FONT_GLYPH_HEIGHT) {
+                bits = font_glyphs[ch][y - GLYPH_TOP];
+            }
+
+            for (uint32_t x = 0; x != CELL_WIDTH; x++) {
+                write_pixel(cell + x * console->bytes_per_pixel,
+                            bits & (0x80 >> x) ? fg : bg,
+                            console->bytes_per_pixel);
+            }
+
+            cell += console->cell_row_size;
+        }
+    }
+}
+
+__optimize(3) static inline uint8_t *
+shadow_row(const struct fb_console *const console, const uint32_t row) {
+    const uint32_t index = (console->top_row + row) % console->rows;
+    return console->shadow + index * CELL_HEIGHT * console->shadow_pitch;
+}
+
+__optimize(3) static inline void
+mark_dirty(struct fb_console *const console,
+           const uint32_t col,
+           const uint32_t row)
+{
+    if (console->dirty_top == console->dirty_bottom) {
+        console->dirty_top = row;
+        console->dirty_bottom = row + 1;
+        console->dirty_left = col;
+        console->dirty_right = col + 1;
+
+        return;
+    }
+
+    console->dirty_top = min(console->dirty_top, row);
+    console->dirty_bottom = max(console->dirty_bottom, row + 1);
+    console->dirty_left = min(console->dirty_left, col);
+    console->dirty_right = max(console->dirty_right, col + 1);
+}
+
+__optimize(3) static void
+draw_cell(struct fb_console *const console,
+          const uint32_t col,
+          const uint32_t row,
+          const char ch)
+{
+    uint32_t glyph = (uint32_t)ch - FONT_FIRST_CHAR;
+    if (glyph >= FONT_CHAR_COUNT) {
+        glyph = '?' - FONT_FIRST_CHAR;
+    }
+
+    const uint8_t *src =
+        console->glyph_cache + glyph * CELL_HEIGHT * console->cell_row_size;
+    uint8_t *dst = shadow_row(console, row) + col * console->cell_row_size;
+
+    for (uint32_t y = 0; y != CELL_HEIGHT; y++) {
+        memcpy(dst, src, console->cell_row_size);
+
+        src += console->cell_row_size;
+        dst += console->shadow_pitch;
+    }
+
+    mark_dirty(console, col, row);
+}
+
+__optimize(3) static void newline(struct fb_console *const console) {
+    console->cursor_col = 0;
+    if (console->cursor_row + 1 != console->rows) {
+        console->cursor_row++;
+        return;
+    }
+
+    // Rotate the top row, which scrolls off, around to become the new bottom
+    // row, and clear it out. Every row moves on screen, but the framebuffer
+    // is only redrawn once by the next flush, however many lines scrolled.
+
+    console->top_row = (console->top_row + 1) % console->rows;
+    for (uint32_t col = 0; col != console->cols; col++) {
+        draw_cell(console, col, console->cursor_row, ' ');
+    }
+
+    console->dirty_top = 0;
+    console->dirty_bottom = console->rows;
+    console->dirty_left = 0;
+    console->dirty_right = console->cols;
+}
+
+__optimize(3)
+static void put_char(struct fb_console *const console, const char ch) {
+    switch (ch) {
+        case '\n':
+            newline(console);
+            return;
+        case '\r':
+            console->cursor_col = 0;
+            return;
+        case '\t':
+            do {
+                put_char(console, ' ');
+            } while (console->cursor_col % TAB_WIDTH != 0);
+
+            return;
+    }
+
+    draw_cell(console, console->cursor_col, console->cursor_row, ch);
+
+    console->cursor_col++;
+    if (console->cursor_col == console->cols) {
+        newline(console);
+    }
+}
+
+// Copy the dirty rectangle of the shadow buffer out to the framebuffer.
+__optimize(3) static void flush(struct fb_console *const console) {
+    if (console->dirty_top == console->dirty_bottom) {
+        return;
+    }
+
+    const uint64_t offset = console->dirty_left * console->cell_row_size;
+    const uint64_t size =
+        (console->dirty_right - console->dirty_left) * console->cell_row_size;
+
+    const uint32_t bottom = console->dirty_bottom;
+    for (uint32_t row = console->dirty_top; row != bottom; row++) {
+        const uint8_t *src = shadow_row(console, row) + offset;
+        uint8_t *dst =
+            console->pixels + row * CELL_HEIGHT * console->pitch + offset;
+
+        for (uint32_t y = 0; y != CELL_HEIGHT; y++) {
+            memcpy(dst, src, size);
+
+            src += console->shadow_pitch;
+            dst += console->pitch;
+        }
+    }
+
+    console->dirty_top = 0;
+    console->dirty_bottom = 0;
+}
+
+__optimize(3) static void
+fb_console_send_char(struct terminal *const term,
+                     const char ch,
+                     const uint32_t amount)
+{
+    struct fb_console *const console =
+        container_of(term, struct fb_console, term);
+
+    const int flag = spin_acquire_with_irq(&console->lock);
+    for (uint32_t i = 0; i != amount; i++) {
+        put_char(console, ch);
+    }
+
+    spin_release_with_irq(&console->lock, flag);
+}
+
+__optimize(3) static void
+fb_console_send_sv(struct terminal *const term, const struct string_view sv) {
+    struct fb_console *const console =
+        container_of(term, struct fb_console, term);
+
+    const int flag = spin_acquire_with_irq(&console->lock);
+    sv_foreach(sv, iter) {
+        put_char(console, *iter);
+    }
+
+    spin_release_with_irq(&console->lock, flag);
+}
+
+// Only called by printk once per batch of records, so a batch that scrolls
+// the screen many times only redraws it once.
+
+__optimize(3) static void fb_console_flush(struct terminal *const term) {
+    struct fb_console *const console =
+        container_of(term, struct fb_console, term);
+
+    const int flag = spin_acquire_with_irq(&console->lock);
+    flush(console);
+    spin_release_with_irq(&console->lock, flag);
+}
+
+static void fb_console_bust_locks(struct terminal *const term) {
+    struct fb_console *const console =
+        container_of(term, struct fb_console, term);
+
+    console->lock = SPINLOCK_INIT();
+}
+
+bool fb_console_init(const struct framebuffer *const fb) {
+    if (fb->bpp % 8 != 0 || fb->bpp == 0 || fb->bpp > 32) {
+        printk(LOGLEVEL_WARN,
+               "fb-console: unsupported bits-per-pixel: %" PRIu16 "\n",
+               fb->bpp);
+        return false;
+    }
+
+    struct fb_console *const console = &g_console;
+
+    console->bytes_per_pixel = fb->bpp / 8;
+    console->cols = fb->width / CELL_WIDTH;
+    console->rows = fb->height / CELL_HEIGHT;
+
+    if (console->cols == 0 || console->rows == 0) {
+        printk(LOGLEVEL_WARN, "fb-console: framebuffer is too small\n");
+        return false;
+    }
+
+    const struct range fb_range =
+        RANGE_INIT(fb->phys, (uint64_t)fb->pitch * fb->height);
+
+    struct range phys_range = RANGE_EMPTY();
+    if (!range_align_out(fb_range, PAGE_SIZE, &phys_range)) {
+        printk(LOGLEVEL_WARN, "fb-console: framebuffer range is invalid\n");
+        return false;
+    }
+
+    // Flushes only ever write to the framebuffer, so combine their writes.
+    console->mmio =
+        vmap_mmio(phys_range, PROT_READ | PROT_WRITE, __VMAP_MMIO_WC);
+
+    if (console->mmio == NULL) {
+        printk(LOGLEVEL_WARN, "fb-console: failed to map framebuffer\n");
+        return false;
+    }
+
+    // Only ever written to with memcpy(), which can't take a volatile pointer.
+    console->pixels =
+        (uint8_t *)(uint64_t)console->mmio->base +
+        (fb_range.front - phys_range.front);
+
+    console->pitch = fb->pitch;
+    console->cell_row_size = CELL_WIDTH * console->bytes_per_pixel;
+    console->shadow_pitch = console->cols * console->cell_row_size;
+
+    console->glyph_cache =
+        vmalloc((uint64_t)FONT_CHAR_COUNT *
+                CELL_HEIGHT *
+                console->cell_row_size);
+
+    if (console->glyph_cache == NULL) {
+        vunmap_mmio(console->mmio);
+        printk(LOGLEVEL_WARN, "fb-console: failed to alloc glyph-cache\n");
+
+        return false;
+    }
+
+    console->shadow =
+        vmalloc((uint64_t)console->rows * CELL_HEIGHT * console->shadow_pitch);
+
+    if (console->shadow == NULL) {
+        vfree(console->glyph_cache);
+        vunmap_mmio(console->mmio);
+
+        printk(LOGLEVEL_WARN, "fb-console: failed to alloc shadow buffer\n");
+        return false;
+    }
+
+    render_glyph_cache(console, fb);
+
+    console->lock = SPINLOCK_INIT();
+    console->cursor_col = 0;
+    console->cursor_row = 0;
+    console->top_row = 0;
+
+    // Clear the screen.
+    for (uint32_t row = 0; row != console->rows; row++) {
+        for (uint32_t col = 0; col != console->cols; col++) {
+            draw_cell(console, col, row, ' ');
+        }
+    }
+
+    flush(console);
+
+    console->term.emit_ch = fb_console_send_char;
+    console->term.emit_sv = fb_console_send_sv;
+    console->term.bust_locks = fb_console_bust_locks;
+    console->term.flush = fb_console_flush;
+    console->term.is_serial = false;
+
+    printk_add_terminal(&console->term);
+    printk(LOGLEVEL_INFO,
+           "fb-console: %" PRIu32 "x%" PRIu32 " cells on a %" PRIu32 "x"
+           "%" PRIu32 " framebuffer\n",
+           console->cols,
+           console->rows,
+           fb->width,
+           fb->height);
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+/*
+ * kernel/dev/fb/console.h
+ * © suhas pai
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+struct framebuffer {
+    uint64_t phys;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;
+    uint16_t bpp;
+
+    uint8_t red_mask_size;
+    uint8_t red_mask_shift;
+    uint8_t green_mask_size;
+    uint8_t green_mask_shift;
+    uint8_t blue_mask_size;
+    uint8_t blue_mask_shift;
+};
+
+/*
+ * Add a printk() terminal that draws text onto `fb`.
+ *
+ * Text is drawn into an off-screen copy of the framebuffer, by copying glyphs
+ * that were rendered in the framebuffer's pixel format ahead of time. After
+ * each write, only the rectangle of cells that changed is copied out to the
+ * framebuffer. Scrolling moves the off-screen copy instead of redrawing any
+ * text.
+ */
+
+bool fb_console_init(const struct framebuffer *fb);
\ No newline at end of file
@@ -0,0 +1,18 @@
+/*
+ * kernel/dev/fb/font.h
+ * © suhas pai
+ */
+
+#pragma once
+#include <stdint.h>
+
+// A 5x8 bitmap font of the printable ascii characters.
+
+#define FONT_GLYPH_WIDTH 5
+#define FONT_GLYPH_HEIGHT 8
+
+#define FONT_FIRST_CHAR ' '
+#define FONT_LAST_CHAR '~'
+#define FONT_CHAR_COUNT (FONT_LAST_CHAR - FONT_FIRST_CHAR + 1)
+
+extern const uint8_t font_glyphs[FONT_CHAR_COUNT][FONT_GLYPH_HEIGHT];
\ No newline at end of file
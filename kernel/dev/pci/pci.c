@@ -177,9 +177,12 @@ bool pci_map_bar(struct pci_device_bar_info *const bar) {
         return true;
     }
 
+    // Prefetchable bars have no read side-effects, so writes to them can be
+    // combined.
+
     uint64_t flags = 0;
     if (bar->is_prefetchable) {
-        flags |= __VMAP_MMIO_WT;
+        flags |= __VMAP_MMIO_WC;
     }
 
     // We use port_range to internally store the phys range.
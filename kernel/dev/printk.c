@@ -5,68 +5,517 @@
 
 #include <stdatomic.h>
 
+#include "asm/irqs.h"
+#include "asm/timestamp.h"
+
+#include "cpu/info.h"
 #include "cpu/spinlock.h"
+
+#include "lib/align.h"
+#include "lib/format.h"
 #include "lib/parse_printf.h"
+#include "lib/size.h"
+
+#include "mm/kmalloc.h"
+#include "mm/page_alloc.h"
 
 #include "printk.h"
 
+/*
+ * Every cpu formats its printk() calls into its own ring of records, so
+ * callers never wait on each other or on a terminal. The records are written
+ * out by printk_drain(), in the order of their sequence numbers, by whichever
+ * cpu manages to take g_drain_lock.
+ *
+ * A record is reserved by moving the ring's head forward with a cas, so isrs
+ * that interrupt a printk() on the same cpu, or cpus without their own ring,
+ * can safely share a ring. A record is only visible to the drainer once the
+ * first word of its header is set with PRINTK_RECORD_COMMITTED.
+ *
+ * The drainer zeroes every record it consumes, so the first word of a record
+ * that's been reserved, but not yet committed, always reads as zero.
+ */
+
+#define PRINTK_RING_ORDER 2
+#define PRINTK_RING_SIZE (PAGE_SIZE << PRINTK_RING_ORDER)
+
+// Records longer than this are cut off.
+#define PRINTK_LINE_MAX 1024
+
+enum printk_record_flags {
+    PRINTK_RECORD_COMMITTED = 1 << 0,
+
+    // Fills the space at the end of the ring that a record didn't fit in.
+    PRINTK_RECORD_PADDING = 1 << 1,
+    PRINTK_RECORD_TRUNCATED = 1 << 2,
+
+    // The record holds a struct printk_binary_payload instead of text.
+    PRINTK_RECORD_BINARY = 1 << 3,
+};
+
+#define PRINTK_RECORD_FLAGS_MASK 0xfu
+
+struct printk_record {
+    // The size of the whole record, which is a multiple of 8, or'd with its
+    // flags. Padding records only have this field.
+
+    _Atomic uint32_t size_and_flags;
+
+    // The length of the text, or the number of words of a binary record.
+    uint16_t length;
+    uint8_t loglevel;
+    uint8_t reserved;
+
+    uint64_t seq;
+    uint64_t timestamp;
+
+    char text[];
+};
+
+/*
+ * Binary records store the arguments of a printk_binary() call, and leave
+ * formatting them to the drainer.
+ *
+ * Strings are copied in after the words, with the word holding the string's
+ * offset from the front of the payload.
+ */
+
+#define PRINTK_BINARY_MAX_WORDS 16
+#define PRINTK_BINARY_STRING_MAX 128
+
+struct printk_binary_payload {
+    const char *fmt;
+
+    uint32_t string_mask;
+    uint32_t reserved;
+
+    uint64_t words[];
+};
+
+struct printk_ring {
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+
+    // Records that didn't fit in the ring, and haven't been reported yet.
+    _Atomic uint64_t dropped;
+
+    struct printk_ring *_Atomic next;
+    char *buffer;
+};
+
+static char g_boot_ring_buffer[PRINTK_RING_SIZE] __aligned(8);
+static struct printk_ring g_boot_ring = {
+    .head = 0,
+    .tail = 0,
+    .dropped = 0,
+    .next = NULL,
+    .buffer = g_boot_ring_buffer,
+};
+
+static struct printk_ring *_Atomic g_first_ring = &g_boot_ring;
 static struct terminal *_Atomic g_first_term = NULL;
+static struct terminal *_Atomic g_preferred_serial = NULL;
+
+static _Atomic uint64_t g_next_seq = 0;
+static struct spinlock g_drain_lock = SPINLOCK_INIT();
+
+static _Atomic bool g_cpu_rings_ready = false;
+static _Atomic bool g_deferral_enabled = false;
+static _Atomic bool g_in_emergency = false;
+
+static _Atomic uint32_t g_console_loglevel = LOGLEVEL_INFO;
+
+// Bitmap of log-levels whose printk() calls are recorded in binary.
+static _Atomic uint32_t g_binary_loglevels = 0;
 
 __optimize(3) void printk_add_terminal(struct terminal *const term) {
     atomic_store(&term->next, g_first_term);
     atomic_store(&g_first_term, term);
 }
 
-__optimize(3)
-void printk(const enum log_level loglevel, const char *const string, ...) {
-    va_list list;
-    (void)loglevel;
+void printk_set_preferred_serial(struct terminal *const term) {
+    atomic_store(&g_preferred_serial, term);
+}
 
-    va_start(list, string);
-    vprintk(loglevel, string, list);
-    va_end(list);
+static void add_ring(struct printk_ring *const ring) {
+    struct printk_ring *next = atomic_load(&g_first_ring);
+    do {
+        atomic_store(&ring->next, next);
+    } while (!atomic_compare_exchange_weak(&g_first_ring, &next, ring));
 }
 
-// FIXME: Allocate a formatted-string over this approach
-__optimize(3) static uint64_t
-write_char(struct printf_spec_info *const spec_info,
-           void *const cb_info,
-           const char ch,
-           const uint64_t amount,
-           bool *const cont_out)
-{
-    (void)spec_info;
-    (void)cb_info;
-    (void)cont_out;
+void printk_init_cpu(struct cpu_info *const cpu) {
+    // The first cpu to be set up keeps the ring used while booting.
+    if (!atomic_exchange(&g_cpu_rings_ready, true)) {
+        cpu->printk_ring = &g_boot_ring;
+        return;
+    }
+
+    cpu->printk_ring = NULL;
+
+    struct printk_ring *const ring = kmalloc(sizeof(*ring));
+    if (ring == NULL) {
+        printk(LOGLEVEL_WARN, "printk: failed to alloc ring for cpu\n");
+        return;
+    }
+
+    struct page *const page =
+        alloc_pages(PAGE_STATE_USED, __ALLOC_ZERO, PRINTK_RING_ORDER);
+
+    if (page == NULL) {
+        printk(LOGLEVEL_WARN, "printk: failed to alloc ring-buffer for cpu\n");
+        kfree(ring);
+
+        return;
+    }
+
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    ring->buffer = page_to_virt(page);
+
+    add_ring(ring);
+    cpu->printk_ring = ring;
+}
+
+void printk_enable_deferral() {
+    atomic_store(&g_deferral_enabled, true);
+}
+
+__optimize(3) static struct printk_ring *get_current_ring() {
+    if (!atomic_load_explicit(&g_cpu_rings_ready, memory_order_relaxed)) {
+        return &g_boot_ring;
+    }
+
+    struct printk_ring *const ring = get_cpu_info()->printk_ring;
+    return ring != NULL ? ring : &g_boot_ring;
+}
+
+__optimize(3) static inline struct printk_record *
+record_at(const struct printk_ring *const ring, const uint64_t pos) {
+    return (struct printk_record *)
+        (ring->buffer + (pos & (PRINTK_RING_SIZE - 1)));
+}
+
+// Reserve `size` bytes in `ring`, and return where the record goes, or NULL
+// if the ring is full.
+
+__optimize(3) static struct printk_record *
+ring_reserve(struct printk_ring *const ring, const uint32_t size) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t padding = 0;
+
+    do {
+        // Records are never split across the end of the ring.
+        const uint64_t space_to_end =
+            PRINTK_RING_SIZE - (head & (PRINTK_RING_SIZE - 1));
 
+        padding = space_to_end < size ? space_to_end : 0;
+
+        const uint64_t tail =
+            atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        if (head + padding + size - tail > PRINTK_RING_SIZE) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return NULL;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&ring->head,
+                                                    &head,
+                                                    head + padding + size,
+                                                    memory_order_relaxed,
+                                                    memory_order_relaxed));
+
+    if (padding != 0) {
+        atomic_store_explicit(&record_at(ring, head)->size_and_flags,
+                              (uint32_t)padding |
+                              PRINTK_RECORD_PADDING |
+                              PRINTK_RECORD_COMMITTED,
+                              memory_order_release);
+    }
+
+    return record_at(ring, head + padding);
+}
+
+__optimize(3) static void emit_sv(const struct string_view sv) {
+    struct terminal *const preferred_serial =
+        atomic_load_explicit(&g_preferred_serial, memory_order_acquire);
+
+    for (struct terminal *term = atomic_load(&g_first_term);
+         term != NULL;
+         term = atomic_load(&term->next))
+    {
+        if (term->is_serial &&
+            preferred_serial != NULL &&
+            term != preferred_serial)
+        {
+            continue;
+        }
+
+        term->emit_sv(term, sv);
+    }
+}
+
+__optimize(3) static void flush_terminals() {
     for (struct terminal *term = atomic_load(&g_first_term);
          term != NULL;
          term = atomic_load(&term->next))
     {
-        term->emit_ch(term, ch, amount);
+        if (term->flush != NULL) {
+            term->flush(term);
+        }
     }
+}
+
+// Formatted output is staged in a chunk of this size before being written out
+// to the terminals.
 
-    return amount;
+#define PRINTK_SINK_CHUNK_SIZE 256
+
+static bool flush_to_terminals(struct printf_sink *const sink) {
+    emit_sv(sv_create_length(sink->buffer, sink->used));
+    return true;
 }
 
-__optimize(3) static uint64_t
-write_sv(struct printf_spec_info *const spec_info,
-         void *const cb_info,
-         const struct string_view sv,
-         bool *const cont_out)
+// Returns the oldest committed record of `ring`, skipping over padding, or
+// NULL if there is none.
+
+__optimize(3) static struct printk_record *
+ring_peek(struct printk_ring *const ring) {
+    do {
+        const uint64_t tail =
+            atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+        struct printk_record *const record = record_at(ring, tail);
+        const uint32_t size_and_flags =
+            atomic_load_explicit(&record->size_and_flags,
+                                 memory_order_acquire);
+
+        if ((size_and_flags & PRINTK_RECORD_COMMITTED) == 0) {
+            return NULL;
+        }
+
+        if ((size_and_flags & PRINTK_RECORD_PADDING) == 0) {
+            return record;
+        }
+
+        const uint32_t size = size_and_flags & ~PRINTK_RECORD_FLAGS_MASK;
+
+        atomic_store_explicit(&record->size_and_flags, 0, memory_order_relaxed);
+        atomic_store_explicit(&ring->tail, tail + size, memory_order_release);
+    } while (true);
+}
+
+__optimize(3) static void
+ring_consume(struct printk_ring *const ring, struct printk_record *const record)
 {
-    (void)spec_info;
-    (void)cb_info;
-    (void)cont_out;
+    const uint32_t size =
+        atomic_load_explicit(&record->size_and_flags, memory_order_relaxed) &
+        ~PRINTK_RECORD_FLAGS_MASK;
+
+    // Zero the whole record, and not just its header, as a later record may
+    // start anywhere inside it.
+
+    bzero(record, size);
+    atomic_store_explicit(&ring->tail,
+                          atomic_load(&ring->tail) + size,
+                          memory_order_release);
+}
+
+__optimize(3) static void report_dropped(struct printk_ring *const ring) {
+    const uint64_t dropped =
+        atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+
+    if (dropped != 0) {
+        char buffer[64];
+        const uint64_t length =
+            format_to_buffer(buffer,
+                             sizeof(buffer),
+                             "printk: dropped %" PRIu64 " messages\n",
+                             dropped);
+
+        emit_sv(sv_create_length(buffer, length));
+    }
+}
+
+__optimize(3)
+static void emit_binary_record(const struct printk_record *const record) {
+    const struct printk_binary_payload *const payload =
+        (const struct printk_binary_payload *)record->text;
+
+    uint64_t words[PRINTK_BINARY_MAX_WORDS];
+    for (uint16_t i = 0; i != record->length; i++) {
+        words[i] = payload->words[i];
+        if (payload->string_mask & (1u << i)) {
+            words[i] += (uint64_t)payload;
+        }
+    }
+
+    char chunk[PRINTK_SINK_CHUNK_SIZE];
+    struct printf_sink sink =
+        PRINTF_SINK_INIT(chunk, sizeof(chunk), flush_to_terminals, NULL);
+
+    parse_printf_words(payload->fmt, &sink, words, record->length);
+    printf_sink_flush(&sink);
+}
+
+// Write out the record with the lowest sequence number across all rings.
+// Returns false if there were no committed records.
+
+__optimize(3) static bool drain_one() {
+    struct printk_ring *oldest_ring = NULL;
+    struct printk_record *oldest = NULL;
+
+    for (struct printk_ring *ring = atomic_load(&g_first_ring);
+         ring != NULL;
+         ring = atomic_load(&ring->next))
+    {
+        report_dropped(ring);
+
+        struct printk_record *const record = ring_peek(ring);
+        if (record != NULL && (oldest == NULL || record->seq < oldest->seq)) {
+            oldest_ring = ring;
+            oldest = record;
+        }
+    }
+
+    if (oldest == NULL) {
+        return false;
+    }
+
+    if (oldest->size_and_flags & PRINTK_RECORD_BINARY) {
+        emit_binary_record(oldest);
+    } else {
+        emit_sv(sv_create_length(oldest->text, oldest->length));
+    }
+
+    if (oldest->size_and_flags & PRINTK_RECORD_TRUNCATED) {
+        emit_sv(SV_STATIC(" [truncated]\n"));
+    }
+
+    ring_consume(oldest_ring, oldest);
+    return true;
+}
+
+__optimize(3) static bool have_committed_records() {
+    for (struct printk_ring *ring = atomic_load(&g_first_ring);
+         ring != NULL;
+         ring = atomic_load(&ring->next))
+    {
+        if (ring_peek(ring) != NULL) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+__optimize(3) void printk_drain() {
+    if (!spin_try_acquire(&g_drain_lock)) {
+        return;
+    }
+
+    do {
+        while (drain_one()) {}
+
+        flush_terminals();
+        spin_release(&g_drain_lock);
+
+        // A record committed after drain_one() last looked, but before the
+        // lock was released, was left behind by its writer for us to write
+        // out, so check again.
+    } while (have_committed_records() && spin_try_acquire(&g_drain_lock));
+}
+
+void printk_begin_emergency() {
+    if (atomic_exchange(&g_in_emergency, true)) {
+        return;
+    }
 
     for (struct terminal *term = atomic_load(&g_first_term);
          term != NULL;
          term = atomic_load(&term->next))
     {
-        term->emit_sv(term, sv);
+        if (term->bust_locks != NULL) {
+            term->bust_locks(term);
+        }
     }
 
-    return sv.length;
+    // Whoever was draining isn't going to finish.
+    g_drain_lock = SPINLOCK_INIT();
+
+    while (drain_one()) {}
+    flush_terminals();
+}
+
+void printk_set_binary_loglevel(const enum log_level loglevel,
+                                const bool enable)
+{
+    if (enable) {
+        atomic_fetch_or(&g_binary_loglevels, 1u << loglevel);
+    } else {
+        atomic_fetch_and(&g_binary_loglevels, ~(1u << loglevel));
+    }
+}
+
+void printk_set_loglevel(const enum log_level loglevel) {
+    atomic_store(&g_console_loglevel, loglevel);
+}
+
+__optimize(3) static inline bool loglevel_enabled(const enum log_level level) {
+    return level >= atomic_load_explicit(&g_console_loglevel,
+                                         memory_order_relaxed);
+}
+
+__optimize(3) bool printk_ratelimit(struct printk_ratelimit *const ratelimit) {
+    const uint64_t now = read_timestamp_counter();
+    const uint64_t interval =
+        timestamp_counter_frequency() * PRINTK_RATELIMIT_INTERVAL_SEC;
+
+    uint64_t begin =
+        atomic_load_explicit(&ratelimit->interval_begin, memory_order_relaxed);
+
+    if (begin == 0 || now - begin >= interval) {
+        // Only the cpu that starts the new interval resets the counts.
+        if (atomic_compare_exchange_strong(&ratelimit->interval_begin,
+                                           &begin,
+                                           now))
+        {
+            const uint32_t suppressed =
+                atomic_exchange(&ratelimit->suppressed, 0);
+
+            atomic_store(&ratelimit->printed, 0);
+            if (suppressed != 0) {
+                printk(LOGLEVEL_WARN,
+                       "printk: %" PRIu32 " messages suppressed\n",
+                       suppressed);
+            }
+        }
+    }
+
+    if (atomic_fetch_add(&ratelimit->printed, 1) >= PRINTK_RATELIMIT_BURST) {
+        atomic_fetch_add(&ratelimit->suppressed, 1);
+        return false;
+    }
+
+    return true;
+}
+
+__optimize(3)
+void (printk)(const enum log_level loglevel, const char *const string, ...) {
+    va_list list;
+    va_start(list, string);
+
+    vprintk(loglevel, string, list);
+    va_end(list);
+}
+
+__optimize(3) void
+(printk_binary)(const enum log_level loglevel, const char *const string, ...) {
+    va_list list;
+    va_start(list, string);
+
+    vprintk_binary(loglevel, string, list);
+    va_end(list);
 }
 
 void putk(const char *const string) {
@@ -74,27 +523,242 @@ void putk(const char *const string) {
 }
 
 void putk_sv(const struct string_view sv) {
-    for (struct terminal *term = atomic_load(&g_first_term);
-         term != NULL;
-         term = atomic_load(&term->next))
-    {
-        term->emit_sv(term, sv);
+    emit_sv(sv);
+    flush_terminals();
+}
+
+__optimize(3)
+static void emergency_vprintk(const char *const string, va_list list) {
+    char chunk[PRINTK_SINK_CHUNK_SIZE];
+    struct printf_sink sink =
+        PRINTF_SINK_INIT(chunk, sizeof(chunk), flush_to_terminals, NULL);
+
+    parse_printf_cached(string, &sink, list);
+    printf_sink_flush(&sink);
+
+    flush_terminals();
+}
+
+__optimize(3) static struct printk_record *
+reserve_record(const enum log_level loglevel,
+               const uint32_t size,
+               const uint16_t length)
+{
+    struct printk_ring *const ring = get_current_ring();
+    struct printk_record *const record = ring_reserve(ring, size);
+
+    if (record != NULL) {
+        record->length = length;
+        record->loglevel = (uint8_t)loglevel;
+        record->seq =
+            atomic_fetch_add_explicit(&g_next_seq, 1, memory_order_relaxed);
+        record->timestamp = read_timestamp_counter();
+    }
+
+    return record;
+}
+
+__optimize(3) static inline void
+commit_record(struct printk_record *const record,
+              const uint32_t size,
+              const uint32_t flags)
+{
+    atomic_store_explicit(&record->size_and_flags,
+                          size | PRINTK_RECORD_COMMITTED | flags,
+                          memory_order_release);
+}
+
+__optimize(3) static void drain_if_allowed() {
+    // Callers with interrupts disabled, such as isrs, may be interrupting
+    // code that's holding a terminal's lock, and shouldn't be held up by a
+    // slow terminal anyway, so leave their records for a later drain.
+
+    if (!atomic_load(&g_deferral_enabled) || are_interrupts_enabled()) {
+        printk_drain();
+    }
+}
+
+struct binary_args {
+    uint64_t words[PRINTK_BINARY_MAX_WORDS];
+    uint32_t string_lengths[PRINTK_BINARY_MAX_WORDS];
+
+    uint32_t string_mask;
+    uint32_t count;
+    uint32_t strings_size;
+
+    bool truncated : 1;
+    bool too_many : 1;
+};
+
+__optimize(3) static bool
+collect_arg(void *const info,
+            const enum printf_arg_kind kind,
+            const uint64_t word,
+            const int precision)
+{
+    struct binary_args *const args = (struct binary_args *)info;
+    if (args->count == PRINTK_BINARY_MAX_WORDS) {
+        args->too_many = true;
+        return false;
+    }
+
+    if (kind == PRINTF_ARG_STRING && word != 0) {
+        const char *const string = (const char *)word;
+        const uint64_t max =
+            precision >= 0 && precision < PRINTK_BINARY_STRING_MAX ?
+                (uint64_t)precision : PRINTK_BINARY_STRING_MAX;
+
+        const uint32_t length = (uint32_t)strnlen(string, max);
+        if (length == PRINTK_BINARY_STRING_MAX && string[length] != '\0') {
+            args->truncated = true;
+        }
+
+        args->string_lengths[args->count] = length;
+        args->string_mask |= 1u << args->count;
+        args->strings_size += length + 1;
+    }
+
+    args->words[args->count] = word;
+    args->count++;
+
+    return true;
+}
+
+__optimize(3) static bool
+enqueue_binary(const enum log_level loglevel,
+               const char *const string,
+               va_list list)
+{
+    struct binary_args args;
+
+    args.string_mask = 0;
+    args.count = 0;
+    args.strings_size = 0;
+    args.truncated = false;
+    args.too_many = false;
+
+    // Calls with too many arguments are formatted as text instead.
+    parse_printf_args(string, collect_arg, &args, list);
+    if (args.too_many) {
+        return false;
+    }
+
+    const uint32_t words_size =
+        sizeof(struct printk_binary_payload) + args.count * sizeof(uint64_t);
+    const uint32_t size =
+        (uint32_t)align_up_assert(sizeof(struct printk_record) +
+                                  words_size +
+                                  args.strings_size,
+                                  8);
+
+    struct printk_record *const record =
+        reserve_record(loglevel, size, (uint16_t)args.count);
+
+    if (record == NULL) {
+        return true;
+    }
+
+    struct printk_binary_payload *const payload =
+        (struct printk_binary_payload *)record->text;
+
+    payload->fmt = string;
+    payload->string_mask = args.string_mask;
+
+    char *strings = (char *)payload + words_size;
+    for (uint32_t i = 0; i != args.count; i++) {
+        if ((args.string_mask & (1u << i)) == 0) {
+            payload->words[i] = args.words[i];
+            continue;
+        }
+
+        const uint32_t length = args.string_lengths[i];
+
+        memcpy(strings, (const char *)args.words[i], length);
+        strings[length] = '\0';
+
+        payload->words[i] = (uint64_t)(strings - (char *)payload);
+        strings += length + 1;
+    }
+
+    commit_record(record,
+                  size,
+                  PRINTK_RECORD_BINARY |
+                  (args.truncated ? PRINTK_RECORD_TRUNCATED : 0));
+    return true;
+}
+
+__optimize(3) static void
+enqueue_text(const enum log_level loglevel,
+             const char *const string,
+             va_list list)
+{
+    // Format one byte past the limit, to tell whether it was cut off.
+    char buffer[PRINTK_LINE_MAX + 1];
+    struct printf_sink sink =
+        PRINTF_SINK_INIT(buffer, sizeof(buffer), /*flush=*/NULL, NULL);
+
+    // printk() format strings are string literals, so can be compiled once and
+    // looked up by their address from then on.
+
+    const uint64_t formatted = parse_printf_cached(string, &sink, list);
+    const bool truncated = formatted > PRINTK_LINE_MAX;
+    const uint16_t length =
+        truncated ? PRINTK_LINE_MAX : (uint16_t)formatted;
+
+    const uint32_t size =
+        (uint32_t)align_up_assert(sizeof(struct printk_record) + length, 8);
+
+    struct printk_record *const record =
+        reserve_record(loglevel, size, length);
+
+    if (record != NULL) {
+        memcpy(record->text, buffer, length);
+        commit_record(record,
+                      size,
+                      truncated ? PRINTK_RECORD_TRUNCATED : 0);
     }
 }
 
 __optimize(3) void
 vprintk(const enum log_level loglevel, const char *const string, va_list list) {
-    (void)loglevel;
+    if (!loglevel_enabled(loglevel)) {
+        return;
+    }
+
+    if (__builtin_expect(atomic_load(&g_in_emergency), 0)) {
+        emergency_vprintk(string, list);
+        return;
+    }
+
+    const uint32_t binary_loglevels =
+        atomic_load_explicit(&g_binary_loglevels, memory_order_relaxed);
 
-    static struct spinlock lock = SPINLOCK_INIT();
-    const int flag = spin_acquire_with_irq(&lock);
+    if ((binary_loglevels & (1u << loglevel)) == 0 ||
+        !enqueue_binary(loglevel, string, list))
+    {
+        enqueue_text(loglevel, string, list);
+    }
+
+    drain_if_allowed();
+}
 
-    parse_printf(string,
-                 write_char,
-                 /*char_cb_info=*/NULL,
-                 write_sv,
-                 /*sv_cb_info=*/NULL,
-                 list);
+__optimize(3) void
+vprintk_binary(const enum log_level loglevel,
+               const char *const string,
+               va_list list)
+{
+    if (!loglevel_enabled(loglevel)) {
+        return;
+    }
+
+    if (__builtin_expect(atomic_load(&g_in_emergency), 0)) {
+        emergency_vprintk(string, list);
+        return;
+    }
+
+    if (!enqueue_binary(loglevel, string, list)) {
+        enqueue_text(loglevel, string, list);
+    }
 
-    spin_release_with_irq(&lock, flag);
+    drain_if_allowed();
 }
\ No newline at end of file
@@ -17,12 +17,40 @@ struct terminal {
     void (*emit_ch)(struct terminal *term, char ch, uint32_t amt);
     void (*emit_sv)(struct terminal *term, struct string_view sv);
 
+    // Optional. Terminals that buffer their output, e.g. to batch up redraws,
+    // write it out here. Called once every batch of records is emitted.
+
+    void (*flush)(struct terminal *term);
+
     // Useful for panic()
     void (*bust_locks)(struct terminal *);
+
+    // Serial terminals all lead to the same place, e.g. the host's log, so only
+    // one of them is written to once there's a preferred one.
+    bool is_serial;
 };
 
 void printk_add_terminal(struct terminal *term);
 
+// Write to `term` instead of every other serial terminal. `term` must already
+// have been added.
+
+void printk_set_preferred_serial(struct terminal *term);
+
+struct cpu_info;
+void printk_init_cpu(struct cpu_info *cpu);
+
+// Once enabled, printk() calls made with interrupts disabled only queue their
+// message, which is written out by the next printk_drain().
+
+void printk_enable_deferral();
+void printk_drain();
+
+// Write out every queued message, and from then on write messages straight to
+// the terminals, ignoring any locks. Only for use by panic().
+
+void printk_begin_emergency();
+
 enum log_level {
     LOGLEVEL_DEBUG,
     LOGLEVEL_INFO,
@@ -31,9 +59,93 @@ enum log_level {
     LOGLEVEL_CRITICAL
 };
 
+// Calls below this level are compiled out entirely. Builds can raise it with
+// e.g. `PRINTK_MIN_LOGLEVEL=LOGLEVEL_WARN`.
+
+#if !defined(PRINTK_MIN_LOGLEVEL)
+    #define PRINTK_MIN_LOGLEVEL LOGLEVEL_DEBUG
+#endif /* !defined(PRINTK_MIN_LOGLEVEL) */
+
+// Messages below the console's log-level, LOGLEVEL_INFO by default, are
+// dropped before any of their arguments are looked at.
+
+void printk_set_loglevel(enum log_level loglevel);
+
+// `string` is compiled once and then looked up by its address, so must be a
+// string literal, or otherwise never change.
+
 __printf_format(2, 3)
 void printk(enum log_level loglevel, const char *string, ...);
 void vprintk(enum log_level loglevel, const char *string, va_list list);
 
+#define printk(loglevel, ...) \
+    do { \
+        if ((loglevel) >= PRINTK_MIN_LOGLEVEL) { \
+            (printk)((loglevel), __VA_ARGS__); \
+        } \
+    } while (false)
+
+/*
+ * Only record `string` and the raw arguments, and leave formatting them to
+ * whoever drains the message, for callers too hot to format every message,
+ * such as timers and allocators.
+ *
+ * `string` must outlive the message, so should be a string literal. Strings
+ * passed for "%s" are copied, and cut off after 128 characters.
+ */
+
+__printf_format(2, 3)
+void printk_binary(enum log_level loglevel, const char *string, ...);
+void
+vprintk_binary(enum log_level loglevel, const char *string, va_list list);
+
+#define printk_binary(loglevel, ...) \
+    do { \
+        if ((loglevel) >= PRINTK_MIN_LOGLEVEL) { \
+            (printk_binary)((loglevel), __VA_ARGS__); \
+        } \
+    } while (false)
+
+// Make every printk() call at `loglevel` behave like printk_binary().
+void printk_set_binary_loglevel(enum log_level loglevel, bool enable);
+
+/*
+ * Lets through at most PRINTK_RATELIMIT_BURST messages every
+ * PRINTK_RATELIMIT_INTERVAL_SEC seconds. Once a new interval starts, the
+ * number of messages that were suppressed in the last one is reported.
+ */
+
+#define PRINTK_RATELIMIT_BURST 10
+#define PRINTK_RATELIMIT_INTERVAL_SEC 5
+
+struct printk_ratelimit {
+    _Atomic uint64_t interval_begin;
+
+    _Atomic uint32_t printed;
+    _Atomic uint32_t suppressed;
+};
+
+#define PRINTK_RATELIMIT_INIT() \
+    ((struct printk_ratelimit){ \
+        .interval_begin = 0, \
+        .printed = 0, \
+        .suppressed = 0 \
+    })
+
+bool printk_ratelimit(struct printk_ratelimit *ratelimit);
+
+// Every use of printk_ratelimited() gets its own limit.
+#define printk_ratelimited(loglevel, ...) \
+    do { \
+        if ((loglevel) >= PRINTK_MIN_LOGLEVEL) { \
+            static struct printk_ratelimit __printk_ratelimit__ = \
+                PRINTK_RATELIMIT_INIT(); \
+\
+            if (printk_ratelimit(&__printk_ratelimit__)) { \
+                printk((loglevel), __VA_ARGS__); \
+            } \
+        } \
+    } while (false)
+
 void putk(const char *string);
 void putk_sv(struct string_view sv);
\ No newline at end of file
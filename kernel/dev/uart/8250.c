@@ -3,6 +3,7 @@
  * © suhas pai
  */
 
+#include "asm/pause.h"
 #include "dev/dtb/dtb.h"
 #include "cpu/spinlock.h"
 
@@ -36,6 +37,19 @@
 #define UART_LSR_DR 0x01    // Receiver data ready
 #define UART_LSR_BRK_ERROR_BITS 0x1E    // BI, FE, PE, OE bits
 
+#define UART_IER_THRI 0x02 // Transmit-hold-register empty interrupt
+
+#define UART_IIR_FIFO_MASK 0xC0 // Both bits are set when the FIFOs work
+
+#define UART_FCR_ENABLE_FIFO 0x01 // Enable FIFOs
+#define UART_FCR_CLEAR_RCVR 0x02  // Clear receive FIFO
+#define UART_FCR_CLEAR_XMIT 0x04  // Clear transmit FIFO
+
+#define UART_MCR_OUT2 0x08 // Connects the interrupt line on PCs
+
+#define UART_FIFO_SIZE 16
+#define UART_TX_RING_SIZE 2048
+
 struct uart8250_info {
     struct terminal term;
     struct spinlock lock;
@@ -45,6 +59,25 @@ struct uart8250_info {
     uint32_t in_freq;
     uint32_t reg_width;
     uint32_t reg_shift;
+
+    // Number of bytes that can be written each time the transmit-hold-register
+    // is empty, which is only 1 for uarts without a working FIFO.
+    uint8_t fifo_size;
+
+    // When set, the THR-empty interrupt refills the FIFO from `tx_ring`, and
+    // callers only queue their bytes. Otherwise, callers write out their bytes
+    // themselves.
+
+    bool irq_enabled;
+    bool thri_armed;
+
+    // Bytes waiting to be written to the FIFO. `tx_head` and `tx_tail` only
+    // ever increase, and are wrapped around the ring when used as indices.
+
+    uint32_t tx_head;
+    uint32_t tx_tail;
+
+    char tx_ring[UART_TX_RING_SIZE];
 };
 
 // for use when initializing serial before mm/kmalloc
@@ -91,19 +124,81 @@ set_reg(const port_t uart8250_base,
     verify_not_reached();
 }
 
-#define MAX_ATTEMPTS 10
+#define MAX_ATTEMPTS 100000
 
-__optimize(3) static void
-uart8250_putc(const port_t base,
-              struct uart8250_info *const info,
-              const char ch)
-{
+__optimize(3)
+static inline uint32_t tx_ring_count(const struct uart8250_info *const info) {
+    return info->tx_head - info->tx_tail;
+}
+
+// Write up to a FIFO's worth of queued bytes if the uart has finished sending
+// out the last batch. Returns false if it hasn't.
+
+__optimize(3) static bool fill_fifo(struct uart8250_info *const info) {
+    if ((get_reg(info->base, info, UART_LSR_OFFSET) & UART_LSR_THRE) == 0) {
+        return false;
+    }
+
+    uint32_t count = min(tx_ring_count(info), info->fifo_size);
+    for (; count != 0; count--) {
+        const uint32_t index = info->tx_tail % UART_TX_RING_SIZE;
+
+        set_reg(info->base, info, UART_THR_OFFSET, info->tx_ring[index]);
+        info->tx_tail++;
+    }
+
+    return true;
+}
+
+__optimize(3) static bool fill_fifo_polled(struct uart8250_info *const info) {
     for (uint64_t i = 0; i != MAX_ATTEMPTS; i++) {
-        if (get_reg(base, info, UART_LSR_OFFSET) & UART_LSR_THRE) {
-            set_reg(base, info, UART_THR_OFFSET, ch);
-            return;
+        if (fill_fifo(info)) {
+            return true;
+        }
+
+        cpu_pause();
+    }
+
+    return false;
+}
+
+__optimize(3)
+static void queue_char(struct uart8250_info *const info, const char ch) {
+    if (tx_ring_count(info) == UART_TX_RING_SIZE) {
+        // The ring only fills up when output outpaces the uart for a while, so
+        // wait on the uart instead of dropping output. Only a uart that has
+        // stopped responding loses its oldest byte.
+
+        if (!fill_fifo_polled(info)) {
+            info->tx_tail++;
         }
     }
+
+    info->tx_ring[info->tx_head % UART_TX_RING_SIZE] = ch;
+    info->tx_head++;
+}
+
+__optimize(3) static void start_tx(struct uart8250_info *const info) {
+    if (!info->irq_enabled) {
+        while (tx_ring_count(info) != 0) {
+            if (!fill_fifo_polled(info)) {
+                info->tx_tail = info->tx_head;
+                return;
+            }
+        }
+
+        return;
+    }
+
+    // Start sending right away if the uart is idle, and leave the rest to the
+    // THR-empty interrupt, which fires as soon as it's enabled if the FIFO is
+    // already empty.
+
+    fill_fifo(info);
+    if (tx_ring_count(info) != 0 && !info->thri_armed) {
+        set_reg(info->base, info, UART_IER_OFFSET, UART_IER_THRI);
+        info->thri_armed = true;
+    }
 }
 
 __optimize(3) static void
@@ -115,9 +210,10 @@ uart8250_send_char(struct terminal *const term,
     const bool flag = spin_acquire_with_irq(&info->lock);
 
     for (uint32_t i = 0; i != amount; i++) {
-        uart8250_putc(info->base, info, ch);
+        queue_char(info, ch);
     }
 
+    start_tx(info);
     spin_release_with_irq(&info->lock, flag);
 }
 
@@ -127,13 +223,51 @@ uart8250_send_sv(struct terminal *const term, const struct string_view sv) {
     const bool flag = spin_acquire_with_irq(&info->lock);
 
     sv_foreach(sv, iter) {
-        uart8250_putc(info->base, info, *iter);
+        queue_char(info, *iter);
     }
 
+    start_tx(info);
     spin_release_with_irq(&info->lock, flag);
 }
 
-bool
+__optimize(3) void uart8250_handle_irq(struct uart8250_info *const info) {
+    spin_acquire(&info->lock);
+
+    // Reading the IIR acknowledges a THR-empty interrupt.
+    get_reg(info->base, info, UART_IIR_OFFSET);
+    fill_fifo(info);
+
+    if (tx_ring_count(info) == 0 && info->thri_armed) {
+        set_reg(info->base, info, UART_IER_OFFSET, 0x00);
+        info->thri_armed = false;
+    }
+
+    spin_release(&info->lock);
+}
+
+void uart8250_enable_irq(struct uart8250_info *const info) {
+    const bool flag = spin_acquire_with_irq(&info->lock);
+
+    set_reg(info->base, info, UART_MCR_OFFSET, UART_MCR_OUT2);
+    info->irq_enabled = true;
+
+    spin_release_with_irq(&info->lock, flag);
+}
+
+static void uart8250_bust_locks(struct terminal *const term) {
+    struct uart8250_info *const info = (struct uart8250_info *)term;
+    info->lock = SPINLOCK_INIT();
+
+    // Nothing can be left to an interrupt after a panic, so have callers write
+    // out their bytes, starting with whatever is still queued.
+
+    set_reg(info->base, info, UART_IER_OFFSET, 0x00);
+
+    info->irq_enabled = false;
+    info->thri_armed = false;
+}
+
+struct uart8250_info *
 uart8250_init(const port_t base,
               const uint32_t baudrate,
               const uint32_t in_freq,
@@ -150,12 +284,12 @@ uart8250_init(const port_t base,
         info = kmalloc(sizeof(*info));
         if (info == NULL) {
             printk(LOGLEVEL_WARN, "uart8250: failed to alloc info\n");
-            return false;
+            return NULL;
         }
     } else {
         if (early_info_count == countof(early_infos)) {
             printk(LOGLEVEL_WARN, "uart8250: exhausted early-infos struct\n");
-            return false;
+            return NULL;
         }
 
         info = &early_infos[early_info_count];
@@ -182,8 +316,22 @@ uart8250_init(const port_t base,
 
     // 8 bits, no parity, one stop bit
     set_reg(base, info, UART_LCR_OFFSET, 0x03);
-    // Enable FIFO
-    set_reg(base, info, UART_FCR_OFFSET, 0x01);
+    // Enable and clear FIFOs
+    set_reg(base,
+            info,
+            UART_FCR_OFFSET,
+            UART_FCR_ENABLE_FIFO | UART_FCR_CLEAR_RCVR | UART_FCR_CLEAR_XMIT);
+
+    // Older uarts have no FIFO, or a broken one, and only take one byte at a
+    // time.
+
+    const uint32_t iir = get_reg(base, info, UART_IIR_OFFSET);
+    if ((iir & UART_IIR_FIFO_MASK) == UART_IIR_FIFO_MASK) {
+        info->fifo_size = UART_FIFO_SIZE;
+    } else {
+        info->fifo_size = 1;
+    }
+
     // No modem control DTR RTS
     set_reg(base, info, UART_MCR_OFFSET, 0x00);
     // Clear line status
@@ -195,11 +343,19 @@ uart8250_init(const port_t base,
 
     info->lock = SPINLOCK_INIT();
 
+    info->irq_enabled = false;
+    info->thri_armed = false;
+    info->tx_head = 0;
+    info->tx_tail = 0;
+
     info->term.emit_ch = uart8250_send_char;
     info->term.emit_sv = uart8250_send_sv;
+    info->term.bust_locks = uart8250_bust_locks;
+    info->term.flush = NULL;
+    info->term.is_serial = true;
 
     printk_add_terminal(&info->term);
-    return true;
+    return info;
 }
 
 bool init_from_dtb(const void *const dtb, const int nodeoff) {
@@ -8,9 +8,23 @@
 #include "cpu/spinlock.h"
 #include "port.h"
 
-bool
+struct uart8250_info;
+
+struct uart8250_info *
 uart8250_init(port_t base,
               uint32_t baudrate,
               uint32_t in_freq,
               uint8_t reg_width,
-              uint8_t reg_shift);
\ No newline at end of file
+              uint8_t reg_shift);
+
+/*
+ * Once the uart's interrupt is routed to a handler that calls
+ * uart8250_handle_irq(), uart8250_enable_irq() has callers only queue their
+ * bytes, and the THR-empty interrupt refill the uart's FIFO from the queue.
+ *
+ * Until then, callers write out their bytes themselves, a FIFO's worth at a
+ * time.
+ */
+
+void uart8250_enable_irq(struct uart8250_info *info);
+void uart8250_handle_irq(struct uart8250_info *info);
\ No newline at end of file
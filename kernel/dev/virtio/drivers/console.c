@@ -0,0 +1,227 @@
+/*
+ * kernel/dev/virtio/drivers/console.c
+ * © suhas pai
+ */
+
+#include "asm/pause.h"
+#include "cpu/spinlock.h"
+
+#include "dev/printk.h"
+#include "lib/string.h"
+
+#include "mm/kmalloc.h"
+#include "mm/page_alloc.h"
+
+#include "dev/virtio/queue/split.h"
+#include "console.h"
+
+// Without VIRTIO_CONSOLE_F_MULTIPORT, the device only has port 0's queues.
+#define VIRTIO_CONSOLE_RECEIVEQ_INDEX 0
+#define VIRTIO_CONSOLE_TRANSMITQ_INDEX 1
+
+#define VIRTIO_CONSOLE_TX_BUFFER_ORDER 3
+#define VIRTIO_CONSOLE_TX_BUFFER_COUNT (1 << VIRTIO_CONSOLE_TX_BUFFER_ORDER)
+
+#define MAX_ATTEMPTS 100000
+
+/*
+ * Every call to emit_sv() or emit_ch() copies its chunk of output into a
+ * page-sized tx-buffer, and hands the whole buffer to the device with a single
+ * notification, instead of the one port-write per byte a uart needs.
+ *
+ * The device's interrupts are left off, and buffers the device is done with
+ * are reclaimed by the next caller that needs one.
+ */
+
+struct virtio_console {
+    struct virtio_device device;
+    struct terminal term;
+    struct spinlock lock;
+
+    struct page *tx_pages;
+
+    // Bitmap of tx-buffers not held by the device.
+    uint32_t free_tx_buffers;
+    uint8_t tx_buffer_of_desc[VIRTQ_MAX_DESC_COUNT];
+};
+
+__optimize(3) static inline
+struct virtio_split_queue *get_tx_queue(struct virtio_console *const console) {
+    return &console->device.queue_list[VIRTIO_CONSOLE_TRANSMITQ_INDEX];
+}
+
+__optimize(3) static void reclaim_tx_buffers(struct virtio_console *console) {
+    struct virtio_split_queue *const queue = get_tx_queue(console);
+    while (true) {
+        const int32_t desc = virtio_split_queue_pop_used(queue, NULL);
+        if (desc == -1) {
+            return;
+        }
+
+        console->free_tx_buffers |= 1u << console->tx_buffer_of_desc[desc];
+    }
+}
+
+// Returns the index of a tx-buffer, waiting for the device to finish with one
+// if they're all in use, or -1 if the device stopped responding.
+
+__optimize(3) static int take_tx_buffer(struct virtio_console *const console) {
+    for (uint64_t i = 0; i != MAX_ATTEMPTS; i++) {
+        if (console->free_tx_buffers != 0) {
+            const int index = __builtin_ctz(console->free_tx_buffers);
+            console->free_tx_buffers &= ~(1u << index);
+
+            return index;
+        }
+
+        cpu_pause();
+        reclaim_tx_buffers(console);
+    }
+
+    return -1;
+}
+
+__optimize(3) static inline
+char *get_tx_buffer(struct virtio_console *const console, const int index) {
+    char *const begin = page_to_virt(console->tx_pages);
+    return begin + ((uint64_t)index << PAGE_SHIFT);
+}
+
+__optimize(3) static void
+submit_tx_buffer(struct virtio_console *const console,
+                 const int index,
+                 const uint32_t length)
+{
+    // There are never more tx-buffers than descriptors, and a tx-buffer is a
+    // single page, so there's always a free descriptor for a tx-buffer.
+
+    const int32_t desc =
+        virtio_split_queue_add_virt_buffer(get_tx_queue(console),
+                                           get_tx_buffer(console, index),
+                                           length,
+                                           /*device_writable=*/false);
+
+    assert(desc != -1);
+    console->tx_buffer_of_desc[desc] = (uint8_t)index;
+}
+
+__optimize(3) static void
+virtio_console_send_char(struct terminal *const term,
+                         const char ch,
+                         uint32_t amount)
+{
+    struct virtio_console *const console =
+        container_of(term, struct virtio_console, term);
+
+    const int flag = spin_acquire_with_irq(&console->lock);
+    reclaim_tx_buffers(console);
+
+    while (amount != 0) {
+        const int index = take_tx_buffer(console);
+        if (index == -1) {
+            break;
+        }
+
+        const uint32_t length = min(amount, (uint32_t)PAGE_SIZE);
+        memset(get_tx_buffer(console, index), ch, length);
+
+        submit_tx_buffer(console, index, length);
+        amount -= length;
+    }
+
+    virtio_split_queue_notify(&console->device, get_tx_queue(console));
+    spin_release_with_irq(&console->lock, flag);
+}
+
+__optimize(3) static void
+virtio_console_send_sv(struct terminal *const term, struct string_view sv) {
+    struct virtio_console *const console =
+        container_of(term, struct virtio_console, term);
+
+    const int flag = spin_acquire_with_irq(&console->lock);
+    reclaim_tx_buffers(console);
+
+    while (sv.length != 0) {
+        const int index = take_tx_buffer(console);
+        if (index == -1) {
+            break;
+        }
+
+        const uint32_t length = (uint32_t)min(sv.length, PAGE_SIZE);
+        memcpy(get_tx_buffer(console, index), sv.begin, length);
+
+        submit_tx_buffer(console, index, length);
+        sv.begin += length;
+        sv.length -= length;
+    }
+
+    virtio_split_queue_notify(&console->device, get_tx_queue(console));
+    spin_release_with_irq(&console->lock, flag);
+}
+
+static void virtio_console_bust_locks(struct terminal *const term) {
+    struct virtio_console *const console =
+        container_of(term, struct virtio_console, term);
+
+    console->lock = SPINLOCK_INIT();
+}
+
+struct virtio_device *
+virtio_console_driver_init(struct virtio_device *const device,
+                           const uint64_t features)
+{
+    (void)features;
+
+    struct virtio_split_queue *const tx_queue =
+        &device->queue_list[VIRTIO_CONSOLE_TRANSMITQ_INDEX];
+
+    if (tx_queue->desc_count < VIRTIO_CONSOLE_TX_BUFFER_COUNT) {
+        printk(LOGLEVEL_WARN,
+               "virtio-console: transmit queue is too small (%" PRIu16 ")\n",
+               tx_queue->desc_count);
+        return NULL;
+    }
+
+    struct virtio_console *const console = kmalloc(sizeof(*console));
+    if (console == NULL) {
+        printk(LOGLEVEL_WARN, "virtio-console: failed to alloc console\n");
+        return NULL;
+    }
+
+    console->tx_pages =
+        alloc_pages(PAGE_STATE_USED,
+                    /*alloc_flags=*/0,
+                    VIRTIO_CONSOLE_TX_BUFFER_ORDER);
+
+    if (console->tx_pages == NULL) {
+        kfree(console);
+        printk(LOGLEVEL_WARN,
+               "virtio-console: failed to alloc transmit buffers\n");
+
+        return NULL;
+    }
+
+    console->device = *device;
+    list_init(&console->device.list);
+
+    console->lock = SPINLOCK_INIT();
+    console->free_tx_buffers = (1u << VIRTIO_CONSOLE_TX_BUFFER_COUNT) - 1;
+
+    // Completed buffers are reclaimed by polling, so the device has no reason
+    // to interrupt us.
+
+    struct virtq_avail *const avail = page_to_virt(tx_queue->avail_page);
+    avail->flags = cpu16_to_le(__VIRTQ_AVAIL_F_NO_INTERRUPT);
+
+    console->term.emit_ch = virtio_console_send_char;
+    console->term.emit_sv = virtio_console_send_sv;
+    console->term.bust_locks = virtio_console_bust_locks;
+    console->term.flush = NULL;
+    console->term.is_serial = true;
+
+    printk_add_terminal(&console->term);
+    printk_set_preferred_serial(&console->term);
+
+    printk(LOGLEVEL_INFO, "virtio-console: now the preferred serial console\n");
+    return &console->device;
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+/*
+ * kernel/dev/virtio/drivers/console.h
+ * © suhas pai
+ */
+
+#pragma once
+#include "dev/virtio/device.h"
+
+struct virtio_device *
+virtio_console_driver_init(struct virtio_device *device, uint64_t features);
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "dev/printk.h"
 
 #include "drivers/block.h"
+#include "drivers/console.h"
 #include "drivers/scsi.h"
 
 #include "queue/split.h"
@@ -23,6 +24,10 @@ struct virtio_driver_info {
 
     uint16_t virtqueue_count;
     uint64_t required_features;
+
+    // Features the driver can use, but can do without. Device features that
+    // are neither required nor optional aren't accepted.
+    uint64_t optional_features;
 };
 
 static const struct virtio_driver_info drivers[] = {
@@ -33,11 +38,19 @@ static const struct virtio_driver_info drivers[] = {
             __VIRTIO_BLOCK_HAS_SEG_MAX |
             __VIRTIO_BLOCK_HAS_BLOCK_SIZE |
             __VIRTIO_BLOCK_SUPPORTS_MULTI_QUEUE,
+        .optional_features = __VIRTIO_BLOCK_IS_READONLY,
+    },
+    [VIRTIO_DEVICE_KIND_CONSOLE] = {
+        .init = virtio_console_driver_init,
+        .virtqueue_count = 2,
+        .required_features = 0,
+        .optional_features = 0,
     },
     [VIRTIO_DEVICE_KIND_SCSI_HOST] = {
         .init = virtio_scsi_driver_init,
         .virtqueue_count = 0,
         .required_features = __VIRTIO_SCSI_HOTPLUG | __VIRTIO_SCSI_CHANGE,
+        .optional_features = 0,
     }
 };
 
@@ -45,7 +58,8 @@ static const struct string_view device_kind_string[] = {
     [VIRTIO_DEVICE_KIND_INVALID] = SV_STATIC("reserved"),
     [VIRTIO_DEVICE_KIND_NETWORK_CARD] = SV_STATIC("network-card"),
     [VIRTIO_DEVICE_KIND_BLOCK_DEVICE] = SV_STATIC("block-device"),
-    [VIRTIO_DEVICE_KIND_CONSOLE] = SV_STATIC("entropy-source"),
+    [VIRTIO_DEVICE_KIND_CONSOLE] = SV_STATIC("console"),
+    [VIRTIO_DEVICE_KIND_ENTROPY_SRC] = SV_STATIC("entropy-source"),
     [VIRTIO_DEVICE_KIND_MEM_BALLOON_TRAD] = SV_STATIC("memory-balloon-trad"),
     [VIRTIO_DEVICE_KIND_IOMEM] = SV_STATIC("iomem"),
     [VIRTIO_DEVICE_KIND_RPMSG] = SV_STATIC("rpmsg"),
@@ -147,6 +161,11 @@ struct virtio_device *virtio_pci_init(struct virtio_device *const device) {
         return NULL;
     }
 
+    features &=
+        driver->required_features |
+        driver->optional_features |
+        __VIRTIO_DEVFEATURE_VERSION_1;
+
     virtio_device_write_features(device, features);
 
     // The transitional driver MUST execute the initialization sequence as
@@ -175,9 +194,10 @@ struct virtio_device *virtio_pci_init(struct virtio_device *const device) {
         printk(LOGLEVEL_INFO, "virtio-pci: device is legacy\n");
     }
 
-    status = virtio_device_read_status(device);
-    virtio_device_write_status(device, status | __VIRTIO_DEVSTATUS_DRIVER_OK);
+    // 7. Perform device-specific setup, including discovery of virtqueues for
+    // the device.
 
+    status = virtio_device_read_status(device);
     if (driver->virtqueue_count != 0) {
         if (!virtio_device_init_queues(device, driver->virtqueue_count)) {
             status |= __VIRTIO_DEVSTATUS_FAILED;
@@ -187,6 +207,10 @@ struct virtio_device *virtio_pci_init(struct virtio_device *const device) {
         }
     }
 
+    // 8. Set the DRIVER_OK status bit. At this point the device is "live".
+    status |= __VIRTIO_DEVSTATUS_DRIVER_OK;
+    virtio_device_write_status(device, status);
+
     struct virtio_device *const ret_device = driver->init(device, features);
     if (ret_device == NULL) {
         virtio_device_write_status(device, status | __VIRTIO_DEVSTATUS_FAILED);
@@ -514,10 +538,11 @@ static void init_from_pci(struct pci_device_info *const pci_device) {
     }
 
 #undef pci_read_virtio_cap_field
-    virtio_pci_init(&virt_device);
 
-    list_add(&g_device_list, &virt_device.list);
-    g_device_count++;
+    // virtio_pci_init() adds the driver's own copy of the device to the list,
+    // as `virt_device` doesn't outlive this function.
+
+    virtio_pci_init(&virt_device);
 }
 
 static struct pci_driver pci_driver = {
@@ -3,8 +3,13 @@
  * © suhas pai
  */
 
+#include <stdatomic.h>
+
 #include "dev/printk.h"
+
 #include "mm/page_alloc.h"
+#include "mm/pagemap.h"
+#include "mm/walker.h"
 
 #include "split.h"
 
@@ -86,6 +91,7 @@ virtio_split_queue_init(struct virtio_device *const device,
         return false;
     }
 
+    virtio_device_set_selected_queue_size(device, desc_count);
     virtio_device_set_selected_queue_desc_phys(device, page_to_phys(desc_pages));
     virtio_device_set_selected_queue_driver_phys(device,
                                                  page_to_phys(avail_page));
@@ -113,8 +119,160 @@ virtio_split_queue_init(struct virtio_device *const device,
     queue->avail_page = avail_page;
     queue->used_pages = used_pages;
 
+    queue->index = queue_index;
+    queue->desc_count = desc_count;
+
+    queue->free_head = 0;
+    queue->free_count = desc_count;
+    queue->last_used_index = 0;
+
     queue->desc_pages_order = desc_pages_order;
     queue->used_pages_order = used_pages_order;
 
     return true;
+}
+
+__optimize(3) static void
+publish_desc_chain(struct virtio_split_queue *const queue, const uint16_t head)
+{
+    struct virtq_avail *const avail = page_to_virt(queue->avail_page);
+    const uint16_t avail_index = le_to_cpu(avail->idx);
+
+    avail->ring[avail_index % queue->desc_count] = cpu_to_le(head);
+
+    // The device must see the descriptor and ring entry before the new index.
+    atomic_thread_fence(memory_order_release);
+    *(volatile le16_t *)&avail->idx = cpu16_to_le((uint16_t)(avail_index + 1));
+}
+
+__optimize(3) int32_t
+virtio_split_queue_add_buffer(struct virtio_split_queue *const queue,
+                              const uint64_t phys,
+                              const uint32_t length,
+                              const bool device_writable)
+{
+    if (queue->free_count == 0) {
+        return -1;
+    }
+
+    const uint16_t head = queue->free_head;
+    struct virtq_desc *const desc =
+        (struct virtq_desc *)page_to_virt(queue->desc_pages) + head;
+
+    queue->free_head = desc->next;
+    queue->free_count--;
+
+    desc->phys_addr = cpu_to_le(phys);
+    desc->len = cpu_to_le(length);
+    desc->flags = device_writable ? cpu16_to_le(__VIRTQ_DESC_F_WRITE) : 0;
+
+    publish_desc_chain(queue, head);
+    return head;
+}
+
+__optimize(3) int32_t
+virtio_split_queue_add_virt_buffer(struct virtio_split_queue *const queue,
+                                   const void *const buffer,
+                                   const uint32_t length,
+                                   const bool device_writable)
+{
+    struct range segments[VIRTIO_SPLIT_QUEUE_MAX_SEGMENTS];
+    const uint64_t segment_count =
+        virt_range_to_phys_segments(&kernel_pagemap,
+                                    RANGE_INIT((uint64_t)buffer, length),
+                                    segments,
+                                    countof(segments));
+
+    if (segment_count == 0 ||
+        segment_count > countof(segments) ||
+        segment_count > queue->free_count)
+    {
+        return -1;
+    }
+
+    struct virtq_desc *const desc_list = page_to_virt(queue->desc_pages);
+    const uint16_t base_flags =
+        device_writable ? __VIRTQ_DESC_F_WRITE : 0;
+
+    // Take the descriptors off the front of the free-list, which leaves them
+    // already chained together through their `next` fields.
+
+    const uint16_t head = queue->free_head;
+    struct virtq_desc *desc = NULL;
+
+    for (uint64_t i = 0; i != segment_count; i++) {
+        desc = desc_list + queue->free_head;
+        queue->free_head = desc->next;
+
+        desc->phys_addr = cpu_to_le(segments[i].front);
+        desc->len = cpu_to_le((uint32_t)segments[i].size);
+        desc->flags = cpu16_to_le(base_flags | __VIRTQ_DESC_F_NEXT);
+    }
+
+    desc->flags = cpu16_to_le(base_flags);
+    queue->free_count -= (uint16_t)segment_count;
+
+    publish_desc_chain(queue, head);
+    return head;
+}
+
+__optimize(3) void
+virtio_split_queue_notify(struct virtio_device *const device,
+                          struct virtio_split_queue *const queue)
+{
+    // Make sure the new avail index is visible before checking whether the
+    // device wants to be told about it.
+
+    atomic_thread_fence(memory_order_seq_cst);
+
+    const struct virtq_used *const used = page_to_virt(queue->used_pages);
+    const uint16_t flags = le_to_cpu(*(const volatile le16_t *)&used->flags);
+
+    if ((flags & __VIRTQ_USED_F_NO_NOTIFY) == 0) {
+        virtio_device_notify_queue(device, queue->index);
+    }
+}
+
+__optimize(3) int32_t
+virtio_split_queue_pop_used(struct virtio_split_queue *const queue,
+                            uint32_t *const length_out)
+{
+    const struct virtq_used *const used = page_to_virt(queue->used_pages);
+    const uint16_t used_index =
+        le_to_cpu(*(const volatile le16_t *)&used->index);
+
+    if (used_index == queue->last_used_index) {
+        return -1;
+    }
+
+    // Don't read the used element before seeing the device's new index.
+    atomic_thread_fence(memory_order_acquire);
+
+    const struct virtq_used_elem *const elem =
+        &used->ring[queue->last_used_index % queue->desc_count];
+
+    const uint16_t head = (uint16_t)le_to_cpu(elem->id);
+    if (length_out != NULL) {
+        *length_out = le_to_cpu(elem->len);
+    }
+
+    // Walk to the end of the buffer's chain of descriptors, and put the whole
+    // chain back at the front of the free-list.
+
+    struct virtq_desc *const desc_list = page_to_virt(queue->desc_pages);
+    struct virtq_desc *desc = desc_list + head;
+    uint16_t desc_count = 1;
+
+    while (le_to_cpu(desc->flags) & __VIRTQ_DESC_F_NEXT) {
+        desc = desc_list + le_to_cpu(desc->next);
+        desc_count++;
+    }
+
+    desc->next = queue->free_head;
+
+    queue->free_head = head;
+    queue->free_count += desc_count;
+    queue->last_used_index++;
+
+    return head;
 }
\ No newline at end of file
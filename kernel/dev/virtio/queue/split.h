@@ -11,6 +11,16 @@ struct virtio_split_queue {
     struct page *avail_page;
     struct page *used_pages;
 
+    uint16_t index;
+    uint16_t desc_count;
+
+    // Free descriptors are chained together through their `next` fields.
+    uint16_t free_head;
+    uint16_t free_count;
+
+    // Index of the next entry of the used ring that hasn't been looked at.
+    uint16_t last_used_index;
+
     uint8_t desc_pages_order;
     uint8_t used_pages_order;
 };
@@ -18,4 +28,43 @@ struct virtio_split_queue {
 bool
 virtio_split_queue_init(struct virtio_device *device,
                         struct virtio_split_queue *queue,
-                        uint16_t queue_index);
\ No newline at end of file
+                        uint16_t queue_index);
+
+// Make a buffer of `length` bytes at `phys` available to the device as a
+// single descriptor. Returns the descriptor's index, or -1 if every descriptor
+// is in use. The device isn't told about the buffer until
+// virtio_split_queue_notify() is called.
+
+int32_t
+virtio_split_queue_add_buffer(struct virtio_split_queue *queue,
+                              uint64_t phys,
+                              uint32_t length,
+                              bool device_writable);
+
+// A buffer added through virtio_split_queue_add_virt_buffer() may be split
+// across at most this many physically contiguous extents.
+
+#define VIRTIO_SPLIT_QUEUE_MAX_SEGMENTS 16
+
+// Like virtio_split_queue_add_buffer(), but takes a buffer in the kernel's
+// address-space, and chains one descriptor for every physically contiguous
+// extent it maps to. Returns -1 if the buffer isn't mapped, is split across
+// too many extents, or if there aren't enough free descriptors.
+
+int32_t
+virtio_split_queue_add_virt_buffer(struct virtio_split_queue *queue,
+                                   const void *buffer,
+                                   uint32_t length,
+                                   bool device_writable);
+
+void
+virtio_split_queue_notify(struct virtio_device *device,
+                          struct virtio_split_queue *queue);
+
+// Returns the descriptor index of the next buffer the device is done with and
+// frees its chain of descriptors, or -1 if the device isn't done with any more
+// buffers.
+
+int32_t
+virtio_split_queue_pop_used(struct virtio_split_queue *queue,
+                            uint32_t *length_out);
\ No newline at end of file
@@ -678,4 +678,17 @@ enum virtio_scsci_task_attr {
     VIRTIO_SCSI_TASK_ATTR_ORDERED,
     VIRTIO_SCSI_TASK_ATTR_HEAD,
     VIRTIO_SCSI_TASK_ATTR_ACA,
+};
+
+enum virtio_console_feature_flags {
+    // Configuration cols and rows are valid.
+    __VIRTIO_CONSOLE_HAS_SIZE = 1 << 0,
+
+    // Device has support for multiple ports; max_nr_ports is valid and control
+    // virtqueues will be used.
+    __VIRTIO_CONSOLE_MULTIPORT = 1 << 1,
+
+    // Device has support for emergency write. Configuration field emerg_wr is
+    // valid.
+    __VIRTIO_CONSOLE_EMERG_WRITE = 1 << 2,
 };
\ No newline at end of file
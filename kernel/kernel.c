@@ -6,10 +6,32 @@
 #include "asm/irqs.h"
 #include "cpu/isr.h"
 
+#if defined(__x86_64__)
+    #include "dev/ps2/keyboard.h"
+#endif /* defined(__x86_64__) */
+
+#include "dev/fb/console.h"
 #include "dev/init.h"
 #include "dev/printk.h"
+#include "lib/size.h"
 
 #include "mm/early.h"
+#include "mm/epoch.h"
+#include "mm/mmio.h"
+
+#if defined(BOOT_BENCHMARKS)
+    #include "mm/vmalloc.h"
+#endif /* defined(BOOT_BENCHMARKS) */
+
+#if defined(BOOT_SELFTESTS)
+    #include "mm/fault.h"
+    #include "mm/kmalloc.h"
+    #include "mm/pagemap.h"
+    #include "mm/pgmap.h"
+    #include "mm/walker.h"
+#endif /* defined(BOOT_SELFTESTS) */
+
+#include "time/time.h"
 
 #include "boot.h"
 #include "limine.h"
@@ -24,10 +46,47 @@ static volatile struct limine_framebuffer_request framebuffer_request = {
     .response = NULL
 };
 
+#if defined(BOOT_BENCHMARKS) && defined(__x86_64__)
+
+// Report the cost of the ps2 keyboard's interrupt handler whenever it has
+// handled more interrupts since the last report.
+
+static void log_ps2_keyboard_stats() {
+    static uint64_t last_interrupt_count = 0;
+
+    const struct ps2_keyboard_stats *const stats = ps2_keyboard_get_stats();
+    const uint64_t interrupt_count = atomic_load(&stats->interrupt_count);
+
+    if (interrupt_count == last_interrupt_count) {
+        return;
+    }
+
+    last_interrupt_count = interrupt_count;
+    printk(LOGLEVEL_INFO,
+           "kernel: ps2 keyboard: %" PRIu64 " irqs, %" PRIu64 " cycles/irq "
+           "(max %" PRIu64 "), %" PRIu64 " events dropped\n",
+           interrupt_count,
+           atomic_load(&stats->interrupt_cycles) / interrupt_count,
+           atomic_load(&stats->max_interrupt_cycles),
+           atomic_load(&stats->dropped_events));
+}
+
+#endif /* defined(BOOT_BENCHMARKS) && defined(__x86_64__) */
+
 // Halt and catch fire function.
 static void hcf(void) {
     for (;;) {
+        printk_drain();
+
+        // An idle cpu is outside every read-section, so use it to move the
+        // global epoch forward even when nothing is being freed.
+
+        epoch_try_reclaim();
 #if defined (__x86_64__)
+        ps2_keyboard_log_events();
+    #if defined(BOOT_BENCHMARKS)
+        log_ps2_keyboard_stats();
+    #endif /* defined(BOOT_BENCHMARKS) */
         asm ("hlt");
 #elif defined (__aarch64__) || defined (__riscv)
         asm ("wfi");
@@ -51,6 +110,221 @@ void test_alloc_largepage() {
     }
 }
 
+#if defined(BOOT_BENCHMARKS)
+
+// Measure how fast the framebuffer can be filled when it's mapped with each
+// cache-kind vmap_mmio() supports.
+
+static void test_framebuffer_fill(const struct limine_framebuffer *const fb) {
+    const struct range fb_range =
+        RANGE_INIT(virt_to_phys(fb->address), fb->pitch * fb->height);
+
+    struct range phys_range = RANGE_EMPTY();
+    if (!range_align_out(fb_range, PAGE_SIZE, &phys_range)) {
+        return;
+    }
+
+    const struct {
+        const char *name;
+        uint64_t flags;
+    } kinds[] = {
+        { "uncached", 0 },
+        { "write-through", __VMAP_MMIO_WT },
+        { "write-combining", __VMAP_MMIO_WC },
+    };
+
+    const uint64_t pass_count = 4;
+    for (uint64_t i = 0; i != countof(kinds); i++) {
+        struct mmio_region *const mmio =
+            vmap_mmio(phys_range, PROT_READ | PROT_WRITE, kinds[i].flags);
+
+        if (mmio == NULL) {
+            continue;
+        }
+
+        volatile uint32_t *const pixels =
+            (volatile uint32_t *)(mmio->base + (fb_range.front -
+                                                phys_range.front));
+
+        const uint64_t pixel_count = fb_range.size / sizeof(uint32_t);
+        const uint64_t begin = nsec_since_boot();
+
+        for (uint64_t pass = 0; pass != pass_count; pass++) {
+            for (uint64_t j = 0; j != pixel_count; j++) {
+                pixels[j] = (uint32_t)pass;
+            }
+        }
+
+        const uint64_t elapsed = nsec_since_boot() - begin;
+        const uint64_t bytes = fb_range.size * pass_count;
+
+        const uint64_t bytes_per_sec =
+            elapsed != 0 ? bytes * 1000000000 / elapsed : 0;
+
+        printk(LOGLEVEL_INFO,
+               "kernel: framebuffer fill (%s): %" PRIu64 " MiB/s\n",
+               kinds[i].name,
+               bytes_per_sec / (uint64_t)mib(1));
+
+        vunmap_mmio(mmio);
+    }
+}
+
+#endif /* defined(BOOT_BENCHMARKS) */
+
+#if defined(BOOT_BENCHMARKS)
+
+// Compare how long printk() holds up its caller when the message is written
+// out to the terminals inline, against when it's only queued, as it is for
+// callers with interrupts disabled.
+
+static void test_printk_latency() {
+    const uint64_t call_count = 16;
+
+    uint64_t begin = nsec_since_boot();
+    for (uint64_t i = 0; i != call_count; i++) {
+        printk(LOGLEVEL_INFO,
+               "kernel: printk latency test (inline) %" PRIu64 "\n",
+               i);
+    }
+
+    const uint64_t inline_elapsed = nsec_since_boot() - begin;
+
+    disable_all_interrupts();
+    begin = nsec_since_boot();
+
+    for (uint64_t i = 0; i != call_count; i++) {
+        printk(LOGLEVEL_INFO,
+               "kernel: printk latency test (deferred) %" PRIu64 "\n",
+               i);
+    }
+
+    const uint64_t deferred_elapsed = nsec_since_boot() - begin;
+
+    enable_all_interrupts();
+    printk_drain();
+
+    printk(LOGLEVEL_INFO,
+           "kernel: printk latency: %" PRIu64 " ns/call inline, %" PRIu64 " "
+           "ns/call deferred\n",
+           inline_elapsed / call_count,
+           deferred_elapsed / call_count);
+}
+
+
+// Measure vmalloc()/vfree() throughput over enough areas for vfree() to purge
+// its lazy areas several times, and report how many tlb-flushes were avoided.
+
+static void test_vmalloc_throughput() {
+    enum {
+        AREA_COUNT = 1024,
+        AREA_SIZE = PAGE_SIZE * 16
+    };
+
+    static void *areas[AREA_COUNT];
+
+    uint64_t begin = nsec_since_boot();
+    uint64_t alloc_count = 0;
+
+    for (; alloc_count != AREA_COUNT; alloc_count++) {
+        areas[alloc_count] = vmalloc(AREA_SIZE);
+        if (areas[alloc_count] == NULL) {
+            break;
+        }
+    }
+
+    const uint64_t alloc_elapsed = nsec_since_boot() - begin;
+    begin = nsec_since_boot();
+
+    for (uint64_t i = 0; i != alloc_count; i++) {
+        vfree(areas[i]);
+    }
+
+    vmalloc_purge_lazy();
+    const uint64_t free_elapsed = nsec_since_boot() - begin;
+
+    if (alloc_count == 0) {
+        printk(LOGLEVEL_WARN, "kernel: vmalloc benchmark failed to allocate\n");
+        return;
+    }
+
+    const struct vmalloc_stats *const stats = vmalloc_get_stats();
+    printk(LOGLEVEL_INFO,
+           "kernel: vmalloc: %" PRIu64 " ns/alloc, %" PRIu64 " ns/free of %"
+           PRIu64 " KiB areas\n",
+           alloc_elapsed / alloc_count,
+           free_elapsed / alloc_count,
+           (uint64_t)AREA_SIZE / (uint64_t)kib(1));
+
+    printk(LOGLEVEL_INFO,
+           "kernel: vmalloc: %" PRIu64 " allocs, %" PRIu64 " frees, %" PRIu64
+           " purges, %" PRIu64 " flushes avoided\n",
+           stats->alloc_count,
+           stats->free_count,
+           stats->purge_count,
+           stats->flushes_avoided);
+}
+
+#endif /* defined(BOOT_BENCHMARKS) */
+
+#if defined(BOOT_SELFTESTS) && !defined(__riscv)
+
+// Fault in a demand-paged vm_area placed in the lower-half of the kernel's
+// pagemap, and check that reads share the zero-page, that a write replaces it
+// with a page of its own, and that unmapping the area with free_pages set
+// leaves the zero-page allocated.
+
+static void test_demand_paging() {
+    const struct range in_range = range_create_end(1ull << 30, 1ull << 31);
+    struct vm_area *const vma =
+        vma_create_demand(&kernel_pagemap,
+                          in_range,
+                          /*size=*/PAGE_SIZE * 2,
+                          /*align=*/PAGE_SIZE,
+                          PROT_RW,
+                          VMA_CACHEKIND_DEFAULT);
+
+    if (vma == NULL) {
+        printk(LOGLEVEL_WARN, "kernel: failed to create demand-paged vma\n");
+        return;
+    }
+
+    const struct page_fault_stats *const stats = page_fault_get_stats();
+    const uint64_t zero_page_count = stats->mapped_zero_page;
+    const uint64_t copy_count = stats->zero_page_copy;
+
+    const uint64_t virt = vma->node.range.front;
+    volatile uint8_t *const ptr = (volatile uint8_t *)virt;
+
+    assert(ptr[0] == 0 && ptr[PAGE_SIZE] == 0);
+    assert(stats->mapped_zero_page == zero_page_count + 2);
+
+    const uint64_t zero_phys = ptwalker_virt_get_phys(&kernel_pagemap, virt);
+    assert(ptwalker_virt_get_phys(&kernel_pagemap, virt + PAGE_SIZE) ==
+           zero_phys);
+
+    ptr[0] = 1;
+
+    assert(stats->zero_page_copy == copy_count + 1);
+    assert(ptwalker_virt_get_phys(&kernel_pagemap, virt) != zero_phys);
+    assert(ptr[0] == 1 && ptr[PAGE_SIZE] == 0);
+
+    const struct pgunmap_options options = {
+        .free_pages = true,
+        .dont_split_large_pages = true
+    };
+
+    assert(pagemap_unmap_range(&kernel_pagemap, vma->node.range, &options));
+
+    pagemap_remove_vma(&kernel_pagemap, vma);
+    kfree(vma);
+
+    assert(phys_to_page(zero_phys)->used.refcount.count > 0);
+    printk(LOGLEVEL_INFO, "kernel: demand-paging test passed\n");
+}
+
+#endif /* defined(BOOT_SELFTESTS) && !defined(__riscv) */
+
 void arch_init();
 void arch_early_init();
 
@@ -67,12 +341,6 @@ void _start(void) {
     struct limine_framebuffer *const framebuffer =
         framebuffer_request.response->framebuffers[0];
 
-    // Note: we assume the framebuffer model is RGB with 32-bit pixels.
-    volatile uint32_t *const fb_ptr = framebuffer->address;
-    for (size_t i = 0; i < 100; i++) {
-        fb_ptr[i * (framebuffer->pitch / 4) + i] = 0xffffff;
-    }
-
     boot_early_init();
     arch_early_init();
 
@@ -86,10 +354,40 @@ void _start(void) {
     isr_init();
     dev_init();
 
+#if defined(BOOT_BENCHMARKS)
+    // The fill test scribbles over the whole framebuffer, so run it before the
+    // console starts drawing on it.
+
+    test_framebuffer_fill(framebuffer);
+#endif /* defined(BOOT_BENCHMARKS) */
+
+    fb_console_init(&(struct framebuffer){
+        .phys = virt_to_phys(framebuffer->address),
+        .width = (uint32_t)framebuffer->width,
+        .height = (uint32_t)framebuffer->height,
+        .pitch = (uint32_t)framebuffer->pitch,
+        .bpp = framebuffer->bpp,
+        .red_mask_size = framebuffer->red_mask_size,
+        .red_mask_shift = framebuffer->red_mask_shift,
+        .green_mask_size = framebuffer->green_mask_size,
+        .green_mask_shift = framebuffer->green_mask_shift,
+        .blue_mask_size = framebuffer->blue_mask_size,
+        .blue_mask_shift = framebuffer->blue_mask_shift
+    });
+
     enable_all_interrupts();
+    printk_enable_deferral();
+
     printk(LOGLEVEL_INFO, "kernel: finished initializing\n");
 
     test_alloc_largepage();
+#if defined(BOOT_SELFTESTS) && !defined(__riscv)
+    test_demand_paging();
+#endif /* defined(BOOT_SELFTESTS) && !defined(__riscv) */
+#if defined(BOOT_BENCHMARKS)
+    test_printk_latency();
+    test_vmalloc_throughput();
+#endif /* defined(BOOT_BENCHMARKS) */
 
     // We're done, just hang...
     hcf();
@@ -0,0 +1,104 @@
+/*
+ * kernel/mm/epoch.c
+ * © suhas pai
+ */
+
+#include <stdatomic.h>
+
+#include "cpu/spinlock.h"
+#include "cpu.h"
+
+#include "epoch.h"
+#include "page_alloc.h"
+
+#define EPOCH_BUCKET_COUNT 3
+
+static _Atomic uint64_t g_global_epoch = 0;
+
+static struct list g_cpu_state_list = LIST_INIT(g_cpu_state_list);
+static struct list g_retired_pages[EPOCH_BUCKET_COUNT] = {
+    LIST_INIT(g_retired_pages[0]),
+    LIST_INIT(g_retired_pages[1]),
+    LIST_INIT(g_retired_pages[2]),
+};
+
+static struct spinlock g_lock = SPINLOCK_INIT();
+
+void epoch_register_cpu(struct epoch_cpu_state *const state) {
+    const int flag = spin_acquire_with_irq(&g_lock);
+    list_add(&g_cpu_state_list, &state->list);
+    spin_release_with_irq(&g_lock, flag);
+}
+
+__optimize(3) void epoch_read_lock() {
+    struct epoch_cpu_state *const state = &get_cpu_info_mut()->epoch_state;
+    if (atomic_fetch_add(&state->nesting, 1) == 0) {
+        atomic_store(&state->epoch, atomic_load(&g_global_epoch));
+    }
+}
+
+__optimize(3) void epoch_read_unlock() {
+    struct epoch_cpu_state *const state = &get_cpu_info_mut()->epoch_state;
+    atomic_fetch_sub_explicit(&state->nesting, 1, memory_order_release);
+}
+
+__optimize(3) void epoch_defer_free_pages(struct list *const pages) {
+    if (list_empty(pages)) {
+        return;
+    }
+
+    const int flag = spin_acquire_with_irq(&g_lock);
+    const uint64_t epoch = atomic_load(&g_global_epoch);
+
+    list_splice(&g_retired_pages[epoch % EPOCH_BUCKET_COUNT], pages);
+    spin_release_with_irq(&g_lock, flag);
+}
+
+__optimize(3) void epoch_defer_free_page(struct page *const page) {
+    const int flag = spin_acquire_with_irq(&g_lock);
+    const uint64_t epoch = atomic_load(&g_global_epoch);
+
+    list_add(&g_retired_pages[epoch % EPOCH_BUCKET_COUNT],
+             &page->table.delayed_free_list);
+
+    spin_release_with_irq(&g_lock, flag);
+}
+
+bool epoch_try_reclaim() {
+    int flag = 0;
+    if (!spin_try_acquire_with_irq(&g_lock, &flag)) {
+        // Another cpu is already reclaiming.
+        return false;
+    }
+
+    const uint64_t epoch = atomic_load(&g_global_epoch);
+
+    struct epoch_cpu_state *iter = NULL;
+    list_foreach(iter, &g_cpu_state_list, list) {
+        if (atomic_load(&iter->nesting) != 0 &&
+            atomic_load(&iter->epoch) != epoch)
+        {
+            spin_release_with_irq(&g_lock, flag);
+            return false;
+        }
+    }
+
+    // Every reader has observed `epoch`, so pages retired two epochs ago can
+    // no longer be reached. Their bucket is reused for the new epoch.
+
+    atomic_store(&g_global_epoch, epoch + 1);
+
+    struct list freeable = LIST_INIT(freeable);
+    list_splice(&freeable, &g_retired_pages[(epoch + 1) % EPOCH_BUCKET_COUNT]);
+
+    spin_release_with_irq(&g_lock, flag);
+
+    struct page *page = NULL;
+    struct page *tmp = NULL;
+
+    list_foreach_mut(page, tmp, &freeable, table.delayed_free_list) {
+        free_page(page);
+    }
+
+    return true;
+}
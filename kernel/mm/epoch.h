@@ -0,0 +1,53 @@
+/*
+ * kernel/mm/epoch.h
+ * © suhas pai
+ */
+
+#pragma once
+#include "lib/list.h"
+
+/*
+ * Epoch-based reclamation of pages that may still be reachable by lockless
+ * readers, such as page-table pages unlinked from a pagemap while another cpu
+ * walks it in ptwalker_virt_get_phys().
+ *
+ * Readers bracket their accesses with epoch_read_lock() and
+ * epoch_read_unlock(). Freed pages are retired into the current epoch's
+ * bucket, and are only returned to the page allocator after the global epoch
+ * has advanced twice, which requires every cpu inside a read-section to have
+ * observed the newer epoch.
+ */
+
+struct epoch_cpu_state {
+    _Atomic uint64_t epoch;
+    _Atomic uint32_t nesting;
+
+    struct list list;
+};
+
+#define EPOCH_CPU_STATE_INIT(name) \
+    ((struct epoch_cpu_state){ \
+        .epoch = 0, \
+        .nesting = 0, \
+        .list = LIST_INIT(name.list) \
+    })
+
+void epoch_register_cpu(struct epoch_cpu_state *state);
+
+void epoch_read_lock();
+void epoch_read_unlock();
+
+struct page;
+
+// `pages` is a list of pages linked through their `delayed_free_list` field,
+// and is left empty.
+
+void epoch_defer_free_pages(struct list *pages);
+void epoch_defer_free_page(struct page *page);
+
+// Advance the global epoch if every cpu has passed a quiescent point, and free
+// the pages that can no longer be reached by any reader. Called from the paths
+// that retire pages, and from the idle loop so retired pages are reclaimed
+// even once frees stop.
+
+bool epoch_try_reclaim();
@@ -0,0 +1,278 @@
+/*
+ * kernel/mm/fault.c
+ * © suhas pai
+ */
+
+#include "lib/align.h"
+#include "cpu.h"
+
+#include "epoch.h"
+#include "fault.h"
+#include "page_alloc.h"
+#include "pgmap.h"
+#include "walker.h"
+
+static struct page_fault_stats g_stats = {
+    .total = 0,
+    .mapped_page = 0,
+    .mapped_largepage = 0,
+    .mapped_zero_page = 0,
+    .zero_page_copy = 0,
+    .spurious = 0,
+    .bad = 0,
+};
+
+static _Atomic(struct page *) g_zero_page = NULL;
+
+#define stat_inc(field) \
+    atomic_fetch_add_explicit(&g_stats.field, 1, memory_order_relaxed)
+
+// The zero-page keeps the ref it was allocated with for as long as the kernel
+// runs, and every pte pointing to it holds one more, so that unmapping a
+// demand-paged range with free_pages set, or replacing the zero-page on a
+// write-fault, never frees it.
+
+static struct page *get_zero_page() {
+    struct page *page =
+        atomic_load_explicit(&g_zero_page, memory_order_acquire);
+
+    if (__builtin_expect(page != NULL, 1)) {
+        return page;
+    }
+
+    struct page *const new_page = alloc_page(PAGE_STATE_USED, __ALLOC_ZERO);
+    if (new_page == NULL) {
+        return NULL;
+    }
+
+    if (!atomic_compare_exchange_strong_explicit(&g_zero_page,
+                                                 &page,
+                                                 new_page,
+                                                 memory_order_acq_rel,
+                                                 memory_order_acquire))
+    {
+        // Another cpu installed the zero-page before us.
+        free_page(new_page);
+        return page;
+    }
+
+    return new_page;
+}
+
+static bool
+access_allowed(const struct vm_area *const vma, const uint8_t flags) {
+    if (flags & PAGE_FAULT_WRITE) {
+        if ((vma->prot & PROT_WRITE) == 0) {
+            return false;
+        }
+    } else if (flags & PAGE_FAULT_EXEC) {
+        if ((vma->prot & PROT_EXEC) == 0) {
+            return false;
+        }
+    } else if ((vma->prot & PROT_READ) == 0) {
+        return false;
+    }
+
+    if ((flags & PAGE_FAULT_USER) && (vma->prot & PROT_USER) == 0) {
+        return false;
+    }
+
+    return true;
+}
+
+// Returns true if no part of the large-page at `virt_addr` is mapped in, i.e.
+// the pte that would point to it isn't present.
+
+static bool
+largepage_slot_is_empty(struct pagemap *const pagemap,
+                        const uint64_t virt_addr,
+                        const pgt_level_t level)
+{
+    epoch_read_lock();
+
+    struct pt_walker walker;
+    ptwalker_default_for_pagemap(&walker, pagemap, virt_addr);
+
+    bool result = walker.level > level;
+    if (walker.level == level) {
+        const pte_t *const pte =
+            walker.tables[level - 1] + walker.indices[level - 1];
+
+        result = !pte_is_present(pte_read(pte));
+    }
+
+    epoch_read_unlock();
+    return result;
+}
+
+static bool
+try_map_largepage(struct pagemap *const pagemap,
+                  const struct vm_area *const vma,
+                  const uint64_t addr)
+{
+    const pgt_level_t level = LARGEPAGE_LEVEL_2MIB;
+    if (!largepage_level_info_list[level].is_supported) {
+        return false;
+    }
+
+    const uint64_t front = align_down(addr, PAGE_SIZE_2MIB);
+    const struct range largepage_range = RANGE_INIT(front, PAGE_SIZE_2MIB);
+
+    if (!range_has(vma->node.range, largepage_range)) {
+        return false;
+    }
+
+    if (!largepage_slot_is_empty(pagemap, front, level)) {
+        return false;
+    }
+
+    struct page *const page = alloc_large_page(__ALLOC_ZERO, level);
+    if (page == NULL) {
+        return false;
+    }
+
+    const bool result =
+        arch_make_mapping(pagemap,
+                          RANGE_INIT(page_to_phys(page), PAGE_SIZE_2MIB),
+                          front,
+                          vma->prot,
+                          vma->cachekind,
+                          /*is_overwrite=*/false);
+
+    if (!result) {
+        free_large_page(page);
+        return false;
+    }
+
+    stat_inc(mapped_largepage);
+    return true;
+}
+
+static enum page_fault_result
+handle_fault_in_vma(struct pagemap *const pagemap,
+                    const struct vm_area *const vma,
+                    const uint64_t addr,
+                    const uint8_t flags)
+{
+    const uint64_t page_addr = align_down(addr, PAGE_SIZE);
+    struct page *const zero_page = get_zero_page();
+
+    if (zero_page == NULL) {
+        return E_PAGE_FAULT_NO_MEM;
+    }
+
+    const uint64_t zero_phys = page_to_phys(zero_page);
+
+    // Another cpu may have resolved a fault on the same page while we waited
+    // for the vma's lock, in which case there's nothing left to do unless
+    // this is a write to the zero-page.
+
+    bool is_overwrite = false;
+    const uint64_t curr_phys = ptwalker_virt_get_phys(pagemap, page_addr);
+
+    if (curr_phys != INVALID_PHYS) {
+        if ((flags & PAGE_FAULT_WRITE) == 0 || curr_phys != zero_phys) {
+            stat_inc(spurious);
+            return E_PAGE_FAULT_OK;
+        }
+
+        is_overwrite = true;
+    } else if ((flags & PAGE_FAULT_WRITE) &&
+               try_map_largepage(pagemap, vma, addr))
+    {
+        // Only writes are given a large page, so reading through a large vma
+        // stays backed by the zero-page.
+
+        return E_PAGE_FAULT_OK;
+    }
+
+    if ((flags & (PAGE_FAULT_WRITE | PAGE_FAULT_EXEC)) == 0) {
+        ref_up(&zero_page->used.refcount);
+        const bool result =
+            arch_make_mapping(pagemap,
+                              RANGE_INIT(zero_phys, PAGE_SIZE),
+                              page_addr,
+                              vma->prot & (prot_t)~PROT_WRITE,
+                              vma->cachekind,
+                              /*is_overwrite=*/false);
+
+        if (!result) {
+            ref_down(&zero_page->used.refcount);
+            return E_PAGE_FAULT_NO_MEM;
+        }
+
+        stat_inc(mapped_zero_page);
+        return E_PAGE_FAULT_OK;
+    }
+
+    struct page *const page = alloc_page(PAGE_STATE_USED, __ALLOC_ZERO);
+    if (page == NULL) {
+        return E_PAGE_FAULT_NO_MEM;
+    }
+
+    const bool result =
+        arch_make_mapping(pagemap,
+                          RANGE_INIT(page_to_phys(page), PAGE_SIZE),
+                          page_addr,
+                          vma->prot,
+                          vma->cachekind,
+                          is_overwrite);
+
+    if (!result) {
+        free_page(page);
+        return E_PAGE_FAULT_NO_MEM;
+    }
+
+    if (is_overwrite) {
+        stat_inc(zero_page_copy);
+    } else {
+        stat_inc(mapped_page);
+    }
+
+    return E_PAGE_FAULT_OK;
+}
+
+enum page_fault_result
+handle_page_fault(const uint64_t addr, const uint8_t flags) {
+    stat_inc(total);
+
+    struct pagemap *const pagemap =
+        (int64_t)addr < 0 ? &kernel_pagemap : get_cpu_info()->pagemap;
+
+    const int flag = spin_acquire_with_irq(&pagemap->addrspace_lock);
+    struct vm_area *const vma = find_vma(pagemap, addr);
+
+    if (vma == NULL) {
+        spin_release_with_irq(&pagemap->addrspace_lock, flag);
+        stat_inc(bad);
+
+        return E_PAGE_FAULT_NO_VMA;
+    }
+
+    if (!vma->is_demand_paged || !access_allowed(vma, flags)) {
+        spin_release_with_irq(&pagemap->addrspace_lock, flag);
+        stat_inc(bad);
+
+        return E_PAGE_FAULT_BAD_ACCESS;
+    }
+
+    // Interrupts stay disabled from taking the addrspace-lock until the
+    // vma's lock is released, and only then is the original flag restored.
+
+    spin_acquire(&vma->lock);
+    spin_release(&pagemap->addrspace_lock);
+
+    const enum page_fault_result result =
+        handle_fault_in_vma(pagemap, vma, addr, flags);
+
+    spin_release_with_irq(&vma->lock, flag);
+    if (result != E_PAGE_FAULT_OK) {
+        stat_inc(bad);
+    }
+
+    return result;
+}
+
+const struct page_fault_stats *page_fault_get_stats() {
+    return &g_stats;
+}
@@ -0,0 +1,55 @@
+/*
+ * kernel/mm/fault.h
+ * © suhas pai
+ */
+
+#pragma once
+#include <stdatomic.h>
+#include "mm_types.h"
+
+enum page_fault_flags {
+    PAGE_FAULT_WRITE = 1 << 0,
+    PAGE_FAULT_EXEC = 1 << 1,
+    PAGE_FAULT_USER = 1 << 2,
+
+    // The fault was taken on a present pte, i.e. it was a protection fault.
+    PAGE_FAULT_PRESENT = 1 << 3,
+};
+
+enum page_fault_result {
+    E_PAGE_FAULT_OK,
+    E_PAGE_FAULT_NO_VMA,
+    E_PAGE_FAULT_BAD_ACCESS,
+    E_PAGE_FAULT_NO_MEM,
+};
+
+struct page_fault_stats {
+    _Atomic uint64_t total;
+
+    _Atomic uint64_t mapped_page;
+    _Atomic uint64_t mapped_largepage;
+    _Atomic uint64_t mapped_zero_page;
+
+    // Write faults that replaced a mapping of the shared zero-page.
+    _Atomic uint64_t zero_page_copy;
+
+    // Faults on a page that was already mapped in by another cpu.
+    _Atomic uint64_t spurious;
+    _Atomic uint64_t bad;
+};
+
+/*
+ * Handle a fault on `addr` by mapping in memory for the demand-paged vm_area
+ * containing it.
+ *
+ * Read-faults map in a shared, read-only zero-page. Write and exec faults map
+ * in a newly allocated zeroed page. On a write-fault, if the large-page
+ * surrounding `addr` lies entirely inside the vm_area and none of it has been
+ * mapped yet, the whole large-page is mapped in at once instead.
+ *
+ * Faults on addresses in the higher-half are resolved against the kernel's
+ * pagemap, and against the current cpu's pagemap otherwise.
+ */
+
+enum page_fault_result handle_page_fault(uint64_t addr, uint8_t flags);
+const struct page_fault_stats *page_fault_get_stats();
@@ -111,12 +111,7 @@ enum vma_cachekind {
     VMA_CACHEKIND_WRITETHROUGH,
     VMA_CACHEKIND_WRITECOMBINING,
     VMA_CACHEKIND_NO_CACHE,
-
-#if defined(__aarch64__) || defined(__riscv64)
     VMA_CACHEKIND_MMIO,
-#else
-    VMA_CACHEKIND_MMIO = VMA_CACHEKIND_NO_CACHE,
-#endif /* defined(__x86_64__) */
 };
 
 pte_t pte_read(const pte_t *pte);
@@ -125,4 +120,7 @@ void pte_write(pte_t *pte, pte_t value);
 bool pte_flags_equal(pte_t pte, pgt_level_t level, uint64_t flags);
 
 void zero_page(void *page);
-void zero_multiple_pages(void *page, uint64_t count);
\ No newline at end of file
+void zero_multiple_pages(void *page, uint64_t count);
+
+// Copy a page's contents, e.g. when migrating it or breaking copy-on-write.
+void copy_page(void *dst, const void *src);
\ No newline at end of file
@@ -4,6 +4,7 @@
  */
 
 #include "dev/printk.h"
+#include "lib/align.h"
 #include "lib/size.h"
 
 #include "mm/pgmap.h"
@@ -11,6 +12,7 @@
 
 #include "kmalloc.h"
 #include "mmio.h"
+#include "vmalloc.h"
 
 static struct address_space mmio_space = ADDRSPACE_INIT(mmio_space);
 static struct spinlock mmio_space_lock = SPINLOCK_INIT();
@@ -45,13 +47,71 @@ __optimize(3) static inline enum prot_fail verify_prot(const prot_t prot) {
 // 16kib of guard pages
 #define GUARD_PAGE_SIZE min(kib(16), PAGE_SIZE)
 
-struct mmio_region *
+static struct list mmio_cache_list = LIST_INIT(mmio_cache_list);
+
+static struct mmio_region *
+find_cached_region(const struct range phys_range,
+                   const prot_t prot,
+                   const enum vma_cachekind cachekind)
+{
+    struct mmio_region *region = NULL;
+    list_foreach(region, &mmio_cache_list, cache_list) {
+        if (region->phys == phys_range.front &&
+            region->size == phys_range.size &&
+            region->prot == prot &&
+            region->cachekind == cachekind)
+        {
+            return region;
+        }
+    }
+
+    return NULL;
+}
+
+// Returns the largest page-size of which an aligned page fits entirely inside
+// `phys_range`. If the virtual address shares the phys-range's offset inside a
+// page of this size, pgmap_at() maps that part of the range with large pages.
+
+static uint64_t largest_page_size_in(const struct range phys_range) {
+    for (int16_t index = countof(LARGEPAGE_LEVELS) - 1; index >= 0; index--) {
+        const pgt_level_t level = LARGEPAGE_LEVELS[index];
+        if (!largepage_level_info_list[level].is_supported) {
+            continue;
+        }
+
+        const uint64_t page_size = PAGE_SIZE_AT_LEVEL(level);
+        if (phys_range.size < page_size) {
+            continue;
+        }
+
+        uint64_t aligned_front = 0;
+        if (!align_up(phys_range.front, page_size, &aligned_front)) {
+            continue;
+        }
+
+        if (range_has(phys_range, RANGE_INIT(aligned_front, page_size))) {
+            return page_size;
+        }
+    }
+
+    return PAGE_SIZE;
+}
+
+static struct mmio_region *
 map_mmio_region(const struct range phys_range,
                 const prot_t prot,
-                const uint64_t flags)
+                const uint64_t flags,
+                const bool shareable)
 {
     struct range in_range =
-        range_create_end(VMAP_BASE + GUARD_PAGE_SIZE, VMAP_END);
+        range_create_end(VMAP_BASE + GUARD_PAGE_SIZE, VMALLOC_BASE);
+
+    enum vma_cachekind cachekind = VMA_CACHEKIND_MMIO;
+    if (flags & __VMAP_MMIO_WC) {
+        cachekind = VMA_CACHEKIND_WRITECOMBINING;
+    } else if (flags & __VMAP_MMIO_WT) {
+        cachekind = VMA_CACHEKIND_WRITETHROUGH;
+    }
 
     struct mmio_region *const mmio = kmalloc(sizeof(*mmio));
     if (mmio == NULL) {
@@ -62,18 +122,49 @@ map_mmio_region(const struct range phys_range,
         return NULL;
     }
 
+    // Reserve enough space to place the mapping at the same offset inside a
+    // large page as the phys-range has, with the space before it left unmapped.
+
+    const uint64_t page_size = largest_page_size_in(phys_range);
+    const uint64_t page_offset = phys_range.front & (page_size - 1);
+
     mmio->node = ADDRSPACE_NODE_INIT(mmio->node, &mmio_space);
-    mmio->node.range.size = phys_range.size + GUARD_PAGE_SIZE;
+    mmio->node.range.size = page_offset + phys_range.size + GUARD_PAGE_SIZE;
+
+    list_init(&mmio->cache_list);
+
+    mmio->refcount = REFCOUNT_CREATE(1);
+    mmio->phys = phys_range.front;
+    mmio->size = phys_range.size;
+    mmio->prot = prot;
+    mmio->cachekind = cachekind;
+    mmio->flags = 0;
+    mmio->low4g_order = 0;
 
     const int flag = spin_acquire_with_irq(&mmio_space_lock);
-    const uint64_t virt_addr =
+    if (shareable) {
+        struct mmio_region *const cached =
+            find_cached_region(phys_range, prot, cachekind);
+
+        if (cached != NULL) {
+            ref_up(&cached->refcount);
+            spin_release_with_irq(&mmio_space_lock, flag);
+
+            kfree(mmio);
+            return cached;
+        }
+    }
+
+    const uint64_t node_addr =
         addrspace_find_space_and_add_node(&mmio_space,
                                           in_range,
                                           &mmio->node,
-                                          /*align=*/PAGE_SIZE);
+                                          /*align=*/page_size);
 
-    if (virt_addr == ADDRSPACE_INVALID_ADDR) {
+    if (node_addr == ADDRSPACE_INVALID_ADDR) {
         spin_release_with_irq(&mmio_space_lock, flag);
+        kfree(mmio);
+
         printk(LOGLEVEL_WARN,
                "vmap_mmio(): failed to find a suitable virtual-address range "
                "to map phys-range " RANGE_FMT "\n",
@@ -82,18 +173,20 @@ map_mmio_region(const struct range phys_range,
         return NULL;
     }
 
+    const uint64_t virt_addr = node_addr + page_offset;
     const struct range virt_range = RANGE_INIT(virt_addr, phys_range.size);
     const bool map_success =
         arch_make_mapping(&kernel_pagemap,
                           phys_range,
                           virt_addr,
                           prot,
-                          (flags & __VMAP_MMIO_WT) ?
-                            VMA_CACHEKIND_WRITETHROUGH : VMA_CACHEKIND_MMIO,
+                          cachekind,
                           /*is_overwrite=*/false);
 
-    spin_release_with_irq(&mmio_space_lock, flag);
     if (!map_success) {
+        addrspace_remove_node(&mmio->node);
+        spin_release_with_irq(&mmio_space_lock, flag);
+
         kfree(mmio);
         printk(LOGLEVEL_WARN,
                "vmap_mmio(): failed to map phys-range " RANGE_FMT " to virtual "
@@ -104,8 +197,12 @@ map_mmio_region(const struct range phys_range,
         return NULL;
     }
 
+    if (shareable) {
+        list_add(&mmio_cache_list, &mmio->cache_list);
+    }
+
+    spin_release_with_irq(&mmio_space_lock, flag);
     mmio->base = (volatile void *)virt_addr;
-    mmio->size = phys_range.size;
 
     return mmio;
 }
@@ -147,14 +244,20 @@ vmap_mmio_low4g(const prot_t prot, const uint8_t order, const uint64_t flags) {
     }
 
     const struct range phys_range =
-        RANGE_INIT(page_to_phys(page), PAGE_SIZE * order);
+        RANGE_INIT(page_to_phys(page), PAGE_SIZE << order);
+
+    // The pages are ours alone, so never share their mapping.
+    struct mmio_region *const mmio =
+        map_mmio_region(phys_range, prot, flags, /*shareable=*/false);
 
-    struct mmio_region *const mmio = map_mmio_region(phys_range, prot, flags);
     if (mmio == NULL) {
         free_pages(page, order);
         return NULL;
     }
 
+    mmio->flags |= __MMIO_REGION_LOW4G;
+    mmio->low4g_order = order;
+
     return mmio;
 }
 
@@ -200,35 +303,132 @@ vmap_mmio(const struct range phys_range,
             return NULL;
     }
 
-    return map_mmio_region(phys_range, prot, flags);
+    return map_mmio_region(phys_range, prot, flags, /*shareable=*/true);
+}
+
+// Returns the level of the largest page, no larger than `max_page_size`, that
+// pgmap_at() would've mapped at `addr`, i.e. the largest page aligned to
+// `addr` that fits before `end`.
+
+static pgt_level_t
+mapped_level_at(const uint64_t addr,
+                const uint64_t end,
+                const uint64_t max_page_size)
+{
+    pgt_level_t result = 1;
+    for (uint8_t index = 0; index != countof(LARGEPAGE_LEVELS); index++) {
+        const pgt_level_t level = LARGEPAGE_LEVELS[index];
+        const uint64_t page_size = PAGE_SIZE_AT_LEVEL(level);
+
+        if (page_size > max_page_size) {
+            break;
+        }
+
+        if (largepage_level_info_list[level].is_supported &&
+            has_align(addr, page_size) &&
+            end - addr >= page_size)
+        {
+            result = level;
+        }
+    }
+
+    return result;
+}
+
+// pgunmap_at() picks the level to unmap at from the size of the range alone,
+// so unmap the region in runs of pages of the same size, in the same sizes
+// map_mmio_region() mapped them with, and end each run before it reaches the
+// size of the next larger page.
+
+static bool
+unmap_region_pages(const struct mmio_region *const region,
+                   const struct pgunmap_options *const options)
+{
+    const struct range virt_range = mmio_region_get_range(region);
+    const uint64_t max_page_size =
+        largest_page_size_in(RANGE_INIT(region->phys, region->size));
+
+    struct pageop pageop;
+    pageop_init(&pageop, &kernel_pagemap, virt_range);
+
+    const uint64_t end = range_get_end_assert(virt_range);
+    uint64_t addr = virt_range.front;
+
+    bool result = true;
+    while (addr != end) {
+        const pgt_level_t level = mapped_level_at(addr, end, max_page_size);
+        const uint64_t page_size = PAGE_SIZE_AT_LEVEL(level);
+        const uint64_t next_size = PAGE_SIZE_AT_LEVEL(level + 1);
+
+        // Stop at the next boundary of the next larger page, and keep a run
+        // that starts on that boundary a page short of it.
+
+        uint64_t max_run_size = next_size - (addr & (next_size - 1));
+        if (max_run_size == next_size) {
+            max_run_size -= page_size;
+        }
+
+        uint64_t run_end = align_down(end, page_size);
+        if (run_end - addr > max_run_size) {
+            run_end = addr + max_run_size;
+        }
+
+        result =
+            pgunmap_with_pageop(&kernel_pagemap,
+                                range_create_end(addr, run_end),
+                                &pageop,
+                                /*map_options=*/NULL,
+                                options);
+
+        if (!result) {
+            break;
+        }
+
+        addr = run_end;
+    }
+
+    pageop_finish(&pageop);
+    return result;
 }
 
 bool vunmap_mmio(struct mmio_region *const region) {
+    // The pages of a low-4g region are a single higher-order allocation, so
+    // they're freed together below, instead of one at a time by pgunmap.
+
     const struct pgunmap_options options = {
-        .free_pages = region->flags & __MMIO_REGION_LOW4G,
+        .free_pages = false,
         .dont_split_large_pages = true
     };
 
     const struct range virt_range = mmio_region_get_range(region);
 
     const int flag = spin_acquire_with_irq(&mmio_space_lock);
-    const bool result =
-        pgunmap_at(&kernel_pagemap,
-                   virt_range,
-                   /*map_options=*/NULL,
-                   &options);
+    if (!ref_down(&region->refcount)) {
+        spin_release_with_irq(&mmio_space_lock, flag);
+        return true;
+    }
 
+    const bool result = unmap_region_pages(region, &options);
     if (!result) {
+        // Keep the region usable, and in the cache, for its current user.
+        ref_up(&region->refcount);
         spin_release_with_irq(&mmio_space_lock, flag);
+
         printk(LOGLEVEL_WARN,
-               "mm: failed to map mmio region at " RANGE_FMT "\n",
+               "mm: failed to unmap mmio region at " RANGE_FMT "\n",
                RANGE_FMT_ARGS(virt_range));
 
         return false;
     }
 
+    list_remove(&region->cache_list);
     addrspace_remove_node(&region->node);
+
     spin_release_with_irq(&mmio_space_lock, flag);
+    if (region->flags & __MMIO_REGION_LOW4G) {
+        free_pages(phys_to_page(region->phys), region->low4g_order);
+    }
+
     kfree(region);
 
     return true;
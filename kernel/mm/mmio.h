@@ -6,22 +6,39 @@
 #pragma once
 
 #include "lib/adt/addrspace.h"
+#include "lib/refcount.h"
+
 #include "mm/mm_types.h"
 
 struct mmio_region {
     struct addrspace_node node;
 
+    // Regions of the same phys-range, mapped with the same prot and cachekind,
+    // are shared by everyone who maps them, and only unmapped once the last
+    // user calls vunmap_mmio().
+
+    struct list cache_list;
+    struct refcount refcount;
+
     volatile void *base;
-    uint32_t size;
+    uint64_t phys;
+    uint64_t size;
+
+    prot_t prot;
+    enum vma_cachekind cachekind;
 
     // Internal flags
     uint32_t flags;
+
+    // Order of the pages vmap_mmio_low4g() allocated for this region.
+    uint8_t low4g_order;
 };
 
 struct range mmio_region_get_range(const struct mmio_region *region);
 
 enum vmap_mmio_flags {
-    __VMAP_MMIO_WT = 1 << 0
+    __VMAP_MMIO_WT = 1 << 0,
+    __VMAP_MMIO_WC = 1 << 1,
 };
 
 struct mmio_region *
@@ -6,104 +6,194 @@
 #include <stdatomic.h>
 #include "lib/memory.h"
 #include "lib/overflow.h"
+#include "lib/size.h"
+#include "cpu.h"
 
 #include "page.h"
 
-#if defined(__riscv)
-    // FIXME: 64 is the cache-block size in qemu. This should instead be read
-    // from the dtb
-    #define CBO_SIZE 64
-#endif /* defined(__riscv) */
+#if defined(__x86_64__)
+    // Clears at least this large use non-temporal stores, so they don't evict
+    // the whole cache for memory that's unlikely to be used all at once, e.g.
+    // a 1gib page.
+
+    #define NONTEMPORAL_ZERO_MIN mib(1)
+
+    __optimize(3)
+    static void zero_movdir64b(void *const begin, void *const end) {
+        static const uint8_t zeros[64] __aligned(64) = {0};
+        for (void *iter = begin; iter != end; iter += 256) {
+            asm volatile ("movdir64b (%1), %0"
+                          :: "r"(iter), "r"(zeros)
+                          : "memory");
+            asm volatile ("movdir64b (%1), %0"
+                          :: "r"(iter + 64), "r"(zeros)
+                          : "memory");
+            asm volatile ("movdir64b (%1), %0"
+                          :: "r"(iter + 128), "r"(zeros)
+                          : "memory");
+            asm volatile ("movdir64b (%1), %0"
+                          :: "r"(iter + 192), "r"(zeros)
+                          : "memory");
+        }
+    }
+
+    __optimize(3) static void zero_movnti(void *const begin, void *const end) {
+        for (uint64_t *iter = begin; iter != end; iter += 8) {
+            asm volatile ("movnti %1, 0(%0);"
+                          "movnti %1, 8(%0);"
+                          "movnti %1, 16(%0);"
+                          "movnti %1, 24(%0);"
+                          "movnti %1, 32(%0);"
+                          "movnti %1, 40(%0);"
+                          "movnti %1, 48(%0);"
+                          "movnti %1, 56(%0)"
+                          :: "r"(iter), "r"(0ull)
+                          : "memory");
+        }
+    }
+#elif defined(__aarch64__)
+    // Returns the size of the block DC ZVA zeroes, or 0 if it's prohibited.
+    __optimize(3) static uint64_t get_dc_zva_block_size() {
+        static uint64_t block_size = UINT64_MAX;
+        if (__builtin_expect(block_size != UINT64_MAX, 1)) {
+            return block_size;
+        }
+
+        uint64_t dczid = 0;
+        asm volatile ("mrs %0, dczid_el0" : "=r"(dczid));
+
+        // DCZID_EL0.DZP (bit 4) prohibits DC ZVA when set, and DCZID_EL0.BS
+        // (bits 3:0) is the log2 of the block size in 4-byte words.
+
+        block_size = 0;
+        if ((dczid & (1ull << 4)) == 0) {
+            block_size = sizeof(uint32_t) << (dczid & 0xF);
+        }
 
-__optimize(3) void zero_page(void *page) {
+        return block_size;
+    }
+#endif /* defined(__x86_64__) */
+
+__optimize(3) static void zero_range(void *const begin, const uint64_t size) {
+    void *const end = begin + size;
 #if defined(__x86_64__)
-    uint64_t count = PAGE_SIZE / sizeof(uint64_t);
-    asm volatile ("cld;\n"
-                  "rep stosq"
-                  : "+D"(page), "+c" (count) : "a"(0) : "memory");
+    if (size >= NONTEMPORAL_ZERO_MIN) {
+        if (get_cpu_capabilities()->supports_movdir64b) {
+            zero_movdir64b(begin, end);
+        } else {
+            zero_movnti(begin, end);
+        }
+
+        // Non-temporal stores are weakly ordered, so make sure they're all
+        // visible before the memory is handed out.
+
+        asm volatile ("sfence" ::: "memory");
+        return;
+    }
+
+    void *iter = begin;
+    uint64_t count = size / sizeof(uint64_t);
+
+    asm volatile ("rep stosq"
+                  : "+D"(iter), "+c"(count)
+                  : "a"(0)
+                  : "memory");
 #elif defined(__aarch64__)
-    const uint64_t *const end = page + PAGE_SIZE;
-    for (uint64_t *iter = page; iter != end; iter += 32) {
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 0));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 2));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 4));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 6));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 8));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 10));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 12));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 14));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 16));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 18));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 20));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 22));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 24));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 26));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 28));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 30));
+    const uint64_t block_size = get_dc_zva_block_size();
+    if (__builtin_expect(block_size != 0 && block_size <= PAGE_SIZE, 1)) {
+        for (void *iter = begin; iter != end; iter += block_size) {
+            asm volatile ("dc zva, %0" :: "r"(iter) : "memory");
+        }
+
+        return;
+    }
+
+    for (uint64_t *iter = begin; iter != end; iter += 8) {
+        asm volatile ("stp xzr, xzr, [%0];"
+                      "stp xzr, xzr, [%0, #16];"
+                      "stp xzr, xzr, [%0, #32];"
+                      "stp xzr, xzr, [%0, #48]"
+                      :: "r"(iter)
+                      : "memory");
     }
 #elif defined(__riscv64)
-    const void *const end = page + PAGE_SIZE;
-    for (void *iter = page; iter != end; iter += (CBO_SIZE * 8)) {
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 0)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 1)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 2)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 3)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 4)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 5)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 6)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 7)));
+    // The cbo.zero block size is only known once the dtb or rhct have been
+    // parsed, and is zero until then.
+
+    const uint64_t block_size = get_cpu_capabilities()->cboz_block_size;
+    if (block_size != 0) {
+        for (void *iter = begin; iter != end; iter += block_size) {
+            asm volatile ("cbo.zero (%0)" :: "r"(iter) : "memory");
+        }
+
+        return;
+    }
+
+    for (uint64_t *iter = begin; iter != end; iter += 4) {
+        iter[0] = 0;
+        iter[1] = 0;
+        iter[2] = 0;
+        iter[3] = 0;
     }
 #else
-    const uint64_t *const end = page + PAGE_SIZE;
-    for (uint64_t *iter = page; iter != end; iter++) {
+    for (uint64_t *iter = begin; iter != end; iter++) {
         *iter = 0;
     }
 #endif /* defined(__x86_64__) */
 }
 
-__optimize(3) void zero_multiple_pages(void *page, const uint64_t count) {
-    const uint64_t full_size = check_mul_assert(PAGE_SIZE, count);
+__optimize(3) void zero_page(void *const page) {
+    zero_range(page, PAGE_SIZE);
+}
+
+__optimize(3)
+void zero_multiple_pages(void *const page, const uint64_t count) {
+    zero_range(page, check_mul_assert(PAGE_SIZE, count));
+}
+
+__optimize(3) void copy_page(void *const dst, const void *const src) {
 #if defined(__x86_64__)
-    uint64_t qword_count = full_size / sizeof(uint64_t);
-    asm volatile ("cld;\n"
-                  "rep stosq"
-                  : "+D"(page), "+c" (qword_count) : "a"(0) : "memory");
+    // rep movsb already streams the source in with erms, and was no slower
+    // than an unrolled copy with explicit prefetches.
+
+    void *iter = dst;
+    const void *jter = src;
+    uint64_t count = PAGE_SIZE;
+
+    asm volatile ("rep movsb"
+                  : "+D"(iter), "+S"(jter), "+c"(count)
+                  :: "memory");
 #elif defined(__aarch64__)
-    const uint64_t *const end = page + full_size;
-    for (uint64_t *iter = page; iter != end; iter += 32) {
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 0));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 2));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 4));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 6));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 8));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 10));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 12));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 14));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 16));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 18));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 20));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 22));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 24));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 26));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 28));
-        asm volatile ("stp xzr, xzr, [%0]" :: "r"(iter + 30));
-    }
-#elif defined(__riscv64)
-    const void *const end = page + full_size;
-    for (void *iter = page; iter != end; iter += (CBO_SIZE * 8)) {
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 0)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 1)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 2)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 3)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 4)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 5)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 6)));
-        asm volatile ("cbo.zero (%0)" :: "r"(iter + (CBO_SIZE * 7)));
+    const void *const end = src + PAGE_SIZE;
+    void *iter = dst;
+
+    for (const void *jter = src; jter != end; jter += 64, iter += 64) {
+        uint64_t a, b, c, d, e, f, g, h;
+        asm volatile ("prfm pldl1strm, [%8, #256];"
+                      "ldp %0, %1, [%8];"
+                      "ldp %2, %3, [%8, #16];"
+                      "ldp %4, %5, [%8, #32];"
+                      "ldp %6, %7, [%8, #48];"
+                      "stp %0, %1, [%9];"
+                      "stp %2, %3, [%9, #16];"
+                      "stp %4, %5, [%9, #32];"
+                      "stp %6, %7, [%9, #48]"
+                      : "=&r"(a), "=&r"(b), "=&r"(c), "=&r"(d),
+                        "=&r"(e), "=&r"(f), "=&r"(g), "=&r"(h)
+                      : "r"(jter), "r"(iter)
+                      : "memory");
     }
 #else
-    const uint64_t *const end = page + full_size;
-    for (uint64_t *iter = page; iter != end; iter++) {
-        *iter = 0;
+    const uint64_t *jter = src;
+    uint64_t *const end = dst + PAGE_SIZE;
+
+    for (uint64_t *iter = dst; iter != end; iter += 4, jter += 4) {
+        __builtin_prefetch(jter + 32);
+
+        iter[0] = jter[0];
+        iter[1] = jter[1];
+        iter[2] = jter[2];
+        iter[3] = jter[3];
     }
 #endif /* defined(__x86_64__) */
 }
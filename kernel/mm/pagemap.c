@@ -24,7 +24,9 @@ __hidden struct pagemap kernel_pagemap = {
     .cpu_lock = SPINLOCK_INIT(),
     .addrspace = ADDRSPACE_INIT(kernel_pagemap.addrspace),
     .addrspace_lock = SPINLOCK_INIT(),
+    .last_vma = NULL,
     .refcount = REFCOUNT_CREATE_MAX(),
+    .xlate_gen = 0,
 };
 
 #if defined(__aarch64__)
@@ -73,7 +75,7 @@ pagemap_find_space_and_add_vma(struct pagemap *const pagemap,
         return false;
     }
 
-    if (vma->prot == PROT_NONE) {
+    if (vma->prot == PROT_NONE || vma->is_demand_paged) {
         spin_release_with_irq(&pagemap->addrspace_lock, flag);
         return true;
     }
@@ -109,7 +111,7 @@ pagemap_add_vma(struct pagemap *const pagemap,
     }
 
     spin_release_with_irq(&pagemap->addrspace_lock, flag);
-    if (vma->prot == PROT_NONE) {
+    if (vma->prot == PROT_NONE || vma->is_demand_paged) {
         return true;
     }
 
@@ -126,6 +128,52 @@ pagemap_add_vma(struct pagemap *const pagemap,
     return map_result;
 }
 
+bool
+pagemap_unmap_range(struct pagemap *const pagemap,
+                    const struct range range,
+                    const struct pgunmap_options *const options)
+{
+    const uint64_t range_end = range_get_end_assert(range);
+
+    bool result = true;
+    struct vm_area *vma = NULL;
+
+    const int flag = spin_acquire_with_irq(&pagemap->addrspace_lock);
+    vma_foreach_in_range(vma, pagemap, range) {
+        // PROT_NONE vm_areas only reserve their range, and were never mapped.
+        if (vma->prot == PROT_NONE) {
+            continue;
+        }
+
+        const uint64_t front = max(vma->node.range.front, range.front);
+        const uint64_t end =
+            min(range_get_end_assert(vma->node.range), range_end);
+
+        if (!arch_unmap_mapping(pagemap,
+                                range_create_end(front, end),
+                                /*map_options=*/NULL,
+                                options))
+        {
+            result = false;
+        }
+    }
+
+    spin_release_with_irq(&pagemap->addrspace_lock, flag);
+    return result;
+}
+
+void
+pagemap_remove_vma(struct pagemap *const pagemap, struct vm_area *const vma) {
+    const int flag = spin_acquire_with_irq(&pagemap->addrspace_lock);
+
+    addrspace_remove_node(&vma->node);
+    if (pagemap->last_vma == vma) {
+        pagemap->last_vma = NULL;
+    }
+
+    spin_release_with_irq(&pagemap->addrspace_lock, flag);
+}
+
 void switch_to_pagemap(struct pagemap *const pagemap) {
 #if defined(__aarch64__)
     assert(pagemap->lower_root != NULL);
@@ -24,6 +24,14 @@ struct pagemap {
 
     struct address_space addrspace;
     struct spinlock addrspace_lock;
+
+    // The vm_area last returned by find_vma(), checked before searching the
+    // address-space. Guarded by addrspace_lock.
+    struct vm_area *last_vma;
+
+    // Bumped by pageop_finish() to invalidate every cpu's xlate_cache entries
+    // for this pagemap.
+    _Atomic uint64_t xlate_gen;
 };
 
 #if defined(__aarch64__)
@@ -46,4 +54,18 @@ pagemap_add_vma(struct pagemap *pagemap,
                 struct vm_area *vma,
                 uint64_t phys_addr);
 
+struct pgunmap_options;
+
+// Unmaps the part of `range` covered by each vm_area overlapping it, leaving
+// the vm_areas in the pagemap's address-space. Returns false if any part of
+// a vm_area failed to unmap.
+
+bool
+pagemap_unmap_range(struct pagemap *pagemap,
+                    struct range range,
+                    const struct pgunmap_options *options);
+
+// Removes `vma` from the pagemap's address-space without unmapping it.
+void pagemap_remove_vma(struct pagemap *pagemap, struct vm_area *vma);
+
 void switch_to_pagemap(struct pagemap *pagemap);
\ No newline at end of file
@@ -11,10 +11,12 @@
 
 #include "cpu.h"
 
+#include "epoch.h"
 #include "pagemap.h"
 #include "page_alloc.h"
 
 #include "walker.h"
+#include "xlate_cache.h"
 
 __optimize(3) void
 pageop_init(struct pageop *const pageop,
@@ -132,10 +134,16 @@ pageop_setup_for_range(struct pageop *const pageop, const struct range virt) {
 }
 
 __optimize(3) static void free_all_pages(struct pageop *const pageop) {
-    struct page *iter = NULL;
-    list_foreach(iter, &pageop->delayed_free, table.delayed_free_list) {
-        free_page(iter);
+    // Lockless page-table walkers may still be reading the pages we unmapped,
+    // so hand them off to be freed once every cpu has passed a quiescent
+    // point.
+
+    if (list_empty(&pageop->delayed_free)) {
+        return;
     }
+
+    epoch_defer_free_pages(&pageop->delayed_free);
+    epoch_try_reclaim();
 }
 
 __optimize(3) void pageop_finish(struct pageop *const pageop) {
@@ -144,6 +152,8 @@ __optimize(3) void pageop_finish(struct pageop *const pageop) {
         return;
     }
 
+    xlate_cache_invalidate_pagemap(pageop->pagemap);
+
     if (get_cpu_info()->pagemap == pageop->pagemap) {
     #if defined(__x86_64__)
         tlb_flush_pageop(pageop);
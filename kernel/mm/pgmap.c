@@ -8,6 +8,7 @@
 
 #include "mm/early.h"
 #include "mm/pageop.h"
+#include "mm/table_pool.h"
 #include "mm/walker.h"
 
 #include "pgmap.h"
@@ -146,6 +147,17 @@ enum override_result {
     OVERRIDE_DONE
 };
 
+__optimize(3) static inline void
+ref_table_for_new_ptes(pte_t *const table,
+                       const uint64_t count,
+                       const bool should_ref)
+{
+    if (should_ref && count != 0) {
+        refcount_increment(&virt_to_page(table)->table.refcount,
+                           (int32_t)count);
+    }
+}
+
 static enum override_result
 override_pte(struct pt_walker *const walker,
              struct current_split_info *const curr_split,
@@ -188,22 +200,28 @@ override_pte(struct pt_walker *const walker,
                 panic("mm: failed to pgmap, result=%d\n", ptwalker_result);
             }
 
-            pte_t *const pte =
-                &walker->tables[level - 1][walker->indices[level - 1]];
+            pte_t *const table = walker->tables[level - 1];
+            pte_write(&table[walker->indices[level - 1]], new_pte_value);
 
-            pte_write(pte, new_pte_value);
+            ref_table_for_new_ptes(table,
+                                   /*count=*/1,
+                                   /*should_ref=*/!options->is_in_early);
             return OVERRIDE_OK;
         }
 
         const pgt_index_t index = walker->indices[walker->level - 1];
         entry = pte_read(&walker->tables[walker->level - 1][index]);
     } else {
-        pte_t *const pte =
-            &walker->tables[level - 1][walker->indices[level - 1]];
+        pte_t *const table = walker->tables[level - 1];
+        pte_t *const pte = &table[walker->indices[level - 1]];
 
         entry = pte_read(pte);
         if (!pte_is_present(entry)) {
             pte_write(pte, new_pte_value);
+            ref_table_for_new_ptes(table,
+                                   /*count=*/1,
+                                   /*should_ref=*/!options->is_in_early);
+
             return OVERRIDE_OK;
         }
     }
@@ -238,175 +256,188 @@ override_pte(struct pt_walker *const walker,
     }
 
     if (level < walker->level) {
+        // Splitting the large page clears its pte and drops the table's ref
+        // for it, so the tables down to `level` have to be filled back in, and
+        // the new pte is a new entry in its table.
+
         split_large_page(walker, pageop, curr_split, level, options);
-    } else {
-        //pageop_flush_address(virt_begin + *offset_in);
+
+        const bool should_ref = !options->is_in_early;
+        const enum pt_walker_result ptwalker_result =
+            ptwalker_fill_in_to(walker,
+                                level,
+                                should_ref,
+                                options->alloc_pgtable_cb_info,
+                                options->free_pgtable_cb_info);
+
+        if (__builtin_expect(ptwalker_result != E_PT_WALKER_OK, 0)) {
+            panic("mm: failed to pgmap, result=%d\n", ptwalker_result);
+        }
+
+        pte_t *const table = walker->tables[level - 1];
+        pte_write(&table[walker->indices[level - 1]], new_pte_value);
+
+        ref_table_for_new_ptes(table, /*count=*/1, should_ref);
+        return OVERRIDE_OK;
     }
 
+    // The pte stays present, so the table's refcount is unchanged, but the
+    // page it pointed to loses its ref.
+
     pte_t *const pte = &walker->tables[level - 1][walker->indices[level - 1]];
     pte_write(pte, new_pte_value);
 
+    if (options->free_pages) {
+        pageop_flush_pte_in_current_range(pageop,
+                                          entry,
+                                          level,
+                                          options->free_pages);
+    }
+
     return OVERRIDE_OK;
 }
 
+__optimize(3) static uint64_t
+overwrite_pte_run(struct pageop *const pageop,
+                  pte_t *pte,
+                  const pte_t *const end,
+                  uint64_t phys_addr,
+                  const struct pgmap_options *const options)
+{
+    const uint64_t pte_flags = options->pte_flags;
+    const bool should_free_pages = options->free_pages;
+
+    uint64_t new_count = 0;
+    for (; pte != end; pte++, phys_addr += PAGE_SIZE) {
+        const pte_t entry = pte_read(pte);
+        if (!pte_is_present(entry)) {
+            pte_write(pte,
+                      phys_create_pte(phys_addr) | PTE_LEAF_FLAGS | pte_flags);
+
+            new_count++;
+            continue;
+        }
+
+        // Avoid overwriting if we have a page that's already mapped with the
+        // same flags.
+
+        if (pte_to_phys(entry) == phys_addr &&
+            pte_flags_equal(entry, /*level=*/1, pte_flags))
+        {
+            continue;
+        }
+
+        pte_write(pte, phys_create_pte(phys_addr) | PTE_LEAF_FLAGS | pte_flags);
+        if (should_free_pages) {
+            pageop_flush_pte_in_current_range(pageop,
+                                              entry,
+                                              /*level=*/1,
+                                              should_free_pages);
+        }
+    }
+
+    return new_count;
+}
+
 __optimize(3) enum map_result
 map_normal(struct pt_walker *const walker,
-           struct current_split_info *const curr_split,
            struct pageop *const pageop,
            const uint64_t phys_begin,
-           const uint64_t virt_begin,
            uint64_t *const offset_in,
            const uint64_t size,
            const struct pgmap_options *const options)
 {
-    uint64_t offset = *offset_in;
+    const uint64_t offset = *offset_in;
     if (__builtin_expect(offset >= size, 0)) {
         return MAP_DONE;
     }
 
     const bool should_ref = !options->is_in_early;
+    const bool is_overwrite = options->is_overwrite;
     const uint64_t pte_flags = options->pte_flags;
 
     void *const alloc_pgtable_cb_info = options->alloc_pgtable_cb_info;
     void *const free_pgtable_cb_info = options->free_pgtable_cb_info;
 
-    enum pt_walker_result ptwalker_result = E_PT_WALKER_OK;
-    if (options->is_overwrite) {
-        do {
-            ptwalker_result =
-                ptwalker_fill_in_to(walker,
-                                    /*level=*/1,
-                                    should_ref,
-                                    alloc_pgtable_cb_info,
-                                    free_pgtable_cb_info);
-
-            if (__builtin_expect(ptwalker_result != E_PT_WALKER_OK, 0)) {
-            panic:
-                panic("mm: failed to pgmap, result=%d\n", ptwalker_result);
-            }
+    uint64_t phys_addr = phys_begin + offset;
+    const uint64_t phys_end = phys_begin + size;
 
-            do {
-                const pte_t new_pte_value =
-                    phys_create_pte(phys_begin + offset) |
-                    PTE_LEAF_FLAGS |
-                    pte_flags;
-
-                const enum override_result override_result =
-                    override_pte(walker,
-                                 curr_split,
-                                 pageop,
-                                 phys_begin,
-                                 virt_begin,
-                                 &offset,
-                                 size,
-                                 /*level=*/1,
-                                 new_pte_value,
-                                 options);
+    do {
+        enum pt_walker_result ptwalker_result =
+            ptwalker_fill_in_to(walker,
+                                /*level=*/1,
+                                should_ref,
+                                alloc_pgtable_cb_info,
+                                free_pgtable_cb_info);
 
-                switch (override_result) {
-                    case OVERRIDE_OK:
-                        break;
-                    case OVERRIDE_DONE:
-                        return MAP_DONE;
-                }
+        if (__builtin_expect(ptwalker_result != E_PT_WALKER_OK, 0)) {
+        panic:
+            panic("mm: failed to pgmap, result=%d\n", ptwalker_result);
+        }
 
-                ptwalker_result =
-                    ptwalker_next_with_options(walker,
-                                               /*level=*/1,
-                                               /*alloc_parents=*/false,
-                                               /*alloc_level=*/false,
-                                               should_ref,
-                                               alloc_pgtable_cb_info,
-                                               free_pgtable_cb_info);
+        // The leaf table is resident, so fill in the run of ptes up to the end
+        // of either the table or the range without going through the walker,
+        // and ref the table once for all the ptes we added.
 
-                if (__builtin_expect(ptwalker_result != E_PT_WALKER_OK, 0)) {
-                    goto panic;
-                }
+        pte_t *const table = walker->tables[0];
+        pte_t *const begin = &table[walker->indices[0]];
+        const pte_t *const end = &table[PGT_PTE_COUNT];
 
-                offset += PAGE_SIZE;
-                if (offset == size) {
-                    *offset_in = offset;
-                    return MAP_DONE;
-                }
+        const uint64_t run_count =
+            min((uint64_t)(end - begin), PAGE_COUNT(phys_end - phys_addr));
 
-                if (walker->indices[0] == 0) {
-                    // Exit if the level above is at index 0, which may mean
-                    // that a large page can be placed at the higher level.
+        pte_t *const run_end = begin + run_count;
+        if (is_overwrite) {
+            const uint64_t new_count =
+                overwrite_pte_run(pageop, begin, run_end, phys_addr, options);
 
-                    if (walker->indices[1] == 0) {
-                        *offset_in = offset;
-                        return MAP_RESTART;
-                    }
+            ref_table_for_new_ptes(table, new_count, should_ref);
+            phys_addr += run_count * PAGE_SIZE;
+        } else {
+            for (pte_t *pte = begin; pte != run_end; pte++) {
+                const pte_t new_pte_value =
+                    phys_create_pte(phys_addr) | PTE_LEAF_FLAGS | pte_flags;
 
-                    break;
-                }
-            } while (true);
-        } while (true);
-    } else {
-        uint64_t phys_addr = phys_begin + offset;
-        const uint64_t phys_end = phys_begin + size;
+                pte_write(pte, new_pte_value);
+                phys_addr += PAGE_SIZE;
+            }
 
-        do {
-            ptwalker_result =
-                ptwalker_fill_in_to(walker,
-                                    /*level=*/1,
-                                    should_ref,
-                                    options->alloc_pgtable_cb_info,
-                                    options->free_pgtable_cb_info);
+            ref_table_for_new_ptes(table, run_count, should_ref);
+        }
 
-            if (__builtin_expect(ptwalker_result != E_PT_WALKER_OK, 0)) {
-                panic("mm: failed to pgmap, result=%d\n", ptwalker_result);
-            }
+        if (run_end != end) {
+            walker->indices[0] = run_end - table;
+            *offset_in = phys_addr - phys_begin;
 
-            pte_t *const table = walker->tables[0];
-            pte_t *pte = &table[walker->indices[0]];
-            const pte_t *const end = &table[PGT_PTE_COUNT];
+            return MAP_DONE;
+        }
 
-            do {
-                const pte_t new_pte_value =
-                    phys_create_pte(phys_addr) | PTE_LEAF_FLAGS | pte_flags;
+        walker->indices[0] = PGT_PTE_COUNT - 1;
+        ptwalker_result =
+            ptwalker_next_with_options(walker,
+                                       /*level=*/1,
+                                       /*alloc_parents=*/false,
+                                       /*alloc_level=*/false,
+                                       should_ref,
+                                       alloc_pgtable_cb_info,
+                                       free_pgtable_cb_info);
 
-                pte_write(pte, new_pte_value);
+        if (__builtin_expect(ptwalker_result != E_PT_WALKER_OK, 0)) {
+            goto panic;
+        }
 
-                phys_addr += PAGE_SIZE;
-                pte++;
-
-                if (pte == end) {
-                    walker->indices[0] = PGT_PTE_COUNT - 1;
-                    ptwalker_result =
-                        ptwalker_next_with_options(walker,
-                                                   /*level=*/1,
-                                                   /*alloc_parents=*/false,
-                                                   /*alloc_level=*/false,
-                                                   should_ref,
-                                                   alloc_pgtable_cb_info,
-                                                   free_pgtable_cb_info);
-
-                    if (__builtin_expect(ptwalker_result != E_PT_WALKER_OK, 0))
-                    {
-                        goto panic;
-                    }
-
-                    // Exit if the level above is at index 0, which may mean
-                    // that a large page can be placed at the higher level.
-
-                    if (walker->indices[1] == 0) {
-                        *offset_in = phys_addr - phys_begin;
-                        return MAP_RESTART;
-                    }
-
-                    break;
-                }
+        *offset_in = phys_addr - phys_begin;
+        if (phys_addr == phys_end) {
+            return MAP_DONE;
+        }
 
-                if (phys_addr == phys_end) {
-                    walker->indices[0] = pte - table;
-                    *offset_in = phys_addr - phys_begin;
+        // Exit if the level above is at index 0, which may mean that a large
+        // page can be placed at the higher level.
 
-                    return MAP_DONE;
-                }
-            } while (true);
-        } while (true);
-    }
+        if (walker->indices[1] == 0) {
+            return MAP_RESTART;
+        }
+    } while (true);
 }
 
 __optimize(3) enum map_result
@@ -499,12 +530,14 @@ map_large_at_top_level_no_overwrite(struct pt_walker *const walker,
     pte_t *const table = walker->tables[level - 1];
     pte_t *pte = &table[walker->indices[level - 1]];
 
+    uint64_t count = 0;
     do {
         const pte_t new_pte_value =
             phys_create_pte(phys_addr) | PTE_LARGE_FLAGS(level) | pte_flags;
 
         pte_write(pte, new_pte_value);
         phys_addr += largepage_size;
+        count++;
 
         if (phys_addr == phys_end) {
             break;
@@ -513,6 +546,7 @@ map_large_at_top_level_no_overwrite(struct pt_walker *const walker,
         pte++;
     } while (phys_addr + largepage_size <= phys_end);
 
+    ref_table_for_new_ptes(table, count, /*should_ref=*/!options->is_in_early);
     walker->indices[level - 1] = pte - table;
     *offset_in = phys_addr - phys_begin;
 
@@ -647,7 +681,8 @@ map_large_at_level_no_overwrite(struct pt_walker *const walker,
         }
 
         pte_t *const table = walker->tables[level - 1];
-        pte_t *pte = &table[walker->indices[level - 1]];
+        pte_t *const begin = &table[walker->indices[level - 1]];
+        pte_t *pte = begin;
         const pte_t *const end = &table[PGT_PTE_COUNT];
 
         do {
@@ -658,6 +693,10 @@ map_large_at_level_no_overwrite(struct pt_walker *const walker,
             phys_addr += largepage_size;
 
             if (phys_addr == phys_end) {
+                ref_table_for_new_ptes(table,
+                                       (uint64_t)(pte - begin + 1),
+                                       should_ref);
+
                 walker->indices[level - 1] = pte - table;
                 *offset_in = phys_addr - phys_begin;
 
@@ -666,6 +705,10 @@ map_large_at_level_no_overwrite(struct pt_walker *const walker,
 
             pte++;
             if (pte == end) {
+                ref_table_for_new_ptes(table,
+                                       (uint64_t)(end - begin),
+                                       should_ref);
+
                 walker->indices[level - 1] = PGT_PTE_COUNT - 1;
                 ptwalker_result =
                     ptwalker_next_with_options(walker,
@@ -692,6 +735,9 @@ map_large_at_level_no_overwrite(struct pt_walker *const walker,
             }
 
             if (phys_addr + largepage_size > phys_end) {
+                ref_table_for_new_ptes(table,
+                                       (uint64_t)(pte - begin),
+                                       should_ref);
                 walker->indices[level - 1] = pte - table;
                 *offset_in = phys_addr - phys_begin;
 
@@ -829,10 +875,8 @@ pgmap_with_ptwalker(struct pt_walker *const walker,
 
         const enum map_result result =
             map_normal(walker,
-                       curr_split,
                        pageop,
                        phys_range.front,
-                       virt_begin,
                        &offset,
                        phys_range.size,
                        options);
@@ -855,6 +899,56 @@ pgmap_with_ptwalker(struct pt_walker *const walker,
     return true;
 }
 
+// Returns an upper bound on the number of tables needed to map `phys_range` at
+// `virt_range`. A level only needs tables for the unaligned head and tail of
+// the range if the level above it can hold large pages for the rest, and the
+// table holding the first address isn't counted at any level it's already
+// present at.
+
+__optimize(3) static uint64_t
+tables_needed_for_range(struct pagemap *const pagemap,
+                        const struct range phys_range,
+                        const struct range virt_range,
+                        const struct pgmap_options *const options)
+{
+    struct pt_walker walker;
+    ptwalker_default_for_pagemap(&walker, pagemap, virt_range.front);
+
+    const uint64_t first = virt_range.front;
+    const uint64_t last = virt_range.front + (virt_range.size - 1);
+
+    uint64_t result = 0;
+    for (pgt_level_t level = 1; level < walker.top_level; level++) {
+        // A table at `level` covers the size of a page one level above.
+        const uint8_t shift = PAGE_SHIFTS[level];
+        uint64_t count = (last >> shift) - (first >> shift) + 1;
+
+        // Large pages at the level above can only be used if the phys and virt
+        // addresses share the same offset into one.
+
+        const uint64_t mask = options->supports_largepage_at_level_mask;
+        if ((mask & (1ull << (level + 1))) != 0 &&
+            has_align(phys_range.front - virt_range.front, 1ull << shift))
+        {
+            count = min(count, (uint64_t)2);
+        }
+
+        if (walker.level <= level) {
+            count--;
+        }
+
+        result += count;
+    }
+
+    return result;
+}
+
+static bool
+map_range(struct pagemap *pagemap,
+          struct range phys_range,
+          uint64_t virt_addr,
+          const struct pgmap_options *options);
+
 bool
 pgmap_at(struct pagemap *const pagemap,
          struct range phys_range,
@@ -878,7 +972,7 @@ pgmap_at(struct pagemap *const pagemap,
         return false;
     }
 
-    struct range virt_range = RANGE_INIT(virt_addr, phys_range.size);
+    const struct range virt_range = RANGE_INIT(virt_addr, phys_range.size);
     if (__builtin_expect(range_overflows(virt_range), 0)) {
         printk(LOGLEVEL_WARN,
                "pgmap_at(): virt-range goes beyond end of address-space\n");
@@ -891,6 +985,149 @@ pgmap_at(struct pagemap *const pagemap,
         return false;
     }
 
+    if (options->is_in_early || options->alloc_pgtable_cb_info != NULL) {
+        return map_range(pagemap, phys_range, virt_addr, options);
+    }
+
+    // Reserve every table we may need before touching the page tables, so we
+    // neither stall on the buddy allocator nor fail halfway through.
+
+    const uint64_t table_count =
+        tables_needed_for_range(pagemap, phys_range, virt_range, options);
+
+    if (table_count == 0) {
+        return map_range(pagemap, phys_range, virt_addr, options);
+    }
+
+    struct table_reserve reserve = TABLE_RESERVE_INIT(reserve);
+    if (!table_pool_take(&reserve, table_count)) {
+        printk(LOGLEVEL_WARN, "pgmap_at(): failed to reserve page-tables\n");
+        return false;
+    }
+
+    struct pgmap_options reserve_options = *options;
+    reserve_options.alloc_pgtable_cb_info = &reserve;
+
+    const bool result =
+        map_range(pagemap, phys_range, virt_addr, &reserve_options);
+
+    table_pool_give_back(&reserve);
+    if (table_pool_needs_refill()) {
+        table_pool_refill();
+    }
+
+    return result;
+}
+
+bool
+pgmap_pages_at(struct pagemap *const pagemap,
+               struct list *const pages,
+               const uint64_t virt_addr,
+               const uint64_t size,
+               const struct pgmap_options *const options)
+{
+    const struct range virt_range = RANGE_INIT(virt_addr, size);
+    if (__builtin_expect(range_empty(virt_range), 0)) {
+        printk(LOGLEVEL_WARN, "pgmap_pages_at(): virt-range is empty\n");
+        return false;
+    }
+
+    if (__builtin_expect(range_overflows(virt_range), 0)) {
+        printk(LOGLEVEL_WARN,
+               "pgmap_pages_at(): virt-range goes beyond end of "
+               "address-space\n");
+        return false;
+    }
+
+    if (__builtin_expect(!range_has_align(virt_range, PAGE_SIZE), 0)) {
+        printk(LOGLEVEL_WARN,
+               "pgmap_pages_at(): virt-range isn't aligned to PAGE_SIZE\n");
+        return false;
+    }
+
+    assert(!options->is_in_early && !options->is_overwrite);
+
+    // The pages aren't contiguous, so every one of them is mapped with a leaf
+    // pte, and every leaf table in the range may be needed.
+
+    struct pgmap_options page_options = *options;
+    page_options.supports_largepage_at_level_mask = 0;
+
+    struct table_reserve reserve = TABLE_RESERVE_INIT(reserve);
+    const uint64_t table_count =
+        tables_needed_for_range(pagemap,
+                                /*phys_range=*/virt_range,
+                                virt_range,
+                                &page_options);
+
+    if (!table_pool_take(&reserve, table_count)) {
+        printk(LOGLEVEL_WARN,
+               "pgmap_pages_at(): failed to reserve page-tables\n");
+        return false;
+    }
+
+    struct pt_walker walker;
+    ptwalker_default_for_pagemap(&walker, pagemap, virt_addr);
+
+    const uint64_t pte_flags = options->pte_flags;
+    uint64_t count = PAGE_COUNT(size);
+
+    struct page *page = NULL;
+    list_foreach(page, pages, used.delayed_free_list) {
+        enum pt_walker_result ptwalker_result =
+            ptwalker_fill_in_to(&walker,
+                                /*level=*/1,
+                                /*should_ref=*/true,
+                                &reserve,
+                                options->free_pgtable_cb_info);
+
+        if (__builtin_expect(ptwalker_result != E_PT_WALKER_OK, 0)) {
+        panic:
+            panic("mm: failed to pgmap, result=%d\n", ptwalker_result);
+        }
+
+        pte_t *const table = walker.tables[0];
+        const pte_t new_pte_value =
+            phys_create_pte(page_to_phys(page)) | PTE_LEAF_FLAGS | pte_flags;
+
+        pte_write(&table[walker.indices[0]], new_pte_value);
+        ref_table_for_new_ptes(table, /*count=*/1, /*should_ref=*/true);
+
+        count--;
+        if (count == 0) {
+            break;
+        }
+
+        ptwalker_result =
+            ptwalker_next_with_options(&walker,
+                                       /*level=*/1,
+                                       /*alloc_parents=*/false,
+                                       /*alloc_level=*/false,
+                                       /*should_ref=*/true,
+                                       &reserve,
+                                       options->free_pgtable_cb_info);
+
+        if (__builtin_expect(ptwalker_result != E_PT_WALKER_OK, 0)) {
+            goto panic;
+        }
+    }
+
+    table_pool_give_back(&reserve);
+    if (table_pool_needs_refill()) {
+        table_pool_refill();
+    }
+
+    return true;
+}
+
+static bool
+map_range(struct pagemap *const pagemap,
+          struct range phys_range,
+          uint64_t virt_addr,
+          const struct pgmap_options *const options)
+{
+    const struct range virt_range = RANGE_INIT(virt_addr, phys_range.size);
+
     struct pt_walker walker;
     if (options->is_in_early) {
         ptwalker_create_for_pagemap(&walker,
@@ -984,11 +1221,59 @@ pgmap_at(struct pagemap *const pagemap,
     return result;
 }
 
+// Clear the run of ptes at `level` in the walker, up to either the end of the
+// table, `max_count` ptes, or a pte pointing to a lower table, and drop the
+// table's refs for all of them at once. Returns the size of the virtual range
+// that was unmapped.
+
+__optimize(3) static uint64_t
+unmap_pte_run(struct pt_walker *const walker,
+              struct pageop *const pageop,
+              const pgt_level_t level,
+              const uint64_t max_count,
+              const bool should_free_pages)
+{
+    pte_t *const table = walker->tables[level - 1];
+    pte_t *const begin = &table[walker->indices[level - 1]];
+
+    const uint64_t run_count =
+        min((uint64_t)(PGT_PTE_COUNT - walker->indices[level - 1]), max_count);
+
+    const pte_t *const end = begin + run_count;
+    uint16_t present_count = 0;
+
+    pte_t *pte = begin;
+    for (; pte != end; pte++) {
+        const pte_t entry = pte_read(pte);
+        if (!pte_is_present(entry)) {
+            continue;
+        }
+
+        if (level > 1 && !pte_is_large(entry)) {
+            break;
+        }
+
+        pte_write(pte, /*value=*/0);
+        present_count++;
+
+        if (should_free_pages) {
+            pageop_flush_pte_in_current_range(pageop,
+                                              entry,
+                                              level,
+                                              should_free_pages);
+        }
+    }
+
+    ptwalker_deref_count_from_level(walker, level, present_count, pageop);
+    return (uint64_t)(pte - begin) * PAGE_SIZE_AT_LEVEL(level);
+}
+
 bool
-pgunmap_at(struct pagemap *const pagemap,
-           const struct range virt_range,
-           const struct pgmap_options *const map_options,
-           const struct pgunmap_options *const unmap_options)
+pgunmap_with_pageop(struct pagemap *const pagemap,
+                    const struct range virt_range,
+                    struct pageop *const pageop,
+                    const struct pgmap_options *const map_options,
+                    const struct pgunmap_options *const unmap_options)
 {
     if (__builtin_expect(!range_has_align(virt_range, PAGE_SIZE), 0)) {
         printk(LOGLEVEL_WARN,
@@ -997,10 +1282,7 @@ pgunmap_at(struct pagemap *const pagemap,
     }
 
     struct pt_walker walker;
-    struct pageop pageop;
-
     ptwalker_default_for_pagemap(&walker, pagemap, virt_range.front);
-    pageop_init(&pageop, pagemap, virt_range);
 
     const bool should_free_pages = unmap_options->free_pages;
     const bool dont_split_large_pages = unmap_options->dont_split_large_pages;
@@ -1025,16 +1307,47 @@ pgunmap_at(struct pagemap *const pagemap,
         if (__builtin_expect(
                 walker.level > 1 && !pte_level_can_have_large(walker.level), 0))
         {
-            pageop_finish(&pageop);
             return false;
         }
 
+        const uint64_t virt_addr = virt_range.front + offset;
+        if (walker.level == level &&
+            has_align(virt_addr, PAGE_SIZE_AT_LEVEL(level)))
+        {
+            const uint64_t max_count =
+                (virt_range.size - offset) >> PAGE_SHIFTS[level - 1];
+
+            offset +=
+                unmap_pte_run(&walker,
+                              pageop,
+                              level,
+                              max_count,
+                              should_free_pages);
+
+            if (offset == virt_range.size) {
+                break;
+            }
+
+            // The run either went up to the end of the table, which may have
+            // been freed along with its parents, or stopped at a pte pointing
+            // to a lower table, so start over from the next address.
+
+            ptwalker_default_for_pagemap(&walker,
+                                         pagemap,
+                                         virt_range.front + offset);
+
+            while (virt_range.size - offset < PAGE_SIZE_AT_LEVEL(level)) {
+                level--;
+            }
+
+            continue;
+        }
+
         if (level < walker.level) {
             // Here, we're exclusively dealing with large pages that must be
             // split.
 
             if (dont_split_large_pages) {
-                pageop_finish(&pageop);
                 return false;
             }
 
@@ -1047,12 +1360,11 @@ pgunmap_at(struct pagemap *const pagemap,
 
             const pte_t entry = pte_read(pte);
             if (__builtin_expect(!pte_is_large(entry), 0)) {
-                pageop_finish(&pageop);
                 return false;
             }
 
             pte_write(pte, /*value=*/0);
-            ptwalker_deref_from_level(&walker, walker.level, &pageop);
+            ptwalker_deref_from_level(&walker, walker.level, pageop);
 
             if (pte_is_dirty(entry)) {
                 page_set_flag(pte_to_page(entry), PAGE_IS_DIRTY);
@@ -1062,13 +1374,12 @@ pgunmap_at(struct pagemap *const pagemap,
             const bool map_result =
                 pgmap_with_ptwalker(&walker,
                                     /*curr_split=*/NULL,
-                                    &pageop,
+                                    pageop,
                                     RANGE_INIT(pte_to_phys(entry), map_size),
                                     virt_range.front + offset,
                                     map_options);
 
             if (!map_result) {
-                pageop_finish(&pageop);
                 return false;
             }
         } else {
@@ -1079,7 +1390,7 @@ pgunmap_at(struct pagemap *const pagemap,
                 const pte_t entry = pte_read(pte);
 
                 pte_write(pte, /*value=*/0);
-                pageop_flush_pte_in_current_range(&pageop,
+                pageop_flush_pte_in_current_range(pageop,
                                                   entry,
                                                   level,
                                                   should_free_pages);
@@ -1087,7 +1398,7 @@ pgunmap_at(struct pagemap *const pagemap,
                 pte_write(pte, /*value=*/0);
             }
 
-            ptwalker_deref_from_level(&walker, walker.level, &pageop);
+            ptwalker_deref_from_level(&walker, walker.level, pageop);
         }
 
         const uint64_t page_size = PAGE_SIZE_AT_LEVEL(level);
@@ -1109,6 +1420,25 @@ pgunmap_at(struct pagemap *const pagemap,
         }
     } while (true);
 
-    pageop_finish(&pageop);
     return true;
+}
+
+bool
+pgunmap_at(struct pagemap *const pagemap,
+           const struct range virt_range,
+           const struct pgmap_options *const map_options,
+           const struct pgunmap_options *const unmap_options)
+{
+    struct pageop pageop;
+    pageop_init(&pageop, pagemap, virt_range);
+
+    const bool result =
+        pgunmap_with_pageop(pagemap,
+                            virt_range,
+                            &pageop,
+                            map_options,
+                            unmap_options);
+
+    pageop_finish(&pageop);
+    return result;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 
 #pragma once
 #include "pagemap.h"
+#include "pageop.h"
 
 struct pgmap_options {
     uint64_t pte_flags;
@@ -25,6 +26,17 @@ pgmap_at(struct pagemap *pagemap,
          uint64_t virt_addr,
          const struct pgmap_options *options);
 
+// Map the pages in `pages`, linked through their used.delayed_free_list, one
+// after the other starting at `virt_addr`. Every table needed is reserved once
+// for the whole range, and the pages are mapped through a single pt_walker.
+
+bool
+pgmap_pages_at(struct pagemap *pagemap,
+               struct list *pages,
+               uint64_t virt_addr,
+               uint64_t size,
+               const struct pgmap_options *options);
+
 struct pgunmap_options {
     bool free_pages : 1;
     bool dont_split_large_pages : 1;
@@ -36,6 +48,18 @@ pgunmap_at(struct pagemap *pagemap,
            const struct pgmap_options *map_options,
            const struct pgunmap_options *unmap_options);
 
+// Like pgunmap_at(), but records the tlb-flush and the pages to free into
+// `pageop` instead of finishing them, so several unmaps can share one
+// pageop_finish(). The caller must extend pageop's flush-range to cover
+// `virt_range`.
+
+bool
+pgunmap_with_pageop(struct pagemap *pagemap,
+                    struct range virt_range,
+                    struct pageop *pageop,
+                    const struct pgmap_options *map_options,
+                    const struct pgunmap_options *unmap_options);
+
 bool
 arch_make_mapping(struct pagemap *pagemap,
                   struct range phys_range,
@@ -44,6 +68,14 @@ arch_make_mapping(struct pagemap *pagemap,
                   enum vma_cachekind cachekind,
                   bool is_overwrite);
 
+bool
+arch_make_mapping_pages(struct pagemap *pagemap,
+                        struct list *pages,
+                        uint64_t virt_addr,
+                        uint64_t size,
+                        prot_t prot,
+                        enum vma_cachekind cachekind);
+
 bool
 arch_unmap_mapping(struct pagemap *pagemap,
                    struct range virt_range,
@@ -0,0 +1,212 @@
+/*
+ * kernel/mm/table_pool.c
+ * © suhas pai
+ */
+
+#include "asm/irqs.h"
+#include "cpu/spinlock.h"
+
+#include "cpu.h"
+#include "page_alloc.h"
+#include "table_pool.h"
+
+static struct table_reserve g_pool = TABLE_RESERVE_INIT(g_pool);
+static struct spinlock g_pool_lock = SPINLOCK_INIT();
+
+__optimize(3) static inline struct page *
+reserve_pop(struct table_reserve *const reserve) {
+    if (reserve->count == 0) {
+        return NULL;
+    }
+
+    struct page *const page =
+        list_head(&reserve->list, struct page, table.delayed_free_list);
+
+    list_remove(&page->table.delayed_free_list);
+    reserve->count--;
+
+    return page;
+}
+
+__optimize(3) static inline void
+reserve_push(struct table_reserve *const reserve, struct page *const page) {
+    list_add(&reserve->list, &page->table.delayed_free_list);
+    reserve->count++;
+}
+
+__optimize(3) static inline void
+reserve_move(struct table_reserve *const to,
+             struct table_reserve *const from,
+             uint64_t count)
+{
+    for (; count != 0; count--) {
+        struct page *const page = reserve_pop(from);
+        if (page == NULL) {
+            break;
+        }
+
+        reserve_push(to, page);
+    }
+}
+
+bool
+table_pool_take(struct table_reserve *const reserve, const uint64_t count) {
+    const bool irqs_enabled = are_interrupts_enabled();
+    disable_all_interrupts();
+
+    struct table_reserve *const cpu_reserve =
+        &get_cpu_info_mut()->table_reserve;
+
+    if (cpu_reserve->count >= count) {
+        reserve_move(reserve, cpu_reserve, count);
+        if (irqs_enabled) {
+            enable_all_interrupts();
+        }
+
+        return true;
+    }
+
+    if (irqs_enabled) {
+        enable_all_interrupts();
+    }
+
+    const int flag = spin_acquire_with_irq(&g_pool_lock);
+    reserve_move(reserve, &g_pool, count);
+    spin_release_with_irq(&g_pool_lock, flag);
+
+    while (reserve->count < count) {
+        struct page *const page = alloc_table();
+        if (page == NULL) {
+            table_pool_give_back(reserve);
+            return false;
+        }
+
+        reserve_push(reserve, page);
+    }
+
+    return true;
+}
+
+__optimize(3)
+struct page *table_reserve_alloc(struct table_reserve *const reserve) {
+    struct page *const page = reserve_pop(reserve);
+    if (page != NULL) {
+        return page;
+    }
+
+    return table_pool_alloc();
+}
+
+void table_pool_give_back(struct table_reserve *const reserve) {
+    if (reserve->count == 0) {
+        return;
+    }
+
+    const bool irqs_enabled = are_interrupts_enabled();
+    disable_all_interrupts();
+
+    struct table_reserve *const cpu_reserve =
+        &get_cpu_info_mut()->table_reserve;
+
+    reserve_move(cpu_reserve,
+                 reserve,
+                 TABLE_RESERVE_CAPACITY - cpu_reserve->count);
+
+    if (irqs_enabled) {
+        enable_all_interrupts();
+    }
+
+    if (reserve->count == 0) {
+        return;
+    }
+
+    const int flag = spin_acquire_with_irq(&g_pool_lock);
+    reserve_move(&g_pool,
+                 reserve,
+                 g_pool.count < TABLE_POOL_HIGH_WATERMARK ?
+                    TABLE_POOL_HIGH_WATERMARK - g_pool.count : 0);
+    spin_release_with_irq(&g_pool_lock, flag);
+
+    struct page *page = NULL;
+    while ((page = reserve_pop(reserve)) != NULL) {
+        free_page(page);
+    }
+}
+
+__optimize(3) struct page *table_pool_alloc() {
+    const bool irqs_enabled = are_interrupts_enabled();
+    disable_all_interrupts();
+
+    struct page *page = reserve_pop(&get_cpu_info_mut()->table_reserve);
+    if (irqs_enabled) {
+        enable_all_interrupts();
+    }
+
+    if (page != NULL) {
+        return page;
+    }
+
+    const int flag = spin_acquire_with_irq(&g_pool_lock);
+    page = reserve_pop(&g_pool);
+    spin_release_with_irq(&g_pool_lock, flag);
+
+    if (page != NULL) {
+        return page;
+    }
+
+    return alloc_table();
+}
+
+__optimize(3) bool table_pool_needs_refill() {
+    const bool irqs_enabled = are_interrupts_enabled();
+    disable_all_interrupts();
+
+    const uint32_t cpu_count = get_cpu_info()->table_reserve.count;
+    if (irqs_enabled) {
+        enable_all_interrupts();
+    }
+
+    if (cpu_count < TABLE_RESERVE_CAPACITY) {
+        return true;
+    }
+
+    const int flag = spin_acquire_with_irq(&g_pool_lock);
+    const uint32_t pool_count = g_pool.count;
+
+    spin_release_with_irq(&g_pool_lock, flag);
+    return pool_count < TABLE_POOL_LOW_WATERMARK;
+}
+
+void table_pool_refill() {
+    int flag = spin_acquire_with_irq(&g_pool_lock);
+    const uint32_t pool_count = g_pool.count;
+
+    spin_release_with_irq(&g_pool_lock, flag);
+
+    struct table_reserve new_tables = TABLE_RESERVE_INIT(new_tables);
+    if (pool_count < TABLE_POOL_LOW_WATERMARK) {
+        for (uint32_t i = pool_count; i != TABLE_POOL_HIGH_WATERMARK; i++) {
+            struct page *const page = alloc_table();
+            if (page == NULL) {
+                break;
+            }
+
+            reserve_push(&new_tables, page);
+        }
+    }
+
+    // Interrupts are disabled while holding the pool's lock, so we can touch
+    // this cpu's reserve as well.
+
+    flag = spin_acquire_with_irq(&g_pool_lock);
+    reserve_move(&g_pool, &new_tables, new_tables.count);
+
+    struct table_reserve *const cpu_reserve =
+        &get_cpu_info_mut()->table_reserve;
+
+    reserve_move(cpu_reserve,
+                 &g_pool,
+                 TABLE_RESERVE_CAPACITY - cpu_reserve->count);
+
+    spin_release_with_irq(&g_pool_lock, flag);
+}
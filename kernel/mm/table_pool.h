@@ -0,0 +1,63 @@
+/*
+ * kernel/mm/table_pool.h
+ * © suhas pai
+ */
+
+#pragma once
+
+#include "lib/list.h"
+#include "mm_types.h"
+
+/*
+ * A pool of pre-zeroed page-table pages, so that pt_walkers don't have to take
+ * the buddy allocator's lock and zero a page in the middle of a mapping.
+ *
+ * Every cpu keeps a reserve large enough for a worst-case walk (one table at
+ * every level below the root), which can be taken from without any locks.
+ * Larger mappings take a reservation for the number of tables they may need
+ * before touching the page tables, so that they never fail halfway through.
+ */
+
+#define TABLE_RESERVE_CAPACITY (PGT_LEVEL_COUNT - 1)
+
+#define TABLE_POOL_LOW_WATERMARK 32
+#define TABLE_POOL_HIGH_WATERMARK 128
+
+struct table_reserve {
+    struct list list;
+    uint32_t count;
+};
+
+#define TABLE_RESERVE_INIT(name) \
+    ((struct table_reserve){ \
+        .list = LIST_INIT(name.list), \
+        .count = 0 \
+    })
+
+struct page;
+
+// Move `count` pre-zeroed tables into `reserve`, falling back to the buddy
+// allocator only if both the cpu's reserve and the pool run out.
+// On failure, `reserve` is left empty.
+
+bool table_pool_take(struct table_reserve *reserve, uint64_t count);
+
+// Pops a table from `reserve`. Falls back to table_pool_alloc() if the
+// reservation ran out.
+
+struct page *table_reserve_alloc(struct table_reserve *reserve);
+
+// Give back the unused tables in `reserve`.
+void table_pool_give_back(struct table_reserve *reserve);
+
+struct page *table_pool_alloc();
+
+// Returns true if the current cpu's reserve isn't full, or the pool has dropped
+// below its low watermark.
+
+bool table_pool_needs_refill();
+
+// Top up the current cpu's reserve and the pool. Must be called outside of any
+// mapping path, as it allocates and zeroes pages.
+
+void table_pool_refill();
@@ -39,8 +39,10 @@ vma_alloc(struct pagemap *const pagemap,
 
     vma->node = ADDRSPACE_NODE_INIT(vma->node, &pagemap->addrspace);
     vma->node.range = range;
+    vma->lock = SPINLOCK_INIT();
     vma->cachekind = cachekind;
     vma->prot = prot;
+    vma->is_demand_paged = false;
 
     return vma;
 }
@@ -91,6 +93,86 @@ vma_create_at(struct pagemap *const pagemap,
     return vma;
 }
 
+struct vm_area *
+vma_create_demand(struct pagemap *const pagemap,
+                  const struct range in_range,
+                  const uint64_t size,
+                  const uint64_t align,
+                  const prot_t prot,
+                  const enum vma_cachekind cachekind)
+{
+    assert(has_align(size, PAGE_SIZE));
+
+    const struct range range = range_create_upto(size);
+    struct vm_area *const vma = vma_alloc(pagemap, range, prot, cachekind);
+
+    if (vma == NULL) {
+        return NULL;
+    }
+
+    vma->is_demand_paged = true;
+    if (!pagemap_find_space_and_add_vma(pagemap,
+                                        vma,
+                                        in_range,
+                                        /*phys_addr=*/INVALID_PHYS,
+                                        align))
+    {
+        kfree(vma);
+        return NULL;
+    }
+
+    return vma;
+}
+
 struct pagemap *vma_pagemap(struct vm_area *const vma) {
     return container_of(vma->node.addrspace, struct pagemap, addrspace);
-}
\ No newline at end of file
+}
+
+__optimize(3)
+struct vm_area *find_vma(struct pagemap *const pagemap, const uint64_t addr) {
+    struct vm_area *const last_vma = pagemap->last_vma;
+    if (last_vma != NULL && range_has_loc(last_vma->node.range, addr)) {
+        return last_vma;
+    }
+
+    struct addrspace_node *const node =
+        addrspace_find_node(&pagemap->addrspace, addr);
+
+    if (node == NULL) {
+        return NULL;
+    }
+
+    struct vm_area *const vma = container_of(node, struct vm_area, node);
+    pagemap->last_vma = vma;
+
+    return vma;
+}
+
+__optimize(3) static inline bool
+vma_overlaps_range(const struct vm_area *const vma, const struct range range) {
+    return vma->node.range.front < range_get_end_assert(range);
+}
+
+__optimize(3) struct vm_area *
+find_first_vma_in_range(struct pagemap *const pagemap, const struct range range)
+{
+    struct addrspace_node *const node =
+        addrspace_find_node_after(&pagemap->addrspace, range.front);
+
+    if (node == NULL) {
+        return NULL;
+    }
+
+    struct vm_area *const vma = container_of(node, struct vm_area, node);
+    return vma_overlaps_range(vma, range) ? vma : NULL;
+}
+
+__optimize(3) struct vm_area *
+vma_next_in_range(struct vm_area *const vma, const struct range range) {
+    struct vm_area *const next = vma_next(vma);
+    if (next == NULL || !vma_overlaps_range(next, range)) {
+        return NULL;
+    }
+
+    return next;
+}
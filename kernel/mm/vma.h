@@ -18,6 +18,12 @@ struct vm_area {
     prot_t prot;
 
     enum vma_cachekind cachekind;
+
+    // Demand-paged vm_areas are only reserved in the address-space when
+    // created. Pages are allocated and mapped in by handle_page_fault() when
+    // first touched.
+
+    bool is_demand_paged : 1;
 };
 
 #define vma_of(obj) container_of((obj), struct vm_area, node.avlnode)
@@ -50,4 +56,34 @@ vma_create_at(struct pagemap *pagemap,
               prot_t prot,
               enum vma_cachekind cachekind);
 
-struct pagemap *vma_pagemap(struct vm_area *const vma);
\ No newline at end of file
+// Reserve `size` bytes of address-space inside `in_range` without mapping any
+// memory. The range is filled in one page (or large page) at a time as it's
+// faulted on.
+
+struct vm_area *
+vma_create_demand(struct pagemap *pagemap,
+                  struct range in_range,
+                  uint64_t size,
+                  uint64_t align,
+                  prot_t prot,
+                  enum vma_cachekind cachekind);
+
+struct pagemap *vma_pagemap(struct vm_area *const vma);
+
+/*
+ * The following require the pagemap's addrspace-lock to be held.
+ */
+
+// Returns the vm_area containing `addr`, or NULL if there is none.
+struct vm_area *find_vma(struct pagemap *pagemap, uint64_t addr);
+
+// Returns the first vm_area overlapping `range`, or NULL if there is none.
+struct vm_area *
+find_first_vma_in_range(struct pagemap *pagemap, struct range range);
+
+struct vm_area *vma_next_in_range(struct vm_area *vma, struct range range);
+
+#define vma_foreach_in_range(vma, pagemap, range) \
+    for (vma = find_first_vma_in_range((pagemap), (range)); \
+         vma != NULL; \
+         vma = vma_next_in_range(vma, (range)))
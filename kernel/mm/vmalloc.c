@@ -0,0 +1,298 @@
+/*
+ * kernel/mm/vmalloc.c
+ * © suhas pai
+ */
+
+#include "dev/printk.h"
+
+#include "lib/adt/addrspace.h"
+#include "lib/align.h"
+#include "lib/overflow.h"
+
+#include "kmalloc.h"
+#include "page_alloc.h"
+#include "pgmap.h"
+#include "vmalloc.h"
+
+struct vmalloc_area {
+    struct addrspace_node node;
+
+    // Linked into lazy_list once the area is freed, and empty until then.
+    struct list lazy_list;
+};
+
+// One unmapped guard page is left after every area.
+#define GUARD_PAGE_SIZE PAGE_SIZE
+
+static struct address_space vmalloc_space = ADDRSPACE_INIT(vmalloc_space);
+static struct spinlock vmalloc_space_lock = SPINLOCK_INIT();
+
+// Freed areas stay in vmalloc_space, and stay mapped, until they're purged, so
+// their address-range can't be handed out while stale tlb entries may still
+// point to it.
+
+static struct list lazy_list = LIST_INIT(lazy_list);
+static uint64_t lazy_page_count = 0;
+
+static struct vmalloc_stats g_stats = {
+    .alloc_count = 0,
+    .free_count = 0,
+    .purge_count = 0,
+    .flushes_avoided = 0,
+};
+
+#define stat_add(field, amount) \
+    atomic_fetch_add_explicit(&g_stats.field, (amount), memory_order_relaxed)
+
+__optimize(3) static inline struct range
+area_get_mapped_range(const struct vmalloc_area *const area) {
+    return RANGE_INIT(area->node.range.front,
+                      area->node.range.size - GUARD_PAGE_SIZE);
+}
+
+// Move every lazy area onto `areas`, to be purged by purge_areas() once
+// vmalloc_space_lock is released. The areas stay in vmalloc_space until then.
+
+static void take_lazy_areas_locked(struct list *const areas) {
+    list_splice(areas, &lazy_list);
+    lazy_page_count = 0;
+}
+
+static void purge_areas(struct list *const areas) {
+    if (list_empty(areas)) {
+        return;
+    }
+
+    const struct pgunmap_options options = {
+        .free_pages = true,
+        .dont_split_large_pages = true
+    };
+
+    struct pageop pageop;
+    pageop_init(&pageop, &kernel_pagemap, RANGE_EMPTY());
+
+    uint64_t flush_front = UINT64_MAX;
+    uint64_t flush_end = 0;
+    uint64_t area_count = 0;
+
+    struct vmalloc_area *area = NULL;
+    struct vmalloc_area *tmp = NULL;
+
+    // Unmap every area into the same pageop so only one tlb-flush is issued,
+    // covering the range bounding all of them.
+
+    list_foreach(area, areas, lazy_list) {
+        const struct range range = area_get_mapped_range(area);
+        const bool result =
+            pgunmap_with_pageop(&kernel_pagemap,
+                                range,
+                                &pageop,
+                                /*map_options=*/NULL,
+                                &options);
+
+        if (!result) {
+            printk(LOGLEVEL_WARN,
+                   "vmalloc: failed to unmap lazy area at " RANGE_FMT "\n",
+                   RANGE_FMT_ARGS(range));
+        }
+
+        flush_front = min(flush_front, range.front);
+        flush_end = max(flush_end, range_get_end_assert(range));
+
+        area_count++;
+    }
+
+    pageop.flush_range = range_create_end(flush_front, flush_end);
+    pageop_finish(&pageop);
+
+    // Only now that no tlb can still point into the areas can their ranges be
+    // handed out again.
+
+    const int flag = spin_acquire_with_irq(&vmalloc_space_lock);
+    list_foreach(area, areas, lazy_list) {
+        addrspace_remove_node(&area->node);
+    }
+
+    spin_release_with_irq(&vmalloc_space_lock, flag);
+    list_foreach_mut(area, tmp, areas, lazy_list) {
+        list_delete(&area->lazy_list);
+        kfree(area);
+    }
+
+    stat_add(purge_count, 1);
+    stat_add(flushes_avoided, area_count - 1);
+}
+
+static void free_page_list(struct list *const pages) {
+    struct page *page = NULL;
+    struct page *tmp = NULL;
+
+    list_foreach_mut(page, tmp, pages, used.delayed_free_list) {
+        list_delete(&page->used.delayed_free_list);
+        free_page(page);
+    }
+}
+
+static void remove_area(struct vmalloc_area *const area) {
+    const int flag = spin_acquire_with_irq(&vmalloc_space_lock);
+
+    addrspace_remove_node(&area->node);
+    spin_release_with_irq(&vmalloc_space_lock, flag);
+
+    kfree(area);
+}
+
+void *vmalloc(const uint64_t size) {
+    uint64_t map_size = 0;
+    if (size == 0 || !align_up(size, PAGE_SIZE, &map_size)) {
+        return NULL;
+    }
+
+    uint64_t node_size = 0;
+    if (!check_add(map_size, GUARD_PAGE_SIZE, &node_size)) {
+        return NULL;
+    }
+
+    struct vmalloc_area *const area = kmalloc(sizeof(*area));
+    if (area == NULL) {
+        printk(LOGLEVEL_WARN,
+               "vmalloc(): failed to allocate vmalloc_area to allocate %" PRIu64
+               " bytes\n",
+               size);
+        return NULL;
+    }
+
+    area->node = ADDRSPACE_NODE_INIT(area->node, &vmalloc_space);
+    area->node.range.size = node_size;
+
+    list_init(&area->lazy_list);
+
+    const struct range in_range = range_create_end(VMALLOC_BASE, VMALLOC_END);
+    int flag = spin_acquire_with_irq(&vmalloc_space_lock);
+
+    uint64_t virt_addr =
+        addrspace_find_space_and_add_node(&vmalloc_space,
+                                          in_range,
+                                          &area->node,
+                                          /*align=*/PAGE_SIZE);
+
+    // Freed areas may be holding on to the space we need.
+    if (virt_addr == ADDRSPACE_INVALID_ADDR && !list_empty(&lazy_list)) {
+        struct list areas = LIST_INIT(areas);
+        take_lazy_areas_locked(&areas);
+
+        spin_release_with_irq(&vmalloc_space_lock, flag);
+        purge_areas(&areas);
+
+        flag = spin_acquire_with_irq(&vmalloc_space_lock);
+        virt_addr =
+            addrspace_find_space_and_add_node(&vmalloc_space,
+                                              in_range,
+                                              &area->node,
+                                              /*align=*/PAGE_SIZE);
+    }
+
+    spin_release_with_irq(&vmalloc_space_lock, flag);
+    if (virt_addr == ADDRSPACE_INVALID_ADDR) {
+        kfree(area);
+        printk(LOGLEVEL_WARN,
+               "vmalloc(): failed to find a virtual-address range to allocate "
+               "%" PRIu64 " bytes\n",
+               size);
+
+        return NULL;
+    }
+
+    // Allocate every page up front, so that the whole area can be mapped in
+    // through a single walk, with its tables reserved once.
+
+    struct list pages = LIST_INIT(pages);
+    for (uint64_t offset = 0; offset != map_size; offset += PAGE_SIZE) {
+        struct page *const page = alloc_page(PAGE_STATE_USED, /*flags=*/0);
+        if (page == NULL) {
+            free_page_list(&pages);
+            remove_area(area);
+
+            return NULL;
+        }
+
+        list_radd(&pages, &page->used.delayed_free_list);
+    }
+
+    // The area's range is reserved, so map it in without holding the lock.
+    const bool map_result =
+        arch_make_mapping_pages(&kernel_pagemap,
+                                &pages,
+                                virt_addr,
+                                map_size,
+                                PROT_READ | PROT_WRITE,
+                                VMA_CACHEKIND_DEFAULT);
+
+    if (!map_result) {
+        free_page_list(&pages);
+        remove_area(area);
+
+        return NULL;
+    }
+
+    stat_add(alloc_count, 1);
+    return (void *)virt_addr;
+}
+
+void vfree(void *const ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    const uint64_t addr = (uint64_t)ptr;
+    const int flag = spin_acquire_with_irq(&vmalloc_space_lock);
+
+    struct addrspace_node *const node =
+        addrspace_find_node(&vmalloc_space, addr);
+
+    if (node == NULL || node->range.front != addr) {
+        spin_release_with_irq(&vmalloc_space_lock, flag);
+        printk(LOGLEVEL_WARN,
+               "vfree(): %p wasn't returned by vmalloc()\n",
+               ptr);
+
+        return;
+    }
+
+    struct vmalloc_area *const area =
+        container_of(node, struct vmalloc_area, node);
+
+    if (!list_empty(&area->lazy_list)) {
+        spin_release_with_irq(&vmalloc_space_lock, flag);
+        printk(LOGLEVEL_WARN, "vfree(): %p was already freed\n", ptr);
+
+        return;
+    }
+
+    list_add(&lazy_list, &area->lazy_list);
+    lazy_page_count += PAGE_COUNT(area_get_mapped_range(area).size);
+
+    struct list areas = LIST_INIT(areas);
+    if (lazy_page_count >= VMALLOC_LAZY_PURGE_PAGES) {
+        take_lazy_areas_locked(&areas);
+    }
+
+    spin_release_with_irq(&vmalloc_space_lock, flag);
+    stat_add(free_count, 1);
+
+    purge_areas(&areas);
+}
+
+void vmalloc_purge_lazy() {
+    struct list areas = LIST_INIT(areas);
+    const int flag = spin_acquire_with_irq(&vmalloc_space_lock);
+
+    take_lazy_areas_locked(&areas);
+    spin_release_with_irq(&vmalloc_space_lock, flag);
+
+    purge_areas(&areas);
+}
+
+const struct vmalloc_stats *vmalloc_get_stats() {
+    return &g_stats;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+/*
+ * kernel/mm/vmalloc.h
+ * © suhas pai
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include "lib/macros.h"
+#include "lib/size.h"
+
+#include "mm_types.h"
+
+// The lower half of the vmap range is left to vmap_mmio(), and vmalloc()
+// hands out the upper half.
+
+#define VMALLOC_BASE (VMAP_BASE + ((VMAP_END - VMAP_BASE) / 2))
+#define VMALLOC_END VMAP_END
+
+// Freed areas are only unmapped, and their tlb entries flushed, once this
+// many pages are waiting to be purged.
+
+#define VMALLOC_LAZY_PURGE_PAGES (mib(32) / PAGE_SIZE)
+
+struct vmalloc_stats {
+    _Atomic uint64_t alloc_count;
+    _Atomic uint64_t free_count;
+
+    // Number of times the lazy areas were unmapped in one batch.
+    _Atomic uint64_t purge_count;
+
+    // Number of tlb-flushes that would've been issued if every vfree()
+    // flushed on its own.
+
+    _Atomic uint64_t flushes_avoided;
+};
+
+void vfree(void *ptr);
+
+__malloclike __malloc_dealloc(vfree, 1) __alloc_size(1)
+void *vmalloc(uint64_t size);
+
+// Unmap all areas queued by vfree() with a single tlb-flush.
+void vmalloc_purge_lazy();
+
+const struct vmalloc_stats *vmalloc_get_stats();
\ No newline at end of file
@@ -7,12 +7,16 @@
     #include "asm/ttbr.h"
 #endif /* defined(__x86_64__) */
 
+#include <stdatomic.h>
 #include "lib/align.h"
 
 #include "cpu.h"
+#include "epoch.h"
 #include "page_alloc.h"
+#include "table_pool.h"
 
 #include "walker.h"
+#include "xlate_cache.h"
 
 static uint64_t
 ptwalker_alloc_pgtable_cb(struct pt_walker *const walker,
@@ -20,9 +24,11 @@ ptwalker_alloc_pgtable_cb(struct pt_walker *const walker,
                           void *const cb_info) {
     (void)walker;
     (void)level;
-    (void)cb_info;
 
-    struct page *const table = alloc_table();
+    struct table_reserve *const reserve = (struct table_reserve *)cb_info;
+    struct page *const table =
+        reserve != NULL ? table_reserve_alloc(reserve) : table_pool_alloc();
+
     if (table != NULL) {
         return page_to_phys(table);
     }
@@ -36,9 +42,16 @@ ptwalker_free_pgtable_cb(struct pt_walker *const walker,
                          void *const cb_info)
 {
     (void)walker;
-    (void)cb_info;
 
-    free_page(page);
+    // Defer the free until no lockless walker can still be reading the table.
+    struct pageop *const pageop = (struct pageop *)cb_info;
+    if (pageop != NULL) {
+        list_add(&pageop->delayed_free, &page->table.delayed_free_list);
+        return;
+    }
+
+    epoch_defer_free_page(page);
+    epoch_try_reclaim();
 }
 
 static inline uint64_t
@@ -569,8 +582,20 @@ ptwalker_fill_in_to(struct pt_walker *const walker,
 
 __optimize(3) void
 ptwalker_deref_from_level(struct pt_walker *const walker,
-                          pgt_level_t level,
-                          void *free_pgtable_cb_info)
+                          const pgt_level_t level,
+                          void *const free_pgtable_cb_info)
+{
+    ptwalker_deref_count_from_level(walker,
+                                    level,
+                                    /*count=*/1,
+                                    free_pgtable_cb_info);
+}
+
+__optimize(3) void
+ptwalker_deref_count_from_level(struct pt_walker *const walker,
+                                pgt_level_t level,
+                                const uint16_t count,
+                                void *const free_pgtable_cb_info)
 {
     if (__builtin_expect(
             level < walker->level || level > walker->top_level, 0))
@@ -578,13 +603,22 @@ ptwalker_deref_from_level(struct pt_walker *const walker,
         return;
     }
 
+    if (__builtin_expect(count == 0, 0)) {
+        return;
+    }
+
     const ptwalker_free_pgtable_t free_pgtable = walker->free_pgtable;
     assert(free_pgtable != NULL);
 
+    // Only the table at `level` loses `count` entries. Every table above it
+    // loses a single entry, and only if the table below it was freed.
+
+    int32_t amount = count;
     pte_t *table = walker->tables[level - 1];
+
     for (; level <= walker->top_level; level++) {
         struct page *const pt = virt_to_page(table);
-        if (!ref_down(&pt->table.refcount)) {
+        if (!refcount_decrement(&pt->table.refcount, amount)) {
             break;
         }
 
@@ -594,6 +628,7 @@ ptwalker_deref_from_level(struct pt_walker *const walker,
         }
 
         free_pgtable(walker, pt, free_pgtable_cb_info);
+        amount = 1;
     }
 
     walker->level = level;
@@ -610,10 +645,18 @@ uint64_t ptwalker_get_virt_addr(const struct pt_walker *const walker) {
     return result;
 }
 
-uint64_t
-ptwalker_virt_get_phys(struct pagemap *const pagemap, const uint64_t virt) {
+__optimize(3) static uint64_t
+virt_get_phys_locked(struct pagemap *const pagemap, const uint64_t virt) {
+    // Read the generation before walking, so that a pageop finishing during
+    // the walk keeps us from caching a stale translation.
+
+    const uint64_t gen =
+        atomic_load_explicit(&pagemap->xlate_gen, memory_order_acquire);
+
     struct pt_walker walker;
-    ptwalker_default_for_pagemap(&walker, pagemap, virt);
+    ptwalker_default_for_pagemap(&walker,
+                                 pagemap,
+                                 align_down(virt, PAGE_SIZE));
 
     if (__builtin_expect(
             walker.level > 1 && !pte_level_can_have_large(walker.level), 0))
@@ -636,9 +679,129 @@ ptwalker_virt_get_phys(struct pagemap *const pagemap, const uint64_t virt) {
     const uint64_t offset =
         virt & mask_for_n_bits(PAGE_SHIFTS[walker.level - 1]);
 
+    xlate_cache_insert(pagemap,
+                       gen,
+                       virt,
+                       pte_to_phys(pte),
+                       (pgt_level_t)walker.level);
+
     return pte_to_phys(pte) + offset;
 }
 
+uint64_t
+ptwalker_virt_get_phys(struct pagemap *const pagemap, const uint64_t virt) {
+    const uint64_t cached_phys = xlate_cache_lookup(pagemap, virt);
+    if (cached_phys != INVALID_PHYS) {
+        return cached_phys;
+    }
+
+    epoch_read_lock();
+    const uint64_t result = virt_get_phys_locked(pagemap, virt);
+    epoch_read_unlock();
+
+    return result;
+}
+
+__optimize(3) static uint64_t
+virt_range_to_phys_segments_locked(struct pagemap *const pagemap,
+                                   const struct range virt_range,
+                                   struct range *const segments,
+                                   const uint64_t segment_capacity)
+{
+    if (__builtin_expect(range_empty(virt_range), 0)) {
+        return 0;
+    }
+
+    uint64_t virt = virt_range.front;
+    uint64_t virt_end = 0;
+
+    if (__builtin_expect(!range_get_end(virt_range, &virt_end), 0)) {
+        return 0;
+    }
+
+    struct pt_walker walker;
+    ptwalker_default_for_pagemap(&walker,
+                                 pagemap,
+                                 align_down(virt, PAGE_SIZE));
+
+    uint64_t segment_count = 0;
+    struct range last_segment = RANGE_EMPTY();
+
+    do {
+        if (walker.level > 1 && !pte_level_can_have_large(walker.level)) {
+            return 0;
+        }
+
+        const pte_t pte =
+            pte_read(walker.tables[walker.level - 1] +
+                     walker.indices[walker.level - 1]);
+
+        if (!pte_is_present(pte) || (walker.level != 1 && !pte_is_large(pte)))
+        {
+            return 0;
+        }
+
+        const uint64_t page_size = PAGE_SIZE_AT_LEVEL(walker.level);
+        const uint64_t offset = virt & (page_size - 1);
+        const uint64_t size = min(page_size - offset, virt_end - virt);
+        const uint64_t phys = pte_to_phys(pte) + offset;
+
+        if (segment_count != 0 &&
+            last_segment.front + last_segment.size == phys)
+        {
+            last_segment.size += size;
+        } else {
+            if (segment_count != 0 && segment_count <= segment_capacity) {
+                segments[segment_count - 1] = last_segment;
+            }
+
+            last_segment = RANGE_INIT(phys, size);
+            segment_count++;
+        }
+
+        virt += size;
+        if (virt == virt_end) {
+            break;
+        }
+
+        const enum pt_walker_result result =
+            ptwalker_next_with_options(&walker,
+                                       walker.level,
+                                       /*alloc_parents=*/false,
+                                       /*alloc_level=*/false,
+                                       /*should_ref=*/false,
+                                       /*alloc_pgtable_cb_info=*/NULL,
+                                       /*free_pgtable_cb_info=*/NULL);
+
+        if (__builtin_expect(result != E_PT_WALKER_OK, 0)) {
+            return 0;
+        }
+    } while (true);
+
+    if (segment_count <= segment_capacity) {
+        segments[segment_count - 1] = last_segment;
+    }
+
+    return segment_count;
+}
+
+uint64_t
+virt_range_to_phys_segments(struct pagemap *const pagemap,
+                            const struct range virt_range,
+                            struct range *const segments,
+                            const uint64_t segment_capacity)
+{
+    epoch_read_lock();
+    const uint64_t result =
+        virt_range_to_phys_segments_locked(pagemap,
+                                           virt_range,
+                                           segments,
+                                           segment_capacity);
+
+    epoch_read_unlock();
+    return result;
+}
+
 bool ptwalker_points_to_largepage(const struct pt_walker *const walker) {
     if (walker->level <= 1 || !pte_level_can_have_large(walker->level)) {
         return false;
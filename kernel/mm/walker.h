@@ -4,6 +4,7 @@
  */
 
 #pragma once
+#include "lib/adt/range.h"
 #include "mm/mm_types.h"
 
 #define PTWALKER_CLEAR 0
@@ -47,7 +48,9 @@ struct pt_walker {
     })
 
 // ptwalker with default settings expects a `struct pageop *` to be provided as
-// the cb_info for free_pgtable.
+// the cb_info for free_pgtable, and optionally a `struct table_reserve *` as
+// the cb_info for alloc_pgtable. Without a reserve, tables are taken from the
+// table-pool.
 
 void ptwalker_default(struct pt_walker *walker, uint64_t virt_addr);
 
@@ -113,6 +116,15 @@ ptwalker_deref_from_level(struct pt_walker *walker,
                           pgt_level_t level,
                           void *free_pgtable_cb_info);
 
+// Drop `count` references from the table at `level` at once, such as after
+// clearing a run of consecutive ptes in that table.
+
+void
+ptwalker_deref_count_from_level(struct pt_walker *walker,
+                                pgt_level_t level,
+                                uint16_t count,
+                                void *free_pgtable_cb_info);
+
 enum pt_walker_result
 ptwalker_fill_in_to(struct pt_walker *walker,
                     pgt_level_t level,
@@ -123,9 +135,29 @@ ptwalker_fill_in_to(struct pt_walker *walker,
 uint64_t ptwalker_get_virt_addr(const struct pt_walker *walker);
 
 /*
- * NOTE: ptwalker_virt_get_phys() requires that pagemap's addrspace-lock is
- * held.
+ * ptwalker_virt_get_phys() doesn't require pagemap's addrspace-lock to be held.
+ * The walk runs inside an epoch read-section, and page-table pages are only
+ * freed once every cpu has left the epoch they were unlinked in.
  */
 
 uint64_t ptwalker_virt_get_phys(struct pagemap *pagemap, uint64_t virt);
+
+/*
+ * Translate `virt_range` in a single walk, storing the physically contiguous
+ * extents it maps to into `segments`, which holds up to `segment_capacity`
+ * entries.
+ *
+ * Returns the total number of extents, which may exceed `segment_capacity`, in
+ * which case only the first `segment_capacity` extents are stored. Returns 0 if
+ * any part of `virt_range` isn't mapped.
+ *
+ * Like ptwalker_virt_get_phys(), this doesn't require the addrspace-lock.
+ */
+
+uint64_t
+virt_range_to_phys_segments(struct pagemap *pagemap,
+                            struct range virt_range,
+                            struct range *segments,
+                            uint64_t segment_capacity);
+
 bool ptwalker_points_to_largepage(const struct pt_walker *walker);
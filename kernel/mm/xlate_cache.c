@@ -0,0 +1,82 @@
+/*
+ * kernel/mm/xlate_cache.c
+ * © suhas pai
+ */
+
+#include <stdatomic.h>
+
+#include "asm/irqs.h"
+#include "cpu.h"
+
+#include "xlate_cache.h"
+
+__optimize(3) uint64_t
+xlate_cache_lookup(const struct pagemap *const pagemap, const uint64_t virt) {
+    const bool irqs_enabled = are_interrupts_enabled();
+    disable_all_interrupts();
+
+    uint64_t result = INVALID_PHYS;
+    const struct xlate_cache *const cache = &get_cpu_info()->xlate_cache;
+
+    if (cache->pagemap != pagemap ||
+        cache->gen != atomic_load_explicit(&pagemap->xlate_gen,
+                                           memory_order_acquire))
+    {
+        goto done;
+    }
+
+    for_each_in_carr(cache->entries, entry) {
+        if (entry->level == 0) {
+            continue;
+        }
+
+        const uint8_t shift = PAGE_SHIFTS[entry->level - 1];
+        if ((virt >> shift) == entry->vpn) {
+            result = entry->phys + (virt & mask_for_n_bits(shift));
+            break;
+        }
+    }
+
+done:
+    if (irqs_enabled) {
+        enable_all_interrupts();
+    }
+
+    return result;
+}
+
+__optimize(3) void
+xlate_cache_insert(const struct pagemap *const pagemap,
+                   const uint64_t gen,
+                   const uint64_t virt,
+                   const uint64_t phys,
+                   const pgt_level_t level)
+{
+    const bool irqs_enabled = are_interrupts_enabled();
+    disable_all_interrupts();
+
+    struct xlate_cache *const cache = &get_cpu_info_mut()->xlate_cache;
+    if (cache->pagemap != pagemap || cache->gen != gen) {
+        *cache = XLATE_CACHE_INIT();
+
+        cache->pagemap = pagemap;
+        cache->gen = gen;
+    }
+
+    const uint8_t shift = PAGE_SHIFTS[level - 1];
+    cache->entries[cache->next_index] = (struct xlate_cache_entry){
+        .vpn = virt >> shift,
+        .phys = phys & ~mask_for_n_bits(shift),
+        .level = level
+    };
+
+    cache->next_index = (cache->next_index + 1) % XLATE_CACHE_ENTRY_COUNT;
+    if (irqs_enabled) {
+        enable_all_interrupts();
+    }
+}
+
+__optimize(3)
+void xlate_cache_invalidate_pagemap(struct pagemap *const pagemap) {
+    atomic_fetch_add_explicit(&pagemap->xlate_gen, 1, memory_order_release);
+}
@@ -0,0 +1,52 @@
+/*
+ * kernel/mm/xlate_cache.h
+ * © suhas pai
+ */
+
+#pragma once
+#include "mm_types.h"
+
+#define XLATE_CACHE_ENTRY_COUNT 8
+
+struct xlate_cache_entry {
+    // virtual page number, shifted by the page-shift of `level`.
+    uint64_t vpn;
+    uint64_t phys;
+
+    // A level of 0 marks an entry as unused.
+    pgt_level_t level;
+};
+
+/*
+ * A small per-cpu cache of translations for the last pagemap looked up on that
+ * cpu. The cache is tagged with the pagemap's translation generation, which
+ * pageop_finish() bumps, so any unmap or overwrite invalidates every cpu's
+ * cache at once without needing an ipi.
+ */
+
+struct xlate_cache {
+    const struct pagemap *pagemap;
+    uint64_t gen;
+
+    struct xlate_cache_entry entries[XLATE_CACHE_ENTRY_COUNT];
+    uint8_t next_index;
+};
+
+#define XLATE_CACHE_INIT() \
+    ((struct xlate_cache){ \
+        .pagemap = NULL, \
+        .gen = 0, \
+        .next_index = 0 \
+    })
+
+struct pagemap;
+
+uint64_t xlate_cache_lookup(const struct pagemap *pagemap, uint64_t virt);
+void
+xlate_cache_insert(const struct pagemap *pagemap,
+                   uint64_t gen,
+                   uint64_t virt,
+                   uint64_t phys,
+                   pgt_level_t level);
+
+void xlate_cache_invalidate_pagemap(struct pagemap *pagemap);
@@ -10,122 +10,45 @@
     #include "lib/align.h"
 #endif /* defined(__riscv64) */
 
+#include "asm/irqs.h"
+#include "dev/printk.h"
+
 #include "lib/macros.h"
+#include "lib/memops.h"
 #include "lib/string.h"
+#include "lib/strscan.h"
 
-__optimize(3) size_t strlen(const char *const str) {
-    size_t result = 0;
-
-    const char *iter = str;
-    for (char ch = *iter; ch != '\0'; ch = *(++iter), result++) {}
-
-    return result;
-}
-
-__optimize(3) size_t strnlen(const char *const str, const size_t limit) {
-    size_t result = 0;
-
-    const char *iter = str;
-    char ch = *iter;
-
-    for (size_t i = 0; i != limit && ch != '\0'; ch = *(++iter), i++) {
-        result++;
-    }
-
-    return result;
-}
+#if defined(__x86_64__) || defined(__riscv64)
+    #include "cpu.h"
+#elif defined(__aarch64__)
+    #include "features.h"
+#endif /* defined(__x86_64__) || defined(__riscv64) */
 
 __optimize(3) int strcmp(const char *const str1, const char *const str2) {
-    const char *iter = str1;
-    const char *jter = str2;
-
-    char ch = *iter, jch = *jter;
-    for (; ch != '\0' && jch != '\0'; ch = *(++iter), jch = *(++jter)) {}
-
-    return ch - jch;
-}
+    const uint8_t *iter = (const uint8_t *)str1;
+    const uint8_t *jter = (const uint8_t *)str2;
 
-__optimize(3)
-int strncmp(const char *str1, const char *const str2, const size_t length) {
-    const char *iter = str1;
-    const char *jter = str2;
-
-    char ch = *iter, jch = *jter;
-    for (size_t i = 0; i != length; i++, ch = iter[i], jch = jter[i]) {
-        if (ch == '\0' || jch == '\0') {
-            break;
+    for (;; iter++, jter++) {
+        if (*iter != *jter || *iter == '\0') {
+            return (int)*iter - (int)*jter;
         }
     }
-
-    return ch - jch;
 }
 
-__optimize(3) char *strchr(const char *const str, const int ch) {
-    c_string_foreach (str, iter) {
-        if (*iter == ch) {
-        #pragma GCC diagnostic push
-        #pragma GCC diagnostic ignored "-Wcast-qual"
-            return (char *)iter;
-        #pragma GCC diagnostic pop
-        }
-    }
-
-    return NULL;
-}
+__optimize(3)
+int strncmp(const char *str1, const char *const str2, const size_t length) {
+    const uint8_t *const iter = (const uint8_t *)str1;
+    const uint8_t *const jter = (const uint8_t *)str2;
 
-__optimize(3) char *strrchr(const char *const str, const int ch) {
-    char *result = NULL;
-    c_string_foreach (str, iter) {
-        if (*iter == ch) {
-        #pragma GCC diagnostic push
-        #pragma GCC diagnostic ignored "-Wcast-qual"
-            result = (char *)iter;
-        #pragma GCC diagnostic pop
+    for (size_t i = 0; i != length; i++) {
+        if (iter[i] != jter[i] || iter[i] == '\0') {
+            return (int)iter[i] - (int)jter[i];
         }
     }
 
-    return result;
+    return 0;
 }
 
-// TODO: Fix
-#define DECL_MEM_CMP_FUNC(type)                                                \
-    __optimize(3) static inline int                                            \
-    VAR_CONCAT(_memcmp_, type)(const void *left,                               \
-                               const void *right,                              \
-                               size_t len,                                     \
-                               const void **const left_out,                    \
-                               const void **const right_out,                   \
-                               size_t *const len_out)                          \
-    {                                                                          \
-        if (len < sizeof(type)) {                                              \
-            return 0;                                                          \
-        }                                                                      \
-                                                                               \
-        do {                                                                   \
-            const type left_ch = *(const type *)left;                          \
-            const type right_ch = *(const type *)right;                        \
-                                                                               \
-            if (left_ch != right_ch) {                                         \
-                return (int)(left_ch - right_ch);                              \
-            }                                                                  \
-                                                                               \
-            left += sizeof(type);                                              \
-            right += sizeof(type);                                             \
-            len -= sizeof(type);                                               \
-        } while (len >= sizeof(type));                                         \
-                                                                               \
-        *left_out = left;                                                      \
-        *right_out = right;                                                    \
-        *len_out = len;                                                        \
-                                                                               \
-        return 0;                                                              \
-    }
-
-DECL_MEM_CMP_FUNC(uint8_t)
-DECL_MEM_CMP_FUNC(uint16_t)
-DECL_MEM_CMP_FUNC(uint32_t)
-DECL_MEM_CMP_FUNC(uint64_t)
-
 #define DECL_MEM_COPY_FUNC(type) \
     __optimize(3) static inline unsigned long  \
     VAR_CONCAT(_memcpy_, type)(void *dst,                  \
@@ -156,61 +79,294 @@ DECL_MEM_COPY_FUNC(uint16_t)
 DECL_MEM_COPY_FUNC(uint32_t)
 DECL_MEM_COPY_FUNC(uint64_t)
 
-__optimize(3) int memcmp(const void *left, const void *right, size_t len) {
-    int res = _memcmp_uint64_t(left, right, len, &left, &right, &len);
-    if (res != 0) {
-        return res;
-    }
+#if defined(__x86_64__)
+    #define REP_MIN 16
+#endif /* defined(__x86_64__) */
 
-    res = _memcmp_uint32_t(left, right, len, &left, &right, &len);
-    if (res != 0) {
-        return res;
-    }
+typedef void *(*memcpy_func_t)(void *dst, const void *src, size_t n);
+typedef void *(*memset_func_t)(void *dst, int val, size_t n);
+typedef int (*memcmp_func_t)(const void *left, const void *right, size_t n);
+
+typedef size_t (*strlen_func_t)(const char *str);
+typedef size_t (*strnlen_func_t)(const char *str, size_t limit);
+typedef void *(*memchr_func_t)(const void *ptr, int ch, size_t n);
+
+/*
+ * Neither the simd variants nor the isrs save the vector registers, so the simd
+ * variants are only used with interrupts disabled. Exception handlers also run
+ * with interrupts disabled, so a memcpy() inside an exception taken in the
+ * middle of a simd memcpy() falls back to the word variant, and leaves the
+ * vector registers alone.
+ *
+ * This means code that's already running with interrupts disabled, e.g. while
+ * holding a lock taken with spin_acquire_with_irq(), never uses the simd
+ * variants.
+ */
 
-    res = _memcmp_uint16_t(left, right, len, &left, &right, &len);
-    if (res != 0) {
-        return res;
+__optimize(3) static inline bool simd_begin() {
+    if (!are_interrupts_enabled()) {
+        return false;
     }
 
-    res = _memcmp_uint8_t(left, right, len, &left, &right, &len);
-    return res;
+    disable_all_interrupts();
+    return true;
 }
 
-#if defined(__x86_64__)
-    #define REP_MOVSB_MIN 16
-#endif /* defined(__x86_64__) */
+__optimize(3) static inline void simd_end() {
+    enable_all_interrupts();
+}
+
+// Copies and compares of up to this many bytes are done by the word variants,
+// which don't loop at that size.
+
+#define SIMD_MIN 32
 
-__optimize(3) void *memcpy(void *dst, const void *src, unsigned long n) {
-    void *ret = dst;
 #if defined(__x86_64__)
-    if (n >= REP_MOVSB_MIN) {
-        asm volatile ("rep movsb" :: "D"(dst), "S"(src), "c"(n) : "memory");
-        return ret;
+    // Without avx2, rep movsb and rep stosb are only faster than the word
+    // variants above this size.
+
+    #define REP_WORDS_MAX 1024
+
+    // With avx2, rep stosb only catches up to the avx2 variant at this size.
+    // The rep movsb threshold depends on fsrm, and is set by memops_init().
+
+    #define REP_STOSB_AVX2_MIN 2048
+
+    static size_t g_rep_movsb_avx2_min = 4096;
+
+    __optimize(3) static void *
+    memcpy_words_or_rep(void *const dst, const void *const src, const size_t n)
+    {
+        if (n >= REP_WORDS_MAX) {
+            return memcpy_rep_movsb(dst, src, n);
+        }
+
+        return memcpy_words(dst, src, n);
     }
-#endif
-    if (n >= sizeof(uint64_t)) {
-        n = _memcpy_uint64_t(dst, src, n, &dst, &src);
-        n = _memcpy_uint32_t(dst, src, n, &dst, &src);
-        n = _memcpy_uint16_t(dst, src, n, &dst, &src);
-
-        _memcpy_uint8_t(dst, src, n, &dst, &src);
-    } else if (n >= sizeof(uint32_t)) {
-        n = _memcpy_uint32_t(dst, src, n, &dst, &src);
-        n = _memcpy_uint16_t(dst, src, n, &dst, &src);
-
-        _memcpy_uint8_t(dst, src, n, &dst, &src);
-    } else if (n >= sizeof(uint16_t)) {
-        n = _memcpy_uint16_t(dst, src, n, &dst, &src);
-        if (n == 0) {
+
+    __optimize(3) static void *
+    memset_words_or_rep(void *const dst, const int val, const size_t n) {
+        if (n >= REP_WORDS_MAX) {
+            return memset_rep_stosb(dst, val, n);
+        }
+
+        return memset_words(dst, val, n);
+    }
+
+    __optimize(3) static void *
+    memcpy_avx2_or_rep(void *const dst, const void *const src, const size_t n) {
+        if (n <= SIMD_MIN) {
+            return memcpy_words(dst, src, n);
+        }
+
+        if (n >= g_rep_movsb_avx2_min) {
+            return memcpy_rep_movsb(dst, src, n);
+        }
+
+        if (!simd_begin()) {
+            return memcpy_words_or_rep(dst, src, n);
+        }
+
+        memcpy_avx2(dst, src, n);
+        simd_end();
+
+        return dst;
+    }
+
+    __optimize(3) static void *
+    memset_avx2_or_rep(void *const dst, const int val, const size_t n) {
+        if (n <= SIMD_MIN) {
+            return memset_words(dst, val, n);
+        }
+
+        if (n >= REP_STOSB_AVX2_MIN) {
+            return memset_rep_stosb(dst, val, n);
+        }
+
+        if (!simd_begin()) {
+            return memset_words_or_rep(dst, val, n);
+        }
+
+        memset_avx2(dst, val, n);
+        simd_end();
+
+        return dst;
+    }
+
+    __optimize(3) static int
+    memcmp_avx2_or_words(const void *const left,
+                         const void *const right,
+                         const size_t n)
+    {
+        if (n <= SIMD_MIN || !simd_begin()) {
+            return memcmp_words(left, right, n);
+        }
+
+        const int result = memcmp_avx2(left, right, n);
+        simd_end();
+
+        return result;
+    }
+
+    // Most strings are short, so only switch to avx2 once the first few words
+    // didn't have the terminator.
+
+    #define STRLEN_SIMD_MIN 64
+
+    __optimize(3) static size_t strlen_avx2_or_words(const char *const str) {
+        const size_t head = strnlen_words(str, STRLEN_SIMD_MIN);
+        if (head != STRLEN_SIMD_MIN) {
+            return head;
+        }
+
+        if (!simd_begin()) {
+            return head + strlen_words(str + head);
+        }
+
+        const size_t result = head + strlen_avx2(str + head);
+        simd_end();
+
+        return result;
+    }
+
+    __optimize(3) static size_t
+    strnlen_avx2_or_words(const char *const str, const size_t limit) {
+        const size_t head_limit =
+            limit < STRLEN_SIMD_MIN ? limit : STRLEN_SIMD_MIN;
+
+        const size_t head = strnlen_words(str, head_limit);
+        if (head != STRLEN_SIMD_MIN) {
+            return head;
+        }
+
+        if (!simd_begin()) {
+            return head + strnlen_words(str + head, limit - head);
+        }
+
+        const size_t result = head + strnlen_avx2(str + head, limit - head);
+        simd_end();
+
+        return result;
+    }
+
+    __optimize(3) static void *
+    memchr_avx2_or_words(const void *const ptr, const int ch, const size_t n) {
+        if (n <= SIMD_MIN || !simd_begin()) {
+            return memchr_words(ptr, ch, n);
+        }
+
+        void *const result = memchr_avx2(ptr, ch, n);
+        simd_end();
+
+        return result;
+    }
+
+    // rep movsb works on every x86_64 cpu, and the kernel requires erms, so
+    // it's used until the cpu's features are known.
+
+    static memcpy_func_t g_memcpy = memcpy_words_or_rep;
+    static memset_func_t g_memset = memset_words_or_rep;
+#else
+    #if defined(__aarch64__)
+        __optimize(3) static void *
+        memcpy_neon_or_words(void *const dst,
+                             const void *const src,
+                             const size_t n)
+        {
+            if (n <= SIMD_MIN || !simd_begin()) {
+                return memcpy_words(dst, src, n);
+            }
+
+            memcpy_neon(dst, src, n);
+            simd_end();
+
             return dst;
         }
 
-        _memcpy_uint8_t(dst, src, n, &dst, &src);
-    } else {
-        _memcpy_uint8_t(dst, src, n, &dst, &src);
+        __optimize(3) static void *
+        memset_neon_or_words(void *const dst, const int val, const size_t n) {
+            if (n <= SIMD_MIN || !simd_begin()) {
+                return memset_words(dst, val, n);
+            }
+
+            memset_neon(dst, val, n);
+            simd_end();
+
+            return dst;
+        }
+
+        __optimize(3) static int
+        memcmp_neon_or_words(const void *const left,
+                             const void *const right,
+                             const size_t n)
+        {
+            if (n <= SIMD_MIN || !simd_begin()) {
+                return memcmp_words(left, right, n);
+            }
+
+            const int result = memcmp_neon(left, right, n);
+            simd_end();
+
+            return result;
+        }
+    #endif /* defined(__aarch64__) */
+
+    static memcpy_func_t g_memcpy = memcpy_words;
+    static memset_func_t g_memset = memset_words;
+#endif /* defined(__x86_64__) */
+
+static memcmp_func_t g_memcmp = memcmp_words;
+
+static strlen_func_t g_strlen = strlen_words;
+static strnlen_func_t g_strnlen = strnlen_words;
+static memchr_func_t g_memchr = memchr_words;
+
+void memops_init() {
+#if defined(__x86_64__)
+    const struct cpu_capabilities *const caps = get_cpu_capabilities();
+
+    // With fsrm, rep movsb catches up to avx2 sooner.
+    if (caps->supports_fsrm) {
+        g_rep_movsb_avx2_min = 2048;
     }
 
-    return ret;
+    if (caps->supports_avx && caps->supports_avx2) {
+        g_memcpy = memcpy_avx2_or_rep;
+        g_memset = memset_avx2_or_rep;
+        g_memcmp = memcmp_avx2_or_words;
+        g_strlen = strlen_avx2_or_words;
+        g_strnlen = strnlen_avx2_or_words;
+        g_memchr = memchr_avx2_or_words;
+
+        printk(LOGLEVEL_INFO,
+               "memops: using avx2 variants, rep movsb from %" PRIu64 " "
+               "bytes\n",
+               (uint64_t)g_rep_movsb_avx2_min);
+    }
+#elif defined(__aarch64__)
+    if (cpu_get_features()->adv_simd == CPU_FEAT_ADV_SIMD_FULL) {
+        g_memcpy = memcpy_neon_or_words;
+        g_memset = memset_neon_or_words;
+        g_memcmp = memcmp_neon_or_words;
+
+        printk(LOGLEVEL_INFO, "memops: using neon variants\n");
+    }
+#endif /* defined(__x86_64__) */
+}
+
+__optimize(3)
+int memcmp(const void *const left, const void *const right, const size_t n) {
+    return g_memcmp(left, right, n);
+}
+
+__optimize(3)
+void *memcpy(void *const dst, const void *const src, const unsigned long n) {
+    return g_memcpy(dst, src, n);
+}
+
+__optimize(3)
+void *memset(void *const dst, const int val, const unsigned long n) {
+    return g_memset(dst, val, n);
 }
 
 #define DECL_MEM_COPY_BACK_FUNC(type) \
@@ -247,15 +403,9 @@ DECL_MEM_COPY_BACK_FUNC(uint64_t)
 __optimize(3) void *memmove(void *dst, const void *src, unsigned long n) {
     void *ret = dst;
     if (src > dst) {
-    #if defined(__x86_64__)
-        if (n >= REP_MOVSB_MIN) {
-            asm volatile ("std;"
-                          "rep movsb;"
-                          "cld"
-                          :: "D"(dst), "S"(src), "c"(n) : "memory");
-            return ret;
-        }
-    #endif /* defined(__x86_64__) */
+        // Every memcpy() variant copies front to back, and loads a chunk
+        // before storing it, so it's safe to use as long as dst is below src.
+
         const uint64_t diff = distance(dst, src);
         if (diff >= sizeof(uint64_t)) {
             memcpy(dst, src, n);
@@ -272,7 +422,7 @@ __optimize(3) void *memmove(void *dst, const void *src, unsigned long n) {
         }
     } else {
     #if defined(__x86_64__)
-        if (n >= REP_MOVSB_MIN) {
+        if (n >= REP_MIN) {
             void *dst_back = &((uint8_t *)dst)[n - 1];
             const void *src_back = &((const uint8_t *)src)[n - 1];
 
@@ -308,73 +458,28 @@ __optimize(3) void *memmove(void *dst, const void *src, unsigned long n) {
     return ret;
 }
 
-#if defined(__x86_64__)
-    #define REP_MIN 16
-#elif defined(__riscv64)
-    // FIXME: 64 is the cbo size in QEMU, read value for dtb instead.
-    #define CBO_SIZE 64
-#endif /* defined(__x86_64__) */
-
-__optimize(3) void *memset(void *dst, const int val, unsigned long n) {
-    void *ret = dst;
-#if defined(__x86_64__)
-    if (n >= REP_MIN) {
-        asm volatile ("rep stosb" :: "D"(dst), "al"(val), "c"(n) : "memory");
-        return ret;
-    }
-#else
-    uint64_t value64 = 0;
-    if (n >= sizeof(uint64_t)) {
-        value64 =
-            (uint64_t)val << 56 |
-            (uint64_t)val << 48 |
-            (uint64_t)val << 40 |
-            (uint64_t)val << 32 |
-            (uint64_t)val << 24 |
-            (uint64_t)val << 16 |
-            (uint64_t)val << 8 |
-            (uint64_t)val;
-
-        do {
-            *(uint64_t *)dst = value64;
-
-            dst += sizeof(uint64_t);
-            n -= sizeof(uint64_t);
-        } while (n >= sizeof(uint64_t));
-
-        while (n >= sizeof(uint32_t)) {
-            *(uint32_t *)dst = value64;
-
-            dst += sizeof(uint32_t);
-            n -= sizeof(uint32_t);
-        }
-
-        while (n >= sizeof(uint16_t)) {
-            *(uint16_t *)dst = value64;
+__optimize(3)
+void *memchr(const void *const ptr, const int ch, const size_t count) {
+    return g_memchr(ptr, ch, count);
+}
 
-            dst += sizeof(uint16_t);
-            n -= sizeof(uint16_t);
-        }
-    }
-#endif /* defined(__x86_64__) */
+__optimize(3) size_t strlen(const char *const str) {
+    return g_strlen(str);
+}
 
-    for (unsigned long i = 0; i != n; i++) {
-        ((uint8_t *)dst)[i] = (uint8_t)val;
-    }
+// The bytes up to `limit` may not all be mapped, so strnlen() can't go
+// through memchr(), whose simd variant loads the whole buffer.
 
-    return ret;
+__optimize(3) size_t strnlen(const char *const str, const size_t limit) {
+    return g_strnlen(str, limit);
 }
 
-__optimize(3)
-void *memchr(const void *const ptr, const int ch, const size_t count) {
-    const uint8_t *const end = ptr + count;
-    for (const uint8_t *iter = (const uint8_t *)ptr; iter != end; iter++) {
-        if (*iter == ch) {
-            return (void *)(uint64_t)iter;
-        }
-    }
+__optimize(3) char *strchr(const char *const str, const int ch) {
+    return strchr_words(str, ch);
+}
 
-    return NULL;
+__optimize(3) char *strrchr(const char *const str, const int ch) {
+    return strrchr_words(str, ch);
 }
 
 __optimize(3) void bzero(void *dst, unsigned long n) {
@@ -393,12 +498,13 @@ __optimize(3) void bzero(void *dst, unsigned long n) {
         n -= sizeof(uint64_t) * 2;
     }
 #elif defined(__riscv64)
-    if (has_align((uint64_t)dst, CBO_SIZE)) {
-        while (n >= CBO_SIZE) {
-            asm volatile ("cbo.zero (%0)" :: "r"(dst));
+    const uint32_t cbo_size = get_cpu_capabilities()->cboz_block_size;
+    if (cbo_size != 0 && has_align((uint64_t)dst, cbo_size)) {
+        while (n >= cbo_size) {
+            asm volatile ("cbo.zero (%0)" :: "r"(dst) : "memory");
 
-            dst += CBO_SIZE;
-            n -= CBO_SIZE;
+            dst += cbo_size;
+            n -= cbo_size;
         }
     }
 #endif
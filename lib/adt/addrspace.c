@@ -20,13 +20,106 @@ struct addrspace_node *addrspace_node_prev(struct addrspace_node *const node) {
 
 __optimize(3)
 struct addrspace_node *addrspace_node_next(struct addrspace_node *const node) {
-    if (node->list.prev == &node->addrspace->list) {
+    if (node->list.next == &node->addrspace->list) {
         return NULL;
     }
 
     return container_of(node->list.next, struct addrspace_node, list);
 }
 
+#if defined(ADDRSPACE_BTREE)
+
+// Add `node` to the address-space's list, after the node that precedes it in
+// the btree.
+
+static void
+add_to_list(struct address_space *const addrspace,
+            struct addrspace_node *const node)
+{
+    struct range_btree_iter iter;
+    const bool found =
+        range_btree_iter_find(&addrspace->btree, node->range.front, &iter);
+
+    assert(found);
+    if (!range_btree_iter_prev(&iter)) {
+        list_add(&addrspace->list, &node->list);
+        return;
+    }
+
+    struct addrspace_node *const prev = range_btree_iter_value(iter);
+    list_add(&prev->list, &node->list);
+}
+
+uint64_t
+addrspace_find_space_and_add_node(struct address_space *const addrspace,
+                                  const struct range in_range,
+                                  struct addrspace_node *const node,
+                                  const uint64_t align)
+{
+    const uint64_t addr =
+        range_btree_find_space(&addrspace->btree,
+                               in_range,
+                               node->range.size,
+                               align);
+
+    if (addr == RANGE_BTREE_INVALID_ADDR) {
+        return ADDRSPACE_INVALID_ADDR;
+    }
+
+    node->range.front = addr;
+    if (!range_btree_insert(&addrspace->btree, node->range, node)) {
+        return ADDRSPACE_INVALID_ADDR;
+    }
+
+    add_to_list(addrspace, node);
+    return addr;
+}
+
+bool
+addrspace_add_node(struct address_space *const addrspace,
+                   struct addrspace_node *const node)
+{
+    if (!range_btree_insert(&addrspace->btree, node->range, node)) {
+        return false;
+    }
+
+    add_to_list(addrspace, node);
+    return true;
+}
+
+__optimize(3) struct addrspace_node *
+addrspace_find_node(const struct address_space *const addrspace,
+                    const uint64_t loc)
+{
+    return range_btree_find(&addrspace->btree, loc);
+}
+
+__optimize(3) struct addrspace_node *
+addrspace_find_node_after(const struct address_space *const addrspace,
+                          const uint64_t loc)
+{
+    struct range_btree_iter iter;
+    if (!range_btree_iter_find(&addrspace->btree, loc, &iter)) {
+        return NULL;
+    }
+
+    return range_btree_iter_value(iter);
+}
+
+void addrspace_remove_node(struct addrspace_node *const node) {
+    range_btree_remove(&node->addrspace->btree, node->range.front);
+    list_remove(&node->list);
+}
+
+__optimize(3) void addrspace_print(struct address_space *const addrspace) {
+    struct addrspace_node *node;
+    list_foreach(node, &addrspace->list, list) {
+        printk(LOGLEVEL_INFO, RANGE_FMT "\n", RANGE_FMT_ARGS(node->range));
+    }
+}
+
+#else
+
 enum traversal_result {
     TRAVERSAL_DONE,
     TRAVERSAL_CONTINUE,
@@ -306,10 +399,54 @@ addrspace_add_node(struct address_space *const addrspace,
                        /*added_node=*/add_node_cb);
 }
 
+__optimize(3) struct addrspace_node *
+addrspace_find_node(const struct address_space *const addrspace,
+                    const uint64_t loc)
+{
+    struct avlnode *avlnode = addrspace->avltree.root;
+    while (avlnode != NULL) {
+        struct addrspace_node *const node = addrspace_node_of(avlnode);
+        if (loc < node->range.front) {
+            avlnode = avlnode->left;
+            continue;
+        }
+
+        if (range_has_loc(node->range, loc)) {
+            return node;
+        }
+
+        avlnode = avlnode->right;
+    }
+
+    return NULL;
+}
+
+__optimize(3) struct addrspace_node *
+addrspace_find_node_after(const struct address_space *const addrspace,
+                          const uint64_t loc)
+{
+    struct addrspace_node *result = NULL;
+    struct avlnode *avlnode = addrspace->avltree.root;
+
+    while (avlnode != NULL) {
+        struct addrspace_node *const node = addrspace_node_of(avlnode);
+        if (range_get_end_assert(node->range) > loc) {
+            result = node;
+            avlnode = avlnode->left;
+        } else {
+            avlnode = avlnode->right;
+        }
+    }
+
+    return result;
+}
+
 void addrspace_remove_node(struct addrspace_node *const node) {
     avltree_delete_node(&node->addrspace->avltree,
                         &node->avlnode,
                         avltree_update);
+
+    list_remove(&node->list);
 }
 
 __optimize(3)
@@ -338,4 +475,6 @@ __optimize(3) void addrspace_print(struct address_space *const addrspace) {
                   avlnode_print_node_cb,
                   avlnode_print_sv_cb,
                   /*cb_info=*/NULL);
-}
\ No newline at end of file
+}
+
+#endif /* defined(ADDRSPACE_BTREE) */
@@ -7,11 +7,20 @@
 
 #include "lib/adt/avltree.h"
 #include "lib/adt/range.h"
+#include "lib/adt/range_btree.h"
 
 #include "lib/list.h"
 
+// Build with ADDRSPACE_BTREE defined to keep the nodes of an address-space in
+// a range_btree instead of an avltree.
+
 struct address_space {
+#if defined(ADDRSPACE_BTREE)
+    struct range_btree btree;
+#else
     struct avltree avltree;
+#endif /* defined(ADDRSPACE_BTREE) */
+
     struct list list;
 };
 
@@ -28,11 +37,19 @@ struct addrspace_node {
     uint64_t largest_free_to_prev;
 };
 
-#define ADDRSPACE_INIT(name) \
-    ((struct address_space){ \
-        .avltree = AVLTREE_INIT(),   \
-        .list = LIST_INIT(name.list) \
-    })
+#if defined(ADDRSPACE_BTREE)
+    #define ADDRSPACE_INIT(name) \
+        ((struct address_space){ \
+            .btree = RANGE_BTREE_INIT(), \
+            .list = LIST_INIT(name.list) \
+        })
+#else
+    #define ADDRSPACE_INIT(name) \
+        ((struct address_space){ \
+            .avltree = AVLTREE_INIT(),   \
+            .list = LIST_INIT(name.list) \
+        })
+#endif /* defined(ADDRSPACE_BTREE) */
 
 #define ADDRSPACE_NODE_INIT(name, addrspace_) \
     ((struct addrspace_node){ \
@@ -61,5 +78,17 @@ bool
 addrspace_add_node(struct address_space *addrspace,
                    struct addrspace_node *node);
 
+// Returns the node whose range contains `loc`, or NULL if `loc` isn't inside
+// any node.
+
+struct addrspace_node *
+addrspace_find_node(const struct address_space *addrspace, uint64_t loc);
+
+// Returns the first node that ends after `loc`, i.e. the node containing `loc`
+// if there is one, or the first node after `loc` otherwise.
+
+struct addrspace_node *
+addrspace_find_node_after(const struct address_space *addrspace, uint64_t loc);
+
 void addrspace_remove_node(struct addrspace_node *node);
 void addrspace_print(struct address_space *addrspace);
\ No newline at end of file
@@ -387,28 +387,6 @@ avltree_delete(struct avltree *const tree,
     }
 }
 
-__optimize(3) struct avlnode *avlnode_successor(struct avlnode *node) {
-    if (node->right != NULL) {
-        node = node->right;
-        while (node->left != NULL) {
-            node = node->left;
-        }
-
-        return node;
-    }
-
-    node = node->parent;
-    while (node != NULL) {
-        if (node->left != NULL) {
-            return node;
-        }
-
-        node = node->parent;
-    }
-
-    return NULL;
-}
-
 void
 avltree_delete_node(struct avltree *const tree,
                     struct avlnode *const node,
@@ -517,6 +495,145 @@ struct avlnode *avltree_rightmost(const struct avltree *const tree) {
     }
 }
 
+__optimize(3) struct avlnode *avlnode_next(struct avlnode *node) {
+    if (node->right != NULL) {
+        node = node->right;
+        while (node->left != NULL) {
+            node = node->left;
+        }
+
+        return node;
+    }
+
+    // Go up until we leave a left subtree, whose parent is then the next node.
+    struct avlnode *parent = node->parent;
+    while (parent != NULL && parent->right == node) {
+        node = parent;
+        parent = parent->parent;
+    }
+
+    return parent;
+}
+
+__optimize(3) struct avlnode *avlnode_prev(struct avlnode *node) {
+    if (node->left != NULL) {
+        node = node->left;
+        while (node->right != NULL) {
+            node = node->right;
+        }
+
+        return node;
+    }
+
+    struct avlnode *parent = node->parent;
+    while (parent != NULL && parent->left == node) {
+        node = parent;
+        parent = parent->parent;
+    }
+
+    return parent;
+}
+
+__optimize(3) struct avlnode *
+avltree_lower_bound(const struct avltree *const tree,
+                    void *const key,
+                    const avlnode_compare_key_t compare_key)
+{
+    struct avlnode *result = NULL;
+    struct avlnode *node = tree->root;
+
+    while (node != NULL) {
+        if (compare_key(node, key) <= 0) {
+            result = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+
+    return result;
+}
+
+__optimize(3) struct avlnode *
+avltree_upper_bound(const struct avltree *const tree,
+                    void *const key,
+                    const avlnode_compare_key_t compare_key)
+{
+    struct avlnode *result = NULL;
+    struct avlnode *node = tree->root;
+
+    while (node != NULL) {
+        if (compare_key(node, key) < 0) {
+            result = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+
+    return result;
+}
+
+// Build a subtree out of the next `count` items of the list, starting at
+// `*item_in`. The left half goes first, so items are consumed in order.
+
+__optimize(3) static struct avlnode *
+build_sorted(struct list **const item_in,
+             const uint64_t count,
+             const avlnode_of_list_t node_of,
+             const avlnode_update_t update)
+{
+    if (count == 0) {
+        return NULL;
+    }
+
+    const uint64_t left_count = count / 2;
+    struct avlnode *const left =
+        build_sorted(item_in, left_count, node_of, update);
+
+    struct list *const item = *item_in;
+    struct avlnode *const node = node_of(item);
+
+    *item_in = item->next;
+
+    node->parent = NULL;
+    node->left = left;
+    node->right = build_sorted(item_in, count - left_count - 1, node_of, update);
+
+    if (left != NULL) {
+        left->parent = node;
+    }
+
+    if (node->right != NULL) {
+        node->right->parent = node;
+    }
+
+    // The two halves differ in size by at most one, so their heights do too.
+    reset_node_height(node);
+    avlnode_update(node, update);
+
+    return node;
+}
+
+__optimize(3) void
+avltree_build_sorted(struct avltree *const tree,
+                     struct list *const list,
+                     const avlnode_of_list_t node_of,
+                     const avlnode_update_t update)
+{
+    assert(tree->root == NULL);
+
+    uint64_t count = 0;
+    for (struct list *item = list->next; item != list; item = item->next) {
+        count++;
+    }
+
+    struct list *item = list->next;
+
+    tree->root = build_sorted(&item, count, node_of, update);
+    avlnode_verify(tree->root, /*parent=*/NULL);
+}
+
 __optimize(3) void
 avltree_print(struct avltree *const tree,
               const avlnode_print_node_cb_t print_node_cb,
@@ -5,6 +5,7 @@
 
 #pragma once
 #include "lib/adt/string_view.h"
+#include "lib/list.h"
 
 struct avlnode {
     struct avlnode *parent;
@@ -72,6 +73,48 @@ avltree_delete_node(struct avltree *tree,
 struct avlnode *avltree_leftmost(const struct avltree *tree);
 struct avlnode *avltree_rightmost(const struct avltree *tree);
 
+// In-order traversal that follows parent links instead of recursing.
+
+struct avlnode *avlnode_next(struct avlnode *node);
+struct avlnode *avlnode_prev(struct avlnode *node);
+
+#define avltree_foreach(node, tree) \
+    for (node = avltree_leftmost(tree); node != NULL; node = avlnode_next(node))
+
+#define avltree_foreach_reverse(node, tree) \
+    for (node = avltree_rightmost(tree); \
+         node != NULL;                   \
+         node = avlnode_prev(node))
+
+// Both take the same key callback as avltree_delete(), which returns a
+// negative value if `key` is ordered before `theirs`, and zero if they match.
+// Returns the first node not ordered before `key`.
+
+struct avlnode *
+avltree_lower_bound(const struct avltree *tree,
+                    void *key,
+                    avlnode_compare_key_t compare_key);
+
+// Returns the first node ordered after `key`.
+
+struct avlnode *
+avltree_upper_bound(const struct avltree *tree,
+                    void *key,
+                    avlnode_compare_key_t compare_key);
+
+typedef struct avlnode *(*avlnode_of_list_t)(struct list *item);
+
+// Build a balanced tree out of `list`, which must already be sorted, in
+// linear time with no comparisons. `node_of` returns the avlnode embedded
+// next to each list item, and `update` is called on every node after both its
+// children. `tree` must be empty, and `list` is left untouched.
+
+void
+avltree_build_sorted(struct avltree *tree,
+                     struct list *list,
+                     avlnode_of_list_t node_of,
+                     avlnode_update_t update);
+
 typedef struct range
 (*avlnode_get_range_t)(struct avltree *tree,
                        struct avlnode *node,
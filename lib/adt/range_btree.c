@@ -0,0 +1,711 @@
+/*
+ * lib/adt/range_btree.c
+ * © suhas pai
+ */
+
+#include "lib/alloc.h"
+#include "lib/align.h"
+#include "lib/assert.h"
+#include "lib/overflow.h"
+#include "lib/string.h"
+
+#include "range_btree.h"
+
+static struct range_btree_node *node_alloc(const bool is_leaf) {
+    struct range_btree_node *const node =
+        malloc(sizeof(struct range_btree_node));
+
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->parent = NULL;
+    node->count = 0;
+    node->is_leaf = is_leaf;
+
+    return node;
+}
+
+__optimize(3) static void
+move_entries(struct range_btree_node *const dst,
+             const uint16_t dst_index,
+             struct range_btree_node *const src,
+             const uint16_t src_index,
+             const uint16_t count)
+{
+    memmove(&dst->fronts[dst_index],
+            &src->fronts[src_index],
+            sizeof(uint64_t) * count);
+    memmove(&dst->ends[dst_index],
+            &src->ends[src_index],
+            sizeof(uint64_t) * count);
+    memmove(&dst->gaps[dst_index],
+            &src->gaps[src_index],
+            sizeof(uint64_t) * count);
+    memmove(&dst->slots[dst_index],
+            &src->slots[src_index],
+            sizeof(void *) * count);
+
+    if (dst != src && !dst->is_leaf) {
+        for (uint16_t i = dst_index; i != dst_index + count; i++) {
+            ((struct range_btree_node *)dst->slots[i])->parent = dst;
+        }
+    }
+}
+
+__optimize(3) static uint16_t
+index_in_parent(const struct range_btree_node *const node) {
+    const struct range_btree_node *const parent = node->parent;
+    for (uint16_t i = 0; i != parent->count; i++) {
+        if (parent->slots[i] == node) {
+            return i;
+        }
+    }
+
+    verify_not_reached();
+}
+
+__optimize(3) static uint64_t
+largest_gap(const struct range_btree_node *const node) {
+    uint64_t result = 0;
+    for (uint16_t i = 0; i != node->count; i++) {
+        result = max(result, node->gaps[i]);
+    }
+
+    return result;
+}
+
+// Store the summary of `node` into its slot in its parent. Returns false if the
+// summary didn't change.
+
+__optimize(3) static bool
+update_summary_at(struct range_btree_node *const node, const uint16_t index) {
+    struct range_btree_node *const parent = node->parent;
+
+    const uint64_t front = node->fronts[0];
+    const uint64_t end = node->ends[node->count - 1];
+    const uint64_t gap = largest_gap(node);
+
+    if (parent->fronts[index] == front &&
+        parent->ends[index] == end &&
+        parent->gaps[index] == gap)
+    {
+        return false;
+    }
+
+    parent->fronts[index] = front;
+    parent->ends[index] = end;
+    parent->gaps[index] = gap;
+
+    return true;
+}
+
+__optimize(3) static void propagate(struct range_btree_node *node) {
+    while (node->parent != NULL) {
+        if (!update_summary_at(node, index_in_parent(node))) {
+            return;
+        }
+
+        node = node->parent;
+    }
+}
+
+__optimize(3) static struct range_btree_node *
+leftmost_leaf(struct range_btree_node *node) {
+    while (!node->is_leaf) {
+        node = node->slots[0];
+    }
+
+    return node;
+}
+
+__optimize(3) static struct range_btree_node *
+rightmost_leaf(struct range_btree_node *node) {
+    while (!node->is_leaf) {
+        node = node->slots[node->count - 1];
+    }
+
+    return node;
+}
+
+// Returns the index of the last entry whose front is at or below `loc`, or 0 if
+// there's no such entry.
+
+__optimize(3) static uint16_t
+find_index(const struct range_btree_node *const node, const uint64_t loc) {
+    uint16_t index = 0;
+    for (uint16_t i = 1; i != node->count; i++) {
+        if (node->fronts[i] > loc) {
+            break;
+        }
+
+        index = i;
+    }
+
+    return index;
+}
+
+__optimize(3) static struct range_btree_node *
+find_leaf(const struct range_btree *const tree, const uint64_t loc) {
+    struct range_btree_node *node = tree->root;
+    while (!node->is_leaf) {
+        node = node->slots[find_index(node, loc)];
+    }
+
+    return node;
+}
+
+// Split `node` in half, adding the new right half to the node's parent, and
+// splitting the parent first if it's full. The tree is left valid even if an
+// allocation fails.
+
+static bool
+split_node(struct range_btree *const tree, struct range_btree_node *const node)
+{
+    struct range_btree_node *parent = node->parent;
+    if (parent == NULL) {
+        parent = node_alloc(/*is_leaf=*/false);
+        if (parent == NULL) {
+            return false;
+        }
+
+        parent->count = 1;
+        parent->slots[0] = node;
+
+        node->parent = parent;
+        tree->root = parent;
+
+        update_summary_at(node, /*index=*/0);
+    } else if (parent->count == RANGE_BTREE_MAX_COUNT) {
+        if (!split_node(tree, parent)) {
+            return false;
+        }
+
+        parent = node->parent;
+    }
+
+    struct range_btree_node *const right = node_alloc(node->is_leaf);
+    if (right == NULL) {
+        return false;
+    }
+
+    const uint16_t left_count = node->count / 2;
+    const uint16_t right_count = node->count - left_count;
+
+    move_entries(right, /*dst_index=*/0, node, left_count, right_count);
+
+    right->count = right_count;
+    node->count = left_count;
+
+    const uint16_t index = index_in_parent(node);
+    move_entries(parent,
+                 index + 2,
+                 parent,
+                 index + 1,
+                 parent->count - index - 1);
+
+    parent->slots[index + 1] = right;
+    parent->count++;
+
+    right->parent = parent;
+
+    update_summary_at(node, index);
+    update_summary_at(right, index + 1);
+
+    return true;
+}
+
+__optimize(3) static void
+leaf_insert_at(struct range_btree_node *const leaf,
+               const uint16_t index,
+               const struct range range,
+               const uint64_t end,
+               const uint64_t gap,
+               void *const value)
+{
+    move_entries(leaf, index + 1, leaf, index, leaf->count - index);
+
+    leaf->fronts[index] = range.front;
+    leaf->ends[index] = end;
+    leaf->gaps[index] = gap;
+    leaf->slots[index] = value;
+
+    leaf->count++;
+}
+
+// Set the gap of the range at `iter` to start from `prev_end`.
+
+__optimize(3) static void
+set_gap(const struct range_btree_iter iter, const uint64_t prev_end) {
+    iter.node->gaps[iter.index] = iter.node->fronts[iter.index] - prev_end;
+    propagate(iter.node);
+}
+
+bool
+range_btree_insert(struct range_btree *const tree,
+                   const struct range range,
+                   void *const value)
+{
+    const uint64_t end = range_get_end_assert(range);
+    if (tree->root == NULL) {
+        struct range_btree_node *const leaf = node_alloc(/*is_leaf=*/true);
+        if (leaf == NULL) {
+            return false;
+        }
+
+        leaf_insert_at(leaf, /*index=*/0, range, end, range.front, value);
+
+        tree->root = leaf;
+        tree->count = 1;
+
+        return true;
+    }
+
+    // Find the neighbors of the new range, and check that they don't overlap
+    // with it.
+
+    struct range_btree_iter next = {0};
+    struct range_btree_iter prev = {0};
+
+    bool has_next = range_btree_iter_find(tree, range.front, &next);
+    bool has_prev = false;
+
+    if (has_next) {
+        if (next.node->fronts[next.index] < end) {
+            return false;
+        }
+
+        prev = next;
+        has_prev = range_btree_iter_prev(&prev);
+    } else {
+        prev.node = rightmost_leaf(tree->root);
+        prev.index = prev.node->count - 1;
+
+        has_prev = true;
+    }
+
+    // Insert after `prev` in its leaf if it has one, as it's the leaf the range
+    // belongs to, or at the very front of the tree otherwise.
+
+    const uint64_t prev_end = has_prev ? prev.node->ends[prev.index] : 0;
+
+    struct range_btree_node *leaf = NULL;
+    uint16_t index = 0;
+
+    if (has_prev) {
+        leaf = prev.node;
+        index = prev.index + 1;
+    } else {
+        leaf = next.node;
+        index = 0;
+    }
+
+    if (leaf->count == RANGE_BTREE_MAX_COUNT) {
+        if (!split_node(tree, leaf)) {
+            return false;
+        }
+
+        if (index > leaf->count) {
+            index -= leaf->count;
+            leaf = leaf->parent->slots[index_in_parent(leaf) + 1];
+        }
+    }
+
+    leaf_insert_at(leaf, index, range, end, range.front - prev_end, value);
+
+    propagate(leaf);
+    tree->count++;
+
+    // The range after the new one now has its gap start at the new range's end.
+    // Find it again, as the split may have moved it.
+
+    if (has_next) {
+        struct range_btree_iter iter = { .node = leaf, .index = index };
+
+        has_next = range_btree_iter_next(&iter);
+        assert(has_next);
+
+        set_gap(iter, end);
+    }
+
+    return true;
+}
+
+static void
+rebalance(struct range_btree *const tree, struct range_btree_node *const node);
+
+static void
+remove_child(struct range_btree *const tree,
+             struct range_btree_node *const parent,
+             const uint16_t index)
+{
+    move_entries(parent,
+                 index,
+                 parent,
+                 index + 1,
+                 parent->count - index - 1);
+
+    parent->count--;
+    if (parent->count != 0) {
+        propagate(parent);
+    }
+
+    rebalance(tree, parent);
+}
+
+static void
+rebalance(struct range_btree *const tree, struct range_btree_node *const node) {
+    if (node->parent == NULL) {
+        if (node->count == 0) {
+            tree->root = NULL;
+            free(node);
+        } else if (!node->is_leaf && node->count == 1) {
+            tree->root = node->slots[0];
+            tree->root->parent = NULL;
+
+            free(node);
+        }
+
+        return;
+    }
+
+    if (node->count >= RANGE_BTREE_MIN_COUNT) {
+        return;
+    }
+
+    struct range_btree_node *const parent = node->parent;
+    const uint16_t node_index = index_in_parent(node);
+
+    if (parent->count == 1) {
+        if (node->count == 0) {
+            free(node);
+            remove_child(tree, parent, node_index);
+        }
+
+        return;
+    }
+
+    const uint16_t left_index = node_index != 0 ? node_index - 1 : node_index;
+    struct range_btree_node *const left = parent->slots[left_index];
+    struct range_btree_node *const right = parent->slots[left_index + 1];
+
+    if (left->count + right->count <= RANGE_BTREE_MAX_COUNT) {
+        // Merge right into left.
+
+        move_entries(left, left->count, right, /*src_index=*/0, right->count);
+        left->count += right->count;
+
+        update_summary_at(left, left_index);
+        free(right);
+
+        remove_child(tree, parent, left_index + 1);
+        return;
+    }
+
+    // Otherwise, even out the entries between the two nodes.
+
+    const uint16_t total = left->count + right->count;
+    const uint16_t new_left_count = total / 2;
+
+    if (left->count > new_left_count) {
+        const uint16_t amount = left->count - new_left_count;
+
+        move_entries(right, amount, right, /*src_index=*/0, right->count);
+        move_entries(right, /*dst_index=*/0, left, new_left_count, amount);
+    } else {
+        const uint16_t amount = new_left_count - left->count;
+
+        move_entries(left, left->count, right, /*src_index=*/0, amount);
+        move_entries(right,
+                     /*dst_index=*/0,
+                     right,
+                     amount,
+                     right->count - amount);
+    }
+
+    left->count = new_left_count;
+    right->count = total - new_left_count;
+
+    update_summary_at(left, left_index);
+    update_summary_at(right, left_index + 1);
+
+    propagate(parent);
+}
+
+void *range_btree_remove(struct range_btree *const tree, const uint64_t front) {
+    if (tree->root == NULL) {
+        return NULL;
+    }
+
+    struct range_btree_node *const leaf = find_leaf(tree, front);
+    const uint16_t index = find_index(leaf, front);
+
+    if (leaf->fronts[index] != front) {
+        return NULL;
+    }
+
+    void *const value = leaf->slots[index];
+
+    // The range after the removed one now has its gap start from the end of
+    // the range before the removed one.
+
+    struct range_btree_iter prev = { .node = leaf, .index = index };
+    struct range_btree_iter next = prev;
+
+    const uint64_t prev_end =
+        range_btree_iter_prev(&prev) ? prev.node->ends[prev.index] : 0;
+    const bool has_next = range_btree_iter_next(&next);
+
+    move_entries(leaf, index, leaf, index + 1, leaf->count - index - 1);
+
+    leaf->count--;
+    tree->count--;
+
+    if (leaf->count != 0) {
+        propagate(leaf);
+    }
+
+    if (has_next) {
+        if (next.node == leaf) {
+            next.index--;
+        }
+
+        set_gap(next, prev_end);
+    }
+
+    rebalance(tree, leaf);
+    return value;
+}
+
+void *range_btree_find(const struct range_btree *const tree, const uint64_t loc)
+{
+    if (tree->root == NULL) {
+        return NULL;
+    }
+
+    const struct range_btree_node *const leaf = find_leaf(tree, loc);
+    const uint16_t index = find_index(leaf, loc);
+
+    if (loc < leaf->fronts[index] || loc >= leaf->ends[index]) {
+        return NULL;
+    }
+
+    return leaf->slots[index];
+}
+
+enum search_result {
+    SEARCH_FOUND,
+    SEARCH_CONTINUE,
+    SEARCH_DONE,
+};
+
+static enum search_result
+search_space(const struct range_btree_node *const node,
+             const struct range in_range,
+             const uint64_t in_end,
+             const uint64_t size,
+             const uint64_t align,
+             uint64_t *const result_out)
+{
+    for (uint16_t i = 0; i != node->count; i++) {
+        // Every gap from here on starts after the end of the previous entry,
+        // which is already past in_range.
+
+        if (i != 0 && node->ends[i - 1] >= in_end) {
+            return SEARCH_DONE;
+        }
+
+        if (node->gaps[i] < size || node->ends[i] <= in_range.front) {
+            continue;
+        }
+
+        if (!node->is_leaf) {
+            const enum search_result result =
+                search_space(node->slots[i],
+                             in_range,
+                             in_end,
+                             size,
+                             align,
+                             result_out);
+
+            if (result != SEARCH_CONTINUE) {
+                return result;
+            }
+
+            continue;
+        }
+
+        const uint64_t gap_front = node->fronts[i] - node->gaps[i];
+        if (gap_front >= in_end) {
+            return SEARCH_DONE;
+        }
+
+        uint64_t aligned_front = 0;
+        if (!align_up(max(gap_front, in_range.front), align, &aligned_front)) {
+            return SEARCH_DONE;
+        }
+
+        uint64_t end = 0;
+        if (!check_add(aligned_front, size, &end)) {
+            return SEARCH_DONE;
+        }
+
+        if (end <= node->fronts[i] && end <= in_end) {
+            *result_out = aligned_front;
+            return SEARCH_FOUND;
+        }
+    }
+
+    return SEARCH_CONTINUE;
+}
+
+uint64_t
+range_btree_find_space(const struct range_btree *const tree,
+                       const struct range in_range,
+                       const uint64_t size,
+                       const uint64_t align)
+{
+    const uint64_t in_end = range_get_end_assert(in_range);
+    uint64_t last_end = 0;
+
+    if (tree->root != NULL) {
+        uint64_t result = 0;
+        const enum search_result search_result =
+            search_space(tree->root, in_range, in_end, size, align, &result);
+
+        switch (search_result) {
+            case SEARCH_FOUND:
+                return result;
+            case SEARCH_DONE:
+                return RANGE_BTREE_INVALID_ADDR;
+            case SEARCH_CONTINUE:
+                break;
+        }
+
+        const struct range_btree_node *const root = tree->root;
+        last_end = root->ends[root->count - 1];
+    }
+
+    // Check the free space after the last range.
+
+    uint64_t aligned_front = 0;
+    if (!align_up(max(last_end, in_range.front), align, &aligned_front)) {
+        return RANGE_BTREE_INVALID_ADDR;
+    }
+
+    uint64_t end = 0;
+    if (!check_add(aligned_front, size, &end) || end > in_end) {
+        return RANGE_BTREE_INVALID_ADDR;
+    }
+
+    return aligned_front;
+}
+
+bool
+range_btree_iter_first(const struct range_btree *const tree,
+                       struct range_btree_iter *const iter_out)
+{
+    if (tree->root == NULL) {
+        return false;
+    }
+
+    iter_out->node = leftmost_leaf(tree->root);
+    iter_out->index = 0;
+
+    return true;
+}
+
+bool
+range_btree_iter_find(const struct range_btree *const tree,
+                      const uint64_t loc,
+                      struct range_btree_iter *const iter_out)
+{
+    if (tree->root == NULL) {
+        return false;
+    }
+
+    struct range_btree_node *const leaf = find_leaf(tree, loc);
+    const uint16_t index = find_index(leaf, loc);
+
+    iter_out->node = leaf;
+    iter_out->index = index;
+
+    if (loc < leaf->ends[index]) {
+        return true;
+    }
+
+    return range_btree_iter_next(iter_out);
+}
+
+__optimize(3) bool range_btree_iter_next(struct range_btree_iter *const iter) {
+    if (iter->index + 1 < iter->node->count) {
+        iter->index++;
+        return true;
+    }
+
+    struct range_btree_node *node = iter->node;
+    while (node->parent != NULL) {
+        const uint16_t index = index_in_parent(node);
+        if (index + 1 < node->parent->count) {
+            iter->node = leftmost_leaf(node->parent->slots[index + 1]);
+            iter->index = 0;
+
+            return true;
+        }
+
+        node = node->parent;
+    }
+
+    return false;
+}
+
+__optimize(3) bool range_btree_iter_prev(struct range_btree_iter *const iter) {
+    if (iter->index != 0) {
+        iter->index--;
+        return true;
+    }
+
+    struct range_btree_node *node = iter->node;
+    while (node->parent != NULL) {
+        const uint16_t index = index_in_parent(node);
+        if (index != 0) {
+            iter->node = rightmost_leaf(node->parent->slots[index - 1]);
+            iter->index = iter->node->count - 1;
+
+            return true;
+        }
+
+        node = node->parent;
+    }
+
+    return false;
+}
+
+__optimize(3)
+struct range range_btree_iter_range(const struct range_btree_iter iter) {
+    return range_create_end(iter.node->fronts[iter.index],
+                            iter.node->ends[iter.index]);
+}
+
+__optimize(3) void *range_btree_iter_value(const struct range_btree_iter iter) {
+    return iter.node->slots[iter.index];
+}
+
+static void destroy_node(struct range_btree_node *const node) {
+    if (!node->is_leaf) {
+        for (uint16_t i = 0; i != node->count; i++) {
+            destroy_node(node->slots[i]);
+        }
+    }
+
+    free(node);
+}
+
+void range_btree_destroy(struct range_btree *const tree) {
+    if (tree->root != NULL) {
+        destroy_node(tree->root);
+    }
+
+    tree->root = NULL;
+    tree->count = 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * lib/adt/range_btree.h
+ * © suhas pai
+ */
+
+#pragma once
+#include "lib/adt/range.h"
+
+/*
+ * A b-tree of non-overlapping ranges, ordered by their front.
+ *
+ * Unlike the avltree, every node holds up to RANGE_BTREE_MAX_COUNT entries,
+ * with the fronts, ends and gaps of all entries stored in their own contiguous
+ * arrays, so a search scans a couple of cache-lines per level instead of
+ * chasing a pointer per entry.
+ *
+ * The gap of an entry is the free space between the end of the range before it
+ * (or zero, for the first range) and its front. Internal nodes keep the
+ * largest gap of each child's subtree, so free-space searches can skip
+ * subtrees that can't fit a request.
+ */
+
+#define RANGE_BTREE_MAX_COUNT 16
+#define RANGE_BTREE_MIN_COUNT (RANGE_BTREE_MAX_COUNT / 4)
+
+#define RANGE_BTREE_INVALID_ADDR UINT64_MAX
+
+struct range_btree_node {
+    struct range_btree_node *parent;
+
+    uint16_t count;
+    bool is_leaf;
+
+    // For leaves, fronts[i] and ends[i] are the bounds of the i-th range, and
+    // gaps[i] is the i-th range's gap. For internal nodes, they're the front
+    // of the first range, the end of the last range and the largest gap inside
+    // the subtree of the i-th child.
+
+    uint64_t fronts[RANGE_BTREE_MAX_COUNT];
+    uint64_t ends[RANGE_BTREE_MAX_COUNT];
+    uint64_t gaps[RANGE_BTREE_MAX_COUNT];
+
+    // Values for leaves, and `struct range_btree_node *` children for internal
+    // nodes.
+
+    void *slots[RANGE_BTREE_MAX_COUNT];
+};
+
+struct range_btree {
+    struct range_btree_node *root;
+    uint64_t count;
+};
+
+#define RANGE_BTREE_INIT() ((struct range_btree){ .root = NULL, .count = 0 })
+
+struct range_btree_iter {
+    struct range_btree_node *node;
+    uint16_t index;
+};
+
+// Returns false if `range` overlaps a range already in the tree, or if
+// allocating a node failed.
+
+bool
+range_btree_insert(struct range_btree *tree, struct range range, void *value);
+
+// Removes the range starting at `front`, and returns its value, or NULL if no
+// range starts at `front`.
+
+void *range_btree_remove(struct range_btree *tree, uint64_t front);
+
+// Returns the value of the range containing `loc`, or NULL if there is none.
+void *range_btree_find(const struct range_btree *tree, uint64_t loc);
+
+// Returns the lowest address aligned to `align` where `size` bytes fit inside
+// both `in_range` and a gap of the tree, or RANGE_BTREE_INVALID_ADDR if there's
+// no such address.
+
+uint64_t
+range_btree_find_space(const struct range_btree *tree,
+                       struct range in_range,
+                       uint64_t size,
+                       uint64_t align);
+
+bool
+range_btree_iter_first(const struct range_btree *tree,
+                       struct range_btree_iter *iter_out);
+
+// Point `iter_out` at the first range that ends after `loc`, i.e. the range
+// containing `loc` if there is one, or the first range after it otherwise.
+
+bool
+range_btree_iter_find(const struct range_btree *tree,
+                      uint64_t loc,
+                      struct range_btree_iter *iter_out);
+
+bool range_btree_iter_next(struct range_btree_iter *iter);
+bool range_btree_iter_prev(struct range_btree_iter *iter);
+
+struct range range_btree_iter_range(struct range_btree_iter iter);
+void *range_btree_iter_value(struct range_btree_iter iter);
+
+// Frees every node of the tree. The values aren't touched.
+void range_btree_destroy(struct range_btree *tree);
@@ -478,184 +478,244 @@ sv_to_signed(const struct string_view sv,
     return result;
 }
 
-#define LOOP_OVER_POSITIVE_INT(base, mod_block)                                \
-    do {                                                                       \
-        const char *const h_var(chars) =                                       \
-            (options.capitalize) ?                                             \
-                get_alphanumeric_upper_string() :                              \
-                get_alphanumeric_lower_string();                               \
-                                                                               \
-        buffer[i + 1] = '\0';                                                  \
-        do {                                                                   \
-            buffer[i] = h_var(chars)[number % (base)];                         \
-            if (number < (base)) {                                             \
-                break;                                                         \
-            }                                                                  \
-                                                                               \
-            assert(i != 0);                                                    \
-            i--;                                                               \
-                                                                               \
-            number /= (base);                                                  \
-        } while (true);                                                        \
-                                                                               \
-        mod_block;                                                             \
-        if (options.include_pos_sign) {                                        \
-            i -= 1;                                                            \
-            buffer[i] = '+';                                                   \
-        }                                                                      \
-    } while (false)
+// "00" through "99", so base-10 conversion can write two digits per division.
+static const char digit_pairs[200] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint64_t powers_of_10[] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull,
+};
+
+__optimize(3) static inline uint8_t count_bits(const uint64_t number) {
+    return (uint8_t)(64 - __builtin_clzll(number | 1));
+}
 
-__optimize(3) struct string_view
-unsigned_to_string_view(uint64_t number,
-                        const enum numeric_base base,
-                        char buffer[static const MAX_CONVERT_CAP],
-                        const struct num_to_str_options options)
-{
-    uint8_t final_index = 0;
+__optimize(3)
+static inline uint8_t count_decimal_digits(const uint64_t number) {
+    // 1233/4096 is just above log10(2), so this is either the number of
+    // digits, or one less than it. Or-ing in 1 makes zero count as one digit,
+    // and never changes the digit count of any other number.
+
+    const uint8_t guess = (uint8_t)((count_bits(number) * 1233) >> 12);
+    return guess + ((number | 1) >= powers_of_10[guess]);
+}
+
+__optimize(3) static inline uint8_t
+count_digits(uint64_t number, const enum numeric_base base) {
     switch (base) {
         case NUMERIC_BASE_2:
-            final_index = MAX_BINARY_CONVERT_CAP - 1;
-            break;
+            return count_bits(number);
         case NUMERIC_BASE_8:
-            final_index = MAX_OCTAL_CONVERT_CAP - 1;
-            break;
+            return (count_bits(number) + 2) / 3;
         case NUMERIC_BASE_10:
-            final_index = MAX_DECIMAL_CONVERT_CAP - 1;
-            break;
+            return count_decimal_digits(number);
         case NUMERIC_BASE_16:
-            final_index = MAX_HEXADECIMAL_CONVERT_CAP - 1;
-            break;
+            return (count_bits(number) + 3) / 4;
         case NUMERIC_BASE_36:
-            final_index = MAX_CONVERT_CAP;
             break;
     }
 
-    // Subtract one because our macro below will add a null-terminator,
-    // so we want to be pointing one before the last index.
-
-    uint8_t i = final_index - 1;
-    LOOP_OVER_POSITIVE_INT(base, {
-        if (options.include_prefix) {
-            buffer[i - 2] = '0';
-            switch (base) {
-                case NUMERIC_BASE_2:
-                    buffer[i - 1] = (options.capitalize_prefix) ? 'B' : 'b';
-                    break;
-                case NUMERIC_BASE_8:
-                    if (!options.use_0_octal_prefix) {
-                        buffer[i - 1] = (options.capitalize_prefix) ? 'O' : 'o';
-                    } else {
-                        i += 1;
-                    }
-
-                    break;
-                case NUMERIC_BASE_10:
-                    break;
-                case NUMERIC_BASE_16:
-                    buffer[i - 1] = (options.capitalize_prefix) ? 'X' : 'x';
-                    break;
-                case NUMERIC_BASE_36:
-                    buffer[i - 1] = (options.capitalize_prefix) ? 'A' : 'a';
-                    break;
-            }
+    uint8_t result = 1;
+    for (; number >= (uint64_t)base; number /= (uint64_t)base) {
+        result++;
+    }
 
-            i -= 2;
-        }
-    });
+    return result;
+}
+
+// Write the digits of `number` backwards, so the last digit is right before
+// `end`.
 
-    // Buffer + final_index points to the null-terminator, which is the end
-    return sv_create_end(&buffer[i], buffer + final_index);
+__optimize(3) static inline void
+write_decimal_digits(uint64_t number, char *end) {
+    while (number >= 100) {
+        const uint64_t index = (number % 100) * 2;
+        number /= 100;
+
+        end -= 2;
+        end[0] = digit_pairs[index];
+        end[1] = digit_pairs[index + 1];
+    }
+
+    if (number >= 10) {
+        end[-2] = digit_pairs[number * 2];
+        end[-1] = digit_pairs[number * 2 + 1];
+    } else {
+        end[-1] = (char)('0' + number);
+    }
 }
 
-#define LOOP_OVER_SIGNED_INT(base, mod_block)                                  \
-    do {                                                                       \
-        if (number < 0) {                                                      \
-            const char *const h_var(chars) =                                   \
-                (options.capitalize) ?                                         \
-                    get_alphanumeric_upper_string() :                          \
-                    get_alphanumeric_lower_string();                           \
-                                                                               \
-            buffer[i + 1] = '\0';                                              \
-            const int64_t h_var(neg_base) = (0 - (int64_t)(base));             \
-            do {                                                               \
-                buffer[i] = h_var(chars)[0 - (number % (base))];               \
-                assert(i != 0);                                                \
-                i--;                                                           \
-                                                                               \
-                if (number > h_var(neg_base)) {                                \
-                    break;                                                     \
-                }                                                              \
-                                                                               \
-                number /= (base);                                              \
-            } while (number != 0);                                             \
-                                                                               \
-            mod_block;                                                         \
-            buffer[i] = '-';                                                   \
-        } else {                                                               \
-            LOOP_OVER_POSITIVE_INT((base), mod_block);                         \
-        }                                                                      \
-    } while (false)
+__optimize(3) static inline void
+write_pow2_digits(uint64_t number,
+                  char *end,
+                  const uint8_t count,
+                  const uint8_t shift,
+                  const char *const chars)
+{
+    const uint64_t mask = (1ull << shift) - 1;
+    for (char *iter = end - count; end != iter; number >>= shift) {
+        *(--end) = chars[number & mask];
+    }
+}
 
-__optimize(3) struct string_view
-signed_to_string_view(int64_t number,
-                      const enum numeric_base base,
-                      char buffer[static const MAX_CONVERT_CAP],
-                      const struct num_to_str_options options)
+__optimize(3) static inline void
+write_digits(uint64_t number,
+             const enum numeric_base base,
+             char *const end,
+             const uint8_t count,
+             const char *const chars)
+{
+    switch (base) {
+        case NUMERIC_BASE_2:
+            write_pow2_digits(number, end, count, /*shift=*/1, chars);
+            return;
+        case NUMERIC_BASE_8:
+            write_pow2_digits(number, end, count, /*shift=*/3, chars);
+            return;
+        case NUMERIC_BASE_10:
+            write_decimal_digits(number, end);
+            return;
+        case NUMERIC_BASE_16:
+            write_pow2_digits(number, end, count, /*shift=*/4, chars);
+            return;
+        case NUMERIC_BASE_36:
+            break;
+    }
+
+    char *iter = end;
+    for (const char *const begin = end - count; iter != begin; ) {
+        *(--iter) = chars[number % (uint64_t)base];
+        number /= (uint64_t)base;
+    }
+}
+
+__optimize(3) static inline char *
+write_prefix(char *iter,
+             const enum numeric_base base,
+             const struct num_to_str_options options)
 {
-    uint8_t final_index = 0;
+    const bool upper = options.capitalize_prefix;
     switch (base) {
         case NUMERIC_BASE_2:
-            final_index = MAX_BINARY_CONVERT_CAP - 1;
+            *iter++ = '0';
+            *iter++ = upper ? 'B' : 'b';
+
             break;
         case NUMERIC_BASE_8:
-            final_index = MAX_OCTAL_CONVERT_CAP - 1;
+            *iter++ = '0';
+            if (!options.use_0_octal_prefix) {
+                *iter++ = upper ? 'O' : 'o';
+            }
+
             break;
         case NUMERIC_BASE_10:
-            final_index = MAX_DECIMAL_CONVERT_CAP - 1;
             break;
         case NUMERIC_BASE_16:
-            final_index = MAX_HEXADECIMAL_CONVERT_CAP - 1;
+            *iter++ = '0';
+            *iter++ = upper ? 'X' : 'x';
+
             break;
         case NUMERIC_BASE_36:
-            final_index = MAX_ALPHABETIC_CONVERT_CAP - 1;
+            *iter++ = '0';
+            *iter++ = upper ? 'A' : 'a';
+
             break;
     }
 
-    // Subtract one because our macro below will add a null-terminator,
-    // so we want to be pointing one before the last index.
-
-    uint8_t i = final_index - 1;
-    LOOP_OVER_SIGNED_INT(base, {
-        if (options.include_prefix) {
-            buffer[i - 2] = '0';
-            switch (base) {
-                case NUMERIC_BASE_2:
-                    buffer[i - 1] = (options.capitalize_prefix) ? 'B' : 'b';
-                    break;
-                case NUMERIC_BASE_8:
-                    if (!options.use_0_octal_prefix) {
-                        buffer[i - 1] = (options.capitalize_prefix) ? 'O' : 'o';
-                    } else {
-                        i += 1;
-                    }
-
-                    break;
-                case NUMERIC_BASE_10:
-                    break;
-                case NUMERIC_BASE_16:
-                    buffer[i - 1] = (options.capitalize_prefix) ? 'X' : 'x';
-                    break;
-                case NUMERIC_BASE_36:
-                    buffer[i - 1] = (options.capitalize_prefix) ? 'A' : 'a';
-                    break;
-            }
+    return iter;
+}
 
-            i -= 2;
-        }
-    });
+// The number of digits is found first, so the sign, prefix and digits are all
+// written in place, front to back, starting at the beginning of `buffer`.
 
-    // Buffer + final_index points to the null-terminator, which is the end
-    return sv_create_end(buffer + i, buffer + final_index);
+__optimize(3) static struct string_view
+magnitude_to_string_view(const uint64_t magnitude,
+                         const bool is_negative,
+                         const enum numeric_base base,
+                         char buffer[static const MAX_CONVERT_CAP],
+                         const struct num_to_str_options options)
+{
+    char *iter = buffer;
+    if (is_negative) {
+        *iter++ = '-';
+    } else if (options.include_pos_sign) {
+        *iter++ = '+';
+    }
+
+    if (options.include_prefix) {
+        iter = write_prefix(iter, base, options);
+    }
+
+    const char *const chars =
+        options.capitalize ?
+            get_alphanumeric_upper_string() : get_alphanumeric_lower_string();
+
+    const uint8_t count = count_digits(magnitude, base);
+    char *const end = iter + count;
+
+    write_digits(magnitude, base, end, count, chars);
+    *end = '\0';
+
+    return sv_create_end(buffer, end);
+}
+
+__optimize(3) struct string_view
+unsigned_to_string_view(const uint64_t number,
+                        const enum numeric_base base,
+                        char buffer[static const MAX_CONVERT_CAP],
+                        const struct num_to_str_options options)
+{
+    return magnitude_to_string_view(number,
+                                    /*is_negative=*/false,
+                                    base,
+                                    buffer,
+                                    options);
+}
+
+__optimize(3) struct string_view
+signed_to_string_view(const int64_t number,
+                      const enum numeric_base base,
+                      char buffer[static const MAX_CONVERT_CAP],
+                      const struct num_to_str_options options)
+{
+    // Negate as unsigned, so INT64_MIN doesn't overflow.
+    const bool is_negative = number < 0;
+    const uint64_t magnitude =
+        is_negative ? 0 - (uint64_t)number : (uint64_t)number;
+
+    return magnitude_to_string_view(magnitude,
+                                    is_negative,
+                                    base,
+                                    buffer,
+                                    options);
 }
 
 unsigned long int
@@ -6,6 +6,11 @@
 #include "format.h"
 #include "parse_printf.h"
 
+// Formatted strings are staged on the stack in chunks of this size before
+// being appended to a string.
+
+#define FORMAT_STRING_CHUNK_SIZE 256
+
 uint64_t
 format_to_buffer(char *const buffer,
                  const uint64_t buffer_len,
@@ -21,59 +26,17 @@ format_to_buffer(char *const buffer,
     return result;
 }
 
-static uint64_t
-buffer_char_callback(struct printf_spec_info *const spec_info,
-                     void *const cb_info,
-                     const char ch,
-                     uint64_t amount,
-                     bool *const cont_out)
-{
-    (void)spec_info;
-
-    struct mutable_buffer *const mbuffer = cb_info;
-    const uint64_t appended = mbuffer_append_byte(mbuffer, ch, amount);
-
-    if (appended != amount) {
-        *cont_out = false;
-    }
-
-    return appended;
-}
-
-static uint64_t
-buffer_sv_callback(struct printf_spec_info *const spec_info,
-                   void *const cb_info,
-                   const struct string_view sv,
-                   bool *const cont_out)
-{
-    (void)spec_info;
-
-    struct mutable_buffer *const mbuffer = cb_info;
-    const uint64_t appended = mbuffer_append_sv(mbuffer, sv);
-
-    if (appended != sv.length) {
-        *cont_out = false;
-    }
-
-    return appended;
-}
-
 uint64_t
 vformat_to_buffer(char *const buffer,
                   const uint64_t buffer_length,
                   const char *const fmt,
                   va_list list)
 {
-    struct mutable_buffer mbuffer =
-        mbuffer_open(buffer, /*used=*/0, buffer_length);
-    const uint64_t result =
-        parse_printf(fmt,
-                     buffer_char_callback,
-                     &mbuffer,
-                     buffer_sv_callback,
-                     &mbuffer,
-                     list);
-    return result;
+    // Format straight into the caller's buffer, and stop once it's full.
+    struct printf_sink sink =
+        PRINTF_SINK_INIT(buffer, buffer_length, /*flush=*/NULL, NULL);
+
+    return parse_printf(fmt, &sink, list);
 }
 
 uint64_t
@@ -87,39 +50,10 @@ format_to_string(struct string *const string, const char *const fmt, ...) {
     return result;
 }
 
-uint64_t
-string_char_callback(struct printf_spec_info *const spec_info,
-                     void *const cb_info,
-                     const char ch,
-                     uint64_t amount,
-                     bool *const cont_out)
-{
-    (void)spec_info;
-
-    struct string *const string = (struct string *)cb_info;
-    if (!string_append_char(string, ch, amount)) {
-        *cont_out = false;
-        return 0;
-    }
-
-    return amount;
-}
-
-uint64_t
-string_sv_callback(struct printf_spec_info *const spec_info,
-                   void *const cb_info,
-                   const struct string_view sv,
-                   bool *const cont_out)
-{
-    (void)spec_info;
-
-    struct string *const string = (struct string *)cb_info;
-    if (!string_append_sv(string, sv)) {
-        *cont_out = false;
-        return 0;
-    }
-
-    return sv.length;
+static bool flush_to_string(struct printf_sink *const sink) {
+    struct string *const string = (struct string *)sink->flush_info;
+    return string_append_sv(string,
+                            sv_create_length(sink->buffer, sink->used)) != NULL;
 }
 
 uint64_t
@@ -127,12 +61,12 @@ vformat_to_string(struct string *const string,
                   const char *const fmt,
                   va_list list)
 {
-    const uint64_t result =
-        parse_printf(fmt,
-                     string_char_callback,
-                     /*write_char_cb=*/string,
-                     string_sv_callback,
-                     /*char_cb_info=*/string,
-                     list);
-    return result;
+    char chunk[FORMAT_STRING_CHUNK_SIZE];
+    struct printf_sink sink =
+        PRINTF_SINK_INIT(chunk, sizeof(chunk), flush_to_string, string);
+
+    parse_printf(fmt, &sink, list);
+    printf_sink_flush(&sink);
+
+    return sink.flushed;
 }
\ No newline at end of file
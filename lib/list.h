@@ -67,6 +67,26 @@ __optimize(3) static inline void list_delete(struct list *const elem) {
     elem->next = NULL;
 }
 
+// Move every item in `list` to the front of `head`, leaving `list` empty.
+__optimize(3) static inline void
+list_splice(struct list *const head, struct list *const list) {
+    if (list_empty(list)) {
+        return;
+    }
+
+    struct list *const first = list->next;
+    struct list *const last = list->prev;
+    struct list *const next = head->next;
+
+    first->prev = head;
+    head->next = first;
+
+    last->next = next;
+    next->prev = last;
+
+    list_init(list);
+}
+
 #define list_rm(type, elem, name) \
     ({ list_remove(elem); container_of(elem, type, name); })
 
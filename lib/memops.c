@@ -0,0 +1,360 @@
+/*
+ * lib/memops.c
+ * © suhas pai
+ */
+
+#include <stdint.h>
+
+#include "lib/macros.h"
+#include "memops.h"
+
+typedef uint16_t unaligned_u16 __attribute__((aligned(1), may_alias));
+typedef uint32_t unaligned_u32 __attribute__((aligned(1), may_alias));
+typedef uint64_t unaligned_u64 __attribute__((aligned(1), may_alias));
+
+// Copies of up to 32 bytes are done with a pair of (possibly overlapping)
+// loads and stores from the front and back, so there's no loop and no byte at
+// a time tail.
+
+__optimize(3) static inline void
+copy_upto_32(uint8_t *const dst, const uint8_t *const src, const size_t n) {
+    if (n > 16) {
+        const uint64_t a = *(const unaligned_u64 *)src;
+        const uint64_t b = *(const unaligned_u64 *)(src + 8);
+        const uint64_t c = *(const unaligned_u64 *)(src + n - 16);
+        const uint64_t d = *(const unaligned_u64 *)(src + n - 8);
+
+        *(unaligned_u64 *)dst = a;
+        *(unaligned_u64 *)(dst + 8) = b;
+        *(unaligned_u64 *)(dst + n - 16) = c;
+        *(unaligned_u64 *)(dst + n - 8) = d;
+    } else if (n >= sizeof(uint64_t)) {
+        const uint64_t a = *(const unaligned_u64 *)src;
+        const uint64_t b = *(const unaligned_u64 *)(src + n - 8);
+
+        *(unaligned_u64 *)dst = a;
+        *(unaligned_u64 *)(dst + n - 8) = b;
+    } else if (n >= sizeof(uint32_t)) {
+        const uint32_t a = *(const unaligned_u32 *)src;
+        const uint32_t b = *(const unaligned_u32 *)(src + n - 4);
+
+        *(unaligned_u32 *)dst = a;
+        *(unaligned_u32 *)(dst + n - 4) = b;
+    } else if (n >= sizeof(uint16_t)) {
+        const uint16_t a = *(const unaligned_u16 *)src;
+        const uint16_t b = *(const unaligned_u16 *)(src + n - 2);
+
+        *(unaligned_u16 *)dst = a;
+        *(unaligned_u16 *)(dst + n - 2) = b;
+    } else if (n != 0) {
+        *dst = *src;
+    }
+}
+
+__optimize(3) static inline void
+set_upto_32(uint8_t *const dst, const uint64_t value, const size_t n) {
+    if (n > 16) {
+        *(unaligned_u64 *)dst = value;
+        *(unaligned_u64 *)(dst + 8) = value;
+        *(unaligned_u64 *)(dst + n - 16) = value;
+        *(unaligned_u64 *)(dst + n - 8) = value;
+    } else if (n >= sizeof(uint64_t)) {
+        *(unaligned_u64 *)dst = value;
+        *(unaligned_u64 *)(dst + n - 8) = value;
+    } else if (n >= sizeof(uint32_t)) {
+        *(unaligned_u32 *)dst = (uint32_t)value;
+        *(unaligned_u32 *)(dst + n - 4) = (uint32_t)value;
+    } else if (n >= sizeof(uint16_t)) {
+        *(unaligned_u16 *)dst = (uint16_t)value;
+        *(unaligned_u16 *)(dst + n - 2) = (uint16_t)value;
+    } else if (n != 0) {
+        *dst = (uint8_t)value;
+    }
+}
+
+// Returns the difference between the first mismatching bytes of `left` and
+// `right`, which must not be equal.
+
+__optimize(3) static inline int
+compare_words(const uint64_t left, const uint64_t right) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    const uint32_t shift = (uint32_t)__builtin_ctzll(left ^ right) & ~7u;
+#else
+    const uint32_t shift =
+        56 - ((uint32_t)__builtin_clzll(left ^ right) & ~7u);
+#endif /* __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ */
+
+    return (int)((left >> shift) & 0xFF) - (int)((right >> shift) & 0xFF);
+}
+
+__optimize(3)
+void *memcpy_words(void *const dst, const void *const src, const size_t n) {
+    if (n <= 32) {
+        copy_upto_32(dst, src, n);
+        return dst;
+    }
+
+    // The last word is copied separately at the end, so the loops never have
+    // to deal with a partial word.
+
+    uint8_t *iter = dst;
+    const uint8_t *jter = src;
+    const uint64_t tail = *(const unaligned_u64 *)(jter + n - 8);
+
+    size_t left = n;
+    for (; left > 32; left -= 32, iter += 32, jter += 32) {
+        const uint64_t a = ((const unaligned_u64 *)jter)[0];
+        const uint64_t b = ((const unaligned_u64 *)jter)[1];
+        const uint64_t c = ((const unaligned_u64 *)jter)[2];
+        const uint64_t d = ((const unaligned_u64 *)jter)[3];
+
+        ((unaligned_u64 *)iter)[0] = a;
+        ((unaligned_u64 *)iter)[1] = b;
+        ((unaligned_u64 *)iter)[2] = c;
+        ((unaligned_u64 *)iter)[3] = d;
+    }
+
+    for (; left > 8; left -= 8, iter += 8, jter += 8) {
+        *(unaligned_u64 *)iter = *(const unaligned_u64 *)jter;
+    }
+
+    *(unaligned_u64 *)((uint8_t *)dst + n - 8) = tail;
+    return dst;
+}
+
+__optimize(3)
+void *memset_words(void *const dst, const int val, const size_t n) {
+    const uint64_t value = (uint8_t)val * 0x0101010101010101ull;
+    if (n <= 32) {
+        set_upto_32(dst, value, n);
+        return dst;
+    }
+
+    uint8_t *iter = dst;
+    size_t left = n;
+
+    for (; left > 32; left -= 32, iter += 32) {
+        ((unaligned_u64 *)iter)[0] = value;
+        ((unaligned_u64 *)iter)[1] = value;
+        ((unaligned_u64 *)iter)[2] = value;
+        ((unaligned_u64 *)iter)[3] = value;
+    }
+
+    set_upto_32(iter, value, left);
+    return dst;
+}
+
+__optimize(3) int
+memcmp_words(const void *const left, const void *const right, const size_t n) {
+    const uint8_t *iter = left;
+    const uint8_t *jter = right;
+
+    if (n < sizeof(uint64_t)) {
+        for (size_t i = 0; i != n; i++) {
+            if (iter[i] != jter[i]) {
+                return (int)iter[i] - (int)jter[i];
+            }
+        }
+
+        return 0;
+    }
+
+    const uint8_t *const end = iter + n - sizeof(uint64_t);
+    for (; iter < end; iter += 8, jter += 8) {
+        const uint64_t a = *(const unaligned_u64 *)iter;
+        const uint64_t b = *(const unaligned_u64 *)jter;
+
+        if (a != b) {
+            return compare_words(a, b);
+        }
+    }
+
+    // Compare the last word, which may overlap bytes already known to be
+    // equal.
+
+    const uint64_t a = *(const unaligned_u64 *)end;
+    const uint64_t b = *(const unaligned_u64 *)(jter + (end - iter));
+
+    return a != b ? compare_words(a, b) : 0;
+}
+
+#if defined(__x86_64__)
+    __optimize(3) void *
+    memcpy_rep_movsb(void *const dst, const void *src, size_t n) {
+        void *iter = dst;
+        asm volatile ("rep movsb"
+                      : "+D"(iter), "+S"(src), "+c"(n)
+                      :: "memory");
+
+        return dst;
+    }
+
+    __optimize(3)
+    void *memset_rep_stosb(void *const dst, const int val, size_t n) {
+        void *iter = dst;
+        asm volatile ("rep stosb"
+                      : "+D"(iter), "+c"(n)
+                      : "a"(val)
+                      : "memory");
+
+        return dst;
+    }
+
+    #define __avx2 __attribute__((target("avx2")))
+
+    typedef char v32qi __attribute__((vector_size(32)));
+    typedef v32qi v32qi_unaligned __attribute__((aligned(1), may_alias));
+    typedef v32qi v32qi_aligned __attribute__((may_alias));
+
+    #define v32_load(ptr) (*(const v32qi_unaligned *)(const void *)(ptr))
+    #define v32_store(ptr, v) (*(v32qi_unaligned *)(void *)(ptr) = (v))
+    #define v32_store_aligned(ptr, v) (*(v32qi_aligned *)(void *)(ptr) = (v))
+
+    __avx2 __optimize(3)
+    void *memcpy_avx2(void *const dst, const void *const src, const size_t n) {
+        uint8_t *const d = dst;
+        const uint8_t *const s = src;
+
+        if (n <= 32) {
+            copy_upto_32(d, s, n);
+            return dst;
+        }
+
+        const v32qi head = v32_load(s);
+        const v32qi tail = v32_load(s + n - 32);
+
+        if (n <= 64) {
+            v32_store(d, head);
+            v32_store(d + n - 32, tail);
+
+            return dst;
+        }
+
+        // Align the destination so the stores in the loop never split a
+        // cache-line. The unaligned head and tail are stored at the end.
+
+        const size_t skew = 32 - ((uintptr_t)d & 31);
+
+        uint8_t *iter = d + skew;
+        const uint8_t *jter = s + skew;
+        size_t left = n - skew;
+
+        for (; left > 128; left -= 128, iter += 128, jter += 128) {
+            const v32qi a = v32_load(jter);
+            const v32qi b = v32_load(jter + 32);
+            const v32qi c = v32_load(jter + 64);
+            const v32qi e = v32_load(jter + 96);
+
+            v32_store_aligned(iter, a);
+            v32_store_aligned(iter + 32, b);
+            v32_store_aligned(iter + 64, c);
+            v32_store_aligned(iter + 96, e);
+        }
+
+        for (; left > 32; left -= 32, iter += 32, jter += 32) {
+            v32_store_aligned(iter, v32_load(jter));
+        }
+
+        v32_store(d, head);
+        v32_store(d + n - 32, tail);
+
+        return dst;
+    }
+
+    __avx2 __optimize(3)
+    void *memset_avx2(void *const dst, const int val, const size_t n) {
+        uint8_t *const d = dst;
+        if (n <= 32) {
+            set_upto_32(d, (uint8_t)val * 0x0101010101010101ull, n);
+            return dst;
+        }
+
+        const v32qi value = (v32qi){} + (char)val;
+        v32_store(d, value);
+        v32_store(d + n - 32, value);
+
+        if (n <= 64) {
+            return dst;
+        }
+
+        uint8_t *iter = d + 32 - ((uintptr_t)d & 31);
+        uint8_t *const end = d + n - 32;
+
+        for (; iter + 128 <= end; iter += 128) {
+            v32_store_aligned(iter, value);
+            v32_store_aligned(iter + 32, value);
+            v32_store_aligned(iter + 64, value);
+            v32_store_aligned(iter + 96, value);
+        }
+
+        for (; iter < end; iter += 32) {
+            v32_store_aligned(iter, value);
+        }
+
+        return dst;
+    }
+
+    // Returns a mask with a bit set for every byte where `left` and `right`
+    // differ.
+
+    __avx2 __optimize(3) static inline uint32_t
+    v32_diff_mask(const uint8_t *const left, const uint8_t *const right) {
+        const v32qi eq = (v32qi)(v32_load(left) == v32_load(right));
+        return ~(uint32_t)__builtin_ia32_pmovmskb256(eq);
+    }
+
+    __avx2 __optimize(3) static inline int
+    diff_at(const uint8_t *const left,
+            const uint8_t *const right,
+            const uint32_t mask)
+    {
+        const uint32_t index = (uint32_t)__builtin_ctz(mask);
+        return (int)left[index] - (int)right[index];
+    }
+
+    __avx2 __optimize(3) int
+    memcmp_avx2(const void *const left, const void *const right, const size_t n)
+    {
+        if (n < 32) {
+            return memcmp_words(left, right, n);
+        }
+
+        const uint8_t *l = left;
+        const uint8_t *r = right;
+        const uint8_t *const l_end = l + n - 32;
+
+        // Compare 64 bytes at a time, only finding the mismatching byte once
+        // the combined compare fails.
+
+        for (; l + 64 <= l_end; l += 64, r += 64) {
+            const v32qi eq =
+                (v32qi)(v32_load(l) == v32_load(r)) &
+                (v32qi)(v32_load(l + 32) == v32_load(r + 32));
+
+            if (__builtin_ia32_pmovmskb256(eq) != -1) {
+                const uint32_t mask = v32_diff_mask(l, r);
+                if (mask != 0) {
+                    return diff_at(l, r, mask);
+                }
+
+                return diff_at(l + 32, r + 32, v32_diff_mask(l + 32, r + 32));
+            }
+        }
+
+        for (; l < l_end; l += 32, r += 32) {
+            const uint32_t mask = v32_diff_mask(l, r);
+            if (mask != 0) {
+                return diff_at(l, r, mask);
+            }
+        }
+
+        // Compare the last 32 bytes, which may overlap bytes already known to
+        // be equal.
+
+        r += l_end - l;
+        l = l_end;
+
+        const uint32_t mask = v32_diff_mask(l, r);
+        return mask != 0 ? diff_at(l, r, mask) : 0;
+    }
+#endif /* defined(__x86_64__) */
\ No newline at end of file
@@ -0,0 +1,43 @@
+/*
+ * lib/memops.h
+ * © suhas pai
+ */
+
+#pragma once
+#include <stddef.h>
+
+/*
+ * The variants of memcpy(), memset() and memcmp() that the kernel picks
+ * between at boot, once it knows what the cpu supports.
+ *
+ * The simd variants use the vector registers without saving them, so callers
+ * are responsible for making sure they're usable and that nothing else on the
+ * cpu is in the middle of using them.
+ */
+
+void *memcpy_words(void *dst, const void *src, size_t n);
+void *memset_words(void *dst, int val, size_t n);
+int memcmp_words(const void *left, const void *right, size_t n);
+
+#if defined(__x86_64__)
+    void *memcpy_rep_movsb(void *dst, const void *src, size_t n);
+    void *memset_rep_stosb(void *dst, int val, size_t n);
+
+    void *memcpy_avx2(void *dst, const void *src, size_t n);
+    void *memset_avx2(void *dst, int val, size_t n);
+    int memcmp_avx2(const void *left, const void *right, size_t n);
+#elif defined(__aarch64__) && defined(BUILD_KERNEL)
+    // Defined in arch/aarch64/lib/memops.S, as the kernel is built with
+    // -mgeneral-regs-only.
+
+    void *memcpy_neon(void *dst, const void *src, size_t n);
+    void *memset_neon(void *dst, int val, size_t n);
+    int memcmp_neon(const void *left, const void *right, size_t n);
+#endif /* defined(__x86_64__) */
+
+#if defined(BUILD_KERNEL)
+    // Point memcpy(), memset() and memcmp() at the fastest variants the cpu
+    // supports. Must be called after the cpu's features have been collected.
+
+    void memops_init();
+#endif /* defined(BUILD_KERNEL) */
\ No newline at end of file
@@ -120,35 +120,50 @@ uint64_t *memset_64(uint64_t *buf, uint64_t count, const uint64_t c) {
     return ret;
 }
 
-__optimize(3) bool
-membuf_8_is_all(uint8_t *const buf, const uint64_t count, const uint8_t c) {
-    const uint8_t *const end = buf + count;
-    for (uint8_t *iter = buf; iter != end; iter++) {
-        if (*iter != c) {
+typedef uint64_t aliasing_u64 __attribute__((may_alias));
+
+// Returns whether all `size` bytes at `buf` match `pattern`, which holds the
+// value being checked for repeated to fill a word. `buf` must be aligned to
+// the size of that value, so every aligned word inside `buf` lines up with
+// `pattern`.
+
+__optimize(3) static inline bool
+membuf_is_all(const void *const buf,
+              const uint64_t size,
+              const uint64_t pattern)
+{
+    const uint8_t *const pattern_bytes = (const uint8_t *)&pattern;
+    const uint8_t *iter = buf;
+    const uint8_t *const end = iter + size;
+
+    for (; ((uintptr_t)iter & 7) != 0 && iter != end; iter++) {
+        if (*iter != pattern_bytes[(uintptr_t)iter & 7]) {
             return false;
         }
     }
 
-    return true;
-}
+    // Or the differences of four words together, so there's only one branch
+    // every 32 bytes.
 
-__optimize(3) bool
-membuf_16_is_all(uint16_t *const buf, const uint64_t count, const uint16_t c) {
-    const uint16_t *const end = buf + count;
-    for (uint16_t *iter = buf; iter != end; iter++) {
-        if (*iter != c) {
+    const aliasing_u64 *word = (const aliasing_u64 *)iter;
+    for (; (uint64_t)(end - (const uint8_t *)word) >= 32; word += 4) {
+        const uint64_t diff =
+            (word[0] ^ pattern) | (word[1] ^ pattern) |
+            (word[2] ^ pattern) | (word[3] ^ pattern);
+
+        if (diff != 0) {
             return false;
         }
     }
 
-    return true;
-}
+    for (; (uint64_t)(end - (const uint8_t *)word) >= 8; word++) {
+        if (*word != pattern) {
+            return false;
+        }
+    }
 
-__optimize(3) bool
-membuf_32_is_all(uint32_t *const buf, const uint64_t count, const uint32_t c) {
-    const uint32_t *const end = buf + count;
-    for (uint32_t *iter = buf; iter != end; iter++) {
-        if (*iter != c) {
+    for (iter = (const uint8_t *)word; iter != end; iter++) {
+        if (*iter != pattern_bytes[(uintptr_t)iter & 7]) {
             return false;
         }
     }
@@ -157,13 +172,25 @@ membuf_32_is_all(uint32_t *const buf, const uint64_t count, const uint32_t c) {
 }
 
 __optimize(3) bool
-membuf_64_is_all(uint64_t *const buf, const uint64_t count, const uint64_t c) {
-    const uint64_t *const end = buf + count;
-    for (uint64_t *iter = buf; iter != end; iter++) {
-        if (*iter != c) {
-            return false;
-        }
-    }
+membuf_8_is_all(uint8_t *const buf, const uint64_t count, const uint8_t c) {
+    return membuf_is_all(buf, count, c * 0x0101010101010101ull);
+}
 
-    return true;
+__optimize(3) bool
+membuf_16_is_all(uint16_t *const buf, const uint64_t count, const uint16_t c) {
+    return membuf_is_all(buf,
+                         count * sizeof(uint16_t),
+                         c * 0x0001000100010001ull);
+}
+
+__optimize(3) bool
+membuf_32_is_all(uint32_t *const buf, const uint64_t count, const uint32_t c) {
+    return membuf_is_all(buf,
+                         count * sizeof(uint32_t),
+                         c * 0x0000000100000001ull);
+}
+
+__optimize(3) bool
+membuf_64_is_all(uint64_t *const buf, const uint64_t count, const uint64_t c) {
+    return membuf_is_all(buf, count * sizeof(uint64_t), c);
 }
\ No newline at end of file
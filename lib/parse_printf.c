@@ -3,13 +3,38 @@
  * © suhas pai
  */
 
+#include <stdatomic.h>
+
 #include "convert.h"
 #include "parse_printf.h"
 
+// Arguments are read either from a va_list, or from an array of words that
+// parse_printf_args() collected earlier.
+
 struct va_list_struct {
     va_list list;
+
+    const uint64_t *words;
+    uint32_t word_count;
+    uint32_t word_index;
 };
 
+__optimize(3)
+static inline uint64_t next_word(struct va_list_struct *const list_struct) {
+    if (list_struct->word_index == list_struct->word_count) {
+        return 0;
+    }
+
+    const uint64_t word = list_struct->words[list_struct->word_index];
+    list_struct->word_index++;
+
+    return word;
+}
+
+#define next_arg(list_struct, type) \
+    ((list_struct)->words != NULL ? \
+        (type)next_word(list_struct) : va_arg((list_struct)->list, type))
+
 __optimize(3) static bool
 parse_flags(struct printf_spec_info *const curr_spec,
             const char *iter,
@@ -82,7 +107,7 @@ parse_width(struct printf_spec_info *const curr_spec,
 
         curr_spec->width = (uint32_t)width;
     } else {
-        const int value = va_arg(list_struct->list, int);
+        const int value = next_arg(list_struct, int);
         curr_spec->width = value >= 0 ? (uint32_t)value : 0;
 
         iter++;
@@ -120,7 +145,7 @@ parse_precision(struct printf_spec_info *const curr_spec,
                 return false;
             }
 
-            curr_spec->precision = va_arg(list_struct->list, int);
+            curr_spec->precision = next_arg(list_struct, int);
             iter++;
 
             break;
@@ -164,7 +189,7 @@ parse_length(struct printf_spec_info *const curr_spec,
                     return false;
                 case 'h': {
                     const uint64_t number =
-                        (uint64_t)(signed char)va_arg(list_struct->list, int);
+                        (uint64_t)(signed char)next_arg(list_struct, int);
 
                     *number_out = number;
                     *is_zero_out = number == 0;
@@ -175,7 +200,7 @@ parse_length(struct printf_spec_info *const curr_spec,
                 }
                 default: {
                     const uint64_t number =
-                        (uint64_t)(short int)va_arg(list_struct->list, int);
+                        (uint64_t)(short int)next_arg(list_struct, int);
 
                     *number_out = number;
                     *is_zero_out = number == 0;
@@ -194,7 +219,7 @@ parse_length(struct printf_spec_info *const curr_spec,
                     return false;
                 case 'l': {
                     const uint64_t number =
-                        (uint64_t)va_arg(list_struct->list, long long int);
+                        (uint64_t)next_arg(list_struct, long long int);
 
                     *number_out = number;
                     *is_zero_out = number == 0;
@@ -206,7 +231,7 @@ parse_length(struct printf_spec_info *const curr_spec,
                 }
                 default: {
                     const uint64_t number =
-                        (uint64_t)va_arg(list_struct->list, long int);
+                        (uint64_t)next_arg(list_struct, long int);
 
                     *number_out = number;
                     *is_zero_out = number == 0;
@@ -219,7 +244,7 @@ parse_length(struct printf_spec_info *const curr_spec,
             break;
         case 'j': {
             const uint64_t number =
-                (uint64_t)va_arg(list_struct->list, intmax_t);
+                (uint64_t)next_arg(list_struct, intmax_t);
 
             *number_out = number;
             *is_zero_out = number == 0;
@@ -230,7 +255,7 @@ parse_length(struct printf_spec_info *const curr_spec,
             break;
         }
         case 'z': {
-            const uint64_t number = (uint64_t)va_arg(list_struct->list, size_t);
+            const uint64_t number = (uint64_t)next_arg(list_struct, size_t);
 
             *number_out = number;
             *is_zero_out = number == 0;
@@ -242,7 +267,7 @@ parse_length(struct printf_spec_info *const curr_spec,
         }
         case 't': {
             const uint64_t number =
-                (uint64_t)va_arg(list_struct->list, ptrdiff_t);
+                (uint64_t)next_arg(list_struct, ptrdiff_t);
 
             *number_out = number;
             *is_zero_out = number == 0;
@@ -282,7 +307,7 @@ handle_spec(struct printf_spec_info *const curr_spec,
             return E_HANDLE_SPEC_REACHED_END;
         case 'b':
             if (curr_spec->length_sv.length == 0) {
-                number = (uint64_t)va_arg(list_struct->list, unsigned);
+                number = (uint64_t)next_arg(list_struct, unsigned);
                 *is_zero_out = number == 0;
             }
 
@@ -294,7 +319,7 @@ handle_spec(struct printf_spec_info *const curr_spec,
             break;
         case 'B':
             if (curr_spec->length_sv.length == 0) {
-                number = (uint64_t)va_arg(list_struct->list, unsigned);
+                number = (uint64_t)next_arg(list_struct, unsigned);
                 *is_zero_out = number == 0;
             }
 
@@ -309,7 +334,7 @@ handle_spec(struct printf_spec_info *const curr_spec,
         case 'd':
         case 'i':
             if (curr_spec->length_sv.length == 0) {
-                number = (uint64_t)va_arg(list_struct->list, int);
+                number = (uint64_t)next_arg(list_struct, int);
                 *is_zero_out = number == 0;
             }
 
@@ -324,7 +349,7 @@ handle_spec(struct printf_spec_info *const curr_spec,
             break;
         case 'u':
             if (curr_spec->length_sv.length == 0) {
-                number = va_arg(list_struct->list, unsigned);
+                number = next_arg(list_struct, unsigned);
                 *is_zero_out = number == 0;
             }
 
@@ -336,7 +361,7 @@ handle_spec(struct printf_spec_info *const curr_spec,
             break;
         case 'o':
             if (curr_spec->length_sv.length == 0) {
-                number = va_arg(list_struct->list, unsigned);
+                number = next_arg(list_struct, unsigned);
                 *is_zero_out = (number == 0);
             }
 
@@ -348,7 +373,7 @@ handle_spec(struct printf_spec_info *const curr_spec,
             break;
         case 'x':
             if (curr_spec->length_sv.length == 0) {
-                number = va_arg(list_struct->list, unsigned);
+                number = next_arg(list_struct, unsigned);
                 *is_zero_out = number == 0;
             }
 
@@ -360,7 +385,7 @@ handle_spec(struct printf_spec_info *const curr_spec,
             break;
         case 'X':
             if (curr_spec->length_sv.length == 0) {
-                number = va_arg(list_struct->list, unsigned);
+                number = next_arg(list_struct, unsigned);
                 *is_zero_out = number == 0;
             }
 
@@ -373,12 +398,12 @@ handle_spec(struct printf_spec_info *const curr_spec,
                                         });
             break;
         case 'c':
-            buffer[0] = (char)va_arg(list_struct->list, int);
+            buffer[0] = (char)next_arg(list_struct, int);
             *parsed_out = sv_create_nocheck(buffer, 1);
 
             break;
         case 's': {
-            const char *const str = va_arg(list_struct->list, const char *);
+            const char *const str = next_arg(list_struct, const char *);
             if (str != NULL) {
                 uint64_t length = 0;
                 if (curr_spec->precision != -1) {
@@ -396,7 +421,7 @@ handle_spec(struct printf_spec_info *const curr_spec,
             break;
         }
         case 'p': {
-            const void *const arg = va_arg(list_struct->list, const void *);
+            const void *const arg = next_arg(list_struct, const void *);
             if (arg != NULL) {
                 const struct num_to_str_options options = {
                     .capitalize = true,
@@ -416,8 +441,14 @@ handle_spec(struct printf_spec_info *const curr_spec,
             break;
         }
         case 'n':
+            // The pointer was only valid when the words were collected.
+            if (list_struct->words != NULL) {
+                next_word(list_struct);
+                return E_HANDLE_SPEC_CONTINUE;
+            }
+
             if (curr_spec->length_sv.length == 0) {
-                *va_arg(list_struct->list, int *) = written_out;
+                *next_arg(list_struct, int *) = written_out;
                 return E_HANDLE_SPEC_CONTINUE;
             }
 
@@ -426,12 +457,12 @@ handle_spec(struct printf_spec_info *const curr_spec,
                     // case 'hh'
                     if (curr_spec->length_sv.length == 2) {
                         if (curr_spec->length_sv.begin[1] == 'h') {
-                            *va_arg(list_struct->list, signed char *) =
+                            *next_arg(list_struct, signed char *) =
                                 written_out;
                             return E_HANDLE_SPEC_CONTINUE;
                         }
                     } else if (curr_spec->length_sv.length == 1) {
-                        *va_arg(list_struct->list, short int *) = written_out;
+                        *next_arg(list_struct, short int *) = written_out;
                         return E_HANDLE_SPEC_CONTINUE;
                     }
 
@@ -440,13 +471,13 @@ handle_spec(struct printf_spec_info *const curr_spec,
                     // case 'll'
                     if (curr_spec->length_sv.length == 2) {
                         if (curr_spec->length_sv.begin[1] == 'l') {
-                            *va_arg(list_struct->list, signed char *) =
+                            *next_arg(list_struct, signed char *) =
                                 written_out;
 
                             return E_HANDLE_SPEC_CONTINUE;
                         }
                     } else if (curr_spec->length_sv.length == 1) {
-                        *va_arg(list_struct->list, long int *) =
+                        *next_arg(list_struct, long int *) =
                             (long int)written_out;
 
                         return E_HANDLE_SPEC_CONTINUE;
@@ -454,14 +485,14 @@ handle_spec(struct printf_spec_info *const curr_spec,
 
                     break;
                 case 'j':
-                    *va_arg(list_struct->list, intmax_t *) =
+                    *next_arg(list_struct, intmax_t *) =
                         (intmax_t)written_out;
                     return E_HANDLE_SPEC_CONTINUE;
                 case 'z':
-                    *va_arg(list_struct->list, size_t *) = written_out;
+                    *next_arg(list_struct, size_t *) = written_out;
                     return E_HANDLE_SPEC_CONTINUE;
                 case 't':
-                    *va_arg(list_struct->list, ptrdiff_t *) =
+                    *next_arg(list_struct, ptrdiff_t *) =
                         (ptrdiff_t)written_out;
                     return E_HANDLE_SPEC_CONTINUE;
             }
@@ -495,125 +526,268 @@ __optimize(3) static inline bool is_int_specifier(const char spec) {
     return false;
 }
 
+__optimize(3) bool printf_sink_flush(struct printf_sink *const sink) {
+    if (sink->flush == NULL || sink->stopped) {
+        return false;
+    }
+
+    if (!sink->flush(sink)) {
+        sink->stopped = true;
+        return false;
+    }
+
+    sink->flushed += sink->used;
+    sink->used = 0;
+
+    return true;
+}
+
+__optimize(3) static void
+sink_write(struct printf_sink *const sink,
+           const char *data,
+           uint64_t length)
+{
+    do {
+        const uint64_t space = sink->capacity - sink->used;
+        if (length <= space) {
+            memcpy(sink->buffer + sink->used, data, length);
+            sink->used += length;
+
+            return;
+        }
+
+        memcpy(sink->buffer + sink->used, data, space);
+        sink->used += space;
+
+        if (!printf_sink_flush(sink)) {
+            sink->stopped = true;
+            return;
+        }
+
+        data += space;
+        length -= space;
+    } while (true);
+}
+
+__optimize(3) static void
+sink_write_ch(struct printf_sink *const sink, const char ch, uint64_t amount) {
+    do {
+        const uint64_t space = sink->capacity - sink->used;
+        if (amount <= space) {
+            memset(sink->buffer + sink->used, ch, amount);
+            sink->used += amount;
+
+            return;
+        }
+
+        memset(sink->buffer + sink->used, ch, space);
+        sink->used += space;
+
+        if (!printf_sink_flush(sink)) {
+            sink->stopped = true;
+            return;
+        }
+
+        amount -= space;
+    } while (true);
+}
+
+__optimize(3) static inline void
+sink_write_sv(struct printf_sink *const sink, const struct string_view sv) {
+    // Most writes are short, and fit in what's left of the buffer.
+    if (__builtin_expect(sv.length <= sink->capacity - sink->used, 1)) {
+        memcpy(sink->buffer + sink->used, sv.begin, sv.length);
+        sink->used += sv.length;
+
+        return;
+    }
+
+    sink_write(sink, sv.begin, sv.length);
+}
+
 __optimize(3) static inline uint64_t
-write_prefix_for_spec(struct printf_spec_info *const info,
-                      const printf_write_char_callback_t write_ch_cb,
-                      void *const ch_cb_info,
-                      const printf_write_sv_callback_t write_sv_cb,
-                      void *const sv_cb_info,
-                      bool *const cont_out)
+sink_written(const struct printf_sink *const sink) {
+    return sink->flushed + sink->used;
+}
+
+__optimize(3) static inline void
+write_prefix_for_spec(const struct printf_spec_info *const info,
+                      struct printf_sink *const sink)
 {
-    uint64_t out = 0;
     if (!info->add_base_prefix) {
-        return out;
+        return;
     }
 
     switch (info->spec) {
         case 'b':
-            out += write_sv_cb(info, sv_cb_info, SV_STATIC("0b"), cont_out);
+            sink_write_sv(sink, SV_STATIC("0b"));
             break;
         case 'B':
-            out += write_sv_cb(info, sv_cb_info, SV_STATIC("0B"), cont_out);
+            sink_write_sv(sink, SV_STATIC("0B"));
             break;
         case 'o':
-            out += write_ch_cb(info, ch_cb_info, '0', 1, cont_out);
+            sink_write_ch(sink, '0', /*amount=*/1);
             break;
         case 'x':
-            out += write_sv_cb(info, sv_cb_info, SV_STATIC("0x"), cont_out);
+            sink_write_sv(sink, SV_STATIC("0x"));
             break;
         case 'X':
-            out += write_sv_cb(info, sv_cb_info, SV_STATIC("0X"), cont_out);
+            sink_write_sv(sink, SV_STATIC("0X"));
             break;
     }
-
-    return out;
 }
 
-__optimize(3) static uint64_t
-pad_with_lead_zeros(struct printf_spec_info *const info,
+__optimize(3) static void
+pad_with_lead_zeros(const struct printf_spec_info *const info,
                     struct string_view *const parsed,
                     const uint64_t zero_count,
                     const bool is_null,
-                    const printf_write_char_callback_t write_char_cb,
-                    void *const cb_info,
-                    const printf_write_sv_callback_t write_sv_cb,
-                    void *const write_sv_cb_info,
-                    bool *const cont_out)
+                    struct printf_sink *const sink)
 {
-    uint64_t out = 0;
     if (!is_null) {
-        out +=
-            write_prefix_for_spec(info,
-                                  write_char_cb,
-                                  cb_info,
-                                  write_sv_cb,
-                                  write_sv_cb_info,
-                                  cont_out);
+        write_prefix_for_spec(info, sink);
     }
 
     if (zero_count == 0) {
-        return out;
+        return;
     }
 
+    // We should only have pos signs when the spec requested it.
     const char front = *parsed->begin;
-    if (front == '+') {
-        // We should only have pos signs when the spec requested it.
-        out += write_char_cb(info, cb_info, '+', /*amount=*/1, cont_out);
-        if (!cont_out) {
-            return out;
+    if (front == '+' || front == '-') {
+        sink_write_ch(sink, front, /*amount=*/1);
+        *parsed = sv_drop_front(*parsed);
+    }
+
+    sink_write_ch(sink, '0', zero_count);
+}
+
+// Convert the argument of `curr_spec`, whose length-modifier, if any, has
+// already been read into `number`, and write it out with its padding. Returns
+// false if formatting should stop.
+
+__optimize(3) static bool
+write_spec(struct printf_spec_info *const curr_spec,
+           char *const buffer,
+           const uint64_t number,
+           bool is_zero,
+           struct va_list_struct *const list_struct,
+           struct printf_sink *const sink)
+{
+    struct string_view parsed = SV_EMPTY();
+    bool is_null = false;
+
+    const enum handle_spec_result handle_spec_result =
+        handle_spec(curr_spec,
+                    buffer,
+                    number,
+                    list_struct,
+                    sink_written(sink),
+                    &parsed,
+                    &is_zero,
+                    &is_null);
+
+    switch (handle_spec_result) {
+        case E_HANDLE_SPEC_OK:
+            break;
+        case E_HANDLE_SPEC_REACHED_END:
+            return false;
+        case E_HANDLE_SPEC_CONTINUE:
+            return true;
+    }
+
+    uint32_t padded_zero_count = 0;
+    uint8_t parsed_length = parsed.length;
+
+    // is_zero being true implies spec is an integer.
+    // We don't write anything if we have a '0' and precision is 0.
+
+    const bool should_write_parsed = !(is_zero && curr_spec->precision == 0);
+    if (!should_write_parsed) {
+        parsed_length = 0;
+    } else if (curr_spec->add_base_prefix) {
+        switch (curr_spec->spec) {
+            case 'o':
+                parsed_length += 1;
+                break;
+            case 'x':
+            case 'X':
+                parsed_length += 2;
+                break;
         }
+    }
 
-        *parsed = sv_drop_front(*parsed);
-    } else if (front == '-') {
-        out += write_char_cb(info, cb_info, '-', /*amount=*/1, cont_out);
-        if (!cont_out) {
-            return out;
+    // If we're not wider than the specified width, we have to pad with
+    // either spaces or zeroes.
+
+    uint32_t space_pad_count = 0;
+    if (is_int_specifier(curr_spec->spec)) {
+        if (curr_spec->precision != -1) {
+            // The case for the string-spec was already handled above
+            // Total digit count doesn't include the sign/prefix.
+
+            uint8_t total_digit_count = parsed.length;
+            if (*parsed.begin == '-' || *parsed.begin == '+') {
+                total_digit_count -= 1;
+            }
+
+            if (total_digit_count < curr_spec->precision) {
+                padded_zero_count =
+                    (uint32_t)curr_spec->precision - total_digit_count;
+
+                parsed_length += padded_zero_count;
+            }
         }
 
-        *parsed = sv_drop_front(*parsed);
+        if (parsed_length != 0 && curr_spec->add_one_space_for_sign) {
+            // Only add a sign if we have neither a '+' or '-'
+            if (*parsed.begin != '+' && *parsed.begin != '-') {
+                space_pad_count += 1;
+            }
+        }
     }
 
-    out += write_char_cb(info, cb_info, '0', zero_count, cont_out);
-    if (!cont_out) {
-        return out;
+    if (parsed_length < curr_spec->width) {
+        const bool pad_with_zeros =
+            curr_spec->leftpad_zeros &&
+            is_int_specifier(curr_spec->spec) &&
+            curr_spec->precision == -1 &&
+            !curr_spec->left_justify; // Zeros are never left-justified
+
+        if (pad_with_zeros) {
+            // We're always resetting padded_zero_count if it was set before
+            padded_zero_count = curr_spec->width - parsed_length;
+        } else {
+            space_pad_count += curr_spec->width - parsed_length;
+        }
     }
 
-    return out;
-}
+    if (!curr_spec->left_justify && space_pad_count != 0) {
+        sink_write_ch(sink, ' ', space_pad_count);
+    }
 
-__optimize(3) static inline uint64_t
-call_cb(struct printf_spec_info *const info,
-        const struct string_view sv,
-        const printf_write_char_callback_t write_char_cb,
-        void *const char_cb_info,
-        const printf_write_sv_callback_t write_sv_cb,
-        void *const sv_cb_info,
-        bool *const cont_out)
-{
-    uint64_t out = 0;
-    if (sv.length == 0) {
-        return out;
+    pad_with_lead_zeros(curr_spec,
+                        &parsed,
+                        padded_zero_count,
+                        is_null,
+                        sink);
+
+    if (should_write_parsed) {
+        sink_write_sv(sink, parsed);
     }
 
-    if (sv.length == 1) {
-        const char ch = *sv.begin;
-        return write_char_cb(info, char_cb_info, ch, /*amount=*/1, cont_out);
+    if (curr_spec->left_justify && space_pad_count != 0) {
+        sink_write_ch(sink, ' ', space_pad_count);
     }
 
-    return write_sv_cb(info, sv_cb_info, sv, cont_out);
+    return !sink->stopped;
 }
 
-__optimize(3) uint64_t
-parse_printf(const char *const fmt,
-             const printf_write_char_callback_t write_char_cb,
-             void *const write_char_cb_info,
-             const printf_write_sv_callback_t write_sv_cb,
-             void *const write_sv_cb_info,
-             va_list list)
+__optimize(3) static uint64_t
+parse_printf_impl(const char *const fmt,
+                  struct printf_sink *const sink,
+                  struct va_list_struct *const list_struct)
 {
-    struct va_list_struct list_struct = {0};
-    va_copy(list_struct.list, list);
-
     // Add 2 for a int-prefix, and one for a sign.
     char buffer[MAX_CONVERT_CAP + 3];
     bzero(buffer, sizeof(buffer));
@@ -621,54 +795,36 @@ parse_printf(const char *const fmt,
     struct printf_spec_info curr_spec = PRINTF_SPEC_INFO_INIT();
     const char *unformatted_start = fmt;
 
-    uint64_t written_out = 0;
-    bool should_continue = true;
-
     const char *iter = strchr(fmt, '%');
     for (; iter != NULL; iter = strchr(iter, '%')) {
-        const struct string_view unformatted =
-            sv_create_end(unformatted_start, iter);
-
-        written_out +=
-            call_cb(NULL,
-                    unformatted,
-                    write_char_cb,
-                    write_char_cb_info,
-                    write_sv_cb,
-                    write_sv_cb_info,
-                    &should_continue);
-
-        if (!should_continue) {
-            break;
+        sink_write_sv(sink, sv_create_end(unformatted_start, iter));
+        if (sink->stopped) {
+            return sink_written(sink);
         }
 
         iter++;
         if (*iter == '\0') {
             // If we only got a percent sign, then we don't print anything
-            va_end(list_struct.list);
-            return written_out;
+            return sink_written(sink);
         }
 
         // Format is %[flags][width][.precision][length]specifier
         if (!parse_flags(&curr_spec, iter, &iter)) {
             // If we have an incomplete spec, then we exit without writing
             // anything.
-            va_end(list_struct.list);
-            return written_out;
+            return sink_written(sink);
         }
 
-        if (!parse_width(&curr_spec, &list_struct, iter, &iter)) {
+        if (!parse_width(&curr_spec, list_struct, iter, &iter)) {
             // If we have an incomplete spec, then we exit without writing
             // anything.
-            va_end(list_struct.list);
-            return written_out;
+            return sink_written(sink);
         }
 
-        if (!parse_precision(&curr_spec, iter, &list_struct, &iter)) {
+        if (!parse_precision(&curr_spec, iter, list_struct, &iter)) {
             // If we have an incomplete spec, then we exit without writing
             // anything.
-            va_end(list_struct.list);
-            return written_out;
+            return sink_written(sink);
         }
 
         uint64_t number = 0;
@@ -677,225 +833,542 @@ parse_printf(const char *const fmt,
         if (!parse_length(&curr_spec,
                           iter,
                           &iter,
-                          &list_struct,
+                          list_struct,
                           &number,
                           &is_zero))
         {
             // If we have an incomplete spec, then we exit without writing
             // anything.
-            va_end(list_struct.list);
-            return written_out;
+            return sink_written(sink);
         }
 
-        // Parse specifier
-        struct string_view parsed = SV_EMPTY();
-        bool is_null = false;
-
         curr_spec.spec = *iter;
         unformatted_start = iter + 1;
 
-        const enum handle_spec_result handle_spec_result =
-            handle_spec(&curr_spec,
+        if (!write_spec(&curr_spec,
                         buffer,
                         number,
-                        &list_struct,
-                        written_out,
-                        &parsed,
-                        &is_zero,
-                        &is_null);
-
-        switch (handle_spec_result) {
-            case E_HANDLE_SPEC_OK:
-                break;
-            case E_HANDLE_SPEC_REACHED_END:
-                va_end(list_struct.list);
-                return written_out;
-            case E_HANDLE_SPEC_CONTINUE:
-                curr_spec = PRINTF_SPEC_INFO_INIT();
-                continue;
+                        is_zero,
+                        list_struct,
+                        sink))
+        {
+            return sink_written(sink);
         }
 
         /* Move past specifier */
         iter++;
+        curr_spec = PRINTF_SPEC_INFO_INIT();
+    }
 
-        uint32_t padded_zero_count = 0;
-        uint8_t parsed_length = parsed.length;
+    if (*unformatted_start != '\0') {
+        sink_write_sv(sink,
+                      sv_create_length(unformatted_start,
+                                       strlen(unformatted_start)));
+    }
 
-        // is_zero being true implies spec is an integer.
-        // We don't write anything if we have a '0' and precision is 0.
+    return sink_written(sink);
+}
 
-        const bool should_write_parsed = !(is_zero && curr_spec.precision == 0);
-        if (!should_write_parsed) {
-            parsed_length = 0;
-        } else if (curr_spec.add_base_prefix) {
-            switch (curr_spec.spec) {
-                case 'o':
-                    parsed_length += 1;
-                    break;
-                case 'x':
-                case 'X':
-                    parsed_length += 2;
-                    break;
-            }
-        }
+__optimize(3) uint64_t
+parse_printf(const char *const fmt,
+             struct printf_sink *const sink,
+             va_list list)
+{
+    struct va_list_struct list_struct = {0};
+    va_copy(list_struct.list, list);
 
-        // If we're not wider than the specified width, we have to pad with
-        // either spaces or zeroes.
+    const uint64_t result = parse_printf_impl(fmt, sink, &list_struct);
 
-        uint32_t space_pad_count = 0;
-        if (is_int_specifier(curr_spec.spec)) {
-            if (curr_spec.precision != -1) {
-                // The case for the string-spec was already handled above
-                // Total digit count doesn't include the sign/prefix.
+    va_end(list_struct.list);
+    return result;
+}
 
-                uint8_t total_digit_count = parsed.length;
-                if (*parsed.begin == '-' || *parsed.begin == '+') {
-                    total_digit_count -= 1;
-                }
+__optimize(3) uint64_t
+parse_printf_words(const char *const fmt,
+                   struct printf_sink *const sink,
+                   const uint64_t *const words,
+                   const uint32_t word_count)
+{
+    // Use a non-null pointer even when there are no words, so next_arg()
+    // never touches the va_list.
 
-                if (total_digit_count < curr_spec.precision) {
-                    padded_zero_count =
-                        (uint32_t)curr_spec.precision - total_digit_count;
+    static const uint64_t no_words[1] = {0};
+    struct va_list_struct list_struct = {
+        .words = word_count != 0 ? words : no_words,
+        .word_count = word_count,
+        .word_index = 0,
+    };
 
-                    parsed_length += padded_zero_count;
-                }
+    return parse_printf_impl(fmt, sink, &list_struct);
+}
+
+// Skips over the length-modifier at `iter`, and returns whether it makes the
+// argument 64-bits wide.
+
+__optimize(3) static inline bool
+skip_length(const char *iter, const char **const iter_out) {
+    bool is_wide = false;
+    switch (*iter) {
+        case 'h':
+            iter++;
+            if (*iter == 'h') {
+                iter++;
             }
 
-            if (parsed_length != 0 && curr_spec.add_one_space_for_sign) {
-                // Only add a sign if we have neither a '+' or '-'
-                if (*parsed.begin != '+' && *parsed.begin != '-') {
-                    space_pad_count += 1;
-                }
+            break;
+        case 'l':
+            iter++;
+            if (*iter == 'l') {
+                iter++;
+            }
+
+            is_wide = true;
+            break;
+        case 'j':
+        case 'z':
+        case 't':
+            iter++;
+            is_wide = true;
+
+            break;
+    }
+
+    *iter_out = iter;
+    return is_wide;
+}
+
+__optimize(3) uint64_t
+parse_printf_args(const char *const fmt,
+                  const printf_arg_callback_t arg_cb,
+                  void *const arg_cb_info,
+                  va_list list)
+{
+    struct va_list_struct list_struct = {0};
+    va_copy(list_struct.list, list);
+
+    struct printf_spec_info spec = PRINTF_SPEC_INFO_INIT();
+    uint64_t arg_count = 0;
+
+#define collect(kind, word) \
+    do { \
+        if (!arg_cb(arg_cb_info, (kind), (word), precision)) { \
+            goto done; \
+        } \
+        arg_count++; \
+    } while (false)
+
+    const char *iter = strchr(fmt, '%');
+    for (; iter != NULL; iter = strchr(iter, '%')) {
+        iter++;
+
+        int precision = -1;
+        if (!parse_flags(&spec, iter, &iter)) {
+            break;
+        }
+
+        if (*iter == '*') {
+            collect(PRINTF_ARG_WORD,
+                    (uint64_t)(int64_t)va_arg(list_struct.list, int));
+            iter++;
+        } else {
+            while (*iter >= '0' && *iter <= '9') {
+                iter++;
             }
         }
 
-        if (parsed_length < curr_spec.width) {
-            const bool pad_with_zeros =
-                curr_spec.leftpad_zeros &&
-                is_int_specifier(curr_spec.spec) &&
-                curr_spec.precision == -1 &&
-                !curr_spec.left_justify; // Zeros are never left-justified
+        if (*iter == '.') {
+            iter++;
+            if (*iter == '*') {
+                precision = va_arg(list_struct.list, int);
+                collect(PRINTF_ARG_WORD, (uint64_t)(int64_t)precision);
 
-            if (pad_with_zeros) {
-                // We're always resetting padded_zero_count if it was set before
-                padded_zero_count = curr_spec.width - parsed_length;
+                iter++;
             } else {
-                space_pad_count += curr_spec.width - parsed_length;
+                precision = 0;
+                while (*iter >= '0' && *iter <= '9') {
+                    precision = precision * 10 + (*iter - '0');
+                    iter++;
+                }
             }
         }
 
-        if (curr_spec.left_justify) {
-            written_out +=
-                pad_with_lead_zeros(&curr_spec,
-                                    &parsed,
-                                    padded_zero_count,
-                                    is_null,
-                                    write_char_cb,
-                                    write_char_cb_info,
-                                    write_sv_cb,
-                                    write_sv_cb_info,
-                                    &should_continue);
-
-            if (!should_continue) {
-                va_end(list_struct.list);
-                return written_out;
-            }
+        const bool is_wide = skip_length(iter, &iter);
+        switch (*iter) {
+            case '\0':
+                goto done;
+            case 's':
+                collect(PRINTF_ARG_STRING,
+                        (uint64_t)va_arg(list_struct.list, const char *));
+                break;
+            case 'p':
+                collect(PRINTF_ARG_WORD,
+                        (uint64_t)va_arg(list_struct.list, const void *));
+                break;
+            case 'n':
+                va_arg(list_struct.list, void *);
+                collect(PRINTF_ARG_WORD, 0);
 
-            if (should_write_parsed) {
-                written_out +=
-                    call_cb(&curr_spec,
-                            parsed,
-                            write_char_cb,
-                            write_char_cb_info,
-                            write_sv_cb,
-                            write_sv_cb_info,
-                            &should_continue);
-
-                if (!should_continue) {
-                    va_end(list_struct.list);
-                    return written_out;
+                break;
+            case 'b':
+            case 'B':
+            case 'c':
+            case 'd':
+            case 'i':
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+                if (is_wide) {
+                    collect(PRINTF_ARG_WORD,
+                            va_arg(list_struct.list, uint64_t));
+                } else {
+                    collect(PRINTF_ARG_WORD,
+                            (uint64_t)(int64_t)va_arg(list_struct.list, int));
                 }
+
+                break;
+        }
+
+        iter++;
+    }
+
+#undef collect
+
+done:
+    va_end(list_struct.list);
+    return arg_count;
+}
+
+// Reads the digits at `iter`, and returns -1 if they don't fit in `max`.
+__optimize(3) static inline int32_t
+read_bounded_int(const char *iter,
+                 const char **const iter_out,
+                 const int32_t max)
+{
+    int32_t result = 0;
+    for (; *iter >= '0' && *iter <= '9'; iter++) {
+        result = result * 10 + (*iter - '0');
+        if (result > max) {
+            return -1;
+        }
+    }
+
+    *iter_out = iter;
+    return result;
+}
+
+__optimize(3) bool
+printf_program_compile(struct printf_program *const program,
+                       const char *const fmt)
+{
+    program->fmt = fmt;
+    program->op_count = 0;
+
+    const char *unformatted_start = fmt;
+    const char *iter = strchr(fmt, '%');
+
+    for (; iter != NULL; iter = strchr(iter, '%')) {
+        // Leave room for the trailing literal.
+        if (program->op_count == PRINTF_PROGRAM_MAX_OPS - 1) {
+            return false;
+        }
+
+        struct printf_op *const op = &program->ops[program->op_count];
+        if ((uint64_t)(iter - fmt) > UINT16_MAX) {
+            return false;
+        }
+
+        op->literal_offset = (uint16_t)(unformatted_start - fmt);
+        op->literal_length = (uint16_t)(iter - unformatted_start);
+
+        // Incomplete specs are left for parse_printf() to deal with.
+        struct printf_spec_info spec = PRINTF_SPEC_INFO_INIT();
+
+        iter++;
+        if (*iter == '\0' || !parse_flags(&spec, iter, &iter)) {
+            return false;
+        }
+
+        op->flags =
+            (spec.add_one_space_for_sign ? __PRINTF_OP_SPACE_FOR_SIGN : 0) |
+            (spec.left_justify ? __PRINTF_OP_LEFT_JUSTIFY : 0) |
+            (spec.add_pos_sign ? __PRINTF_OP_POS_SIGN : 0) |
+            (spec.add_base_prefix ? __PRINTF_OP_BASE_PREFIX : 0) |
+            (spec.leftpad_zeros ? __PRINTF_OP_LEFTPAD_ZEROS : 0);
+
+        op->width = 0;
+        if (*iter == '*') {
+            op->flags |= __PRINTF_OP_WIDTH_FROM_ARG;
+            iter++;
+        } else {
+            const int32_t width = read_bounded_int(iter, &iter, UINT16_MAX);
+            if (width == -1) {
+                return false;
             }
 
-            if (space_pad_count != 0) {
-                written_out +=
-                    write_char_cb(&curr_spec,
-                                  write_char_cb_info,
-                                  ' ',
-                                  space_pad_count,
-                                  &should_continue);
-
-                if (!should_continue) {
-                    va_end(list_struct.list);
-                    return written_out;
+            op->width = (uint16_t)width;
+        }
+
+        op->precision = -1;
+        if (*iter == '.') {
+            iter++;
+            if (*iter == '*') {
+                op->flags |= __PRINTF_OP_PRECISION_FROM_ARG;
+                iter++;
+            } else {
+                const int32_t precision =
+                    read_bounded_int(iter, &iter, INT16_MAX);
+
+                if (precision == -1) {
+                    return false;
                 }
+
+                op->precision = (int16_t)precision;
             }
-        } else {
-            if (space_pad_count != 0) {
-                written_out +=
-                    write_char_cb(&curr_spec,
-                                  write_char_cb_info,
-                                  ' ',
-                                  space_pad_count,
-                                  &should_continue);
-
-                if (!should_continue) {
-                    va_end(list_struct.list);
-                    return written_out;
-                }
+        }
+
+        if (*iter == '\0') {
+            return false;
+        }
+
+        op->length_offset = (uint16_t)(iter - fmt);
+        skip_length(iter, &iter);
+
+        if (*iter == '\0') {
+            return false;
+        }
+
+        op->spec = *iter;
+        program->op_count++;
+
+        iter++;
+        unformatted_start = iter;
+    }
+
+    const uint64_t length = strlen(unformatted_start);
+    if ((uint64_t)(unformatted_start - fmt) + length > UINT16_MAX) {
+        return false;
+    }
+
+    struct printf_op *const op = &program->ops[program->op_count];
+
+    op->literal_offset = (uint16_t)(unformatted_start - fmt);
+    op->literal_length = (uint16_t)length;
+    op->spec = '\0';
+
+    program->op_count++;
+    return true;
+}
+
+__optimize(3) uint64_t
+parse_printf_program(const struct printf_program *const program,
+                     struct printf_sink *const sink,
+                     va_list list)
+{
+    struct va_list_struct list_struct = {0};
+    va_copy(list_struct.list, list);
+
+    // Add 2 for a int-prefix, and one for a sign.
+    char buffer[MAX_CONVERT_CAP + 3];
+    bzero(buffer, sizeof(buffer));
+
+    const char *const fmt = program->fmt;
+    const struct printf_op *const end = program->ops + program->op_count;
+
+    for (const struct printf_op *op = program->ops; op != end; op++) {
+        sink_write_sv(sink,
+                      sv_create_length(fmt + op->literal_offset,
+                                       op->literal_length));
+
+        if (sink->stopped || op->spec == '\0') {
+            break;
+        }
+
+        struct printf_spec_info spec = {
+            .add_one_space_for_sign =
+                (op->flags & __PRINTF_OP_SPACE_FOR_SIGN) != 0,
+            .left_justify = (op->flags & __PRINTF_OP_LEFT_JUSTIFY) != 0,
+            .add_pos_sign = (op->flags & __PRINTF_OP_POS_SIGN) != 0,
+            .add_base_prefix = (op->flags & __PRINTF_OP_BASE_PREFIX) != 0,
+            .leftpad_zeros = (op->flags & __PRINTF_OP_LEFTPAD_ZEROS) != 0,
+            .spec = op->spec,
+            .width = op->width,
+            .precision = op->precision,
+            .length_sv = SV_EMPTY()
+        };
+
+        if (op->flags & __PRINTF_OP_WIDTH_FROM_ARG) {
+            const int value = next_arg(&list_struct, int);
+            spec.width = value >= 0 ? (uint32_t)value : 0;
+        }
+
+        if (op->flags & __PRINTF_OP_PRECISION_FROM_ARG) {
+            spec.precision = next_arg(&list_struct, int);
+        }
+
+        const char *iter = fmt + op->length_offset;
+
+        uint64_t number = 0;
+        bool is_zero = false;
+
+        parse_length(&spec, iter, &iter, &list_struct, &number, &is_zero);
+        if (!write_spec(&spec, buffer, number, is_zero, &list_struct, sink)) {
+            break;
+        }
+    }
+
+    va_end(list_struct.list);
+    return sink_written(sink);
+}
+
+/*
+ * Compiled programs are kept in an open-addressed table keyed by the address
+ * of their format string, with linear probing. Neither keys nor programs are
+ * ever removed, so a program found in the table stays valid forever.
+ *
+ * A cpu inserting a format first claims a slot by setting its key, then
+ * compiles the format and publishes the program. Lookups that find the key
+ * but no program yet fall back to parse_printf() in the meantime.
+ *
+ * Formats that don't compile, or that arrive once the pool is used up, are
+ * recorded with `g_uncached_program`, so later lookups of them fall back
+ * without compiling them again.
+ *
+ * The pool is sized for every printk() call-site in the kernel, with some to
+ * spare, and the table is twice the size of the pool so probes stay short.
+ */
+
+#define PRINTF_PROGRAM_POOL_SIZE 512
+#define PRINTF_PROGRAM_TABLE_SIZE (PRINTF_PROGRAM_POOL_SIZE * 2)
+
+static struct printf_program g_program_pool[PRINTF_PROGRAM_POOL_SIZE];
+static _Atomic uint32_t g_program_pool_used = 0;
+
+static const struct printf_program g_uncached_program = {
+    .fmt = NULL,
+    .op_count = 0,
+};
+
+struct printf_program_slot {
+    const char *_Atomic fmt;
+    const struct printf_program *_Atomic program;
+};
+
+static struct printf_program_slot g_program_table[PRINTF_PROGRAM_TABLE_SIZE];
+static _Atomic uint32_t g_program_table_used = 0;
+
+__optimize(3) static inline uint32_t table_index_for(const char *const fmt) {
+    const uint64_t hash = (uint64_t)fmt * 0x9e3779b97f4a7c15ull;
+    return (uint32_t)(hash >> 32) % PRINTF_PROGRAM_TABLE_SIZE;
+}
+
+__optimize(3) static inline const struct printf_program *
+slot_program(struct printf_program_slot *const slot) {
+    const struct printf_program *const program =
+        atomic_load_explicit(&slot->program, memory_order_acquire);
+
+    return program != &g_uncached_program ? program : NULL;
+}
+
+__optimize(3) static struct printf_program *alloc_program() {
+    uint32_t index =
+        atomic_load_explicit(&g_program_pool_used, memory_order_relaxed);
+
+    do {
+        if (index == PRINTF_PROGRAM_POOL_SIZE) {
+            return NULL;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&g_program_pool_used,
+                                                    &index,
+                                                    index + 1,
+                                                    memory_order_relaxed,
+                                                    memory_order_relaxed));
+
+    return &g_program_pool[index];
+}
+
+__optimize(3) static const struct printf_program *
+fill_slot(struct printf_program_slot *const slot, const char *const fmt) {
+    const struct printf_program *result = &g_uncached_program;
+
+    // Don't compile formats that can't be cached anyway.
+    if (atomic_load_explicit(&g_program_pool_used, memory_order_relaxed) !=
+            PRINTF_PROGRAM_POOL_SIZE)
+    {
+        struct printf_program compiled;
+        if (printf_program_compile(&compiled, fmt)) {
+            struct printf_program *const program = alloc_program();
+            if (program != NULL) {
+                *program = compiled;
+                result = program;
             }
+        }
+    }
+
+    atomic_store_explicit(&slot->program, result, memory_order_release);
+    return result != &g_uncached_program ? result : NULL;
+}
+
+__optimize(3)
+const struct printf_program *printf_program_lookup(const char *const fmt) {
+    uint32_t index = table_index_for(fmt);
+    for (uint32_t i = 0; i != PRINTF_PROGRAM_TABLE_SIZE; i++) {
+        struct printf_program_slot *const slot = &g_program_table[index];
+        const char *key =
+            atomic_load_explicit(&slot->fmt, memory_order_relaxed);
+
+        if (__builtin_expect(key == fmt, 1)) {
+            return slot_program(slot);
+        }
+
+        if (key == NULL) {
+            // Keep the table at most about half full, so every probe ends at
+            // an empty slot quickly. Past that, new formats aren't cached.
+
+            const uint32_t used =
+                atomic_load_explicit(&g_program_table_used,
+                                     memory_order_relaxed);
 
-            written_out +=
-                pad_with_lead_zeros(&curr_spec,
-                                    &parsed,
-                                    padded_zero_count,
-                                    is_null,
-                                    write_char_cb,
-                                    write_char_cb_info,
-                                    write_sv_cb,
-                                    write_sv_cb_info,
-                                    &should_continue);
-
-            if (!should_continue) {
-                va_end(list_struct.list);
-                return written_out;
+            if (used >= PRINTF_PROGRAM_TABLE_SIZE / 2) {
+                return NULL;
             }
 
-            if (should_write_parsed) {
-                written_out +=
-                    call_cb(&curr_spec,
-                            parsed,
-                            write_char_cb,
-                            write_char_cb_info,
-                            write_sv_cb,
-                            write_sv_cb_info,
-                            &should_continue);
-
-                if (!should_continue) {
-                    va_end(list_struct.list);
-                    return written_out;
-                }
+            if (atomic_compare_exchange_strong_explicit(&slot->fmt,
+                                                        &key,
+                                                        fmt,
+                                                        memory_order_relaxed,
+                                                        memory_order_relaxed))
+            {
+                atomic_fetch_add_explicit(&g_program_table_used,
+                                          1,
+                                          memory_order_relaxed);
+
+                return fill_slot(slot, fmt);
+            }
+
+            // Another cpu claimed the slot first, possibly for `fmt` itself,
+            // in which case its program may not be published yet.
+
+            if (key == fmt) {
+                return slot_program(slot);
             }
         }
 
-        curr_spec = PRINTF_SPEC_INFO_INIT();
+        index = (index + 1) % PRINTF_PROGRAM_TABLE_SIZE;
     }
 
-    if (*unformatted_start != '\0') {
-        const struct string_view unformatted =
-            sv_create_length(unformatted_start, strlen(unformatted_start));
+    return NULL;
+}
 
-        curr_spec = PRINTF_SPEC_INFO_INIT();
-        written_out +=
-            call_cb(NULL,
-                    unformatted,
-                    write_char_cb,
-                    write_char_cb_info,
-                    write_sv_cb,
-                    write_sv_cb_info,
-                    &should_continue);
+__optimize(3) uint64_t
+parse_printf_cached(const char *const fmt,
+                    struct printf_sink *const sink,
+                    va_list list)
+{
+    const struct printf_program *const program = printf_program_lookup(fmt);
+    if (program == NULL) {
+        return parse_printf(fmt, sink, list);
     }
 
-    va_end(list_struct.list);
-    return written_out;
+    return parse_printf_program(program, sink, list);
 }
\ No newline at end of file
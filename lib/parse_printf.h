@@ -34,23 +34,142 @@ struct printf_spec_info {
         .length_sv = SV_EMPTY() \
     })
 
-typedef uint64_t
-(*printf_write_char_callback_t)(struct printf_spec_info *spec_info,
-                                void *info,
-                                char ch,
-                                uint64_t times,
-                                bool *should_continue_out);
-
-typedef uint64_t
-(*printf_write_sv_callback_t)(struct printf_spec_info *spec_info,
-                              void *info,
-                              struct string_view sv,
-                              bool *should_continue_out);
+/*
+ * parse_printf() writes its output into `buffer`, and calls `flush` to hand
+ * off the buffer's contents whenever it fills up. Formatting stops if `flush`
+ * returns false, or if `flush` is NULL and the buffer is full.
+ *
+ * Nothing is flushed once formatting is done, callers should call
+ * printf_sink_flush() themselves if they need to.
+ */
+
+struct printf_sink {
+    char *buffer;
+    uint64_t capacity;
+    uint64_t used;
+
+    bool (*flush)(struct printf_sink *sink);
+    void *flush_info;
+
+    // Bytes already handed off to `flush`.
+    uint64_t flushed;
+    bool stopped;
+};
+
+#define PRINTF_SINK_INIT(buffer_, capacity_, flush_, flush_info_) \
+    ((struct printf_sink){ \
+        .buffer = (buffer_), \
+        .capacity = (capacity_), \
+        .used = 0, \
+        .flush = (flush_), \
+        .flush_info = (flush_info_), \
+        .flushed = 0, \
+        .stopped = false \
+    })
+
+bool printf_sink_flush(struct printf_sink *sink);
+
+// Returns the number of bytes written to `sink`, including those flushed.
+uint64_t parse_printf(const char *fmt, struct printf_sink *sink, va_list list);
+
+// Format `fmt` with arguments taken from `words`, as collected by
+// parse_printf_args(), instead of a va_list.
+
+uint64_t
+parse_printf_words(const char *fmt,
+                   struct printf_sink *sink,
+                   const uint64_t *words,
+                   uint32_t word_count);
+
+enum printf_arg_kind {
+    PRINTF_ARG_WORD,
+
+    // The word is a pointer to a string, which may not outlive the call.
+    PRINTF_ARG_STRING,
+};
+
+typedef bool
+(*printf_arg_callback_t)(void *info,
+                         enum printf_arg_kind kind,
+                         uint64_t word,
+                         int precision);
+
+/*
+ * Call `arg_cb` with every argument `fmt` reads from `list`, in order, widened
+ * to 64-bits, without formatting anything. Arguments for "%n" are passed as
+ * zero. Stops early if `arg_cb` returns false.
+ *
+ * Returns the number of arguments `arg_cb` accepted.
+ */
+
+uint64_t
+parse_printf_args(const char *fmt,
+                  printf_arg_callback_t arg_cb,
+                  void *arg_cb_info,
+                  va_list list);
+
+/*
+ * A format string that's been parsed ahead of time by printf_program_compile(),
+ * so formatting with it skips parsing flags, widths and precisions.
+ *
+ * Every op is the literal text before a spec, followed by the spec itself. The
+ * last op only has the literal text after the last spec.
+ */
+
+#define PRINTF_PROGRAM_MAX_OPS 16
+
+enum printf_op_flags {
+    __PRINTF_OP_SPACE_FOR_SIGN = 1 << 0,
+    __PRINTF_OP_LEFT_JUSTIFY = 1 << 1,
+    __PRINTF_OP_POS_SIGN = 1 << 2,
+    __PRINTF_OP_BASE_PREFIX = 1 << 3,
+    __PRINTF_OP_LEFTPAD_ZEROS = 1 << 4,
+
+    // The width or precision is "*", and is read from the arguments.
+    __PRINTF_OP_WIDTH_FROM_ARG = 1 << 5,
+    __PRINTF_OP_PRECISION_FROM_ARG = 1 << 6,
+};
+
+struct printf_op {
+    uint16_t literal_offset;
+    uint16_t literal_length;
+
+    // Where the spec's length-modifier, if any, begins. The modifier is read
+    // again when formatting, as it decides the type of the argument.
+
+    uint16_t length_offset;
+
+    uint8_t flags;
+    char spec;
+
+    uint16_t width;
+    int16_t precision;
+};
+
+struct printf_program {
+    const char *fmt;
+
+    uint8_t op_count;
+    struct printf_op ops[PRINTF_PROGRAM_MAX_OPS];
+};
+
+// Returns false if `fmt` has too many specs, or any incomplete spec, in which
+// case it should be formatted with parse_printf() instead.
+
+bool
+printf_program_compile(struct printf_program *program, const char *fmt);
+
+uint64_t
+parse_printf_program(const struct printf_program *program,
+                     struct printf_sink *sink,
+                     va_list list);
+
+// Returns the compiled program for `fmt`, compiling and caching it by its
+// address on first use, or NULL if it can't be compiled or cached. `fmt` must
+// never change or be freed, e.g. a string literal.
+
+const struct printf_program *printf_program_lookup(const char *fmt);
 
+// parse_printf(), but through printf_program_lookup() when possible.
 uint64_t
-parse_printf(const char *fmt,
-             printf_write_char_callback_t write_char_cb,
-             void *char_cb_info,
-             printf_write_sv_callback_t write_sv_cb,
-             void *sv_cb_info,
-             va_list list);
+parse_printf_cached(const char *fmt, struct printf_sink *sink, va_list list);
\ No newline at end of file
@@ -39,7 +39,7 @@ bool refcount_decrement(struct refcount *const ref, const int32_t amount) {
         panic("refcount_decrement() called on maxed refcount");
     }
 
-    return old == 1;
+    return old == amount;
 }
 
 __optimize(3) void ref_up(struct refcount *const ref) {
@@ -0,0 +1,418 @@
+/*
+ * lib/strscan.c
+ * © suhas pai
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lib/macros.h"
+#include "strscan.h"
+
+#define ONES 0x0101010101010101ull
+#define LOWS 0x7F7F7F7F7F7F7F7Full
+#define HIGHS 0x8080808080808080ull
+
+typedef uint64_t aliasing_u64 __attribute__((may_alias));
+
+// Returns whether `word` has a zero byte. Cheaper than zero_byte_mask(), but
+// the mask it builds can have false positives after the first zero byte, so
+// it's only good for finding whether there is one.
+
+__optimize(3) static inline bool has_zero_byte(const uint64_t word) {
+    return ((word - ONES) & ~word & HIGHS) != 0;
+}
+
+// Returns a mask with the top bit of every zero byte of `word` set.
+__optimize(3) static inline uint64_t zero_byte_mask(const uint64_t word) {
+    return ~(((word & LOWS) + LOWS) | word | LOWS);
+}
+
+// Byte indices count from the lowest address, whatever the endianness.
+__optimize(3) static inline uint32_t first_byte(const uint64_t mask) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return (uint32_t)__builtin_ctzll(mask) / 8;
+#else
+    return (uint32_t)__builtin_clzll(mask) / 8;
+#endif /* __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ */
+}
+
+__optimize(3) static inline uint32_t last_byte(const uint64_t mask) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return 7 - (uint32_t)__builtin_clzll(mask) / 8;
+#else
+    return 7 - (uint32_t)__builtin_ctzll(mask) / 8;
+#endif /* __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ */
+}
+
+// Returns a mask of the bytes at `index` and after.
+__optimize(3) static inline uint64_t bytes_from(const uint32_t index) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return ~0ull << (index * 8);
+#else
+    return ~0ull >> (index * 8);
+#endif /* __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ */
+}
+
+// Returns a mask of the bytes up to and including `index`.
+__optimize(3) static inline uint64_t bytes_upto(const uint32_t index) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return ~0ull >> (56 - index * 8);
+#else
+    return ~0ull << (56 - index * 8);
+#endif /* __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ */
+}
+
+// Every variant starts at the word containing the first byte, and ignores the
+// bytes before it, so every load is aligned.
+
+__optimize(3) static inline const aliasing_u64 *word_of(const void *const ptr) {
+    return (const aliasing_u64 *)((uintptr_t)ptr & ~(uintptr_t)7);
+}
+
+__optimize(3) static inline uint32_t offset_in_word(const void *const ptr) {
+    return (uint32_t)((uintptr_t)ptr & 7);
+}
+
+// Returns a pointer to the first zero byte of the words at `iter` and after,
+// where `iter` is the word after the first one searched.
+//
+// Two words are checked at a time once `iter` is aligned to 16 bytes, so both
+// are always in the same page.
+
+__optimize(3) static inline const char *
+find_zero_byte_after(const aliasing_u64 *iter) {
+    if (((uintptr_t)iter & 8) != 0) {
+        if (has_zero_byte(*iter)) {
+            return (const char *)iter + first_byte(zero_byte_mask(*iter));
+        }
+
+        iter++;
+    }
+
+    for (;; iter += 2) {
+        const uint64_t a = iter[0];
+        const uint64_t b = iter[1];
+
+        if ((((a - ONES) & ~a) | ((b - ONES) & ~b)) & HIGHS) {
+            break;
+        }
+    }
+
+    uint64_t mask = zero_byte_mask(iter[0]);
+    if (mask == 0) {
+        iter++;
+        mask = zero_byte_mask(iter[0]);
+    }
+
+    return (const char *)iter + first_byte(mask);
+}
+
+__optimize(3) size_t strlen_words(const char *const str) {
+    const aliasing_u64 *const iter = word_of(str);
+    const uint64_t mask =
+        zero_byte_mask(*iter) & bytes_from(offset_in_word(str));
+
+    if (mask != 0) {
+        return (size_t)((const char *)iter + first_byte(mask) - str);
+    }
+
+    return (size_t)(find_zero_byte_after(iter + 1) - str);
+}
+
+__optimize(3) size_t strnlen_words(const char *const str, const size_t limit) {
+    const char *const end = memchr_words(str, '\0', limit);
+    return end != NULL ? (size_t)(end - str) : limit;
+}
+
+__optimize(3) char *strchr_words(const char *const str, const int ch) {
+    const uint64_t pattern = (uint8_t)ch * ONES;
+    const aliasing_u64 *iter = word_of(str);
+
+    uint64_t word = *iter;
+    uint64_t mask =
+        (zero_byte_mask(word) | zero_byte_mask(word ^ pattern)) &
+        bytes_from(offset_in_word(str));
+
+    if (mask == 0) {
+        do {
+            iter++;
+            word = *iter;
+        } while (!has_zero_byte(word) && !has_zero_byte(word ^ pattern));
+
+        mask = zero_byte_mask(word) | zero_byte_mask(word ^ pattern);
+    }
+
+    // The first byte found is either `ch` or the terminator.
+    const char *const result = (const char *)iter + first_byte(mask);
+    return *result == (char)ch ? (char *)(uintptr_t)result : NULL;
+}
+
+__optimize(3) char *strrchr_words(const char *const str, const int ch) {
+    const uint64_t pattern = (uint8_t)ch * ONES;
+    const uint64_t first_mask = bytes_from(offset_in_word(str));
+    const aliasing_u64 *iter = word_of(str);
+
+    uint64_t word = *iter;
+    uint64_t zeros = zero_byte_mask(word) & first_mask;
+    uint64_t matches = zero_byte_mask(word ^ pattern) & first_mask;
+
+    const char *result = NULL;
+    while (zeros == 0) {
+        if (matches != 0) {
+            result = (const char *)iter + last_byte(matches);
+        }
+
+        iter++;
+        word = *iter;
+
+        zeros = zero_byte_mask(word);
+        matches = zero_byte_mask(word ^ pattern);
+    }
+
+    // Ignore matches after the terminator, but keep the terminator itself so
+    // strrchr(str, '\0') finds it.
+
+    matches &= bytes_upto(first_byte(zeros));
+    if (matches != 0) {
+        result = (const char *)iter + last_byte(matches);
+    }
+
+    return (char *)(uintptr_t)result;
+}
+
+__optimize(3)
+void *memchr_words(const void *const ptr, const int ch, const size_t count) {
+    if (count == 0) {
+        return NULL;
+    }
+
+    const uint64_t pattern = (uint8_t)ch * ONES;
+    const uint32_t offset = offset_in_word(ptr);
+    const aliasing_u64 *iter = word_of(ptr);
+
+    // The number of bytes left to search, counting from the front of `iter`.
+    size_t left = count <= SIZE_MAX - offset ? count + offset : SIZE_MAX;
+    uint64_t mask = zero_byte_mask(*iter ^ pattern) & bytes_from(offset);
+
+    if (mask == 0) {
+        if (left <= sizeof(uint64_t)) {
+            return NULL;
+        }
+
+        left -= sizeof(uint64_t);
+        iter++;
+
+        // As with strlen_words(), search two words at a time once aligned to
+        // 16 bytes, while both words are entirely inside the buffer.
+
+        if (((uintptr_t)iter & 8) != 0 && left >= 16) {
+            mask = zero_byte_mask(*iter ^ pattern);
+            if (mask == 0) {
+                left -= sizeof(uint64_t);
+                iter++;
+            }
+        }
+
+        if (mask == 0) {
+            for (; left >= 16; left -= 16, iter += 2) {
+                const uint64_t a = iter[0] ^ pattern;
+                const uint64_t b = iter[1] ^ pattern;
+
+                if ((((a - ONES) & ~a) | ((b - ONES) & ~b)) & HIGHS) {
+                    break;
+                }
+            }
+
+            // Either the pair at `iter` has a match, or there are less than
+            // two words left.
+
+            for (; left != 0; iter++) {
+                mask = zero_byte_mask(*iter ^ pattern);
+                if (mask != 0) {
+                    break;
+                }
+
+                left = left > sizeof(uint64_t) ? left - sizeof(uint64_t) : 0;
+            }
+
+            if (mask == 0) {
+                return NULL;
+            }
+        }
+    }
+
+    const uint32_t index = first_byte(mask);
+    if (index >= left) {
+        return NULL;
+    }
+
+    return (void *)((uintptr_t)iter + index);
+}
+
+#if defined(__x86_64__)
+    #define __avx2 __attribute__((target("avx2")))
+
+    typedef char v32qi __attribute__((vector_size(32)));
+    typedef v32qi v32qi_unaligned __attribute__((aligned(1), may_alias));
+    typedef v32qi v32qi_aligned __attribute__((may_alias));
+
+    #define v32_load(ptr) (*(const v32qi_unaligned *)(const void *)(ptr))
+    #define v32_load_aligned(ptr) (*(const v32qi_aligned *)(const void *)(ptr))
+
+    __avx2 __optimize(3) static inline uint32_t
+    v32_eq_mask(const v32qi vec, const v32qi pattern) {
+        return (uint32_t)__builtin_ia32_pmovmskb256((v32qi)(vec == pattern));
+    }
+
+    // Returns whether any byte of the 128 bytes at `iter` matches the byte
+    // repeated in `pattern`.
+
+    __avx2 __optimize(3) static inline bool
+    v32x4_has_eq(const uint8_t *const iter, const v32qi pattern) {
+        const v32qi eq =
+            (v32qi)((v32_load(iter) == pattern) |
+                    (v32_load(iter + 32) == pattern) |
+                    (v32_load(iter + 64) == pattern) |
+                    (v32_load(iter + 96) == pattern));
+
+        return __builtin_ia32_pmovmskb256(eq) != 0;
+    }
+
+    // Returns the first byte matching `pattern` in the 128 bytes at `iter`,
+    // which must have one.
+
+    __avx2 __optimize(3) static inline const uint8_t *
+    v32x4_find_eq(const uint8_t *iter, const v32qi pattern) {
+        for (;; iter += 32) {
+            const uint32_t mask = v32_eq_mask(v32_load(iter), pattern);
+            if (mask != 0) {
+                return iter + __builtin_ctz(mask);
+            }
+        }
+    }
+
+    __avx2 __optimize(3) size_t strlen_avx2(const char *const str) {
+        const v32qi zero = {};
+        const uint8_t *const begin = (const uint8_t *)str;
+        const uint32_t offset = (uint32_t)((uintptr_t)begin & 31);
+        const uint8_t *iter = (const uint8_t *)((uintptr_t)begin - offset);
+
+        uint32_t mask = v32_eq_mask(v32_load_aligned(iter), zero) >> offset;
+        if (mask != 0) {
+            return (size_t)__builtin_ctz(mask);
+        }
+
+        // The loop loads 128 bytes at a time, so align to 128 first to keep
+        // all four loads inside the same page.
+
+        for (iter += 32; ((uintptr_t)iter & 127) != 0; iter += 32) {
+            mask = v32_eq_mask(v32_load_aligned(iter), zero);
+            if (mask != 0) {
+                return (size_t)(iter + __builtin_ctz(mask) - begin);
+            }
+        }
+
+        while (!v32x4_has_eq(iter, zero)) {
+            iter += 128;
+        }
+
+        return (size_t)(v32x4_find_eq(iter, zero) - begin);
+    }
+
+    // Unlike memchr_avx2(), the bytes up to `limit` aren't promised to be
+    // mapped, only the bytes up to the terminator, so every load is aligned,
+    // as in strlen_avx2().
+
+    __avx2 __optimize(3)
+    size_t strnlen_avx2(const char *const str, const size_t limit) {
+        if (limit == 0) {
+            return 0;
+        }
+
+        const v32qi zero = {};
+        const uint8_t *const begin = (const uint8_t *)str;
+        const uint32_t offset = (uint32_t)((uintptr_t)begin & 31);
+        const uint8_t *iter = (const uint8_t *)((uintptr_t)begin - offset);
+
+        // The number of bytes left to search, counting from the front of
+        // `iter`.
+
+        size_t left = limit <= SIZE_MAX - offset ? limit + offset : SIZE_MAX;
+        uint32_t mask =
+            v32_eq_mask(v32_load_aligned(iter), zero) & (~0u << offset);
+
+        while (mask == 0) {
+            if (left <= 32) {
+                return limit;
+            }
+
+            left -= 32;
+            iter += 32;
+
+            // Once aligned to 128 bytes, skip whole blocks of 128 bytes, but
+            // only while the block after them still has bytes to search.
+
+            if (((uintptr_t)iter & 127) == 0) {
+                while (left > 128 && !v32x4_has_eq(iter, zero)) {
+                    left -= 128;
+                    iter += 128;
+                }
+            }
+
+            mask = v32_eq_mask(v32_load_aligned(iter), zero);
+        }
+
+        const uint32_t index = (uint32_t)__builtin_ctz(mask);
+        if (index >= left) {
+            return limit;
+        }
+
+        return (size_t)(iter + index - begin);
+    }
+
+    __avx2 __optimize(3)
+    void *memchr_avx2(const void *const ptr, const int ch, const size_t count) {
+        if (count < 32) {
+            return memchr_words(ptr, ch, count);
+        }
+
+        const v32qi pattern = (v32qi){} + (char)ch;
+        const uint8_t *const begin = ptr;
+        const uint8_t *const end = begin + count;
+
+        uint32_t mask = v32_eq_mask(v32_load(begin), pattern);
+        if (mask != 0) {
+            return (void *)(uintptr_t)(begin + __builtin_ctz(mask));
+        }
+
+        // Continue from the next aligned block, which may overlap the bytes
+        // just searched.
+
+        const uint8_t *iter =
+            (const uint8_t *)(((uintptr_t)begin + 32) & ~(uintptr_t)31);
+
+        for (; end - iter >= 128; iter += 128) {
+            if (v32x4_has_eq(iter, pattern)) {
+                return (void *)(uintptr_t)v32x4_find_eq(iter, pattern);
+            }
+        }
+
+        for (; end - iter >= 32; iter += 32) {
+            mask = v32_eq_mask(v32_load_aligned(iter), pattern);
+            if (mask != 0) {
+                return (void *)(uintptr_t)(iter + __builtin_ctz(mask));
+            }
+        }
+
+        // Search the last 32 bytes, which may overlap bytes already searched.
+        if (iter != end) {
+            mask = v32_eq_mask(v32_load(end - 32), pattern);
+            if (mask != 0) {
+                return (void *)(uintptr_t)(end - 32 + __builtin_ctz(mask));
+            }
+        }
+
+        return NULL;
+    }
+#endif /* defined(__x86_64__) */
\ No newline at end of file
@@ -0,0 +1,33 @@
+/*
+ * lib/strscan.h
+ * © suhas pai
+ */
+
+#pragma once
+#include <stddef.h>
+
+/*
+ * Variants of strlen(), strnlen(), strchr(), strrchr() and memchr() that scan
+ * more than a byte at a time.
+ *
+ * Every load is aligned to its own size, so no load crosses into a page the
+ * string or buffer doesn't touch, even when it reads past the terminator or
+ * the end of the buffer.
+ *
+ * As with lib/memops.h, the simd variants use the vector registers without
+ * saving them.
+ */
+
+size_t strlen_words(const char *str);
+size_t strnlen_words(const char *str, size_t limit);
+
+char *strchr_words(const char *str, int ch);
+char *strrchr_words(const char *str, int ch);
+
+void *memchr_words(const void *ptr, int ch, size_t count);
+
+#if defined(__x86_64__)
+    size_t strlen_avx2(const char *str);
+    size_t strnlen_avx2(const char *str, size_t limit);
+    void *memchr_avx2(const void *ptr, int ch, size_t count);
+#endif /* defined(__x86_64__) */
\ No newline at end of file
@@ -3,14 +3,20 @@
  * © suhas pai
  */
 
+#include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "lib/adt/avltree.h"
 #include "lib/list.h"
 
+#include "bench.h"
+
 struct node {
     struct avlnode info;
+    struct list list;
+
     uint32_t number;
 };
 
@@ -60,6 +66,159 @@ static void print_tree(struct avltree *const tree) {
     avltree_print(tree, avlnode_print_node_cb, avlnode_print_sv_cb, NULL);
 }
 
+static struct avlnode *node_of_list(struct list *const item) {
+    return &container_of(item, struct node, list)->info;
+}
+
+// Nodes hold the even numbers [0, count * 2), so odd keys fall between nodes.
+static struct node *
+create_sorted_nodes(struct list *const list, const uint32_t count) {
+    struct node *const nodes = malloc(sizeof(struct node) * count);
+    for (uint32_t i = 0; i != count; i++) {
+        nodes[i].info = AVLNODE_INIT();
+        nodes[i].number = i * 2;
+
+        list_radd(list, &nodes[i].list);
+    }
+
+    return nodes;
+}
+
+static uint32_t check_balanced(struct avlnode *const node) {
+    if (node == NULL) {
+        return 0;
+    }
+
+    const uint32_t left = check_balanced(node->left);
+    const uint32_t right = check_balanced(node->right);
+
+    assert(left <= right + 1 && right <= left + 1);
+    assert(node->height == 1 + max(left, right));
+
+    return node->height;
+}
+
+static uint32_t number_of(struct avlnode *const avlnode) {
+    return container_of(avlnode, struct node, info)->number;
+}
+
+static void test_build_sorted() {
+    for (uint32_t count = 0; count != 70; count++) {
+        struct list list = LIST_INIT(list);
+        struct node *const nodes = create_sorted_nodes(&list, count);
+        struct avltree tree = AVLTREE_INIT();
+
+        avltree_build_sorted(&tree, &list, node_of_list, /*update=*/NULL);
+        check_balanced(tree.root);
+
+        uint32_t expected = 0;
+        struct avlnode *avlnode = NULL;
+
+        avltree_foreach(avlnode, &tree) {
+            assert(number_of(avlnode) == expected);
+            expected += 2;
+        }
+
+        assert(expected == count * 2);
+        avltree_foreach_reverse(avlnode, &tree) {
+            expected -= 2;
+            assert(number_of(avlnode) == expected);
+        }
+
+        assert(expected == 0);
+        for (uint32_t key = 0; key != count * 2 + 1; key++) {
+            struct avlnode *const lower =
+                avltree_lower_bound(&tree,
+                                    (void *)(uint64_t)key,
+                                    (avlnode_compare_key_t)identify);
+            struct avlnode *const upper =
+                avltree_upper_bound(&tree,
+                                    (void *)(uint64_t)key,
+                                    (avlnode_compare_key_t)identify);
+
+            const uint32_t lower_expected = (key + 1) & ~1u;
+            const uint32_t upper_expected = (key + 2) & ~1u;
+
+            if (lower_expected < count * 2) {
+                assert(lower != NULL && number_of(lower) == lower_expected);
+            } else {
+                assert(lower == NULL);
+            }
+
+            if (upper_expected < count * 2) {
+                assert(upper != NULL && number_of(upper) == upper_expected);
+            } else {
+                assert(upper == NULL);
+            }
+        }
+
+        // The tree should still support regular deletes.
+        for (uint32_t i = 0; i < count; i += 3) {
+            avltree_delete(&tree,
+                           (void *)(uint64_t)(i * 2),
+                           (avlnode_compare_key_t)identify,
+                           /*update=*/NULL);
+        }
+
+        check_balanced(tree.root);
+        free(nodes);
+    }
+}
+
+static void bench_count(const uint32_t count) {
+    printf("avltree, %" PRIu32 " nodes:\n", count);
+
+    struct list list = LIST_INIT(list);
+    struct node *const nodes = create_sorted_nodes(&list, count);
+    struct avltree tree = AVLTREE_INIT();
+
+    // avltree verifies the subtrees it rotates on every insert in test builds,
+    // which makes avltree_insert() quadratic, so only time it on small trees.
+
+    uint64_t begin = 0;
+    if (count <= 10000) {
+        begin = bench_now_ns();
+        for (uint32_t i = 0; i != count; i++) {
+            avltree_insert(&tree,
+                           &nodes[i].info,
+                           (avlnode_compare_t)compare,
+                           /*update=*/NULL,
+                           /*added_node=*/NULL);
+        }
+
+        bench_report("avltree_insert (sorted)", count, begin, bench_now_ns());
+        tree = AVLTREE_INIT();
+    }
+
+    begin = bench_now_ns();
+
+    avltree_build_sorted(&tree, &list, node_of_list, /*update=*/NULL);
+    bench_report("avltree_build_sorted", count, begin, bench_now_ns());
+
+    uint64_t sum = 0;
+    struct avlnode *avlnode = NULL;
+
+    begin = bench_now_ns();
+    avltree_foreach(avlnode, &tree) {
+        sum += number_of(avlnode);
+    }
+
+    bench_report("avltree_foreach", count, begin, bench_now_ns());
+    assert(sum == (uint64_t)count * (count - 1));
+
+    begin = bench_now_ns();
+    for (uint32_t i = 0; i != count; i++) {
+        const uint64_t key = (uint64_t)rand() % (count * 2);
+        sum +=
+            avltree_lower_bound(&tree,
+                                (void *)key,
+                                (avlnode_compare_key_t)identify) != NULL;
+    }
+
+    bench_report("avltree_lower_bound", count, begin, bench_now_ns());
+    free(nodes);
+}
+
 void test_avltree() {
     struct avltree tree = AVLTREE_INIT();
 
@@ -87,4 +246,9 @@ void test_avltree() {
 
     printf("After deleting:\n");
     print_tree(&tree);
+
+    test_build_sorted();
+    for (uint32_t count = 1000; count <= 1000000; count *= 10) {
+        bench_count(count);
+    }
 }
\ No newline at end of file
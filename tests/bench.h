@@ -0,0 +1,30 @@
+/*
+ * tests/bench.h
+ * © suhas pai
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+static inline uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void
+bench_report(const char *const name,
+             const uint64_t count,
+             const uint64_t begin_ns,
+             const uint64_t end_ns)
+{
+    const uint64_t total = end_ns - begin_ns;
+    printf("\t%-40s %10" PRIu64 " ops, %8.2f ns/op\n",
+           name,
+           count,
+           (double)total / (double)count);
+}
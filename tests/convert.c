@@ -10,8 +10,10 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "lib/convert.h"
+#include "bench.h"
 
 struct str_to_num_test {
     const char *string;
@@ -492,6 +494,120 @@ void run_num_to_str_test(const struct num_to_str_test *const test) {
     }
 }
 
+// Compare against snprintf() for numbers of every length, with and without a
+// sign and prefix.
+
+static void check_against_printf(const uint64_t number) {
+    char expected[MAX_CONVERT_CAP + 8];
+    char buffer[MAX_CONVERT_CAP];
+
+    snprintf(expected, sizeof(expected), "%" PRIu64, number);
+    assert(sv_equals_c_str(unsigned_to_string_view(number,
+                                                   NUMERIC_BASE_10,
+                                                   buffer,
+                                                   NUM_TO_STR_OPTIONS_INIT()),
+                           expected));
+
+    snprintf(expected, sizeof(expected), "%+" PRId64, (int64_t)number);
+    assert(sv_equals_c_str(signed_to_string_view((int64_t)number,
+                                                 NUMERIC_BASE_10,
+                                                 buffer,
+                                                 (struct num_to_str_options){
+                                                    .include_pos_sign = true
+                                                 }),
+                           expected));
+
+    snprintf(expected, sizeof(expected), "0x%" PRIx64, number);
+    assert(sv_equals_c_str(unsigned_to_string_view(number,
+                                                   NUMERIC_BASE_16,
+                                                   buffer,
+                                                   (struct num_to_str_options){
+                                                      .include_prefix = true
+                                                   }),
+                           expected));
+
+    snprintf(expected, sizeof(expected), "0%" PRIo64, number);
+    assert(sv_equals_c_str(unsigned_to_string_view(number,
+                                                   NUMERIC_BASE_8,
+                                                   buffer,
+                                                   (struct num_to_str_options){
+                                                      .include_prefix = true,
+                                                      .use_0_octal_prefix = true
+                                                   }),
+                           expected));
+}
+
+// The conversion this replaced, which divides once per digit, kept to compare
+// against.
+
+static struct string_view
+per_digit_to_string_view(uint64_t number,
+                         const uint64_t base,
+                         char buffer[static const MAX_CONVERT_CAP])
+{
+    const char *const chars = "0123456789abcdefghijklmnopqrstuvwxyz";
+    uint8_t i = MAX_CONVERT_CAP - 2;
+
+    buffer[i + 1] = '\0';
+    do {
+        buffer[i] = chars[number % base];
+        if (number < base) {
+            break;
+        }
+
+        i--;
+        number /= base;
+    } while (true);
+
+    return sv_create_end(buffer + i, buffer + MAX_CONVERT_CAP - 1);
+}
+
+#define BENCH_COUNT 2000000
+#define BENCH_RUNS 5
+
+static void bench_base(const enum numeric_base base, const char *const name) {
+    static uint64_t numbers[1024];
+
+    // Mix small and large numbers, as printk() sees both.
+    for (uint32_t i = 0; i != countof(numbers); i++) {
+        const uint64_t random = (uint64_t)rand() << 32 | (uint64_t)rand();
+        numbers[i] = random >> (rand() % 64);
+    }
+
+    double results[2];
+    for (uint32_t kind = 0; kind != 2; kind++) {
+        char buffer[MAX_CONVERT_CAP];
+        volatile uint64_t sink = 0;
+        uint64_t best = UINT64_MAX;
+
+        for (uint32_t run = 0; run != BENCH_RUNS; run++) {
+            const uint64_t begin = bench_now_ns();
+            for (uint32_t i = 0; i != BENCH_COUNT; i++) {
+                const uint64_t number = numbers[i % countof(numbers)];
+                const struct string_view sv =
+                    kind == 0 ?
+                        per_digit_to_string_view(number, base, buffer) :
+                        unsigned_to_string_view(number,
+                                                base,
+                                                buffer,
+                                                NUM_TO_STR_OPTIONS_INIT());
+
+                sink += sv.length;
+            }
+
+            const uint64_t elapsed = bench_now_ns() - begin;
+            if (elapsed < best) {
+                best = elapsed;
+            }
+        }
+
+        (void)sink;
+        results[kind] = (double)best / BENCH_COUNT;
+    }
+
+    printf("\t%-10s %10.2f %10.2f\n", name, results[0], results[1]);
+}
+
 void test_convert() {
     for_each_in_carr (str_to_num_test_list, test) {
         run_str_to_num_test(test);
@@ -500,4 +616,28 @@ void test_convert() {
     for_each_in_carr (num_to_str_test_list, test) {
         run_num_to_str_test(test);
     }
+
+    for (uint32_t shift = 0; shift != 64; shift++) {
+        const uint64_t power = 1ull << shift;
+
+        check_against_printf(power);
+        check_against_printf(power - 1);
+        check_against_printf(power + 1);
+        check_against_printf(~power);
+    }
+
+    for (uint64_t power = 1; power <= 1000000000000000000ull; power *= 10) {
+        check_against_printf(power - 1);
+        check_against_printf(power);
+    }
+
+    printf("unsigned_to_string_view(), ns/op:\n\t%-10s %10s %10s\n",
+           "base",
+           "per-digit",
+           "current");
+
+    bench_base(NUMERIC_BASE_2, "2");
+    bench_base(NUMERIC_BASE_8, "8");
+    bench_base(NUMERIC_BASE_10, "10");
+    bench_base(NUMERIC_BASE_16, "16");
 }
\ No newline at end of file
@@ -6,8 +6,31 @@
 #include <assert.h>
 
 #include "lib/format.h"
+#include "lib/parse_printf.h"
+
+#include "bench.h"
 #include "common.h"
 
+static char cached_buffer[4096];
+
+// Formats through a compiled and cached program.
+static uint64_t
+format_cached(char *const buffer,
+              const uint64_t buffer_len,
+              const char *const fmt,
+              ...)
+{
+    struct printf_sink sink = PRINTF_SINK_INIT(buffer, buffer_len, NULL, NULL);
+
+    va_list list;
+    va_start(list, fmt);
+
+    const uint64_t result = parse_printf_cached(fmt, &sink, list);
+
+    va_end(list);
+    return result;
+}
+
 #define test_format_to_buffer(buffer_len, expected, str, ...)                  \
     do {                                                                       \
         int count = 0;                                                         \
@@ -31,7 +54,19 @@
                                                                                \
         assert(length == LEN_OF(expected));                                    \
         assert(count == (int)LEN_OF(expected));                                \
+                                                                               \
+        count = 0;                                                             \
+        assert(format_cached(cached_buffer,                                    \
+                             buffer_len,                                       \
+                             str "%n",                                         \
+                             ##__VA_ARGS__,                                    \
+                             &count) == length);                               \
+                                                                               \
+        check_strings(expected, cached_buffer);                                \
+        assert(count == (int)LEN_OF(expected));                                \
+                                                                               \
         memset(buffer, '\0', countof(buffer));                                 \
+        memset(cached_buffer, '\0', countof(cached_buffer));                   \
                                                                                \
         string_destroy(&string);                                               \
     } while (false)
@@ -46,9 +81,209 @@
                                                                                \
         check_strings(expected, buffer);                                       \
         assert(length == LEN_OF(expected));                                    \
+        assert(format_cached(cached_buffer,                                    \
+                             buffer_len,                                       \
+                             str,                                              \
+                             ##__VA_ARGS__) == length);                        \
+                                                                               \
+        check_strings(expected, cached_buffer);                                \
         memset(buffer, '\0', countof(buffer));                                 \
+        memset(cached_buffer, '\0', countof(cached_buffer));                   \
     } while (false)
 
+struct words_info {
+    uint64_t words[16];
+    uint32_t count;
+};
+
+static bool
+collect_word(void *const info,
+             const enum printf_arg_kind kind,
+             const uint64_t word,
+             const int precision)
+{
+    (void)kind;
+    (void)precision;
+
+    struct words_info *const words_info = (struct words_info *)info;
+    if (words_info->count == countof(words_info->words)) {
+        return false;
+    }
+
+    words_info->words[words_info->count] = word;
+    words_info->count++;
+
+    return true;
+}
+
+static uint64_t
+collect_words(struct words_info *const info, const char *const fmt, ...) {
+    va_list list;
+    va_start(list, fmt);
+
+    const uint64_t result = parse_printf_args(fmt, collect_word, info, list);
+
+    va_end(list);
+    return result;
+}
+
+// Check that collecting the arguments, and formatting them later from the
+// collected words, gives the same result as formatting them directly.
+
+#define test_format_words(expected, str, arg_count, ...)                       \
+    do {                                                                       \
+        struct words_info info = { .count = 0 };                               \
+        assert(collect_words(&info, str, ##__VA_ARGS__) == (arg_count));       \
+                                                                               \
+        struct printf_sink sink =                                              \
+            PRINTF_SINK_INIT(buffer, countof(buffer), NULL, NULL);             \
+        const uint64_t length =                                                \
+            parse_printf_words(str, &sink, info.words, info.count);            \
+                                                                               \
+        check_strings(expected, buffer);                                       \
+        assert(length == LEN_OF(expected));                                    \
+        memset(buffer, '\0', countof(buffer));                                 \
+    } while (false)
+
+// Chunks smaller than the output, to check that flushing mid-spec works.
+static bool flush_to_string(struct printf_sink *const sink) {
+    string_append_sv((struct string *)sink->flush_info,
+                     sv_create_length(sink->buffer, sink->used));
+    return true;
+}
+
+static void
+check_small_chunks(const char *const expected, const char *const fmt, ...) {
+    struct string string = STRING_EMPTY();
+    char chunk[3];
+
+    struct printf_sink sink =
+        PRINTF_SINK_INIT(chunk, sizeof(chunk), flush_to_string, &string);
+
+    va_list list;
+    va_start(list, fmt);
+
+    const uint64_t length = parse_printf(fmt, &sink, list);
+    printf_sink_flush(&sink);
+
+    va_end(list);
+
+    assert(length == strlen(expected));
+    assert(string_length(string) == strlen(expected));
+    assert(memcmp(string.gbuffer.begin, expected, strlen(expected)) == 0);
+
+    string_destroy(&string);
+}
+
+#define BENCH_COUNT 1000000
+#define BENCH_RUNS 5
+
+static void
+bench_format(const char *const name, const char *const fmt, ...) {
+    char buffer[256];
+    uint64_t best_buffer = UINT64_MAX;
+    uint64_t best_cached = UINT64_MAX;
+    uint64_t best_string = UINT64_MAX;
+
+    for (uint32_t run = 0; run != BENCH_RUNS; run++) {
+        va_list list;
+        uint64_t begin = bench_now_ns();
+
+        for (uint32_t i = 0; i != BENCH_COUNT; i++) {
+            va_start(list, fmt);
+            vformat_to_buffer(buffer, sizeof(buffer), fmt, list);
+            va_end(list);
+        }
+
+        const uint64_t buffer_elapsed = bench_now_ns() - begin;
+        if (buffer_elapsed < best_buffer) {
+            best_buffer = buffer_elapsed;
+        }
+
+        begin = bench_now_ns();
+        for (uint32_t i = 0; i != BENCH_COUNT; i++) {
+            struct printf_sink sink =
+                PRINTF_SINK_INIT(buffer, sizeof(buffer), NULL, NULL);
+
+            va_start(list, fmt);
+            parse_printf_cached(fmt, &sink, list);
+            va_end(list);
+        }
+
+        const uint64_t cached_elapsed = bench_now_ns() - begin;
+        if (cached_elapsed < best_cached) {
+            best_cached = cached_elapsed;
+        }
+
+        begin = bench_now_ns();
+        for (uint32_t i = 0; i != BENCH_COUNT / 10; i++) {
+            struct string string = STRING_EMPTY();
+
+            va_start(list, fmt);
+            vformat_to_string(&string, fmt, list);
+            va_end(list);
+
+            string_destroy(&string);
+        }
+
+        const uint64_t string_elapsed = (bench_now_ns() - begin) * 10;
+        if (string_elapsed < best_string) {
+            best_string = string_elapsed;
+        }
+    }
+
+    printf("\t%-12s %10.2f %10.2f %10.2f\n",
+           name,
+           (double)best_buffer / BENCH_COUNT,
+           (double)best_cached / BENCH_COUNT,
+           (double)best_string / BENCH_COUNT);
+}
+
+// Use more distinct formats than there are printk() call-sites in the kernel,
+// twice over, and check every one is still formatted correctly, and stays
+// cached once it is.
+
+#define MANY_FORMATS_COUNT 600
+
+static void check_many_formats() {
+    static char formats[MANY_FORMATS_COUNT][32];
+    static const struct printf_program *programs[MANY_FORMATS_COUNT];
+
+    char expected[64];
+    uint32_t cached_count = 0;
+
+    for (uint32_t pass = 0; pass != 2; pass++) {
+        for (uint32_t i = 0; i != MANY_FORMATS_COUNT; i++) {
+            if (pass == 0) {
+                snprintf(formats[i], sizeof(formats[i]), "fmt %u: %%d\n", i);
+            }
+
+            snprintf(expected, sizeof(expected), "fmt %u: %d\n", i, -(int)i);
+            memset(cached_buffer, '\0', countof(cached_buffer));
+
+            format_cached(cached_buffer,
+                          countof(cached_buffer),
+                          formats[i],
+                          -(int)i);
+
+            check_strings(expected, cached_buffer);
+
+            const struct printf_program *const program =
+                printf_program_lookup(formats[i]);
+
+            if (pass == 0) {
+                programs[i] = program;
+                cached_count += program != NULL;
+            } else {
+                assert(program == programs[i]);
+            }
+        }
+    }
+
+    // Only a handful of formats were cached by the earlier tests.
+    assert(cached_count >= 400);
+}
+
 void test_format() {
     char buffer[4096] = {0};
 
@@ -155,4 +390,54 @@ void test_format() {
 
     const char buffer2[] = "Hello, There";
     test_format_to_buffer(countof(buffer), "Hel", "%.*s", 3, buffer2);
+
+    test_format_words("test", "test", 0);
+    test_format_words("5 -3 ff", "%d %i %x", 3, 5, -3, 0xff);
+    test_format_words("-0003", "%05d", 1, -3);
+    test_format_words("-1 -2", "%hhd %hd", 2, -1, -2);
+    test_format_words("18446744073709551615 -9223372036854775808",
+                      "%" PRIu64 " %" PRId64,
+                      2,
+                      UINT64_MAX,
+                      INT64_MIN);
+    test_format_words("   Hi|Hel|(null)",
+                      "%5s|%.*s|%s",
+                      4,
+                      "Hi",
+                      3,
+                      "Hello",
+                      (char *)NULL);
+    test_format_words("   42", "%*d", 2, 5, 42);
+    test_format_words("0x1 (nil) %", "%p %p %%", 2, (void *)0x1, NULL);
+    test_format_words("c", "%c", 1, 'c');
+
+    check_small_chunks("a   42|-0005|0x2a|Hello, There",
+                       "a %4d|%05d|%#x|%s",
+                       42,
+                       -5,
+                       42,
+                       "Hello, There");
+    check_small_chunks("          ", "%10s", "");
+
+    check_many_formats();
+
+    printf("format, ns/op:\n\t%-12s %10s %10s %10s\n",
+           "kind",
+           "buffer",
+           "cached",
+           "string");
+    bench_format("literal", "kernel: finished initializing\n");
+    bench_format("ints",
+                 "isr: vector %" PRIu8 ", irq %d, cpu %" PRIu32 "\n",
+                 (uint8_t)34,
+                 11,
+                 (uint32_t)3);
+    bench_format("mixed",
+                 "mm: mapped %p-%p (%s), %" PRIu64 " pages, flags 0x%x\n",
+                 (void *)0xffff800000000000,
+                 (void *)0xffff800000200000,
+                 "kernel",
+                 (uint64_t)512,
+                 0x3f);
+    bench_format("padded", "%-16s|%08x|%10d|\n", "name", 0xbeef, -42);
 }
\ No newline at end of file
@@ -8,6 +8,9 @@ extern void test_format();
 extern void test_time();
 extern void test_avltree();
 extern void test_bitmap();
+extern void test_range_btree();
+extern void test_memops();
+extern void test_strscan();
 
 int main() {
     test_convert();
@@ -15,6 +18,9 @@ int main() {
     test_time();
     test_avltree();
     test_bitmap();
+    test_range_btree();
+    test_memops();
+    test_strscan();
 
     return 0;
 }
\ No newline at end of file
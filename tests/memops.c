@@ -0,0 +1,245 @@
+/*
+ * tests/memops.c
+ * © suhas pai
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/macros.h"
+#include "lib/memops.h"
+
+#include "bench.h"
+
+typedef void *(*memcpy_func_t)(void *dst, const void *src, size_t n);
+typedef void *(*memset_func_t)(void *dst, int val, size_t n);
+typedef int (*memcmp_func_t)(const void *left, const void *right, size_t n);
+
+struct variant {
+    const char *name;
+
+    memcpy_func_t memcpy;
+    memset_func_t memset;
+    memcmp_func_t memcmp;
+};
+
+static void *glibc_memcpy(void *const dst, const void *const src, size_t n) {
+    return memcpy(dst, src, n);
+}
+
+static void *glibc_memset(void *const dst, const int val, const size_t n) {
+    return memset(dst, val, n);
+}
+
+static int
+glibc_memcmp(const void *const left, const void *const right, const size_t n) {
+    return memcmp(left, right, n);
+}
+
+static const struct variant variants[] = {
+    { "glibc", glibc_memcpy, glibc_memset, glibc_memcmp },
+    { "words", memcpy_words, memset_words, memcmp_words },
+#if defined(__x86_64__)
+    { "rep", memcpy_rep_movsb, memset_rep_stosb, NULL },
+    { "avx2", memcpy_avx2, memset_avx2, memcmp_avx2 },
+#endif /* defined(__x86_64__) */
+};
+
+static bool variant_supported(const struct variant *const variant) {
+#if defined(__x86_64__)
+    if (variant->memcpy == memcpy_avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif /* defined(__x86_64__) */
+
+    (void)variant;
+    return true;
+}
+
+static int sign_of(const int value) {
+    return (value > 0) - (value < 0);
+}
+
+#define CHECK_MAX_SIZE 300
+#define CHECK_MAX_ALIGN 32
+
+// Pad every buffer on both sides to catch writes out of bounds.
+#define CHECK_PAD 64
+#define CHECK_BUFFER_SIZE \
+    (CHECK_PAD + CHECK_MAX_ALIGN + CHECK_MAX_SIZE + CHECK_PAD)
+
+static void check_variant(const struct variant *const variant) {
+    static uint8_t src[CHECK_BUFFER_SIZE];
+    static uint8_t dst[CHECK_BUFFER_SIZE];
+    static uint8_t expected[CHECK_BUFFER_SIZE];
+
+    for (size_t i = 0; i != sizeof(src); i++) {
+        src[i] = (uint8_t)rand();
+    }
+
+    for (size_t size = 0; size <= CHECK_MAX_SIZE; size++) {
+        for (size_t src_off = 0; src_off < CHECK_MAX_ALIGN; src_off += 3) {
+            for (size_t dst_off = 0; dst_off != CHECK_MAX_ALIGN; dst_off++) {
+                uint8_t *const d = dst + CHECK_PAD + dst_off;
+                uint8_t *const s = src + CHECK_PAD + src_off;
+
+                memset(dst, 0xAA, sizeof(dst));
+                memset(expected, 0xAA, sizeof(expected));
+                memcpy(expected + CHECK_PAD + dst_off, s, size);
+
+                assert(variant->memcpy(d, s, size) == d);
+                assert(memcmp(dst, expected, sizeof(dst)) == 0);
+
+                memset(expected + CHECK_PAD + dst_off, 0x5C, size);
+                assert(variant->memset(d, 0x5C, size) == d);
+                assert(memcmp(dst, expected, sizeof(dst)) == 0);
+
+                if (variant->memcmp == NULL) {
+                    continue;
+                }
+
+                memcpy(d, s, size);
+                assert(variant->memcmp(d, s, size) == 0);
+
+                if (size == 0) {
+                    continue;
+                }
+
+                // Flip a byte at a random position, so the mismatch is found
+                // inside a word or vector and not just at its front.
+
+                const size_t index = (size_t)rand() % size;
+                d[index] ^= (uint8_t)(1 + rand() % 255);
+
+                assert(sign_of(variant->memcmp(d, s, size)) ==
+                       sign_of(memcmp(d, s, size)));
+                assert(sign_of(variant->memcmp(s, d, size)) ==
+                       sign_of(memcmp(s, d, size)));
+            }
+        }
+    }
+}
+
+static const size_t bench_sizes[] = { 16, 64, 256, 1024, 4096, 65536 };
+static const size_t bench_aligns[][2] = { { 0, 0 }, { 1, 3 } };
+
+// Each benchmark runs for about this many bytes per size, so the small sizes
+// get enough iterations to be timed.
+
+#define BENCH_BYTES (4ull << 20)
+
+enum bench_kind {
+    BENCH_MEMCPY,
+    BENCH_MEMSET,
+    BENCH_MEMCMP,
+};
+
+// The machines these run on are noisy, so take the fastest of a few runs.
+#define BENCH_RUNS 5
+
+static double
+bench_variant(const struct variant *const variant,
+              const enum bench_kind kind,
+              uint8_t *const dst,
+              const uint8_t *const src,
+              const size_t size)
+{
+    const uint64_t iterations = BENCH_BYTES / size;
+    volatile int sink = 0;
+
+    // memcmp() has to go through all of both buffers to be timed fairly.
+    if (kind == BENCH_MEMCMP) {
+        memcpy(dst, src, size);
+    }
+
+    uint64_t best = UINT64_MAX;
+    for (uint32_t run = 0; run != BENCH_RUNS; run++) {
+        const uint64_t begin = bench_now_ns();
+        for (uint64_t i = 0; i != iterations; i++) {
+            switch (kind) {
+                case BENCH_MEMCPY:
+                    variant->memcpy(dst, src, size);
+                    break;
+                case BENCH_MEMSET:
+                    variant->memset(dst, (int)i, size);
+                    break;
+                case BENCH_MEMCMP:
+                    sink += variant->memcmp(dst, src, size);
+                    break;
+            }
+        }
+
+        const uint64_t elapsed = bench_now_ns() - begin;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    (void)sink;
+    return (double)best / (double)iterations;
+}
+
+static void bench_kind(const enum bench_kind kind, const char *const name) {
+    const size_t buffer_size = 65536 + 64;
+
+    uint8_t *const src = aligned_alloc(64, buffer_size);
+    uint8_t *const dst = aligned_alloc(64, buffer_size);
+
+    for (size_t i = 0; i != buffer_size; i++) {
+        src[i] = (uint8_t)i;
+        dst[i] = (uint8_t)i;
+    }
+
+    printf("%s, ns/op:\n\t%-18s", name, "size (dst/src off)");
+    for (size_t i = 0; i != countof(variants); i++) {
+        printf(" %10s", variants[i].name);
+    }
+
+    printf("\n");
+    for (size_t i = 0; i != countof(bench_sizes); i++) {
+        for (size_t j = 0; j != countof(bench_aligns); j++) {
+            const size_t size = bench_sizes[i];
+            const size_t dst_off = bench_aligns[j][0];
+            const size_t src_off = bench_aligns[j][1];
+
+            printf("\t%8zu (+%zu/+%zu)    ", size, dst_off, src_off);
+            for (size_t k = 0; k != countof(variants); k++) {
+                const struct variant *const variant = &variants[k];
+                if (!variant_supported(variant)
+                    || (kind == BENCH_MEMCMP && variant->memcmp == NULL))
+                {
+                    printf(" %10s", "-");
+                    continue;
+                }
+
+                const double ns =
+                    bench_variant(variant,
+                                  kind,
+                                  dst + dst_off,
+                                  src + src_off,
+                                  size);
+
+                printf(" %10.2f", ns);
+            }
+
+            printf("\n");
+        }
+    }
+
+    free(src);
+    free(dst);
+}
+
+void test_memops() {
+    for (size_t i = 0; i != countof(variants); i++) {
+        if (variant_supported(&variants[i])) {
+            check_variant(&variants[i]);
+        }
+    }
+
+    bench_kind(BENCH_MEMCPY, "memcpy");
+    bench_kind(BENCH_MEMSET, "memset");
+    bench_kind(BENCH_MEMCMP, "memcmp");
+}
\ No newline at end of file
@@ -0,0 +1,229 @@
+/*
+ * tests/range_btree.c
+ * © suhas pai
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "lib/adt/avltree.h"
+#include "lib/adt/range_btree.h"
+
+#include "bench.h"
+
+struct avl_range_node {
+    struct avlnode info;
+    struct range range;
+};
+
+static struct avlnode *
+avl_build_balanced(struct avl_range_node *const nodes,
+                   const uint64_t begin,
+                   const uint64_t end,
+                   struct avlnode *const parent)
+{
+    if (begin == end) {
+        return NULL;
+    }
+
+    const uint64_t mid = begin + (end - begin) / 2;
+    struct avlnode *const avlnode = &nodes[mid].info;
+
+    avlnode->parent = parent;
+    avlnode->left = avl_build_balanced(nodes, begin, mid, avlnode);
+    avlnode->right = avl_build_balanced(nodes, mid + 1, end, avlnode);
+
+    return avlnode;
+}
+
+static struct avl_range_node *
+avl_range_find(const struct avltree *const tree, const uint64_t loc) {
+    struct avlnode *avlnode = tree->root;
+    while (avlnode != NULL) {
+        struct avl_range_node *const node =
+            container_of(avlnode, struct avl_range_node, info);
+
+        if (loc < node->range.front) {
+            avlnode = avlnode->left;
+        } else if (loc - node->range.front < node->range.size) {
+            return node;
+        } else {
+            avlnode = avlnode->right;
+        }
+    }
+
+    return NULL;
+}
+
+#define RANGE_STRIDE 0x10000
+#define RANGE_SIZE 0x4000
+
+// Fisher-Yates shuffle of the indices [0, count), so nodes are inserted in a
+// random order.
+
+static uint64_t *shuffled_indices(const uint64_t count) {
+    uint64_t *const indices = malloc(sizeof(uint64_t) * count);
+    for (uint64_t i = 0; i != count; i++) {
+        indices[i] = i;
+    }
+
+    for (uint64_t i = count - 1; i != 0; i--) {
+        const uint64_t j = (uint64_t)rand() % (i + 1);
+        const uint64_t tmp = indices[i];
+
+        indices[i] = indices[j];
+        indices[j] = tmp;
+    }
+
+    return indices;
+}
+
+static void test_correctness() {
+    struct range_btree tree = RANGE_BTREE_INIT();
+    const uint64_t count = 5000;
+
+    uint64_t *const indices = shuffled_indices(count);
+    for (uint64_t i = 0; i != count; i++) {
+        const struct range range =
+            RANGE_INIT(indices[i] * RANGE_STRIDE, RANGE_SIZE);
+
+        assert(range_btree_insert(&tree, range, (void *)(range.front + 1)));
+        assert(!range_btree_insert(&tree, range, NULL));
+    }
+
+    // Every gap is RANGE_STRIDE - RANGE_SIZE, except the one before the first
+    // range.
+
+    assert(range_btree_find_space(&tree,
+                                  RANGE_MAX(),
+                                  RANGE_STRIDE - RANGE_SIZE,
+                                  /*align=*/RANGE_STRIDE) ==
+           (RANGE_STRIDE * (count - 1)) + RANGE_STRIDE);
+    assert(range_btree_find_space(&tree,
+                                  RANGE_INIT(RANGE_STRIDE, UINT64_MAX / 2),
+                                  RANGE_STRIDE - RANGE_SIZE,
+                                  /*align=*/0x1000) ==
+           RANGE_STRIDE + RANGE_SIZE);
+
+    for (uint64_t i = 0; i != count; i++) {
+        const uint64_t front = i * RANGE_STRIDE;
+
+        assert(range_btree_find(&tree, front) == (void *)(front + 1));
+        assert(range_btree_find(&tree, front + RANGE_SIZE - 1) ==
+               (void *)(front + 1));
+        assert(range_btree_find(&tree, front + RANGE_SIZE) == NULL);
+    }
+
+    struct range_btree_iter iter;
+    uint64_t expected_front = 0;
+
+    for (bool has = range_btree_iter_first(&tree, &iter);
+         has;
+         has = range_btree_iter_next(&iter))
+    {
+        assert(range_btree_iter_range(iter).front == expected_front);
+        expected_front += RANGE_STRIDE;
+    }
+
+    assert(expected_front == count * RANGE_STRIDE);
+
+    // Remove every other range, which should merge the gaps around them.
+    for (uint64_t i = 0; i < count; i += 2) {
+        const uint64_t front = indices[i] * RANGE_STRIDE;
+        assert(range_btree_remove(&tree, front) == (void *)(front + 1));
+    }
+
+    assert(tree.count == count / 2);
+    for (uint64_t i = 1; i < count; i += 2) {
+        const uint64_t front = indices[i] * RANGE_STRIDE;
+        assert(range_btree_remove(&tree, front) == (void *)(front + 1));
+    }
+
+    assert(tree.root == NULL);
+    free(indices);
+}
+
+static void bench_count(const uint64_t count) {
+    printf("range_btree vs avltree, %" PRIu64 " nodes:\n", count);
+
+    uint64_t *const indices = shuffled_indices(count);
+    uint64_t *const lookups = malloc(sizeof(uint64_t) * count);
+
+    for (uint64_t i = 0; i != count; i++) {
+        lookups[i] =
+            ((uint64_t)rand() % count) * RANGE_STRIDE +
+            (uint64_t)rand() % RANGE_SIZE;
+    }
+
+    // avltree verifies the subtrees it touches on every insert in test builds,
+    // so build a balanced tree by hand instead of timing avltree_insert().
+
+    struct avl_range_node *const avl_nodes =
+        malloc(sizeof(struct avl_range_node) * count);
+
+    for (uint64_t i = 0; i != count; i++) {
+        avl_nodes[i].range = RANGE_INIT(i * RANGE_STRIDE, RANGE_SIZE);
+    }
+
+    struct avltree avltree = AVLTREE_INIT();
+    avltree.root = avl_build_balanced(avl_nodes, 0, count, /*parent=*/NULL);
+
+    struct range_btree btree = RANGE_BTREE_INIT();
+    uint64_t begin = bench_now_ns();
+
+    for (uint64_t i = 0; i != count; i++) {
+        const struct range range =
+            RANGE_INIT(indices[i] * RANGE_STRIDE, RANGE_SIZE);
+
+        range_btree_insert(&btree, range, /*value=*/NULL);
+    }
+
+    bench_report("range_btree insert", count, begin, bench_now_ns());
+
+    uint64_t found = 0;
+    begin = bench_now_ns();
+
+    for (uint64_t i = 0; i != count; i++) {
+        found += avl_range_find(&avltree, lookups[i]) != NULL;
+    }
+
+    bench_report("avltree lookup", count, begin, bench_now_ns());
+    assert(found == count);
+
+    found = 0;
+    begin = bench_now_ns();
+
+    for (uint64_t i = 0; i != count; i++) {
+        struct range_btree_iter iter;
+        found += range_btree_iter_find(&btree, lookups[i], &iter);
+    }
+
+    bench_report("range_btree lookup", count, begin, bench_now_ns());
+    assert(found == count);
+
+    const uint64_t space_count = count < 10000 ? count : 10000;
+    begin = bench_now_ns();
+
+    for (uint64_t i = 0; i != space_count; i++) {
+        const uint64_t front = lookups[i] & ~(RANGE_STRIDE - 1);
+        range_btree_find_space(&btree,
+                               RANGE_INIT(front, UINT64_MAX / 2),
+                               RANGE_SIZE,
+                               /*align=*/0x1000);
+    }
+
+    bench_report("range_btree find-space", space_count, begin, bench_now_ns());
+
+    range_btree_destroy(&btree);
+
+    free(avl_nodes);
+    free(lookups);
+    free(indices);
+}
+
+void test_range_btree() {
+    test_correctness();
+    for (uint64_t count = 1000; count <= 1000000; count *= 10) {
+        bench_count(count);
+    }
+}
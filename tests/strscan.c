@@ -0,0 +1,373 @@
+/*
+ * tests/strscan.c
+ * © suhas pai
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "lib/macros.h"
+#include "lib/memory.h"
+#include "lib/strscan.h"
+
+#include "bench.h"
+
+typedef size_t (*strlen_func_t)(const char *str);
+typedef size_t (*strnlen_func_t)(const char *str, size_t limit);
+typedef void *(*memchr_func_t)(const void *ptr, int ch, size_t count);
+
+struct variant {
+    const char *name;
+
+    strlen_func_t strlen;
+    strnlen_func_t strnlen;
+    memchr_func_t memchr;
+};
+
+static size_t glibc_strlen(const char *const str) {
+    return strlen(str);
+}
+
+static size_t glibc_strnlen(const char *const str, const size_t limit) {
+    return strnlen(str, limit);
+}
+
+static void *glibc_memchr(const void *const ptr, const int ch, size_t count) {
+    return memchr(ptr, ch, count);
+}
+
+static const struct variant variants[] = {
+    { "glibc", glibc_strlen, glibc_strnlen, glibc_memchr },
+    { "words", strlen_words, strnlen_words, memchr_words },
+#if defined(__x86_64__)
+    { "avx2", strlen_avx2, strnlen_avx2, memchr_avx2 },
+#endif /* defined(__x86_64__) */
+};
+
+static bool variant_supported(const struct variant *const variant) {
+#if defined(__x86_64__)
+    if (variant->strlen == strlen_avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif /* defined(__x86_64__) */
+
+    (void)variant;
+    return true;
+}
+
+#define CHECK_MAX_LENGTH 300
+#define CHECK_MAX_ALIGN 32
+
+static void check_strings() {
+    static char buffer[CHECK_MAX_ALIGN + CHECK_MAX_LENGTH + 64];
+    for (size_t length = 0; length <= CHECK_MAX_LENGTH; length++) {
+        for (size_t off = 0; off != CHECK_MAX_ALIGN; off++) {
+            // Fill the space around the string with the characters searched
+            // for, so a search that runs past the terminator is caught.
+
+            memset(buffer, 'x', sizeof(buffer));
+            char *const str = buffer + off;
+
+            for (size_t i = 0; i != length; i++) {
+                str[i] = (char)('a' + rand() % 8);
+            }
+
+            str[length] = '\0';
+
+            assert(strlen_words(str) == length);
+            for (size_t limit = 0; limit <= length + 2; limit++) {
+                assert(strnlen_words(str, limit) == strnlen(str, limit));
+            }
+
+            assert(strnlen_words(str, SIZE_MAX) == length);
+            for (int ch = 'a'; ch <= 'i'; ch++) {
+                assert(strchr_words(str, ch) == strchr(str, ch));
+                assert(strrchr_words(str, ch) == strrchr(str, ch));
+            }
+
+            assert(strchr_words(str, 'x') == NULL);
+            assert(strrchr_words(str, 'x') == NULL);
+            assert(strchr_words(str, '\0') == str + length);
+            assert(strrchr_words(str, '\0') == str + length);
+        }
+    }
+}
+
+static void check_variant(const struct variant *const variant) {
+    static uint8_t buffer[CHECK_MAX_ALIGN + CHECK_MAX_LENGTH + 64];
+    for (size_t size = 0; size <= CHECK_MAX_LENGTH; size++) {
+        for (size_t off = 0; off != CHECK_MAX_ALIGN; off++) {
+            memset(buffer, 0x55, sizeof(buffer));
+
+            char *const str = (char *)buffer + off;
+            memset(str, 'a', size);
+            str[size] = '\0';
+
+            assert(variant->strlen(str) == size);
+            assert(variant->strnlen(str, SIZE_MAX) == size);
+
+            for (size_t limit = 0; limit <= size + 2; limit++) {
+                const size_t expected = limit < size ? limit : size;
+                assert(variant->strnlen(str, limit) == expected);
+            }
+
+            uint8_t *const begin = buffer + off;
+            memset(begin, 0, size);
+
+            assert(variant->memchr(begin, 0x55, size) == NULL);
+            if (size == 0) {
+                continue;
+            }
+
+            // Place matches at a random position and at the very end, so
+            // both the first match and the bounds are checked.
+
+            const size_t index = (size_t)rand() % size;
+            begin[size - 1] = 0x55;
+            assert(variant->memchr(begin, 0x55, size) == begin + size - 1);
+
+            begin[index] = 0x55;
+            assert(variant->memchr(begin, 0x55, size) == begin + index);
+            assert(variant->memchr(begin, 0x55, index) == NULL);
+        }
+    }
+}
+
+// Put strings and buffers right before an unmapped page, so any read past
+// their end that crosses into the next page faults.
+
+static void check_page_boundary(const struct variant *const variant) {
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    uint8_t *const pages =
+        mmap(NULL,
+             page_size * 2,
+             PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS,
+             -1,
+             0);
+
+    assert(pages != MAP_FAILED);
+    assert(mprotect(pages + page_size, page_size, PROT_NONE) == 0);
+
+    uint8_t *const page_end = pages + page_size;
+    for (size_t size = 1; size <= 256; size++) {
+        uint8_t *const begin = page_end - size;
+
+        memset(begin, 'a', size);
+        begin[size - 1] = '\0';
+
+        assert(variant->strlen((const char *)begin) == size - 1);
+
+        // The limit of strnlen() can run past the end of the mapping, as long
+        // as the string is terminated before it.
+
+        assert(variant->strnlen((const char *)begin, size + page_size)
+                == size - 1);
+        assert(variant->memchr(begin, 'b', size) == NULL);
+
+        if (variant->strlen == strlen_words) {
+            const char *const str = (const char *)begin;
+
+            assert(strnlen_words(str, size) == size - 1);
+            assert(strchr_words(str, 'b') == NULL);
+            const char *const last_a = size > 1 ? str + size - 2 : NULL;
+            assert(strrchr_words(str, 'a') == last_a);
+        }
+    }
+
+    munmap(pages, page_size * 2);
+}
+
+static void check_membuf_is_all() {
+    static uint64_t buffer[64];
+    for (size_t count = 0; count <= 48; count++) {
+        for (size_t off = 0; off != 8; off++) {
+            uint8_t *const bytes = (uint8_t *)buffer + off;
+
+            memset(buffer, 0xFF, sizeof(buffer));
+            memset(bytes, 0x3C, count);
+
+            assert(membuf_8_is_all(bytes, count, 0x3C));
+            if (count != 0) {
+                bytes[(size_t)rand() % count] = 0x3D;
+                assert(!membuf_8_is_all(bytes, count, 0x3C));
+            }
+
+            uint16_t *const words = (uint16_t *)buffer + off;
+            memset(buffer, 0xFF, sizeof(buffer));
+            memset_16(words, count, 0x1234);
+
+            assert(membuf_16_is_all(words, count, 0x1234));
+            if (count != 0) {
+                words[(size_t)rand() % count] = 0x1235;
+                assert(!membuf_16_is_all(words, count, 0x1234));
+            }
+
+            uint32_t *const dwords = (uint32_t *)buffer + off;
+            memset(buffer, 0xFF, sizeof(buffer));
+            memset_32(dwords, count, 0x12345678);
+
+            assert(membuf_32_is_all(dwords, count, 0x12345678));
+            if (count != 0) {
+                dwords[(size_t)rand() % count] = 0x12345679;
+                assert(!membuf_32_is_all(dwords, count, 0x12345678));
+            }
+
+            uint64_t *const qwords = buffer + off;
+            memset(buffer, 0xFF, sizeof(buffer));
+            memset_64(qwords, count, 0x123456789ABCDEF0);
+
+            assert(membuf_64_is_all(qwords, count, 0x123456789ABCDEF0));
+            if (count != 0) {
+                qwords[(size_t)rand() % count] = 0;
+                assert(!membuf_64_is_all(qwords, count, 0x123456789ABCDEF0));
+            }
+        }
+    }
+}
+
+static const size_t bench_sizes[] = { 8, 32, 128, 1024, 4096, 65536 };
+
+#define BENCH_BYTES (4ull << 20)
+#define BENCH_RUNS 5
+
+enum bench_kind {
+    BENCH_STRLEN,
+    BENCH_MEMCHR,
+};
+
+static double
+bench_variant(const struct variant *const variant,
+              const enum bench_kind kind,
+              const char *const str,
+              const size_t size)
+{
+    const uint64_t iterations = BENCH_BYTES / size;
+    volatile uint64_t sink = 0;
+
+    uint64_t best = UINT64_MAX;
+    for (uint32_t run = 0; run != BENCH_RUNS; run++) {
+        const uint64_t begin = bench_now_ns();
+        for (uint64_t i = 0; i != iterations; i++) {
+            switch (kind) {
+                case BENCH_STRLEN:
+                    sink += variant->strlen(str);
+                    break;
+                case BENCH_MEMCHR:
+                    sink += (uint64_t)variant->memchr(str, '\0', size);
+                    break;
+            }
+        }
+
+        const uint64_t elapsed = bench_now_ns() - begin;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    (void)sink;
+    return (double)best / (double)iterations;
+}
+
+static void bench_kind(const enum bench_kind kind, const char *const name) {
+    const size_t buffer_size = 65536 + 64;
+    char *const buffer = aligned_alloc(64, buffer_size);
+
+    printf("%s, ns/op:\n\t%-10s", name, "size");
+    for (size_t i = 0; i != countof(variants); i++) {
+        printf(" %10s", variants[i].name);
+    }
+
+    printf("\n");
+    for (size_t i = 0; i != countof(bench_sizes); i++) {
+        const size_t size = bench_sizes[i];
+
+        // Start one byte in, so the scans begin unaligned. strlen() is timed
+        // over `size` bytes, and memchr() has to search all of them.
+
+        char *const str = buffer + 1;
+        memset(str, 'a', size);
+        str[size - 1] = kind == BENCH_STRLEN ? '\0' : 'a';
+
+        printf("\t%10zu", size);
+        for (size_t j = 0; j != countof(variants); j++) {
+            if (!variant_supported(&variants[j])) {
+                printf(" %10s", "-");
+                continue;
+            }
+
+            printf(" %10.2f", bench_variant(&variants[j], kind, str, size));
+        }
+
+        printf("\n");
+    }
+
+    free(buffer);
+}
+
+__attribute__((noinline)) static bool
+bytewise_is_all(uint8_t *const buf, const uint64_t count, const uint8_t c) {
+    for (uint64_t i = 0; i != count; i++) {
+        if (buf[i] != c) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void bench_membuf_is_all() {
+    const size_t size = 65536;
+    uint8_t *const buffer = aligned_alloc(64, size);
+
+    memset(buffer, 0, size);
+    printf("membuf_8_is_all(), 64KiB, ns/op:\n");
+
+    bool (*const funcs[])(uint8_t *, uint64_t, uint8_t) = {
+        bytewise_is_all,
+        membuf_8_is_all,
+    };
+
+    const char *const names[] = { "bytewise", "words" };
+    for (size_t i = 0; i != countof(funcs); i++) {
+        volatile bool sink = false;
+        uint64_t best = UINT64_MAX;
+
+        for (uint32_t run = 0; run != BENCH_RUNS; run++) {
+            const uint64_t begin = bench_now_ns();
+            for (uint32_t j = 0; j != 64; j++) {
+                sink = funcs[i](buffer, size, 0);
+            }
+
+            const uint64_t elapsed = bench_now_ns() - begin;
+            if (elapsed < best) {
+                best = elapsed;
+            }
+        }
+
+        (void)sink;
+        printf("\t%-10s %10.2f\n", names[i], (double)best / 64);
+    }
+
+    free(buffer);
+}
+
+void test_strscan() {
+    check_strings();
+    check_membuf_is_all();
+
+    for (size_t i = 0; i != countof(variants); i++) {
+        if (variant_supported(&variants[i])) {
+            check_variant(&variants[i]);
+            check_page_boundary(&variants[i]);
+        }
+    }
+
+    bench_kind(BENCH_STRLEN, "strlen");
+    bench_kind(BENCH_MEMCHR, "memchr");
+    bench_membuf_is_all();
+}
\ No newline at end of file